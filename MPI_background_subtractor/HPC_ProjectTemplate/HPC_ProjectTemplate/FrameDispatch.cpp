@@ -0,0 +1,142 @@
+#include "FrameDispatch.h"
+
+#include <algorithm>
+
+#include "Trace.h"
+
+using namespace std;
+
+// Worker -> rank 0: { frames done, seconds spent }; rank 0 -> worker: the
+// next range [first, last), empty once every frame is taken
+static const int TAG_REQUEST = 1;
+static const int TAG_RANGE = 2;
+
+FrameDispatch::FrameDispatch(int numFrames, int minChunk, int rank, int size, MPI_Comm comm)
+    : numFrames_(numFrames), minChunk_(max(1, minChunk)), rank_(rank), size_(size), comm_(comm), next_(0),
+      rates_(size, 0.0), finished_(0), frames_(size, 0), chunks_(size, 0) {}
+
+void FrameDispatch::assign(int worker, int& first, int& last) {
+    double known = 0;
+    int reported = 0;
+    for (double rate : rates_) {
+        if (rate > 0) {
+            known += rate;
+            reported++;
+        }
+    }
+    double mean = reported > 0 ? known / reported : 1;
+    double total = 0;
+    for (double rate : rates_) {
+        total += rate > 0 ? rate : mean;
+    }
+    double rate = rates_[worker] > 0 ? rates_[worker] : mean;
+    int remaining = numFrames_ - next_;
+    int chunk = min(remaining, max(minChunk_, (int)(remaining * rate / total / 2)));
+    first = next_;
+    last = next_ + chunk;
+    next_ = last;
+    if (chunk > 0) {
+        frames_[worker] += chunk;
+        chunks_[worker]++;
+    }
+}
+
+// Answers every request already waiting, or exactly one (waiting for it)
+// when `block` is set.
+void FrameDispatch::serveRequests(bool block) {
+    for (;;) {
+        MPI_Status status;
+        int waiting = 1;
+        if (block) {
+            MPI_Probe(MPI_ANY_SOURCE, TAG_REQUEST, comm_, &status);
+        }
+        else {
+            MPI_Iprobe(MPI_ANY_SOURCE, TAG_REQUEST, comm_, &waiting, &status);
+        }
+        if (!waiting) {
+            return;
+        }
+        int worker = status.MPI_SOURCE;
+        double report[2];
+        MPI_Recv(report, 2, MPI_DOUBLE, worker, TAG_REQUEST, comm_, MPI_STATUS_IGNORE);
+        if (report[1] > 0) {
+            rates_[worker] = report[0] / report[1];
+        }
+        int range[2];
+        assign(worker, range[0], range[1]);
+        if (range[0] == range[1]) {
+            finished_++;
+        }
+        MPI_Send(range, 2, MPI_INT, worker, TAG_RANGE, comm_);
+        if (block) {
+            return;
+        }
+    }
+}
+
+void FrameDispatch::runMaster(const function<void(int)>& process) {
+    double busy = 0;
+    int done = 0;
+    for (;;) {
+        serveRequests(false);
+        int first, last;
+        assign(0, first, last);
+        if (first == last) {
+            break;
+        }
+        for (int f = first; f < last; f++) {
+            // Between frames, so a waiting rank gets its answer within one
+            // of this rank's frames
+            serveRequests(false);
+            double start = MPI_Wtime();
+            process(f);
+            busy += MPI_Wtime() - start;
+            done++;
+            rates_[0] = done / busy;
+        }
+    }
+    while (finished_ < size_ - 1) {
+        serveRequests(true);
+    }
+}
+
+void FrameDispatch::runWorker(const function<void(int)>& process) {
+    double report[2] = { 0, 0 };
+    int range[2];
+    {
+        TRACE_SCOPE("dispatch wait");
+        MPI_Send(report, 2, MPI_DOUBLE, 0, TAG_REQUEST, comm_);
+        MPI_Recv(range, 2, MPI_INT, 0, TAG_RANGE, comm_, MPI_STATUS_IGNORE);
+    }
+    double busy = 0;
+    int done = 0;
+    while (range[0] < range[1]) {
+        int next[2];
+        MPI_Request requests[2];
+        for (int f = range[0]; f < range[1]; f++) {
+            if (f == range[1] - 1) {
+                report[0] = done;
+                report[1] = busy;
+                MPI_Isend(report, 2, MPI_DOUBLE, 0, TAG_REQUEST, comm_, &requests[0]);
+                MPI_Irecv(next, 2, MPI_INT, 0, TAG_RANGE, comm_, &requests[1]);
+            }
+            double start = MPI_Wtime();
+            process(f);
+            busy += MPI_Wtime() - start;
+            done++;
+        }
+        TRACE_SCOPE("dispatch wait");
+        MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+        range[0] = next[0];
+        range[1] = next[1];
+    }
+}
+
+void FrameDispatch::run(const function<void(int)>& process) {
+    if (rank_ == 0) {
+        runMaster(process);
+    }
+    else {
+        runWorker(process);
+    }
+}
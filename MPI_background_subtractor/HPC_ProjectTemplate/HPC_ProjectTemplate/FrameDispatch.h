@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <mpi.h>
+
+// Master-worker distribution of frames for --decompose frames --balance
+// dynamic. Rank 0 hands out contiguous frame ranges on demand and works on
+// its own between requests; every other rank asks for its next range while
+// it starts the last frame of the current one, so it does not sit idle
+// waiting for the answer.
+//
+// Each request carries the rank's frames done and seconds spent (decode
+// included), and ranges are sized from those rates: a rank gets half its
+// throughput-weighted share of the frames left, at least minChunk. Faster
+// nodes get longer ranges, and ranges shrink towards the end so every rank
+// finishes at about the same time. Ranks with no report yet count at the
+// mean rate of the others.
+//
+// All MPI calls are made from the calling thread (MPI_THREAD_FUNNELED);
+// process() may use OpenMP inside.
+class FrameDispatch {
+public:
+    FrameDispatch(int numFrames, int minChunk, int rank, int size, MPI_Comm comm);
+
+    FrameDispatch(const FrameDispatch&) = delete;
+    FrameDispatch& operator=(const FrameDispatch&) = delete;
+
+    // Calls process(f) for every frame this rank is given, in increasing
+    // order, until all numFrames are taken. Collective.
+    void run(const std::function<void(int)>& process);
+
+    // Rank 0: frames and ranges each rank was given
+    const std::vector<int>& rankFrames() const { return frames_; }
+    const std::vector<int>& rankChunks() const { return chunks_; }
+
+private:
+    void assign(int worker, int& first, int& last);
+    void serveRequests(bool block);
+    void runMaster(const std::function<void(int)>& process);
+    void runWorker(const std::function<void(int)>& process);
+
+    int numFrames_;
+    int minChunk_;
+    int rank_;
+    int size_;
+    MPI_Comm comm_;
+    // Rank 0: next frame to hand out, per-rank frames/s reported so far,
+    // and ranks already told there is nothing left
+    int next_;
+    std::vector<double> rates_;
+    int finished_;
+    std::vector<int> frames_;
+    std::vector<int> chunks_;
+};
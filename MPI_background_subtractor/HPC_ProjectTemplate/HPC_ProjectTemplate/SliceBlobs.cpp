@@ -0,0 +1,99 @@
+#include "SliceBlobs.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "Frame.h"
+#include "Trace.h"
+
+using namespace std;
+
+// Rows per thread work item, as in the OpenMP backend
+static const int BLOB_ROW_BLOCK = 64;
+
+namespace {
+
+template <typename T>
+void append(vector<char>& out, const T* items, size_t count) {
+    const char* bytes = (const char*)items;
+    out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+template <typename T>
+const char* extract(const char* in, vector<T>& items, size_t count) {
+    items.resize(count);
+    memcpy(items.data(), in, count * sizeof(T));
+    return in + count * sizeof(T);
+}
+
+// Header of five ints (top, rows and the three counts), then the arrays.
+// Every rank runs the same binary, so the structs go as raw bytes.
+void packBand(const BlobBand& band, vector<char>& out) {
+    int header[5] = { band.Top, band.Rows, (int)band.Components.size(), (int)band.FirstRow.size(),
+        (int)band.LastRow.size() };
+    out.clear();
+    append(out, header, 5);
+    append(out, band.Components.data(), band.Components.size());
+    append(out, band.FirstRow.data(), band.FirstRow.size());
+    append(out, band.LastRow.data(), band.LastRow.size());
+}
+
+const char* unpackBand(const char* in, BlobBand& band) {
+    int header[5];
+    memcpy(header, in, sizeof(header));
+    in += sizeof(header);
+    band.Top = header[0];
+    band.Rows = header[1];
+    in = extract(in, band.Components, header[2]);
+    in = extract(in, band.FirstRow, header[3]);
+    return extract(in, band.LastRow, header[4]);
+}
+
+}
+
+SliceBlobs::SliceBlobs(int width, int rows, int top, int rank, MPI_Comm comm)
+    : width_(width), stride_(alignedStride(width)), rows_(rows), top_(top), rank_(rank), comm_(comm),
+      bands_(max(1, (rows + BLOB_ROW_BLOCK - 1) / BLOB_ROW_BLOCK)) {
+    int size;
+    MPI_Comm_size(comm_, &size);
+    if (rank_ == 0) {
+        sizes_.resize(size);
+        displs_.resize(size);
+    }
+}
+
+vector<Blob> SliceBlobs::gather(const uint8_t* slice, int minArea) {
+    int numBands = bands_.size();
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < numBands; b++) {
+        int first = min(b * BLOB_ROW_BLOCK, rows_);
+        int count = min(BLOB_ROW_BLOCK, rows_ - first);
+        labelBand(slice + (size_t)first * stride_, width_, stride_, count, top_ + first, bands_[b]);
+    }
+    packBand(mergeBands(bands_), packed_);
+
+    TRACE_SCOPE("blob gather");
+    int bytes = packed_.size();
+    TRACE_COUNT("blob gather bytes", bytes);
+    MPI_Gather(&bytes, 1, MPI_INT, sizes_.data(), 1, MPI_INT, 0, comm_);
+    if (rank_ == 0) {
+        int total = 0;
+        for (size_t r = 0; r < sizes_.size(); r++) {
+            displs_[r] = total;
+            total += sizes_[r];
+        }
+        received_.resize(total);
+    }
+    MPI_Gatherv(packed_.data(), bytes, MPI_BYTE, received_.data(), sizes_.data(), displs_.data(),
+        MPI_BYTE, 0, comm_);
+    if (rank_ != 0) {
+        return vector<Blob>();
+    }
+
+    // Ranks hold consecutive row ranges in rank order
+    vector<BlobBand> slices(sizes_.size());
+    for (size_t r = 0; r < slices.size(); r++) {
+        unpackBand(received_.data() + displs_[r], slices[r]);
+    }
+    return blobList(mergeBands(slices), minArea);
+}
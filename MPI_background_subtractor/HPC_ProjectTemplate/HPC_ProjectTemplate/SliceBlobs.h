@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mpi.h>
+
+#include "Blobs.h"
+
+// Blob extraction on row-aligned MPI slices. Each rank labels its own rows
+// (split into bands across its threads) and reduces them to one BlobBand:
+// component sums plus the runs on its first and last row. Only that goes to
+// rank 0, packed into one MPI_Gatherv, where the bands are merged along the
+// slice borders; the mask itself is never gathered.
+class SliceBlobs {
+public:
+    // This rank holds image rows [top, top + rows).
+    SliceBlobs(int width, int rows, int top, int rank, MPI_Comm comm);
+
+    // Collective. Returns the blobs of the whole mask on rank 0, nothing
+    // elsewhere.
+    std::vector<Blob> gather(const uint8_t* slice, int minArea);
+
+private:
+    int width_;
+    int stride_;
+    int rows_;
+    int top_;
+    int rank_;
+    MPI_Comm comm_;
+    std::vector<BlobBand> bands_;
+    std::vector<char> packed_;
+    std::vector<char> received_;
+    std::vector<int> sizes_;
+    std::vector<int> displs_;
+};
@@ -0,0 +1,79 @@
+#include "SliceMorphology.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "Frame.h"
+#include "Trace.h"
+
+using namespace std;
+
+// Output rows per thread work item, as in the OpenMP backend
+static const int MORPH_ROW_BLOCK = 64;
+
+SliceMorphology::SliceMorphology(const MorphologyConfig& config, int width, int rows, int rank,
+    int size, MPI_Comm comm)
+    : config_(config), width_(width), stride_(alignedStride(width)), rows_(rows),
+      halo_(morphologyHalo(config)), comm_(comm) {
+    above_ = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+    below_ = rank + 1 < size ? rank + 1 : MPI_PROC_NULL;
+    size_t bytes = (size_t)(rows_ + 2 * halo_) * stride_;
+    for (int b = 0; b < 2; b++) {
+        bands_[b] = (uint8_t*)alignedAlloc(bytes);
+        memset(bands_[b], 0, bytes);
+    }
+}
+
+SliceMorphology::~SliceMorphology() {
+    alignedFree(bands_[0]);
+    alignedFree(bands_[1]);
+}
+
+// Sends this rank's first halo rows up and its last ones down, receiving the
+// neighbours' rows into the halo. Edge ranks keep identity rows instead.
+void SliceMorphology::exchangeHalo(uint8_t* band, uint8_t identity) {
+    if (halo_ == 0) {
+        return;
+    }
+    size_t haloBytes = (size_t)halo_ * stride_;
+    uint8_t* top = band;
+    uint8_t* first = band + haloBytes;
+    uint8_t* last = band + (size_t)rows_ * stride_;
+    uint8_t* bottom = band + (size_t)(rows_ + halo_) * stride_;
+    if (above_ == MPI_PROC_NULL) {
+        memset(top, identity, haloBytes);
+    }
+    if (below_ == MPI_PROC_NULL) {
+        memset(bottom, identity, haloBytes);
+    }
+    TRACE_SCOPE("halo exchange");
+    TRACE_COUNT("halo bytes", 2 * haloBytes);
+    MPI_Sendrecv(first, (int)haloBytes, MPI_UNSIGNED_CHAR, above_, 0,
+        bottom, (int)haloBytes, MPI_UNSIGNED_CHAR, below_, 0, comm_, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(last, (int)haloBytes, MPI_UNSIGNED_CHAR, below_, 1,
+        top, (int)haloBytes, MPI_UNSIGNED_CHAR, above_, 1, comm_, MPI_STATUS_IGNORE);
+}
+
+void SliceMorphology::apply(uint8_t* slice) {
+    int passes = morphologyPasses(config_.Op);
+    if (passes == 0) {
+        return;
+    }
+    size_t haloBytes = (size_t)halo_ * stride_;
+    size_t sliceBytes = (size_t)rows_ * stride_;
+    int bandRows = rows_ + 2 * halo_;
+    memcpy(bands_[0] + haloBytes, slice, sliceBytes);
+
+    for (int p = 0; p < passes; p++) {
+        bool dilate = morphologyDilates(config_.Op, p);
+        uint8_t* src = bands_[p & 1];
+        uint8_t* dst = bands_[(p + 1) & 1];
+        exchangeHalo(src, dilate ? 0 : 255);
+#pragma omp parallel for schedule(static)
+        for (int i = halo_; i < halo_ + rows_; i += MORPH_ROW_BLOCK) {
+            morphologyPass(src, dst, width_, stride_, bandRows, config_, dilate, i,
+                min(i + MORPH_ROW_BLOCK, halo_ + rows_));
+        }
+    }
+    memcpy(slice, bands_[passes & 1] + haloBytes, sliceBytes);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <mpi.h>
+
+#include "Morphology.h"
+
+// Mask cleanup on row-aligned MPI slices. Each rank holds `rows` whole image
+// rows (with the image stride); before every erode/dilate pass it swaps
+// morphologyHalo() rows with the ranks above and below (MPI_Sendrecv), so
+// every rank cleans its own slice and the full mask is never gathered.
+// Halo rows past the top or bottom of the image hold the pass's identity.
+class SliceMorphology {
+public:
+    // Every rank must hold at least morphologyHalo(config) rows.
+    SliceMorphology(const MorphologyConfig& config, int width, int rows, int rank, int size,
+        MPI_Comm comm);
+    ~SliceMorphology();
+
+    SliceMorphology(const SliceMorphology&) = delete;
+    SliceMorphology& operator=(const SliceMorphology&) = delete;
+
+    // Cleans this rank's rows of `slice` in place.
+    void apply(uint8_t* slice);
+
+private:
+    void exchangeHalo(uint8_t* band, uint8_t identity);
+
+    MorphologyConfig config_;
+    int width_;
+    int stride_;
+    int rows_;
+    int halo_;
+    int above_;
+    int below_;
+    MPI_Comm comm_;
+    // rows_ + 2 * halo_ rows each; the slice sits halo_ rows down
+    uint8_t* bands_[2];
+};
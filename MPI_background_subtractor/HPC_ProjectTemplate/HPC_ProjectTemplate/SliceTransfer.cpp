@@ -0,0 +1,97 @@
+#include "SliceTransfer.h"
+
+#include <string.h>
+
+#include "Trace.h"
+
+using namespace std;
+
+int sliceRows(int count) {
+    return count > 0 ? (count + SLICE_WIDTH - 1) / SLICE_WIDTH : 1;
+}
+
+SliceTransfer::SliceTransfer(const vector<int>& counts, const vector<int>& displs, int rank,
+    MPI_Comm comm)
+    : counts_(counts), displs_(displs), rank_(rank), comm_(comm) {
+    int size = counts.size();
+    packCounts_.resize(size);
+    packDispls_.resize(size);
+    wordCounts_.resize(size);
+    wordDispls_.resize(size);
+    int offset = 0;
+    for (int r = 0; r < size; r++) {
+        packCounts_[r] = 3 * SLICE_WIDTH * sliceRows(counts[r]);
+        packDispls_[r] = offset;
+        offset += packCounts_[r];
+        wordCounts_[r] = counts[r] / 64;
+        wordDispls_[r] = displs[r] / 64;
+    }
+    slotPlane_ = SLICE_WIDTH * sliceRows(counts[rank]);
+
+    // Zeroed once: packing never writes the padding, so it stays zero
+    for (int b = 0; b < 2; b++) {
+        send_[b] = nullptr;
+        if (rank == 0) {
+            send_[b] = (uint8_t*)alignedAlloc(offset);
+            memset(send_[b], 0, offset);
+        }
+        recv_[b] = (uint8_t*)alignedAlloc(packCounts_[rank]);
+        memset(recv_[b], 0, packCounts_[rank]);
+        scatterRequests_[b] = MPI_REQUEST_NULL;
+        gatherRequests_[b] = MPI_REQUEST_NULL;
+    }
+}
+
+SliceTransfer::~SliceTransfer() {
+    for (int b = 0; b < 2; b++) {
+        MPI_Wait(&scatterRequests_[b], MPI_STATUS_IGNORE);
+        MPI_Wait(&gatherRequests_[b], MPI_STATUS_IGNORE);
+        alignedFree(send_[b]);
+        alignedFree(recv_[b]);
+    }
+}
+
+void SliceTransfer::scatter(const Frame& frame, int buffer) {
+    if (rank_ == 0) {
+        uint8_t* packed = send_[buffer];
+        for (size_t r = 0; r < counts_.size(); r++) {
+            int slot = packCounts_[r] / 3;
+            for (int c = 0; c < 3; c++) {
+                memcpy(packed + packDispls_[r] + c * slot, channelPlane(frame, c) + displs_[r], counts_[r]);
+            }
+        }
+    }
+    TRACE_COUNT("scatter bytes", packCounts_[rank_]);
+    MPI_Iscatterv(send_[buffer], packCounts_.data(), packDispls_.data(), MPI_UNSIGNED_CHAR,
+        recv_[buffer], packCounts_[rank_], MPI_UNSIGNED_CHAR, 0, comm_, &scatterRequests_[buffer]);
+}
+
+void SliceTransfer::waitScatter(int buffer) {
+    TRACE_SCOPE("scatter wait");
+    MPI_Wait(&scatterRequests_[buffer], MPI_STATUS_IGNORE);
+}
+
+Frame SliceTransfer::slice(int buffer) const {
+    Frame frame;
+    frame.Data = recv_[buffer];
+    frame.Red = recv_[buffer];
+    frame.Green = recv_[buffer] + slotPlane_;
+    frame.Blue = recv_[buffer] + 2 * slotPlane_;
+    frame.Width = SLICE_WIDTH;
+    frame.Height = sliceRows(counts_[rank_]);
+    frame.Stride = SLICE_WIDTH;
+    frame.PixelStep = 1;
+    frame.Layout = FRAME_PLANAR;
+    return frame;
+}
+
+void SliceTransfer::gatherMask(const BitMask& localBits, BitMask& mask, int buffer) {
+    TRACE_COUNT("gather bytes", wordCounts_[rank_] * sizeof(uint64_t));
+    MPI_Igatherv(localBits.Words, wordCounts_[rank_], MPI_UINT64_T, mask.Words, wordCounts_.data(),
+        wordDispls_.data(), MPI_UINT64_T, 0, comm_, &gatherRequests_[buffer]);
+}
+
+void SliceTransfer::waitGather(int buffer) {
+    TRACE_SCOPE("gather wait");
+    MPI_Wait(&gatherRequests_[buffer], MPI_STATUS_IGNORE);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mpi.h>
+
+#include "BitMask.h"
+#include "Frame.h"
+
+// Double-buffered, packed transfer of per-rank pixel slices. Each rank's
+// R, G and B slices travel as one uint8 message (its "slot": three planes,
+// each zero-padded to whole slice rows), sent with MPI_Iscatterv so the
+// next frame can be in flight while the current one is processed. Masks
+// come back bit-packed (one bit per pixel) with MPI_Igatherv. Buffer index
+// 0 or 1 selects the half of the double buffer; a buffer must be waited on
+// before it is reused.
+//
+// A slice of n pixels is held as sliceRows(n) rows of SLICE_WIDTH so the
+// threads inside a rank can split it by rows; the tail of the last row is
+// zero padding.
+const int SLICE_WIDTH = 2048;
+
+int sliceRows(int count);
+
+class SliceTransfer {
+public:
+    SliceTransfer(const std::vector<int>& counts, const std::vector<int>& displs, int rank,
+        MPI_Comm comm);
+    ~SliceTransfer();
+
+    SliceTransfer(const SliceTransfer&) = delete;
+    SliceTransfer& operator=(const SliceTransfer&) = delete;
+
+    // Rank 0 packs `frame` (ignored on other ranks; it may be freed once this
+    // returns) and every rank posts the receive of its slot.
+    void scatter(const Frame& frame, int buffer);
+    void waitScatter(int buffer);
+
+    // This rank's received slices as a SLICE_WIDTH-wide planar frame.
+    Frame slice(int buffer) const;
+
+    // Gathers the counts[rank] / 64 words of this rank's slice bits into
+    // the full-image `mask` on rank 0. Counts must be multiples of 64,
+    // which whole image rows are.
+    void gatherMask(const BitMask& localBits, BitMask& mask, int buffer);
+    void waitGather(int buffer);
+
+private:
+    std::vector<int> counts_;
+    std::vector<int> displs_;
+    std::vector<int> packCounts_;
+    std::vector<int> packDispls_;
+    std::vector<int> wordCounts_;
+    std::vector<int> wordDispls_;
+    int rank_;
+    int slotPlane_;
+    MPI_Comm comm_;
+    uint8_t* send_[2];
+    uint8_t* recv_[2];
+    MPI_Request scatterRequests_[2];
+    MPI_Request gatherRequests_[2];
+};
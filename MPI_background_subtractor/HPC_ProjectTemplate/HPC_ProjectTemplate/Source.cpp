@@ -3,314 +3,1153 @@
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
-#include <msclr\marshal_cppstd.h>
-#include <ctime>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
 #include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-#pragma once
+#include "BackgroundModel.h"
+#include "BenchReport.h"
+#include "BitMask.h"
+#include "Blobs.h"
+#include "ForegroundMasks.h"
+#include "FrameCache.h"
+#include "FrameDispatch.h"
+#include "FramePool.h"
+#include "FrameStream.h"
+#include "ImageIO.h"
+#include "Kernels.h"
+#include "MaskWriter.h"
+#include "Morphology.h"
+#include "Options.h"
+#include "SliceBlobs.h"
+#include "SliceMorphology.h"
+#include "SliceTransfer.h"
+#include "Synthetic.h"
+#include "Trace.h"
 
-#using <mscorlib.dll>
-#using <System.dll>
-#using <System.Drawing.dll>
-#using <System.Windows.Forms.dll>
 using namespace std;
-using namespace msclr::interop;
 
 const int NUM_FRAMES = 20;
 const int THRESHOLD = 30;
+// Frames decoded and masked together in the --all-masks pass
+const int MASK_FRAME_GROUP = 8;
+// Slice rows handed to a thread at a time
+const int ROW_BLOCK = 16;
+// Pixels per work item when threads accumulate whole frames
+const int SUM_CHUNK = 64 * 1024;
 
-struct ColorImage {
-    int* Red;
-    int* Green;
-    int* Blue;
-    int Width;
-    int Height;
+vector<string> getImagePaths(int numFrames) {
+    vector<string> paths;
+    for (int i = 1; i <= numFrames; i++) {
+        paths.push_back(INPUT_DIR + "frame" + to_string(i) + ".png");
+    }
+    return paths;
+}
+
+// Final background and last-frame mask, valid on rank 0 (and on every rank
+// when BackgroundOnAllRanks is set).
+struct RunResult {
+    Frame Background;
+    BitMask Mask;
+    bool BackgroundOnAllRanks;
+    // Scatter/reduce plus compute, excluding PNG decode
+    double ComputeSeconds;
+    // Per-rank state: model or partial sums
+    size_t StateBytes;
+    // Busy time of each OpenMP thread on this rank
+    vector<double> ThreadSeconds;
+    // Foreground pixels summed over every mask, and masks counted (rank 0)
+    double ForegroundPixels;
+    int MaskCount;
+    // Change skipping over all ranks' tiles (rank 0)
+    ChangeSkipStats Skipped;
+    // Pyramid pixels summed over all ranks, times of the slowest (rank 0)
+    PyramidStats Pyramid;
+    // --balance dynamic: frames and ranges each rank was given (rank 0)
+    vector<int> RankFrames;
+    vector<int> RankChunks;
 };
 
-ColorImage inputColorImage(int* w, int* h, System::String^ imagePath) {
-    ColorImage img;
-    System::Drawing::Bitmap BM(imagePath);
-    img.Width = BM.Width;
-    img.Height = BM.Height;
-    *w = BM.Width;
-    *h = BM.Height;
+int threadIndex() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
 
-    img.Red = new int[BM.Height * BM.Width];
-    img.Green = new int[BM.Height * BM.Width];
-    img.Blue = new int[BM.Height * BM.Width];
+// One frame of a rank's slice, split across the rank's threads by rows:
+// accumulate every block, commit once, then refresh background and mask.
+// The mask is written as bytes when `mask` is set (it is still to be
+// cleaned or labelled), otherwise straight into `bits`. With the pyramid,
+// `regions` dilates the model's coarse regions across rank borders between
+// the commit and the refinement.
+void processSlice(BackgroundModel& model, const Frame& slice, uint8_t* mask, BitMask& bits,
+    int threshold, SliceMorphology* regions, vector<double>& threadSeconds) {
+    int rows = slice.Height;
+#pragma omp parallel
+    {
+        double busy = 0;
+#pragma omp for schedule(static)
+        for (int i = 0; i < rows; i += ROW_BLOCK) {
+            double start = MPI_Wtime();
+            model.accumulate(slice, i, min(i + ROW_BLOCK, rows));
+            busy += MPI_Wtime() - start;
+        }
+        // The halo exchange is MPI, so this runs on the thread that
+        // initialised it (MPI_THREAD_FUNNELED)
+#pragma omp master
+        {
+            model.commitFrame();
+            if (regions) {
+                regions->apply(model.pyramidRegions());
+            }
+        }
+#pragma omp barrier
 
-    for (int i = 0; i < BM.Height; i++) {
-        for (int j = 0; j < BM.Width; j++) {
-            System::Drawing::Color c = BM.GetPixel(j, i);
-            img.Red[i * BM.Width + j] = c.R;
-            img.Green[i * BM.Width + j] = c.G;
-            img.Blue[i * BM.Width + j] = c.B;
+#pragma omp for schedule(static)
+        for (int i = 0; i < rows; i += ROW_BLOCK) {
+            double start = MPI_Wtime();
+            int last = min(i + ROW_BLOCK, rows);
+            model.updateBackground(slice, i, last);
+            if (mask) {
+                model.foregroundMask(slice, mask, threshold, i, last);
+            }
+            else {
+                model.foregroundBits(slice, bits, threshold, i, last);
+            }
+            busy += MPI_Wtime() - start;
         }
+        threadSeconds[threadIndex()] += busy;
     }
-    return img;
 }
 
-void createColorImage(ColorImage img, string filename) {
-    System::Drawing::Bitmap MyNewImage(img.Width, img.Height);
-
-    for (int i = 0; i < MyNewImage.Height; i++) {
-        for (int j = 0; j < MyNewImage.Width; j++) {
-            int r = max(0, min(255, img.Red[i * img.Width + j]));
-            int g = max(0, min(255, img.Green[i * img.Width + j]));
-            int b = max(0, min(255, img.Blue[i * img.Width + j]));
+string maskFileName(int frameIndex) {
+    return "foreground_mask_parallel_" + to_string(frameIndex + 1) + ".png";
+}
 
-            System::Drawing::Color c = System::Drawing::Color::FromArgb(r, g, b);
-            MyNewImage.SetPixel(j, i, c);
+// One string from every rank, in rank order on rank 0 (empty elsewhere).
+vector<string> gatherStrings(const string& text, int rank, int size) {
+    int bytes = text.size();
+    vector<int> sizes(rank == 0 ? size : 0);
+    vector<int> displs(rank == 0 ? size : 0);
+    MPI_Gather(&bytes, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    vector<char> received;
+    if (rank == 0) {
+        int total = 0;
+        for (int r = 0; r < size; r++) {
+            displs[r] = total;
+            total += sizes[r];
         }
+        received.resize(total);
+    }
+    MPI_Gatherv(text.data(), bytes, MPI_CHAR, received.data(), sizes.data(), displs.data(), MPI_CHAR, 0,
+        MPI_COMM_WORLD);
+    vector<string> strings;
+    for (int r = 0; rank == 0 && r < size; r++) {
+        strings.push_back(string(received.data() + displs[r], sizes[r]));
     }
-    MyNewImage.Save("..//Data//Output//" + gcnew System::String(filename.c_str()));
-    cout << "Color image saved: " << filename << endl;
+    return strings;
 }
 
-void createGrayImage(int* image, int width, int height, string filename) {
-    System::Drawing::Bitmap MyNewImage(width, height);
+// Blob lists of consecutive frames from every rank, written by rank 0 in
+// rank order. Each rank packs a count per frame followed by its blobs.
+void gatherFrameBlobs(const vector<vector<Blob>>& frameBlobs, int firstFrame, BlobLog* blobLog,
+    int rank, int size) {
+    vector<char> packed;
+    for (const auto& blobs : frameBlobs) {
+        int count = blobs.size();
+        packed.insert(packed.end(), (const char*)&count, (const char*)(&count + 1));
+        packed.insert(packed.end(), (const char*)blobs.data(), (const char*)(blobs.data() + count));
+    }
 
-    for (int i = 0; i < MyNewImage.Height; i++) {
-        for (int j = 0; j < MyNewImage.Width; j++) {
-            int val = max(0, min(255, image[i * width + j]));
-            System::Drawing::Color c = System::Drawing::Color::FromArgb(val, val, val);
-            MyNewImage.SetPixel(j, i, c);
+    TRACE_SCOPE("blob gather");
+    int bytes = packed.size();
+    TRACE_COUNT("blob gather bytes", bytes);
+    vector<int> sizes(rank == 0 ? size : 0);
+    vector<int> displs(rank == 0 ? size : 0);
+    vector<int> firstFrames(rank == 0 ? size : 0);
+    MPI_Gather(&bytes, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Gather(&firstFrame, 1, MPI_INT, firstFrames.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    vector<char> received;
+    if (rank == 0) {
+        int total = 0;
+        for (int r = 0; r < size; r++) {
+            displs[r] = total;
+            total += sizes[r];
         }
+        received.resize(total);
+    }
+    MPI_Gatherv(packed.data(), bytes, MPI_BYTE, received.data(), sizes.data(), displs.data(), MPI_BYTE,
+        0, MPI_COMM_WORLD);
+    if (rank != 0) {
+        return;
     }
-    MyNewImage.Save("..//Data//Output//" + gcnew System::String(filename.c_str()));
-    cout << "Grayscale image saved: " << filename << endl;
-}
 
-vector<string> getImagePaths() {
-    vector<string> paths;
-    for (int i = 1; i <= NUM_FRAMES; i++) {
-        paths.push_back("..//Data//Input//frame" + to_string(i) + ".png");
+    vector<Blob> blobs;
+    for (int r = 0; r < size; r++) {
+        const char* in = received.data() + displs[r];
+        const char* end = in + sizes[r];
+        for (int f = firstFrames[r]; in < end; f++) {
+            int count;
+            memcpy(&count, in, sizeof(count));
+            in += sizeof(count);
+            blobs.resize(count);
+            memcpy(blobs.data(), in, count * sizeof(Blob));
+            in += count * sizeof(Blob);
+            blobLog->write(f, blobs);
+        }
     }
-    return paths;
 }
 
-int main(int argc, char* argv[]) {
-    MPI_Init(&argc, &argv);
-
-    int rank, size;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
-
-    vector<string> imagePaths;
-    vector<ColorImage> colorImages;
-    int width = 0, height = 0;
-    int start_s, stop_s, TotalTime = 0;
-
-    // Rank 0 loads all images
-    if (rank == 0) {
-        cout << "Parallel Background subtractor using MPI" << endl;
-        imagePaths = getImagePaths();
-        for (const auto& path : imagePaths) {
-            System::String^ imagePath = marshal_as<System::String^>(path);
-            ColorImage img = inputColorImage(&width, &height, imagePath);
-            colorImages.push_back(img);
+// Pixel-slice mode: frames are streamed from rank 0, which decodes one
+// frame at a time and scatters it; every rank folds its slice into a
+// BackgroundModel and refreshes its slice of the mask.
+//
+// With nonBlocking (the default) the three channels travel packed in one
+// MPI_Iscatterv and frame f + 1 is in flight while frame f is processed;
+// per-frame masks for --save-masks return the same way via MPI_Igatherv.
+// Otherwise each channel is a blocking MPI_Scatterv, as before. Rank 0
+// hands the gathered masks to `maskWriter`.
+//
+// From a frame cache (--frame-cache) nothing is decoded or scattered: every
+// rank maps the cache and reads its own pixel range of each frame in place.
+//
+// Rank 0 reads the frames from `source` (null on the other ranks). With
+// numFrames < 0 the source is an open-ended stream, and rank 0 tells the
+// others after every frame whether another one follows.
+RunResult runPixelSlices(const vector<string>& imagePaths, int numFrames, FrameSource* source, int threshold,
+    BackgroundMode mode, double alpha, int windowSize, const ChangeSkipConfig& skip,
+    const PyramidConfig& pyramid, const MorphologyConfig& cleanup, bool nonBlocking, bool saveMasks,
+    MaskWriter* maskWriter, bool labelBlobs, BlobLog* blobLog, int numThreads, int rank, int size,
+    int& width, int& height) {
+    PoolBuffer pooled;
+    int framesRead = 0;
+    double computeTime = 0;
+    // Collective; rank 0's frame is in `pooled` until the next call
+    auto readFrame = [&]() {
+        int more = rank == 0 ? source->next(pooled) : framesRead < numFrames;
+        if (numFrames < 0) {
+            MPI_Bcast(&more, 1, MPI_INT, 0, MPI_COMM_WORLD);
         }
+        framesRead += more;
+        return more != 0;
+    };
 
-        cout << "Images loaded by rank 0" << endl;
+    string cacheFile;
+    vector<int> cacheIndices(imagePaths.size());
+    const FrameCache* cache = nullptr;
+    // Rank 0 reads the first frame to learn the dimensions, unless the
+    // frames come from a cache
+    if (!imagePaths.empty() && parseFrameCachePath(imagePaths[0], &cacheFile, &cacheIndices[0])) {
+        for (int f = 0; f < numFrames; f++) {
+            parseFrameCachePath(imagePaths[f], &cacheFile, &cacheIndices[f]);
+        }
+        cache = &mapFrameCache(cacheFile);
+        width = cache->width();
+        height = cache->height();
+    }
+    else if (!readFrame()) {
+        if (rank == 0) {
+            cout << "No input frames" << endl;
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    else if (rank == 0) {
+        width = pooled.frame().Width;
+        height = pooled.frame().Height;
     }
 
     // Broadcast image dimensions to all processes
     MPI_Bcast(&width, 1, MPI_INT, 0, MPI_COMM_WORLD);
     MPI_Bcast(&height, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-    int totalPixels = width * height;
-    int pixelsPerProcess = totalPixels / size;
-    int remainder = totalPixels % size;
-
+    // Slices are whole padded rows (stride bytes each), so a rank's mask slice
+    // is a band of image rows for the morphology halo exchange; the padding
+    // is zero in every frame and passes through the mean and mask unchanged.
+    //
+    // Change skipping tiles the whole image, and the pyramid averages it in
+    // blocks, so ranks then get whole tile or block rows; the last rank
+    // takes the partial one at the bottom.
+    int stride = alignedStride(width);
+    int unit = skip.Enabled ? CHANGE_TILE_ROWS : pyramid.Levels > 0 ? 1 << pyramid.Levels : 1;
+    int units = (height + unit - 1) / unit;
+    if (unit > 1 && units < size) {
+        if (rank == 0) {
+            cout << (skip.Enabled ? "--skip-static" : "--pyramid") << " needs at least " << unit
+                << " image rows per process" << endl;
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int rowsPerProcess = units / size * unit;
+    int remainder = units % size;
 
-    vector<int> counts(size, pixelsPerProcess);
+    vector<int> counts(size, rowsPerProcess * stride);
     vector<int> displs(size, 0);
 
     for (int i = 0; i < remainder; i++) {
-        counts[i]++;
+        counts[i] += unit * stride;
     }
+    counts[size - 1] -= (units * unit - height) * stride;
 
     for (int i = 1; i < size; i++) {
         displs[i] = displs[i - 1] + counts[i - 1];
     }
 
+    // Mask gathers move 64-bit words; whole padded rows are multiples of 64
+    vector<int> wordCounts(size);
+    vector<int> wordDispls(size);
+    for (int i = 0; i < size; i++) {
+        wordCounts[i] = counts[i] / 64;
+        wordDispls[i] = displs[i] / 64;
+    }
+
     int myCount = counts[rank];
-    int myDispl = displs[rank];
 
- 
-    int* localRedSum = new int[myCount]();
-    int* localGreenSum = new int[myCount]();
-    int* localBlueSum = new int[myCount]();
+    int fewestRows = *min_element(counts.begin(), counts.end()) / stride;
+    if (cleanup.Op != MORPH_NONE && fewestRows < max(1, morphologyHalo(cleanup))) {
+        if (rank == 0) {
+            cout << "--morph needs at least " << max(1, morphologyHalo(cleanup))
+                << " image rows per process" << endl;
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    SliceMorphology morphology(cleanup, width, myCount / stride, rank, size, MPI_COMM_WORLD);
+    // The coarse regions are dilated by the margin over the whole image, so
+    // every rank needs as many coarse rows as the margin
+    MorphologyConfig dilation = { MORPH_NONE, 1, 1 };
+    if (pyramid.Levels > 0 && pyramid.Margin > 0) {
+        dilation = { MORPH_DILATE, 2 * pyramid.Margin + 1, 2 * pyramid.Margin + 1 };
+        if (fewestRows < unit * pyramid.Margin) {
+            if (rank == 0) {
+                cout << "--pyramid-margin " << pyramid.Margin << " needs at least " << unit * pyramid.Margin
+                    << " image rows per process" << endl;
+            }
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    SliceMorphology regionDilation(dilation, (width + unit - 1) / unit, (myCount / stride + unit - 1) / unit,
+        rank, size, MPI_COMM_WORLD);
+    SliceBlobs sliceBlobs(width, myCount / stride, displs[rank] / stride, rank, MPI_COMM_WORLD);
+    int minArea = blobLog ? blobLog->minArea() : 0;
+
+    // Each rank's share is laid out as SLICE_WIDTH-wide rows for its threads;
+    // the first myCount samples of every plane are the slice. The buffers
+    // are reused for every frame.
+    int rows = sliceRows(myCount);
+    // With change skipping or the pyramid the model sees the slice as the
+    // band of image rows it is (the same samples, stride apart), so its
+    // tiles and blocks are the image's.
+    bool imageRows = skip.Enabled || pyramid.Levels > 0;
+    int modelRows = imageRows ? myCount / stride : rows;
+    BackgroundModel model(imageRows ? width : SLICE_WIDTH, modelRows, mode, alpha, windowSize);
+    model.setChangeSkipping(skip, displs[rank] / stride / CHANGE_TILE_ROWS);
+    model.setPyramid(pyramid, false, displs[rank] / stride >> pyramid.Levels);
+    vector<double> threadSeconds(numThreads, 0.0);
 
-    
-    MPI_Barrier(MPI_COMM_WORLD);
-    if (rank == 0) {
-        start_s = clock();
+    // Masks leave the rank bit-packed. Byte masks are only kept while
+    // morphology or blob labelling still needs them.
+    bool byteMasks = cleanup.Op != MORPH_NONE || labelBlobs;
+    uint8_t* localMasks[2] = {};
+    BitMask localBits[2];
+    for (int b = 0; b < 2; b++) {
+        localMasks[b] = byteMasks ? allocateMask(SLICE_WIDTH, rows) : nullptr;
+        localBits[b] = allocateBitMask(SLICE_WIDTH, rows);
     }
+    // Holds the last frame's mask once the frames are done
+    int lastBuffer = 0;
+    int processed = 0;
+    double foregroundPixels = 0;
 
-    // Scatter image data and calculate local sums
-    for (int frame = 0; frame < NUM_FRAMES; frame++) {
-        int* redChannel = nullptr;
-        int* greenChannel = nullptr;
-        int* blueChannel = nullptr;
+    // Clean, label, pack and count one frame's slice mask
+    auto finishMask = [&](int buffer, int frameIndex) {
+        if (!byteMasks) {
+            return;
+        }
+        morphology.apply(localMasks[buffer]);
+        if (labelBlobs) {
+            vector<Blob> frameBlobs = sliceBlobs.gather(localMasks[buffer], minArea);
+            if (rank == 0) {
+                blobLog->write(frameIndex, frameBlobs);
+            }
+        }
+        packMaskRows(localBits[buffer], localMasks[buffer], 0, rows);
+    };
+    // This rank's slice of frame f, in place in the cache. Its last slice row
+    // runs on into the next rank's pixels (or the plane's zero slack); those
+    // samples are never counted or gathered.
+    auto cachedSlice = [&](int f) {
+        Frame slice = cache->frame(cacheIndices[f]);
+        slice.Red += displs[rank];
+        slice.Green += displs[rank];
+        slice.Blue += displs[rank];
+        slice.Width = SLICE_WIDTH;
+        slice.Height = rows;
+        slice.Stride = SLICE_WIDTH;
+        return slice;
+    };
+    // This rank's image rows within the slice bits
+    auto countSlice = [&](int buffer) {
+        BitMask imageRows = { localBits[buffer].Words, width, myCount / stride, stride / 64 };
+        foregroundPixels += countForeground(imageRows);
+    };
+    auto process = [&](const Frame& slice, int buffer) {
+        Frame view = slice;
+        BitMask bits = localBits[buffer];
+        if (imageRows) {
+            view.Width = width;
+            view.Height = modelRows;
+            view.Stride = stride;
+            bits = { bits.Words, width, modelRows, stride / 64 };
+        }
+        processSlice(model, view, localMasks[buffer], bits, threshold,
+            dilation.Op != MORPH_NONE ? &regionDilation : nullptr, threadSeconds);
+    };
 
-        if (rank == 0) {
-            redChannel = colorImages[frame].Red;
-            greenChannel = colorImages[frame].Green;
-            blueChannel = colorImages[frame].Blue;
+    if (nonBlocking) {
+        SliceTransfer transfer(counts, displs, rank, MPI_COMM_WORLD);
+        BitMask masks[2] = {};
+        int pendingMask[2] = { -1, -1 };
+        if (rank == 0 && saveMasks) {
+            masks[0] = allocateBitMask(width, height);
+            masks[1] = allocateBitMask(width, height);
+        }
+
+        // Rank 0's decode and file writes are excluded from the timing
+        MPI_Barrier(MPI_COMM_WORLD);
+        double excluded = 0;
+        double start = MPI_Wtime();
+
+        if (cache) {
+            cache->prefetch(cacheIndices[0], displs[rank], myCount);
+        }
+        else {
+            transfer.scatter(pooled.frame(), 0);
+            transfer.waitScatter(0);
         }
 
-        int* localRed = new int[myCount];
-        int* localGreen = new int[myCount];
-        int* localBlue = new int[myCount];
+        for (int k = 0; ; k++) {
+            int current = k & 1;
+            int next = current ^ 1;
+            bool more;
+            if (cache) {
+                more = k + 1 < numFrames;
+                if (more) {
+                    cache->prefetch(cacheIndices[k + 1], displs[rank], myCount);
+                }
+            }
+            else {
+                double decodeStart = MPI_Wtime();
+                more = readFrame();
+                if (rank == 0) {
+                    excluded += MPI_Wtime() - decodeStart;
+                }
+                if (more) {
+                    transfer.scatter(pooled.frame(), next);
+                }
+            }
 
-        // Scatter each channel
-        MPI_Scatterv(redChannel, counts.data(), displs.data(), MPI_INT,
-            localRed, myCount, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Scatterv(greenChannel, counts.data(), displs.data(), MPI_INT,
-            localGreen, myCount, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Scatterv(blueChannel, counts.data(), displs.data(), MPI_INT,
-            localBlue, myCount, MPI_INT, 0, MPI_COMM_WORLD);
+            // The mask buffer from frame k - 2 must have landed before reuse
+            transfer.waitGather(current);
+            if (rank == 0 && pendingMask[current] >= 0) {
+                double writeStart = MPI_Wtime();
+                maskWriter->write(masks[current], maskFileName(pendingMask[current]));
+                excluded += MPI_Wtime() - writeStart;
+            }
 
-        // Accumulate sums
-        for (int i = 0; i < myCount; i++) {
-            localRedSum[i] += localRed[i];
-            localGreenSum[i] += localGreen[i];
-            localBlueSum[i] += localBlue[i];
+            process(cache ? cachedSlice(k) : transfer.slice(current), current);
+            finishMask(current, k);
+            countSlice(current);
+            processed++;
+            if (saveMasks) {
+                transfer.gatherMask(localBits[current], masks[current], current);
+                pendingMask[current] = k;
+            }
+
+            if (!more) {
+                lastBuffer = current;
+                break;
+            }
+            if (!cache) {
+                transfer.waitScatter(next);
+            }
         }
 
-        delete[] localRed;
-        delete[] localGreen;
-        delete[] localBlue;
+        for (int b = 0; b < 2; b++) {
+            transfer.waitGather(b);
+            if (rank == 0 && pendingMask[b] >= 0) {
+                double writeStart = MPI_Wtime();
+                maskWriter->write(masks[b], maskFileName(pendingMask[b]));
+                excluded += MPI_Wtime() - writeStart;
+            }
+        }
+        computeTime = MPI_Wtime() - start - excluded;
+        freeBitMask(masks[0]);
+        freeBitMask(masks[1]);
     }
+    else {
+        Frame localFrame = allocateFrame(SLICE_WIDTH, rows);
+        BitMask mask = {};
+        if (rank == 0 && saveMasks) {
+            mask = allocateBitMask(width, height);
+        }
+        // Frame 0 is already read unless it comes from the cache
+        for (int f = 0; cache ? f < numFrames : f == 0 || readFrame(); f++) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            double start = MPI_Wtime();
 
-    // Calculate local mean
-    for (int i = 0; i < myCount; i++) {
-        localRedSum[i] /= NUM_FRAMES;
-        localGreenSum[i] /= NUM_FRAMES;
-        localBlueSum[i] /= NUM_FRAMES;
-    }
+            // Scatter each channel
+            for (int c = 0; c < 3 && !cache; c++) {
+                TRACE_SCOPE("scatter");
+                TRACE_COUNT("scatter bytes", myCount);
+                MPI_Scatterv(rank == 0 ? channelPlane(pooled.frame(), c) : nullptr, counts.data(), displs.data(),
+                    MPI_UNSIGNED_CHAR, channelPlane(localFrame, c), myCount, MPI_UNSIGNED_CHAR, 0,
+                    MPI_COMM_WORLD);
+            }
 
-    // Gather background results to rank 0
-    int* backgroundRed = nullptr;
-    int* backgroundGreen = nullptr;
-    int* backgroundBlue = nullptr;
+            process(cache ? cachedSlice(f) : localFrame, lastBuffer);
+            finishMask(lastBuffer, f);
+            countSlice(lastBuffer);
+            processed++;
+            computeTime += MPI_Wtime() - start;
 
+            if (saveMasks) {
+                TRACE_SCOPE("gather");
+                TRACE_COUNT("gather bytes", myCount / 8);
+                MPI_Gatherv(localBits[lastBuffer].Words, myCount / 64, MPI_UINT64_T, mask.Words,
+                    wordCounts.data(), wordDispls.data(), MPI_UINT64_T, 0, MPI_COMM_WORLD);
+                if (rank == 0) {
+                    maskWriter->write(mask, maskFileName(f));
+                }
+            }
+        }
+        freeFrame(localFrame);
+        freeBitMask(mask);
+    }
+
+    // Gather background and the last frame's mask to rank 0
+    model.refreshBackground();
+    RunResult result = {};
     if (rank == 0) {
-        backgroundRed = new int[totalPixels];
-        backgroundGreen = new int[totalPixels];
-        backgroundBlue = new int[totalPixels];
+        result.Background = allocateFrame(width, height);
+        result.Mask = allocateBitMask(width, height);
+    }
+
+    double start = MPI_Wtime();
+    for (int c = 0; c < 3; c++) {
+        TRACE_SCOPE("gather");
+        TRACE_COUNT("gather bytes", myCount);
+        MPI_Gatherv(channelPlane(model.background(), c), myCount, MPI_UNSIGNED_CHAR,
+            channelPlane(result.Background, c), counts.data(), displs.data(), MPI_UNSIGNED_CHAR, 0,
+            MPI_COMM_WORLD);
+    }
+    {
+        TRACE_SCOPE("gather");
+        TRACE_COUNT("gather bytes", myCount / 8);
+        MPI_Gatherv(localBits[lastBuffer].Words, myCount / 64, MPI_UINT64_T, result.Mask.Words,
+            wordCounts.data(), wordDispls.data(), MPI_UINT64_T, 0, MPI_COMM_WORLD);
     }
 
-    MPI_Gatherv(localRedSum, myCount, MPI_INT,
-        backgroundRed, counts.data(), displs.data(), MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Gatherv(localGreenSum, myCount, MPI_INT,
-        backgroundGreen, counts.data(), displs.data(), MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Gatherv(localBlueSum, myCount, MPI_INT,
-        backgroundBlue, counts.data(), displs.data(), MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+    computeTime += MPI_Wtime() - start;
 
+    result.ComputeSeconds = computeTime;
+    result.StateBytes = model.memoryBytes();
+    result.ThreadSeconds = threadSeconds;
+    MPI_Reduce(&foregroundPixels, &result.ForegroundPixels, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    result.MaskCount = processed;
+    ChangeSkipStats skipped = model.changeSkipStats();
+    unsigned long long localTiles[2] = { skipped.Tiles, skipped.Skipped };
+    unsigned long long tiles[2] = {};
+    MPI_Reduce(localTiles, tiles, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    result.Skipped.Tiles = tiles[0];
+    result.Skipped.Skipped = tiles[1];
+    PyramidStats local = model.pyramidStats();
+    unsigned long long localPixels[4] = { local.Pixels, local.Refined, local.Foreground, local.Missed };
+    unsigned long long pixels[4] = {};
+    MPI_Reduce(localPixels, pixels, 4, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    double localSeconds[4] = { local.DownsampleSeconds, local.AccumulateSeconds, local.PyramidSeconds,
+        local.CheckSeconds };
+    double seconds[4] = {};
+    MPI_Reduce(localSeconds, seconds, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    result.Pyramid = { pixels[0], pixels[1], local.CheckedFrames, pixels[2], pixels[3], seconds[0], seconds[1],
+        seconds[2], seconds[3] };
+    for (int b = 0; b < 2; b++) {
+        alignedFree(localMasks[b]);
+        freeBitMask(localBits[b]);
+    }
+    return result;
+}
 
-    int* lastFrameRed = nullptr;
-    int* lastFrameGreen = nullptr;
-    int* lastFrameBlue = nullptr;
+// Frame-parallel mode: every rank decodes its own contiguous range of frames
+// from disk and sums whole frames locally; the partial sums are combined
+// with MPI_Reduce (or MPI_Allreduce when every rank needs the background).
+// Rank r takes range size - 1 - r, so rank 0 decodes the last frame itself
+// and can mask it without another transfer. Running mean only.
+//
+// With `dynamic` the ranges are handed out by rank 0 on demand instead
+// (FrameDispatch.h), sized by each rank's measured frame rate; rank 0 loads
+// the last frame for the mask separately if another rank sums it. The sums
+// do not depend on which rank adds a frame, so the output is the same.
+RunResult runFrameParallel(const vector<string>& imagePaths, int threshold,
+    const MorphologyConfig& cleanup, bool allRanks, BlobLog* blobLog, bool dynamic, int minChunk,
+    int numThreads, int rank, int size, int& width, int& height) {
+    int numFrames = imagePaths.size();
+    int range = size - 1 - rank;
+    int first = (int)((long long)numFrames * range / size);
+    int last = (int)((long long)numFrames * (range + 1) / size);
+    double computeTime = 0;
 
+    // From a frame cache each rank maps only its own frames; dynamic ranges
+    // are not known up front, so loadFrame() maps the whole file then
+    if (!dynamic) {
+        mapCachedFrames(imagePaths, first, last);
+    }
+    Frame lastFrame = {};
     if (rank == 0) {
-        lastFrameRed = colorImages.back().Red;
-        lastFrameGreen = colorImages.back().Green;
-        lastFrameBlue = colorImages.back().Blue;
+        lastFrame = loadFrame(&width, &height, imagePaths[numFrames - 1]);
     }
+    MPI_Bcast(&width, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&height, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
+    int stride = alignedStride(width);
+    int planeSize = stride * height;
+    vector<double> threadSeconds(numThreads, 0.0);
+    vector<uint32_t> sums[3];
+    for (int c = 0; c < 3; c++) {
+        sums[c].assign(planeSize, 0);
+    }
 
-    int* localBgRed = new int[myCount];
-    int* localBgGreen = new int[myCount];
-    int* localBgBlue = new int[myCount];
-    int* localFrameRed = new int[myCount];
-    int* localFrameGreen = new int[myCount];
-    int* localFrameBlue = new int[myCount];
-
-    MPI_Scatterv(backgroundRed, counts.data(), displs.data(), MPI_INT,
-        localBgRed, myCount, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Scatterv(backgroundGreen, counts.data(), displs.data(), MPI_INT,
-        localBgGreen, myCount, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Scatterv(backgroundBlue, counts.data(), displs.data(), MPI_INT,
-        localBgBlue, myCount, MPI_INT, 0, MPI_COMM_WORLD);
+    auto sumFrame = [&](int f) {
+        int frameWidth, frameHeight;
+        Frame frame = f == numFrames - 1 && rank == 0 ? lastFrame
+            : loadFrame(&frameWidth, &frameHeight, imagePaths[f]);
 
-    MPI_Scatterv(lastFrameRed, counts.data(), displs.data(), MPI_INT,
-        localFrameRed, myCount, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Scatterv(lastFrameGreen, counts.data(), displs.data(), MPI_INT,
-        localFrameGreen, myCount, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Scatterv(lastFrameBlue, counts.data(), displs.data(), MPI_INT,
-        localFrameBlue, myCount, MPI_INT, 0, MPI_COMM_WORLD);
+        double start = MPI_Wtime();
+        int chunks = (planeSize + SUM_CHUNK - 1) / SUM_CHUNK;
+#pragma omp parallel
+        {
+            double busy = 0;
+#pragma omp for schedule(static)
+            for (int k = 0; k < chunks; k++) {
+                double chunkStart = MPI_Wtime();
+                size_t offset = (size_t)k * SUM_CHUNK;
+                size_t n = min((size_t)SUM_CHUNK, planeSize - offset);
+                for (int c = 0; c < 3; c++) {
+                    kernels().accumulatePlane(sums[c].data() + offset, channelPlane(frame, c) + offset, n);
+                }
+                busy += MPI_Wtime() - chunkStart;
+            }
+            threadSeconds[threadIndex()] += busy;
+        }
+        computeTime += MPI_Wtime() - start;
 
+        if (frame.Data != lastFrame.Data) {
+            freeFrame(frame);
+        }
+    };
 
-    int* localForeground = new int[myCount];
-    for (int i = 0; i < myCount; i++) {
-        int bgGray = (localBgRed[i] + localBgGreen[i] + localBgBlue[i]) / 3;
-        int frameGray = (localFrameRed[i] + localFrameGreen[i] + localFrameBlue[i]) / 3;
-        int diff = abs(bgGray - frameGray);
-        localForeground[i] = (diff > THRESHOLD) ? 255 : 0;
+    RunResult result = {};
+    if (dynamic) {
+        FrameDispatch dispatch(numFrames, minChunk, rank, size, MPI_COMM_WORLD);
+        dispatch.run(sumFrame);
+        result.RankFrames = dispatch.rankFrames();
+        result.RankChunks = dispatch.rankChunks();
+    }
+    else {
+        for (int f = first; f < last; f++) {
+            sumFrame(f);
+        }
+    }
+    result.BackgroundOnAllRanks = allRanks;
+    if (rank == 0 || allRanks) {
+        result.Background = allocateFrame(width, height);
     }
 
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    vector<uint32_t> total(rank == 0 || allRanks ? planeSize : 0);
+    FixedPointDivisor divisor = makeDivisor(numFrames, 255u * numFrames);
+    for (int c = 0; c < 3; c++) {
+        TRACE_SCOPE("reduce");
+        TRACE_COUNT("reduce bytes", planeSize * sizeof(uint32_t));
+        if (allRanks) {
+            MPI_Allreduce(sums[c].data(), total.data(), planeSize, MPI_UINT32_T, MPI_SUM, MPI_COMM_WORLD);
+        }
+        else {
+            MPI_Reduce(sums[c].data(), total.data(), planeSize, MPI_UINT32_T, MPI_SUM, 0, MPI_COMM_WORLD);
+        }
+        if (rank == 0 || allRanks) {
+            kernels().dividePlane(channelPlane(result.Background, c), total.data(), planeSize, divisor);
+        }
+    }
 
-    int* foregroundMask = nullptr;
     if (rank == 0) {
-        foregroundMask = new int[totalPixels];
+        const Frame& bg = result.Background;
+        result.Mask = allocateBitMask(width, height);
+        if (cleanup.Op == MORPH_NONE && !blobLog) {
+            kernels().thresholdBits(result.Mask.Words, bg.Red, bg.Green, bg.Blue,
+                lastFrame.Red, lastFrame.Green, lastFrame.Blue, planeSize, threshold);
+        }
+        else {
+            uint8_t* mask = allocateMask(width, height);
+            uint8_t* scratch = allocateMask(width, height);
+            kernels().thresholdMask(mask, bg.Red, bg.Green, bg.Blue,
+                lastFrame.Red, lastFrame.Green, lastFrame.Blue, planeSize, threshold);
+            applyMorphology(mask, scratch, width, height, stride, cleanup);
+            if (blobLog) {
+                blobLog->write(numFrames - 1, findBlobs(mask, width, height, stride, blobLog->minArea()));
+            }
+            packMaskRows(result.Mask, mask, 0, height);
+            alignedFree(mask);
+            alignedFree(scratch);
+        }
+        result.ForegroundPixels = countForeground(result.Mask);
+        result.MaskCount = 1;
+        freeFrame(lastFrame);
     }
+    MPI_Barrier(MPI_COMM_WORLD);
+    computeTime += MPI_Wtime() - start;
 
-    MPI_Gatherv(localForeground, myCount, MPI_INT,
-        foregroundMask, counts.data(), displs.data(), MPI_INT, 0, MPI_COMM_WORLD);
+    // Decode time differs per rank; report the slowest compute
+    MPI_Allreduce(&computeTime, &result.ComputeSeconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    result.StateBytes = 3 * (size_t)planeSize * sizeof(uint32_t);
+    result.ThreadSeconds = threadSeconds;
+    return result;
+}
 
- 
-    MPI_Barrier(MPI_COMM_WORLD);
+static int run(int argc, char* argv[], int provided) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    int numFrames = intOption(argc, argv, "--frames", NUM_FRAMES);
+    int threshold = intOption(argc, argv, "--threshold", THRESHOLD);
+    double alpha = doubleOption(argc, argv, "--ema", 0);
+    double mixtureRate = doubleOption(argc, argv, "--mog", 0);
+    int windowSize = intOption(argc, argv, "--window", 0);
+    // --median with --window N is the median of the last N frames
+    // --skip-static reuses the background and mask of tiles that moved by
+    // no more than --skip-threshold N since they were last processed;
+    // each tile is still processed once every --skip-refresh N frames
+    ChangeSkipConfig skip;
+    skip.Enabled = hasOption(argc, argv, "--skip-static");
+    skip.Threshold = intOption(argc, argv, "--skip-threshold", 12);
+    skip.RefreshInterval = intOption(argc, argv, "--skip-refresh", 16);
+    // --pyramid N thresholds at 1/2^N resolution first (--pyramid-threshold)
+    // and refines only within --pyramid-margin N coarse pixels of what it
+    // finds; every --pyramid-check N frames the mask is compared with the
+    // full-resolution one
+    PyramidConfig pyramid;
+    pyramid.Levels = intOption(argc, argv, "--pyramid", 0);
+    pyramid.Margin = intOption(argc, argv, "--pyramid-margin", 2);
+    pyramid.Threshold = intOption(argc, argv, "--pyramid-threshold", threshold / 2);
+    pyramid.CheckInterval = intOption(argc, argv, "--pyramid-check", 10);
+    MorphologyConfig cleanup;
+    cleanup.Op = morphologyOp(stringOption(argc, argv, "--morph", "none"));
+    cleanup.KernelWidth = intOption(argc, argv, "--morph-width", 3);
+    cleanup.KernelHeight = intOption(argc, argv, "--morph-height", cleanup.KernelWidth);
+    BackgroundMode mode = hasOption(argc, argv, "--median") ? BACKGROUND_MEDIAN
+        : mixtureRate > 0 ? BACKGROUND_MIXTURE
+        : windowSize > 0 ? BACKGROUND_WINDOW
+        : alpha > 0 ? BACKGROUND_EMA : BACKGROUND_RUNNING_MEAN;
+    if (mode == BACKGROUND_MIXTURE) {
+        alpha = mixtureRate;
+    }
+    bool allMasks = hasOption(argc, argv, "--all-masks");
+    // --blobs writes each frame's blobs of at least --min-area pixels
+    bool labelBlobs = hasOption(argc, argv, "--blobs");
+    int minArea = intOption(argc, argv, "--min-area", 20);
+    unique_ptr<BlobLog> blobLog;
+    // --synthetic WxH replaces the input PNGs with generated frames;
+    // --warmup N and --repeat N rerun the whole run, and --report FILE
+    // appends each measured run to a CSV. --trace FILE records the last run
+    // of every rank as one Chrome trace (builds with BGS_TRACE only)
+    string synthetic = stringOption(argc, argv, "--synthetic", "");
+    int warmup = max(0, intOption(argc, argv, "--warmup", 0));
+    int repeat = max(1, intOption(argc, argv, "--repeat", 1));
+    string report = stringOption(argc, argv, "--report", "");
+    string trace = stringOption(argc, argv, "--trace", "");
+    // --frame-cache FILE decodes the inputs once into FILE (again only when
+    // they change); later runs map it, each rank only what it reads
+    string frameCache = stringOption(argc, argv, "--frame-cache", "");
+    // --input FILE has rank 0 read an uncompressed video stream (- for
+    // stdin) to its end instead of the PNGs: --input-format y4m (default)
+    // or rgb24, which needs --size WxH
+    string input = stringOption(argc, argv, "--input", "");
+    bool saveMasks = hasOption(argc, argv, "--save-masks");
+    // --output png|pnm|raw|none, --png-level N (0-9) and --output-threads N
+    // mask encoder threads per writing rank
+    OutputConfig output = { OUTPUT_PNG, intOption(argc, argv, "--png-level", -1) };
+    bool outputKnown = parseOutputFormat(stringOption(argc, argv, "--output", "png"), &output.Format);
+    int outputThreads = intOption(argc, argv, "--output-threads", 0);
+    bool frameParallel = stringOption(argc, argv, "--decompose", "pixels") == "frames";
+    // --balance dynamic has rank 0 hand out frame ranges on demand, sized
+    // by each rank's measured rate and at least --min-chunk N frames
+    // (--decompose frames only)
+    bool dynamic = stringOption(argc, argv, "--balance", "static") == "dynamic";
+    int minChunk = intOption(argc, argv, "--min-chunk", 1);
+    bool nonBlocking = stringOption(argc, argv, "--transfer", "packed") != "blocking";
+#ifdef _OPENMP
+    int numThreads = max(1, intOption(argc, argv, "--threads", 1));
+    omp_set_num_threads(numThreads);
+#else
+    int numThreads = 1;
+#endif
+
+    if (skip.Enabled && (skip.RefreshInterval < 1 || skip.RefreshInterval > MAX_SKIP_REFRESH)) {
+        if (rank == 0) {
+            cout << "--skip-refresh takes 1 to " << MAX_SKIP_REFRESH << " frames" << endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (frameParallel && (mode != BACKGROUND_RUNNING_MEAN || skip.Enabled || pyramid.Levels != 0)) {
+        if (rank == 0) {
+            cout << "--decompose frames supports the running mean only, without --skip-static or --pyramid"
+                << endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (!outputKnown || output.PngLevel < -1 || output.PngLevel > 9) {
+        if (rank == 0) {
+            cout << "--output must be png, pnm, raw or none, and --png-level 0 to 9" << endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    setOutputConfig(output);
+    if (dynamic && !frameParallel) {
+        if (rank == 0) {
+            cout << "--balance dynamic needs --decompose frames" << endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (pyramid.Levels < 0 || pyramid.Levels > MAX_PYRAMID_LEVELS
+        || (pyramid.Levels > 0 && (skip.Enabled || mode == BACKGROUND_MIXTURE))) {
+        if (rank == 0) {
+            cout << "--pyramid takes 0 (off) to " << MAX_PYRAMID_LEVELS << " levels, without --skip-static or --mog"
+                << endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    int width = 0, height = 0;
+    vector<string> imagePaths;
+    unique_ptr<FrameStream> stream;
+    if (!input.empty()) {
+        StreamFormat format;
+        string size = stringOption(argc, argv, "--size", "");
+        const char* error = !parseStreamFormat(stringOption(argc, argv, "--input-format", "y4m"), &format)
+            ? "--input-format must be y4m or rgb24"
+            : !size.empty() && !parseFrameSize(size, &width, &height) ? "--size needs a size such as 1920x1080"
+            : frameParallel || allMasks || warmup + repeat > 1 || !frameCache.empty()
+            ? "--input is read once, in pixel slices without --all-masks or --frame-cache" : nullptr;
+        if (error) {
+            if (rank == 0) {
+                cout << error << endl;
+            }
+            MPI_Finalize();
+            return 1;
+        }
+        if (rank == 0) {
+            stream.reset(new FrameStream(input, format, width, height));
+        }
+        numFrames = -1;
+    }
+    else if (!synthetic.empty()) {
+        if (!parseFrameSize(synthetic, &width, &height)) {
+            if (rank == 0) {
+                cout << "--synthetic needs a size such as 1920x1080" << endl;
+            }
+            MPI_Finalize();
+            return 1;
+        }
+        imagePaths = syntheticFramePaths(width, height, numFrames);
+    }
+    else {
+        imagePaths = getImagePaths(numFrames);
+    }
+    if (input.empty() && imagePaths.empty()) {
+        if (rank == 0) {
+            cout << "No input images found!" << endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (!frameCache.empty()) {
+        if (rank == 0 && !frameCacheMatches(frameCache, imagePaths)) {
+            cout << "Building frame cache " << frameCache << endl;
+            buildFrameCache(frameCache, imagePaths);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        imagePaths = frameCachePaths(frameCache, imagePaths.size());
+    }
     if (rank == 0) {
-        stop_s = clock();
-        TotalTime = (stop_s - start_s) / double(CLOCKS_PER_SEC) * 1000;
+        cout << "Parallel Background subtractor using MPI" << endl;
+    }
 
-        // Create background image structure
-        ColorImage colorBackground;
-        colorBackground.Width = width;
-        colorBackground.Height = height;
-        colorBackground.Red = backgroundRed;
-        colorBackground.Green = backgroundGreen;
-        colorBackground.Blue = backgroundBlue;
+    RunResult result = {};
+    double wallTime = 0;
+    FramePool pool;
+    // Rank 0's compute time of each measured run; the other ranks' also
+    // include waiting for rank 0 to read frames
+    vector<double> computeSeconds;
+    for (int rep = 0; rep < warmup + repeat; rep++) {
+        if (rep > 0) {
+            freeFrame(result.Background);
+            freeBitMask(result.Mask);
+        }
+        if (labelBlobs && rank == 0) {
+            blobLog.reset(new BlobLog(OUTPUT_DIR + "foreground_blobs_parallel.csv", minArea));
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (!trace.empty() && rep == warmup + repeat - 1) {
+            traceEnable(rank);
+        }
+        unique_ptr<MaskWriter> maskWriter;
+        if (rank == 0 && saveMasks && !allMasks) {
+            maskWriter.reset(new MaskWriter(outputThreads));
+        }
+        double wallStart = MPI_Wtime();
+        FrameSource source = stream ? FrameSource(*stream, pool) : FrameSource(imagePaths, pool);
+        result = frameParallel
+            ? runFrameParallel(imagePaths, threshold, cleanup, allMasks,
+                allMasks ? nullptr : blobLog.get(), dynamic, minChunk, numThreads, rank, size, width, height)
+            : runPixelSlices(imagePaths, numFrames, rank == 0 ? &source : nullptr, threshold, mode, alpha,
+                windowSize, skip, pyramid, cleanup, nonBlocking, saveMasks && !allMasks, maskWriter.get(), labelBlobs && !allMasks,
+                blobLog.get(), numThreads, rank, size, width, height);
+        if (maskWriter) {
+            maskWriter->finish();
+        }
+        wallTime = MPI_Wtime() - wallStart;
+        if (numFrames < 0) {
+            numFrames = result.MaskCount;
+        }
+
+        if (rep < warmup || rank != 0) {
+            continue;
+        }
+        computeSeconds.push_back(result.ComputeSeconds);
+        if (warmup + repeat > 1) {
+            cout << "Run " << rep - warmup + 1 << ": " << result.ComputeSeconds * 1000 << " ms compute, "
+                << wallTime * 1000 << " ms wall" << endl;
+        }
+        if (!report.empty()) {
+            BenchRecord record = { "mpi", frameParallel ? "frames" : nonBlocking ? "pixels" : "pixels-blocking",
+                backgroundModeName(mode), kernels().Name, width, height, numFrames, numThreads, size,
+                rep - warmup, result.ComputeSeconds, wallTime };
+            appendBenchRecord(report, record);
+        }
+    }
+    Frame& colorBackground = result.Background;
+    int stride = alignedStride(width);
+
+    // Per-rank and per-thread timings, collected on rank 0
+    vector<double> rankSeconds(rank == 0 ? size : 0);
+    vector<double> allThreadSeconds(rank == 0 ? size * numThreads : 0);
+    double localSeconds = result.ComputeSeconds;
+    MPI_Gather(&localSeconds, 1, MPI_DOUBLE, rankSeconds.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gather(result.ThreadSeconds.data(), numThreads, MPI_DOUBLE, allThreadSeconds.data(), numThreads,
+        MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    // Optional second pass: every frame masked against the final background.
+    // Frames are split across ranks in contiguous ranges; each rank decodes
+    // its own frames and masks them a group at a time.
+    double maskTime = 0;
+    if (allMasks) {
+        if (!result.BackgroundOnAllRanks) {
+            if (rank != 0) {
+                colorBackground = allocateFrame(width, height);
+            }
+            for (int c = 0; c < 3; c++) {
+                TRACE_SCOPE("broadcast");
+                TRACE_COUNT("broadcast bytes", stride * height);
+                MPI_Bcast(channelPlane(colorBackground, c), stride * height, MPI_UNSIGNED_CHAR, 0,
+                    MPI_COMM_WORLD);
+            }
+        }
+
+        int first = (int)((long long)numFrames * rank / size);
+        int last = (int)((long long)numFrames * (rank + 1) / size);
+        mapCachedFrames(imagePaths, first, last);
+        vector<Frame> group;
+        vector<uint8_t*> masks(MASK_FRAME_GROUP);
+        for (auto& mask : masks) {
+            mask = allocateMask(width, height);
+        }
+        uint8_t* scratch = allocateMask(width, height);
+        BitMask bits = allocateBitMask(width, height);
+        MaskWriter maskWriter(saveMasks ? outputThreads : 0);
+        double foregroundPixels = 0;
+        vector<vector<Blob>> frameBlobs(labelBlobs ? last - first : 0);
+
+        for (int g = first; g < last; g += MASK_FRAME_GROUP) {
+            int count = min(MASK_FRAME_GROUP, last - g);
+            for (int f = g; f < g + count; f++) {
+                group.push_back(loadFrame(&width, &height, imagePaths[f]));
+            }
+
+            double groupStart = MPI_Wtime();
+            foregroundMasks(colorBackground, group.data(), count, masks.data(), threshold);
+            for (int k = 0; k < count; k++) {
+                applyMorphology(masks[k], scratch, width, height, stride, cleanup);
+                if (labelBlobs) {
+                    frameBlobs[g + k - first] = findBlobs(masks[k], width, height, stride, minArea);
+                }
+                packMaskRows(bits, masks[k], 0, height);
+                foregroundPixels += countForeground(bits);
+            }
+            maskTime += MPI_Wtime() - groupStart;
+
+            for (int k = 0; saveMasks && k < count; k++) {
+                maskWriter.write(masks[k], width, height, maskFileName(g + k));
+            }
+            for (auto& frame : group) {
+                freeFrame(frame);
+            }
+            group.clear();
+        }
+
+        for (auto& mask : masks) {
+            alignedFree(mask);
+        }
+        alignedFree(scratch);
+        freeBitMask(bits);
+        maskWriter.finish();
+        // These masks replace the streaming run's in the foreground figure
+        MPI_Reduce(&foregroundPixels, &result.ForegroundPixels, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        result.MaskCount = numFrames;
+        if (labelBlobs) {
+            gatherFrameBlobs(frameBlobs, first, blobLog.get(), rank, size);
+        }
+        double localTime = maskTime;
+        MPI_Reduce(&localTime, &maskTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    }
+
+    // The trace covers the --all-masks pass too
+    vector<string> traceSummaries, traceEvents;
+    if (!trace.empty() && TRACE_COMPILED) {
+        traceSummaries = gatherStrings(traceSummary(), rank, size);
+        traceEvents = gatherStrings(traceEventsJson(), rank, size);
+    }
+
+    if (rank == 0) {
+        double computeTime = medianOf(computeSeconds);
 
         // Save results
         createColorImage(colorBackground, "color_background_parallel.png");
-        createGrayImage(foregroundMask, width, height, "foreground_mask_parallel.png");
+        createGrayImage(result.Mask, "foreground_mask_parallel.png");
 
-        cout << "Processing time: " << TotalTime << " ms" << endl;
+        cout << "Processing time: " << computeTime * 1000 << " ms" << (repeat > 1 ? " (median)" : "") << endl;
+        cout << "Throughput: " << megapixelsPerSecond(width, height, numFrames, computeTime) << " MP/s" << endl;
+        cout << "Wall time (with decode): " << (int)(wallTime * 1000) << " ms" << endl;
         cout << "Used parameters:" << endl;
-        cout << "  Number of frames: " << NUM_FRAMES << endl;
-        cout << "  Threshold value: " << THRESHOLD << endl;
+        cout << "  Number of frames: " << numFrames << endl;
+        cout << "  Threshold value: " << threshold << endl;
         cout << "  Number of MPI processes: " << size << endl;
-
-        // Clean up
-        delete[] backgroundRed;
-        delete[] backgroundGreen;
-        delete[] backgroundBlue;
-        delete[] foregroundMask;
-
-        for (auto& img : colorImages) {
-            delete[] img.Red;
-            delete[] img.Green;
-            delete[] img.Blue;
+        cout << "  OpenMP threads per process: " << numThreads
+            << (provided >= MPI_THREAD_FUNNELED ? "" : " (MPI lacks MPI_THREAD_FUNNELED)") << endl;
+        cout << "  Decomposition: " << (frameParallel ? dynamic ? "frames, dynamic ranges" : "frames" : nonBlocking
+            ? "pixel slices, packed non-blocking" : "pixel slices, blocking") << endl;
+        if (dynamic) {
+            cout << "  Frames per rank:";
+            for (int r = 0; r < size; r++) {
+                cout << " " << result.RankFrames[r] << " (" << result.RankChunks[r] << " ranges)";
+            }
+            cout << endl;
+        }
+        cout << "  Background: " << backgroundModeName(mode) << endl;
+        cout << "  State memory per rank: " << result.StateBytes / 1024 << " KiB" << endl;
+        if (allMasks) {
+            cout << "  Per-frame masks: " << numFrames << " in " << (int)(maskTime * 1000)
+                << " ms (slowest rank)" << endl;
+        }
+        cout << "  Mask cleanup: " << morphologyName(cleanup.Op);
+        if (cleanup.Op != MORPH_NONE) {
+            cout << " " << cleanup.KernelWidth << "x" << cleanup.KernelHeight;
+        }
+        cout << endl;
+        if (skip.Enabled) {
+            cout << "  Change skipping: " << 100.0 * result.Skipped.Skipped / max<size_t>(1, result.Skipped.Tiles)
+                << "% of tiles skipped (threshold " << skip.Threshold << ", refresh every "
+                << skip.RefreshInterval << " frames)" << endl;
+        }
+        if (pyramid.Levels > 0) {
+            cout << pyramidReport(pyramid, result.Pyramid);
+        }
+        // Pixel slices mask every frame against the background as it stood
+        // then; --decompose frames masks only the last frame, and
+        // --all-masks every frame, against the final background
+        const char* masks = allMasks ? "per mask against the final background"
+            : frameParallel ? "in the last frame's mask against the final background"
+            : "per mask against the running background";
+        cout << "  Foreground: " << 100.0 * result.ForegroundPixels / result.MaskCount / ((double)width * height)
+            << "% of pixels " << masks << endl;
+        if (blobLog) {
+            cout << "  Blobs: " << blobLog->blobs() << " in " << blobLog->frames() << " frames (min area "
+                << blobLog->minArea() << ")" << endl;
         }
+        if (!frameParallel) {
+            FramePoolStats poolStats = pool.stats();
+            cout << "  Frame pool (rank 0): peak " << poolStats.PeakInUseBytes / 1024 << " KiB in use, "
+                << poolStats.HeldBytes / 1024 << " KiB held, " << poolStats.Allocations << " allocations, "
+                << poolStats.Reuses << " reuses" << endl;
+        }
+        cout << "  SIMD kernels: " << kernels().Name << endl;
+        for (int r = 0; r < size; r++) {
+            cout << "  Rank " << r << ": " << (int)(rankSeconds[r] * 1000) << " ms, threads:";
+            for (int t = 0; t < numThreads; t++) {
+                cout << " " << (int)(allThreadSeconds[r * numThreads + t] * 1e6) / 1000.0;
+            }
+            cout << " ms" << endl;
+        }
+        if (!trace.empty()) {
+            if (TRACE_COMPILED) {
+                for (const string& summary : traceSummaries) {
+                    cout << summary;
+                }
+                writeTrace(trace, traceEvents);
+                cout << "Trace written to " << trace << endl;
+            }
+            else {
+                cout << "Built without BGS_TRACE; --trace ignored" << endl;
+            }
+        }
+
+        freeBitMask(result.Mask);
     }
 
-    // Clean up local memory
-    delete[] localRedSum;
-    delete[] localGreenSum;
-    delete[] localBlueSum;
-    delete[] localBgRed;
-    delete[] localBgGreen;
-    delete[] localBgBlue;
-    delete[] localFrameRed;
-    delete[] localFrameGreen;
-    delete[] localFrameBlue;
-    delete[] localForeground;
+    freeFrame(colorBackground);
 
     MPI_Finalize();
-
- 
     return 0;
+}
+
+// Errors that reach here (an unreadable input, a malformed stream, a bad
+// option value) end the run with a message instead of std::terminate. The
+// other ranks may be waiting for this one in a collective, so the whole
+// job is aborted.
+int main(int argc, char* argv[]) {
+    // Only the main thread makes MPI calls; OpenMP threads just compute
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    try {
+        return run(argc, argv, provided);
+    }
+    catch (const exception& e) {
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        cout << "Error on rank " << rank << ": " << e.what() << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
 }
\ No newline at end of file
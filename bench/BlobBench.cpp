@@ -0,0 +1,160 @@
+// Blob extraction on random masks: checks the run-based labelling, whole
+// and split into row bands, against a flood fill, then times it per band
+// height as the backends split it.
+//
+// usage: blob_bench [width] [height] [repetitions]
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "Blobs.h"
+#include "Frame.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Blocky noise so components come in many sizes and shapes.
+static uint8_t* randomMask(int width, int height, int density, mt19937& rng) {
+    uint8_t* mask = allocateMask(width, height);
+    int stride = alignedStride(width);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            bool on = (int)(rng() % 100) < density;
+            if (i > 0 && rng() % 2) {
+                on = mask[(size_t)(i - 1) * stride + j] != 0;
+            }
+            mask[(size_t)i * stride + j] = on ? 255 : 0;
+        }
+    }
+    return mask;
+}
+
+static vector<Blob> floodFill(const uint8_t* mask, int width, int height, int stride, int minArea) {
+    vector<Blob> blobs;
+    vector<char> seen((size_t)width * height, 0);
+    vector<int> stack;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (!mask[(size_t)y * stride + x] || seen[(size_t)y * width + x]) {
+                continue;
+            }
+            Blob blob = { 0, x, y, x, y, 0, 0 };
+            double sumX = 0, sumY = 0;
+            seen[(size_t)y * width + x] = 1;
+            stack.push_back(y * width + x);
+            while (!stack.empty()) {
+                int p = stack.back();
+                stack.pop_back();
+                int px = p % width, py = p / width;
+                blob.Area++;
+                sumX += px;
+                sumY += py;
+                blob.Left = min(blob.Left, px);
+                blob.Top = min(blob.Top, py);
+                blob.Right = max(blob.Right, px);
+                blob.Bottom = max(blob.Bottom, py);
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int nx = px + dx, ny = py + dy;
+                        if (nx < 0 || nx >= width || ny < 0 || ny >= height
+                            || !mask[(size_t)ny * stride + nx] || seen[(size_t)ny * width + nx]) {
+                            continue;
+                        }
+                        seen[(size_t)ny * width + nx] = 1;
+                        stack.push_back(ny * width + nx);
+                    }
+                }
+            }
+            if (blob.Area >= minArea) {
+                blob.CentroidX = sumX / blob.Area;
+                blob.CentroidY = sumY / blob.Area;
+                blobs.push_back(blob);
+            }
+        }
+    }
+    return blobs;
+}
+
+static vector<Blob> bandedBlobs(const uint8_t* mask, int width, int height, int stride, int minArea,
+    int bandRows) {
+    vector<BlobBand> bands((height + bandRows - 1) / bandRows);
+    for (size_t b = 0; b < bands.size(); b++) {
+        int first = (int)b * bandRows;
+        labelBand(mask + (size_t)first * stride, width, stride, min(bandRows, height - first), first,
+            bands[b]);
+    }
+    return blobList(mergeBands(bands), minArea);
+}
+
+// Same blobs, compared as sorted sets since flood fill finds them in
+// top-left pixel order rather than the list's order.
+static bool sameBlobs(vector<Blob> a, vector<Blob> b) {
+    auto key = [](const Blob& blob) {
+        return make_tuple(blob.Top, blob.Left, blob.Bottom, blob.Right, blob.Area);
+    };
+    auto less = [&](const Blob& x, const Blob& y) { return key(x) < key(y); };
+    sort(a.begin(), a.end(), less);
+    sort(b.begin(), b.end(), less);
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (key(a[i]) != key(b[i]) || fabs(a[i].CentroidX - b[i].CentroidX) > 1e-9
+            || fabs(a[i].CentroidY - b[i].CentroidY) > 1e-9) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : 1920;
+    int height = argc > 2 ? atoi(argv[2]) : 1080;
+    int repetitions = argc > 3 ? atoi(argv[3]) : 5;
+    mt19937 rng(3);
+
+    int failures = 0;
+    for (int density : { 5, 30, 60 }) {
+        const int checkWidth = 131;
+        const int checkHeight = 97;
+        uint8_t* mask = randomMask(checkWidth, checkHeight, density, rng);
+        int stride = alignedStride(checkWidth);
+        for (int minArea : { 1, 10 }) {
+            vector<Blob> expected = floodFill(mask, checkWidth, checkHeight, stride, minArea);
+            failures += !sameBlobs(findBlobs(mask, checkWidth, checkHeight, stride, minArea), expected);
+            for (int bandRows : { 1, 2, 7, 64 }) {
+                failures += !sameBlobs(bandedBlobs(mask, checkWidth, checkHeight, stride, minArea,
+                    bandRows), expected);
+            }
+        }
+        alignedFree(mask);
+    }
+    cout << "Blob check: " << (failures ? "MISMATCH" : "exact") << endl;
+
+    cout << "Blob benchmark " << width << "x" << height << endl;
+    int stride = alignedStride(width);
+    for (int density : { 2, 20 }) {
+        uint8_t* mask = randomMask(width, height, density, rng);
+        size_t blobs = 0;
+        cout << density << "% seeds:";
+        for (int bandRows : { 16, 64, height }) {
+            double total = 0;
+            for (int rep = 0; rep < repetitions; rep++) {
+                Clock::time_point start = Clock::now();
+                blobs = bandedBlobs(mask, width, height, stride, 1, bandRows).size();
+                total += chrono::duration<double, milli>(Clock::now() - start).count();
+            }
+            cout << " " << bandRows << "-row bands " << total / repetitions << " ms";
+        }
+        cout << ", " << blobs << " blobs" << endl;
+        alignedFree(mask);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+// Per-frame PNG decode/encode timings for the native ImageIO path.
+// When compiled with /clr it also times the old System::Drawing::Bitmap
+// GetPixel/SetPixel path on the same frames for comparison.
+//
+// usage: imageio_bench [input_dir] [num_frames] [output_dir]
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ImageIO.h"
+
+#ifdef _MANAGED
+#include <msclr\marshal_cppstd.h>
+#using <System.dll>
+#using <System.Drawing.dll>
+using namespace msclr::interop;
+#endif
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+struct Timing {
+    double decodeMs;
+    double encodeMs;
+};
+
+static Timing benchNative(const vector<string>& paths, const string& outDir, FrameLayout layout) {
+    Timing t = { 0, 0 };
+    vector<uint8_t> rgb;
+    for (size_t f = 0; f < paths.size(); f++) {
+        int width, height;
+        Clock::time_point start = Clock::now();
+        Frame img = inputColorImage(&width, &height, paths[f], layout);
+        t.decodeMs += elapsedMs(start);
+
+        start = Clock::now();
+        if (layout == FRAME_INTERLEAVED) {
+            writePng(outDir + "bench_native.png", img.Data, width, height, 3, img.Stride);
+        }
+        else {
+            rgb.resize((size_t)width * height * 3);
+            for (int i = 0; i < height; i++) {
+                for (int j = 0; j < width; j++) {
+                    rgb[3 * (i * width + j)] = img.Red[i * img.Stride + j];
+                    rgb[3 * (i * width + j) + 1] = img.Green[i * img.Stride + j];
+                    rgb[3 * (i * width + j) + 2] = img.Blue[i * img.Stride + j];
+                }
+            }
+            writePng(outDir + "bench_native.png", rgb.data(), width, height, 3, width * 3);
+        }
+        t.encodeMs += elapsedMs(start);
+
+        freeFrame(img);
+    }
+    return t;
+}
+
+#ifdef _MANAGED
+static Timing benchBitmap(const vector<string>& paths, const string& outDir) {
+    Timing t = { 0, 0 };
+    for (size_t f = 0; f < paths.size(); f++) {
+        Clock::time_point start = Clock::now();
+        System::Drawing::Bitmap BM(marshal_as<System::String^>(paths[f]));
+        int width = BM.Width, height = BM.Height;
+        vector<int> red(width * height), green(width * height), blue(width * height);
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                System::Drawing::Color c = BM.GetPixel(j, i);
+                red[i * width + j] = c.R;
+                green[i * width + j] = c.G;
+                blue[i * width + j] = c.B;
+            }
+        }
+        t.decodeMs += elapsedMs(start);
+
+        start = Clock::now();
+        System::Drawing::Bitmap out(width, height);
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                out.SetPixel(j, i, System::Drawing::Color::FromArgb(
+                    red[i * width + j], green[i * width + j], blue[i * width + j]));
+            }
+        }
+        out.Save(marshal_as<System::String^>(outDir + "bench_bitmap.png"));
+        t.encodeMs += elapsedMs(start);
+    }
+    return t;
+}
+#endif
+
+static void report(const char* name, const Timing& t, size_t frames) {
+    cout << name << ": decode " << t.decodeMs / frames << " ms/frame, encode "
+        << t.encodeMs / frames << " ms/frame" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string inputDir = argc > 1 ? string(argv[1]) + "/" : INPUT_DIR;
+    int numFrames = argc > 2 ? atoi(argv[2]) : 20;
+    string outDir = argc > 3 ? string(argv[3]) + "/" : OUTPUT_DIR;
+
+    vector<string> paths;
+    for (int i = 1; i <= numFrames; i++) {
+        paths.push_back(inputDir + "frame" + to_string(i) + ".png");
+    }
+
+    cout << "Image I/O benchmark over " << numFrames << " frames" << endl;
+    report("planar  ", benchNative(paths, outDir, FRAME_PLANAR), paths.size());
+    report("interlvd", benchNative(paths, outDir, FRAME_INTERLEAVED), paths.size());
+#ifdef _MANAGED
+    report("bitmap  ", benchBitmap(paths, outDir), paths.size());
+#else
+    cout << "bitmap  : skipped (build with /clr to time System::Drawing)" << endl;
+#endif
+    return 0;
+}
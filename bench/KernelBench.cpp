@@ -0,0 +1,275 @@
+// Times the background-mean, foreground-mask (byte and bit-packed),
+// Gaussian-mixture and change-detection kernels for every instruction set the CPU supports and
+// checks each one is bit-exact with the scalar path, on the frames and on
+// plane lengths that leave a vector tail.
+//
+// usage: kernel_bench [width] [height] [num_frames] [repetitions]
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Frame.h"
+#include "Kernels.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct Result {
+    double meanMs;
+    double maskMs;
+    double slideMs;
+    double mixtureMs;
+    double bitsMs;
+    double changeMs;
+    vector<uint8_t> mean;
+    vector<uint32_t> window;
+    vector<uint8_t> mask;
+    vector<uint8_t> grayMask;
+    vector<uint64_t> bits;
+    vector<uint64_t> packed;
+    vector<float> mixture;
+    vector<uint8_t> mixtureOut;
+    vector<uint8_t> changes;
+    // Plane kernels over ODD_LENGTHS, guard samples included
+    vector<uint32_t> oddSums;
+    vector<uint8_t> oddBytes;
+    vector<uint64_t> oddBits;
+};
+
+const int MIXTURE_FRAMES = 10;
+// Not multiples of any vector width: every tail path runs
+const size_t ODD_LENGTHS[] = { 1, 63, 65, 1000003 };
+const size_t ODD_GUARD = 64;
+const MixtureParams MIXTURE_PARAMS = { 0.05f, 16.0f, 15.0f, 4.0f, 75.0f, 0.9f };
+
+// Runs the mixture over the first frames; returns its state and the last
+// frame's background and mask.
+static double runMixture(const KernelTable& k, const vector<Frame>& frames, Result& r) {
+    size_t planeSize = (size_t)frames[0].Stride * frames[0].Height;
+    const int fields = 5;
+    r.mixture.assign((size_t)MIXTURE_COMPONENTS * fields * planeSize, 0.0f);
+    r.mixtureOut.assign(4 * planeSize, 0);
+    MixtureRun run;
+    for (int c = 0; c < MIXTURE_COMPONENTS; c++) {
+        float* planes = r.mixture.data() + (size_t)c * fields * planeSize;
+        fill(planes + planeSize, planes + 2 * planeSize, MIXTURE_PARAMS.InitialVariance);
+        run.Weight[c] = planes;
+        run.Variance[c] = planes + planeSize;
+        for (int ch = 0; ch < 3; ch++) {
+            run.Mean[c][ch] = planes + (2 + ch) * planeSize;
+            run.Background[ch] = r.mixtureOut.data() + ch * planeSize;
+        }
+    }
+    run.Mask = r.mixtureOut.data() + 3 * planeSize;
+
+    int numFrames = min((int)frames.size(), MIXTURE_FRAMES);
+    Clock::time_point start = Clock::now();
+    for (int f = 0; f < numFrames; f++) {
+        run.Sample[0] = frames[f].Red;
+        run.Sample[1] = frames[f].Green;
+        run.Sample[2] = frames[f].Blue;
+        k.mixtureUpdate(run, planeSize, MIXTURE_PARAMS);
+    }
+    return chrono::duration<double, milli>(Clock::now() - start).count() / numFrames;
+}
+
+// Runs the plane kernels on each of ODD_LENGTHS over six random planes (the
+// background and current frame's channels; all six are summed, one sample
+// in so the loads are unaligned). Outputs run ODD_GUARD samples past n, so
+// a kernel writing beyond its length shows up as a mismatch too.
+static void runOddLengths(const KernelTable& k, const vector<vector<uint8_t>>& planes, Result& r) {
+    FixedPointDivisor divisor = makeDivisor(9, 255u * 9);
+    for (size_t n : ODD_LENGTHS) {
+        // At least 255 so the slide never underflows; at most 255 * 9 after
+        // both updates so every quotient fits a byte
+        vector<uint32_t> sums(n + ODD_GUARD);
+        for (size_t i = 0; i < sums.size(); i++) {
+            sums[i] = 255 + (uint32_t)(i % 1500);
+        }
+        k.accumulatePlane(sums.data(), planes[0].data(), n);
+        k.slidePlane(sums.data(), planes[1].data(), planes[2].data(), n);
+        vector<uint8_t> mean(n + ODD_GUARD, 0xAB);
+        k.dividePlane(mean.data(), sums.data(), n, divisor);
+
+        vector<uint8_t> mask(n + ODD_GUARD, 0xAB);
+        k.thresholdMask(mask.data(), planes[0].data(), planes[1].data(), planes[2].data(),
+            planes[3].data(), planes[4].data(), planes[5].data(), n, 30);
+        size_t words = (n + 63) / 64 + 1;
+        vector<uint64_t> bits(words, ~0ull);
+        k.thresholdBits(bits.data(), planes[0].data(), planes[1].data(), planes[2].data(),
+            planes[3].data(), planes[4].data(), planes[5].data(), n, 30);
+        vector<uint64_t> packed(words, ~0ull);
+        k.packMask(packed.data(), mask.data(), n);
+
+        vector<uint32_t> total(n + ODD_GUARD, 7);
+        const uint8_t* all[6];
+        for (int p = 0; p < 6; p++) {
+            all[p] = planes[p].data();
+        }
+        k.sumPlanes(total.data(), all, 6, 1, n);
+        vector<uint8_t> gray(n + ODD_GUARD, 0xAB);
+        k.grayPlane(gray.data(), planes[0].data(), planes[1].data(), planes[2].data(), n);
+        vector<uint8_t> grayMask(n + ODD_GUARD, 0xAB);
+        k.grayMask(grayMask.data(), gray.data(), planes[3].data(), planes[4].data(), planes[5].data(),
+            n, 30);
+        // Differences of at most 12 levels, so the largest can sit in the tail
+        vector<uint8_t> nudged(planes[0].begin(), planes[0].begin() + n);
+        for (size_t i = 0; i < n; i++) {
+            nudged[i] = (uint8_t)min(255, nudged[i] + (int)(i * 7 % 13));
+        }
+
+        r.oddSums.insert(r.oddSums.end(), sums.begin(), sums.end());
+        r.oddSums.insert(r.oddSums.end(), total.begin(), total.end());
+        r.oddBytes.insert(r.oddBytes.end(), mean.begin(), mean.end());
+        r.oddBytes.insert(r.oddBytes.end(), mask.begin(), mask.end());
+        r.oddBytes.insert(r.oddBytes.end(), gray.begin(), gray.end());
+        r.oddBytes.insert(r.oddBytes.end(), grayMask.begin(), grayMask.end());
+        r.oddBytes.push_back(k.maxDifference(planes[0].data(), nudged.data(), n));
+        r.oddBits.insert(r.oddBits.end(), bits.begin(), bits.end());
+        r.oddBits.insert(r.oddBits.end(), packed.begin(), packed.end());
+    }
+}
+
+static Result run(const KernelTable& k, const vector<Frame>& frames,
+    const vector<vector<uint8_t>>& oddPlanes, int repetitions) {
+    const Frame& first = frames[0];
+    size_t planeSize = (size_t)first.Stride * first.Height;
+    int numFrames = frames.size();
+    FixedPointDivisor divisor = makeDivisor(numFrames, 255u * numFrames);
+
+    vector<const uint8_t*> planes(numFrames);
+    for (int f = 0; f < numFrames; f++) {
+        planes[f] = frames[f].Red;
+    }
+
+    Result r;
+    r.mean.resize(planeSize);
+    r.mask.resize(planeSize);
+    vector<uint32_t> sums(planeSize);
+
+    Clock::time_point start = Clock::now();
+    for (int rep = 0; rep < repetitions; rep++) {
+        fill(sums.begin(), sums.end(), 0);
+        k.sumPlanes(sums.data(), planes.data(), numFrames, 0, planeSize);
+        k.dividePlane(r.mean.data(), sums.data(), planeSize, divisor);
+    }
+    r.meanMs = chrono::duration<double, milli>(Clock::now() - start).count() / repetitions;
+
+    // Sliding-window update: swap each frame for the next one
+    start = Clock::now();
+    for (int f = 1; f < numFrames; f++) {
+        k.slidePlane(sums.data(), planes[f], planes[f - 1], planeSize);
+    }
+    r.slideMs = chrono::duration<double, milli>(Clock::now() - start).count() / max(1, numFrames - 1);
+    r.window = sums;
+
+    const Frame& bg = frames[0];
+    const Frame& cur = frames[numFrames - 1];
+    start = Clock::now();
+    for (int rep = 0; rep < repetitions; rep++) {
+        k.thresholdMask(r.mask.data(), bg.Red, bg.Green, bg.Blue,
+            cur.Red, cur.Green, cur.Blue, planeSize, 30);
+    }
+    r.maskMs = chrono::duration<double, milli>(Clock::now() - start).count() / repetitions;
+
+    // Same mask through a precomputed gray background
+    vector<uint8_t> gray(planeSize);
+    r.grayMask.resize(planeSize);
+    k.grayPlane(gray.data(), bg.Red, bg.Green, bg.Blue, planeSize);
+    k.grayMask(r.grayMask.data(), gray.data(), cur.Red, cur.Green, cur.Blue, planeSize, 30);
+
+    // Bit-packed mask, straight from the threshold and packed from bytes
+    r.bits.resize(planeSize / 64);
+    start = Clock::now();
+    for (int rep = 0; rep < repetitions; rep++) {
+        k.thresholdBits(r.bits.data(), bg.Red, bg.Green, bg.Blue,
+            cur.Red, cur.Green, cur.Blue, planeSize, 30);
+    }
+    r.bitsMs = chrono::duration<double, milli>(Clock::now() - start).count() / repetitions;
+    r.packed.resize(planeSize / 64);
+    k.packMask(r.packed.data(), r.mask.data(), planeSize);
+
+    // Change detection against a copy of the background nudged by a few
+    // levels, over runs of every length and alignment up to two tiles
+    vector<uint8_t> nudged(bg.Red, bg.Red + planeSize);
+    for (size_t i = 0; i < planeSize; i++) {
+        nudged[i] = (uint8_t)min(255, nudged[i] + (int)(i * 7 % 13));
+    }
+    for (size_t n = 0, offset = 0; n <= 256 && offset + n <= planeSize; n++, offset = (offset + 61) % 64) {
+        r.changes.push_back(k.maxDifference(bg.Red + offset, nudged.data() + offset, n));
+    }
+    start = Clock::now();
+    for (int rep = 0; rep < repetitions; rep++) {
+        r.changes.push_back(k.maxDifference(bg.Red, nudged.data(), planeSize));
+    }
+    r.changeMs = chrono::duration<double, milli>(Clock::now() - start).count() / repetitions;
+
+    r.mixtureMs = runMixture(k, frames, r);
+    runOddLengths(k, oddPlanes, r);
+    return r;
+}
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : 1920;
+    int height = argc > 2 ? atoi(argv[2]) : 1080;
+    int numFrames = argc > 3 ? atoi(argv[3]) : 100;
+    int repetitions = argc > 4 ? atoi(argv[4]) : 5;
+
+    mt19937 rng(42);
+    vector<Frame> frames;
+    for (int f = 0; f < numFrames; f++) {
+        Frame frame = allocateFrame(width, height);
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                frame.Red[i * frame.Stride + j] = rng() & 0xFF;
+                frame.Green[i * frame.Stride + j] = rng() & 0xFF;
+                frame.Blue[i * frame.Stride + j] = rng() & 0xFF;
+            }
+        }
+        frames.push_back(frame);
+    }
+    size_t oddSize = *max_element(begin(ODD_LENGTHS), end(ODD_LENGTHS)) + ODD_GUARD;
+    vector<vector<uint8_t>> oddPlanes(6, vector<uint8_t>(oddSize));
+    for (auto& plane : oddPlanes) {
+        for (auto& sample : plane) {
+            sample = rng() & 0xFF;
+        }
+    }
+
+    cout << "Kernel benchmark " << width << "x" << height << ", " << numFrames
+        << " frames, selected ISA: " << kernels().Name << endl;
+
+    Result reference = run(SCALAR_KERNELS, frames, oddPlanes, repetitions);
+    const char* isas[] = { "scalar", "sse2", "avx2", "avx512" };
+    int failures = 0;
+    for (const char* isa : isas) {
+        const KernelTable* table = kernelTableFor(isa);
+        if (!table) {
+            cout << isa << ": not supported" << endl;
+            continue;
+        }
+        Result r = run(*table, frames, oddPlanes, repetitions);
+        bool exact = r.mean == reference.mean && r.mask == reference.mask
+            && r.window == reference.window && r.grayMask == reference.mask
+            && r.bits == reference.bits && r.packed == reference.bits
+            && r.mixture == reference.mixture && r.mixtureOut == reference.mixtureOut
+            && r.changes == reference.changes && r.oddSums == reference.oddSums
+            && r.oddBytes == reference.oddBytes && r.oddBits == reference.oddBits;
+        failures += !exact;
+        cout << isa << ": mean " << r.meanMs << " ms, mask " << r.maskMs
+            << " ms, bits " << r.bitsMs << " ms, slide " << r.slideMs << " ms, mixture " << r.mixtureMs
+            << " ms/frame, change " << r.changeMs << " ms, "
+            << (exact ? "bit-exact" : "MISMATCH") << endl;
+    }
+
+    for (auto& frame : frames) {
+        freeFrame(frame);
+    }
+    return failures ? 1 : 0;
+}
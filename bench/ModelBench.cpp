@@ -0,0 +1,132 @@
+// Throughput of the streaming background models on synthetic frames: the
+// running mean and sliding-window mean against the histogram median, whole
+// sequence and windowed, and the Gaussian mixture. The median backgrounds
+// are checked against a per-pixel sort of the same samples: a window median
+// must be exact; without a window the levels inside a coarse bin are only
+// estimated after the median moves, so its largest error is printed.
+//
+// usage: model_bench [width] [height] [num_frames] [window]
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "BackgroundModel.h"
+#include "Frame.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Slowly varying scene with noise and an occasional bright object, so the
+// median does real stepping rather than sitting on one level.
+static Frame syntheticFrame(int width, int height, int index, mt19937& rng) {
+    Frame frame = allocateFrame(width, height);
+    for (int c = 0; c < 3; c++) {
+        uint8_t* plane = channelPlane(frame, c);
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                int value = (i * 3 + j * 5 + c * 40) % 200 + (int)(rng() % 32);
+                if ((j + index * 7) % 64 < 8) {
+                    value = 250;
+                }
+                plane[(size_t)i * frame.Stride + j] = (uint8_t)min(value, 255);
+            }
+        }
+    }
+    return frame;
+}
+
+// Lower median of frames [first, last) per sample, the slow way; returns
+// the samples that differ and the largest difference.
+static int checkMedian(const Frame& background, const vector<Frame>& frames, int first, int last,
+    int* maxError) {
+    vector<uint8_t> samples;
+    int mismatches = 0;
+    *maxError = 0;
+    for (int c = 0; c < 3; c++) {
+        const uint8_t* bg = channelPlane(background, c);
+        for (int i = 0; i < background.Height; i++) {
+            for (int j = 0; j < background.Width; j++) {
+                size_t p = (size_t)i * background.Stride + j;
+                samples.clear();
+                for (int f = first; f < last; f++) {
+                    samples.push_back(channelPlane(frames[f], c)[p]);
+                }
+                size_t k = (samples.size() - 1) / 2;
+                nth_element(samples.begin(), samples.begin() + k, samples.end());
+                mismatches += bg[p] != samples[k];
+                *maxError = max(*maxError, abs(bg[p] - samples[k]));
+            }
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : 640;
+    int height = argc > 2 ? atoi(argv[2]) : 480;
+    int numFrames = argc > 3 ? atoi(argv[3]) : 60;
+    int window = argc > 4 ? atoi(argv[4]) : 15;
+
+    mt19937 rng(11);
+    vector<Frame> frames;
+    for (int f = 0; f < numFrames; f++) {
+        frames.push_back(syntheticFrame(width, height, f, rng));
+    }
+    double megapixels = (double)width * height * numFrames / 1e6;
+
+    cout << "Model benchmark " << width << "x" << height << ", " << numFrames << " frames, window "
+        << window << endl;
+
+    struct Case {
+        const char* Name;
+        BackgroundMode Mode;
+        int Window;
+    };
+    Case cases[] = {
+        { "running mean", BACKGROUND_RUNNING_MEAN, 0 },
+        { "window mean", BACKGROUND_WINDOW, window },
+        { "median", BACKGROUND_MEDIAN, 0 },
+        { "window median", BACKGROUND_MEDIAN, window },
+        { "Gaussian mixture", BACKGROUND_MIXTURE, 0 },
+    };
+
+    int failures = 0;
+    for (const Case& test : cases) {
+        BackgroundModel model(width, height, test.Mode, 0.05, test.Window);
+        Clock::time_point start = Clock::now();
+        for (const Frame& frame : frames) {
+            model.addFrame(frame);
+        }
+        double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+        cout << test.Name << ": " << seconds * 1000 << " ms, " << megapixels / seconds
+            << " Mpixel/s, state " << model.memoryBytes() / 1024 << " KiB";
+        if (test.Mode == BACKGROUND_MEDIAN) {
+            int first = test.Window > 0 ? max(0, numFrames - test.Window) : 0;
+            int maxError;
+            int mismatches = checkMedian(model.background(), frames, first, numFrames, &maxError);
+            if (mismatches == 0) {
+                cout << ", exact";
+            }
+            else if (test.Window > 0) {
+                failures++;
+                cout << ", MISMATCH";
+            }
+            else {
+                cout << ", " << 100.0 * mismatches / (3.0 * width * height) << "% of samples off, by up to "
+                    << maxError << " levels";
+            }
+        }
+        cout << endl;
+    }
+
+    for (auto& frame : frames) {
+        freeFrame(frame);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+// Times mask erode/dilate/open/close over a range of kernel sizes, which
+// should cost about the same per pixel whatever the size, and checks every
+// result against a direct min/max over the rectangle on a small mask.
+//
+// usage: morphology_bench [width] [height] [repetitions]
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include "Frame.h"
+#include "Morphology.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static uint8_t* randomMask(int width, int height, mt19937& rng) {
+    uint8_t* mask = allocateMask(width, height);
+    int stride = alignedStride(width);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            mask[(size_t)i * stride + j] = rng() % 3 == 0 ? 255 : 0;
+        }
+    }
+    return mask;
+}
+
+static void directPass(const uint8_t* src, uint8_t* dst, int width, int height, int stride,
+    int kw, int kh, bool dilate) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int value = dilate ? 0 : 255;
+            for (int dy = -(kh / 2); dy < kh - kh / 2; dy++) {
+                for (int dx = -(kw / 2); dx < kw - kw / 2; dx++) {
+                    int yy = y + dy;
+                    int xx = x + dx;
+                    if (yy < 0 || yy >= height || xx < 0 || xx >= width) {
+                        continue;
+                    }
+                    int sample = src[(size_t)yy * stride + xx];
+                    value = dilate ? max(value, sample) : min(value, sample);
+                }
+            }
+            dst[(size_t)y * stride + x] = (uint8_t)value;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : 1920;
+    int height = argc > 2 ? atoi(argv[2]) : 1080;
+    int repetitions = argc > 3 ? atoi(argv[3]) : 5;
+    mt19937 rng(5);
+    MorphologyOp ops[] = { MORPH_ERODE, MORPH_DILATE, MORPH_OPEN, MORPH_CLOSE };
+
+    // Correctness on a small mask with odd and even kernels
+    int failures = 0;
+    const int checkWidth = 97;
+    const int checkHeight = 61;
+    int checkStride = alignedStride(checkWidth);
+    uint8_t* original = randomMask(checkWidth, checkHeight, rng);
+    uint8_t* mask = allocateMask(checkWidth, checkHeight);
+    uint8_t* scratch = allocateMask(checkWidth, checkHeight);
+    uint8_t* expected[2] = { allocateMask(checkWidth, checkHeight), allocateMask(checkWidth, checkHeight) };
+    for (MorphologyOp op : ops) {
+        for (int kw = 1; kw <= 8; kw++) {
+            for (int kh = 1; kh <= 8; kh += 3) {
+                MorphologyConfig config = { op, kw, kh };
+                memcpy(mask, original, (size_t)checkStride * checkHeight);
+                applyMorphology(mask, scratch, checkWidth, checkHeight, checkStride, config);
+
+                const uint8_t* input = original;
+                int passes = morphologyPasses(op);
+                for (int p = 0; p < passes; p++) {
+                    directPass(input, expected[p], checkWidth, checkHeight, checkStride, kw, kh,
+                        morphologyDilates(op, p));
+                    input = expected[p];
+                }
+                for (int i = 0; i < checkHeight; i++) {
+                    if (memcmp(mask + (size_t)i * checkStride, input + (size_t)i * checkStride,
+                        checkWidth) != 0) {
+                        failures++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    cout << "Morphology check: " << (failures ? "MISMATCH" : "exact") << endl;
+    alignedFree(original);
+    alignedFree(mask);
+    alignedFree(scratch);
+    alignedFree(expected[0]);
+    alignedFree(expected[1]);
+
+    cout << "Morphology benchmark " << width << "x" << height << endl;
+    int stride = alignedStride(width);
+    original = randomMask(width, height, rng);
+    mask = allocateMask(width, height);
+    scratch = allocateMask(width, height);
+    int sizes[] = { 3, 7, 15, 31, 63 };
+    for (MorphologyOp op : ops) {
+        cout << morphologyName(op) << ":";
+        for (int k : sizes) {
+            MorphologyConfig config = { op, k, k };
+            double total = 0;
+            for (int rep = 0; rep < repetitions; rep++) {
+                memcpy(mask, original, (size_t)stride * height);
+                Clock::time_point start = Clock::now();
+                applyMorphology(mask, scratch, width, height, stride, config);
+                total += chrono::duration<double, milli>(Clock::now() - start).count();
+            }
+            cout << " " << k << "x" << k << " " << total / repetitions << " ms";
+        }
+        cout << endl;
+    }
+    alignedFree(original);
+    alignedFree(mask);
+    alignedFree(scratch);
+    return failures ? 1 : 0;
+}
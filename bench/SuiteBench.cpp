@@ -0,0 +1,257 @@
+// Benchmark suite across the sequential, OpenMP and MPI backends on
+// synthetic frames (no PNGs needed). Runs each backend binary, found next to
+// this one, over every combination of frame size, frame count and thread /
+// rank count, each with --warmup and --repeat, and collects their --report
+// rows into one CSV. Each configuration is then summarised in a JSON file
+// with the median, min and max throughput in megapixels per second.
+//
+// usage: suite_bench [--sizes 640x360,1280x720,1920x1080] [--frames 20,100]
+//     [--threads 1,2,4] [--ranks 1,2,4] [--warmup 1] [--repeat 3]
+//     [--backends sequential,openmp,mpi] [--mpirun mpirun] [--args "..."]
+//     [--out suite]
+//
+// Run it where the backends run (they write images to ../Data/OutPut).
+// Writes <out>.csv (one row per measured run), <out>.json and the backends'
+// console output to <out>.log. --args is passed to every backend, e.g.
+// "--ema 0.05"; --mpirun may carry launcher flags, e.g. "mpirun --oversubscribe".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BenchReport.h"
+#include "Options.h"
+#include "Synthetic.h"
+
+using namespace std;
+
+namespace {
+
+vector<string> splitList(const string& text) {
+    vector<string> items;
+    stringstream in(text);
+    string item;
+    while (getline(in, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+vector<int> intList(const string& text) {
+    vector<int> values;
+    for (const string& item : splitList(text)) {
+        values.push_back(max(1, atoi(item.c_str())));
+    }
+    return values;
+}
+
+string directoryOf(const string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == string::npos ? "." : path.substr(0, slash);
+}
+
+string quoted(const string& text) {
+    return "\"" + text + "\"";
+}
+
+string jsonString(const string& text) {
+    string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+struct Summary {
+    double Median;
+    double Min;
+    double Max;
+};
+
+Summary summarise(const vector<double>& values) {
+    return { medianOf(values), *min_element(values.begin(), values.end()),
+        *max_element(values.begin(), values.end()) };
+}
+
+void writeSummary(ostream& out, const char* name, const vector<double>& values) {
+    Summary s = summarise(values);
+    out << "    " << jsonString(name) << ": { \"median\": " << s.Median << ", \"min\": " << s.Min
+        << ", \"max\": " << s.Max << " }";
+}
+
+void writeArray(ostream& out, const char* name, const vector<double>& values) {
+    out << "    " << jsonString(name) << ": [";
+    for (size_t i = 0; i < values.size(); i++) {
+        out << (i ? ", " : "") << values[i];
+    }
+    out << "]";
+}
+
+// Measured runs of one configuration, in CSV order.
+struct Configuration {
+    vector<string> Fields;
+    vector<double> ComputeSeconds;
+    vector<double> WallSeconds;
+    vector<double> ComputeRate;
+    vector<double> WallRate;
+};
+
+// Groups the report rows by every column before "repetition".
+vector<Configuration> readReport(const string& path, vector<string>& header) {
+    ifstream in(path);
+    string line;
+    getline(in, line);
+    header = splitList(line);
+    size_t keyColumns = find(header.begin(), header.end(), "repetition") - header.begin();
+
+    vector<Configuration> configurations;
+    map<vector<string>, size_t> index;
+    while (getline(in, line)) {
+        vector<string> fields = splitList(line);
+        if (fields.size() != header.size()) {
+            continue;
+        }
+        vector<string> key(fields.begin(), fields.begin() + keyColumns);
+        auto found = index.find(key);
+        if (found == index.end()) {
+            found = index.insert({ key, configurations.size() }).first;
+            configurations.push_back(Configuration());
+            configurations.back().Fields = key;
+        }
+        Configuration& c = configurations[found->second];
+        c.ComputeSeconds.push_back(atof(fields[keyColumns + 1].c_str()));
+        c.WallSeconds.push_back(atof(fields[keyColumns + 2].c_str()));
+        c.ComputeRate.push_back(atof(fields[keyColumns + 3].c_str()));
+        c.WallRate.push_back(atof(fields[keyColumns + 4].c_str()));
+    }
+    return configurations;
+}
+
+bool isNumber(const string& text) {
+    return !text.empty() && text.find_first_not_of("0123456789") == string::npos;
+}
+
+void writeJson(const string& path, const vector<string>& header, const vector<Configuration>& configurations) {
+    ofstream out(path);
+    out << "[\n";
+    for (size_t i = 0; i < configurations.size(); i++) {
+        const Configuration& c = configurations[i];
+        out << "  {\n";
+        for (size_t f = 0; f < c.Fields.size(); f++) {
+            out << "    " << jsonString(header[f]) << ": "
+                << (isNumber(c.Fields[f]) ? c.Fields[f] : jsonString(c.Fields[f])) << ",\n";
+        }
+        out << "    \"repetitions\": " << c.ComputeSeconds.size() << ",\n";
+        writeArray(out, "compute_s", c.ComputeSeconds);
+        out << ",\n";
+        writeArray(out, "wall_s", c.WallSeconds);
+        out << ",\n";
+        writeSummary(out, "compute_mpix_s", c.ComputeRate);
+        out << ",\n";
+        writeSummary(out, "wall_mpix_s", c.WallRate);
+        out << "\n  }" << (i + 1 < configurations.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> sizes = splitList(stringOption(argc, argv, "--sizes", "640x360,1280x720,1920x1080"));
+    vector<int> frameCounts = intList(stringOption(argc, argv, "--frames", "20,100"));
+    vector<int> threadCounts = intList(stringOption(argc, argv, "--threads", "1,2,4"));
+    vector<int> rankCounts = intList(stringOption(argc, argv, "--ranks", "1,2,4"));
+    vector<string> backends = splitList(stringOption(argc, argv, "--backends", "sequential,openmp,mpi"));
+    int warmup = max(0, intOption(argc, argv, "--warmup", 1));
+    int repeat = max(1, intOption(argc, argv, "--repeat", 3));
+    string mpirun = stringOption(argc, argv, "--mpirun", "mpirun");
+    string extraArgs = stringOption(argc, argv, "--args", "");
+    string out = stringOption(argc, argv, "--out", "suite");
+
+    string binDir = directoryOf(argv[0]);
+    map<string, string> binaries = {
+        { "sequential", "sequential_background_subtractor" },
+        { "openmp", "openMP_background_subtractor" },
+        { "mpi", "MPI_background_subtractor" },
+    };
+    for (const string& size : sizes) {
+        int width, height;
+        if (!parseFrameSize(size, &width, &height)) {
+            cout << "bad size " << size << " (expected WxH)" << endl;
+            return 1;
+        }
+    }
+
+    string csvPath = out + ".csv";
+    string logPath = out + ".log";
+    remove(csvPath.c_str());
+    remove(logPath.c_str());
+
+    int runs = 0;
+    int failures = 0;
+    for (const string& backend : backends) {
+        if (!binaries.count(backend)) {
+            cout << "unknown backend " << backend << endl;
+            return 1;
+        }
+        string binary = quoted(binDir + "/" + binaries[backend]);
+        // Threads do not apply to the sequential backend, ranks only to MPI
+        vector<int> threads = backend == "sequential" ? vector<int>{ 1 } : threadCounts;
+        vector<int> ranks = backend == "mpi" ? rankCounts : vector<int>{ 1 };
+        for (const string& size : sizes) {
+            for (int frames : frameCounts) {
+                for (int numRanks : ranks) {
+                    for (int numThreads : threads) {
+                        string command = backend == "mpi" ? mpirun + " -np " + to_string(numRanks) + " " : "";
+                        command += binary + " --synthetic " + size + " --frames " + to_string(frames)
+                            + " --warmup " + to_string(warmup) + " --repeat " + to_string(repeat)
+                            + " --report " + quoted(csvPath);
+                        if (backend != "sequential") {
+                            command += " --threads " + to_string(numThreads);
+                        }
+                        if (!extraArgs.empty()) {
+                            command += " " + extraArgs;
+                        }
+                        cout << backend << " " << size << ", " << frames << " frames, " << numRanks
+                            << " ranks, " << numThreads << " threads" << endl;
+                        runs++;
+                        if (system((command + " >> " + quoted(logPath) + " 2>&1").c_str()) != 0) {
+                            cout << "  failed: " << command << endl;
+                            failures++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    vector<string> header;
+    vector<Configuration> configurations = readReport(csvPath, header);
+    writeJson(out + ".json", header, configurations);
+
+    char line[160];
+    snprintf(line, sizeof(line), "%-11s %-10s %11s %6s %7s %5s %13s %10s", "backend", "flow", "size", "frames",
+        "threads", "ranks", "compute MP/s", "wall MP/s");
+    cout << endl << line << " (medians)" << endl;
+    for (const Configuration& c : configurations) {
+        // Fields: backend, flow, background, isa, width, height, frames, threads, ranks
+        snprintf(line, sizeof(line), "%-11s %-10s %5sx%-5s %6s %7s %5s %13.1f %10.1f", c.Fields[0].c_str(),
+            c.Fields[1].c_str(), c.Fields[4].c_str(), c.Fields[5].c_str(), c.Fields[6].c_str(),
+            c.Fields[7].c_str(), c.Fields[8].c_str(), medianOf(c.ComputeRate), medianOf(c.WallRate));
+        cout << line << endl;
+    }
+    cout << runs - failures << " of " << runs << " runs succeeded; wrote " << csvPath << ", " << out
+        << ".json" << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+// Compares the OpenMP background-mean engines on synthetic frames: the row
+// loop against the tiled engine over a range of tile sizes and schedules.
+// Every result is checked to be bit-exact with the row loop.
+//
+// usage: tile_bench [width] [height] [num_frames] [threads] [repetitions]
+
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BackgroundMean.h"
+#include "Frame.h"
+
+using namespace std;
+
+static bool sameFrame(const Frame& a, const Frame& b) {
+    return memcmp(a.Data, b.Data, frameBytes(a)) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : 1920;
+    int height = argc > 2 ? atoi(argv[2]) : 1080;
+    int numFrames = argc > 3 ? atoi(argv[3]) : 50;
+    int threads = argc > 4 ? atoi(argv[4]) : omp_get_max_threads();
+    int repetitions = argc > 5 ? atoi(argv[5]) : 3;
+
+    mt19937 rng(7);
+    vector<Frame> frames;
+    for (int f = 0; f < numFrames; f++) {
+        Frame frame = allocateFrame(width, height);
+        for (int c = 0; c < 3; c++) {
+            uint8_t* plane = channelPlane(frame, c);
+            for (int i = 0; i < height; i++) {
+                for (int j = 0; j < width; j++) {
+                    plane[(size_t)i * frame.Stride + j] = rng() & 0xFF;
+                }
+            }
+        }
+        frames.push_back(frame);
+    }
+
+    cout << "Tile benchmark " << width << "x" << height << ", " << numFrames << " frames, "
+        << threads << " threads, default tile " << defaultTileRows(frames[0].Stride) << " rows" << endl;
+
+    Frame reference = calculateColorBackgroundMean(frames, threads);
+    double start = omp_get_wtime();
+    for (int rep = 0; rep < repetitions; rep++) {
+        Frame mean = calculateColorBackgroundMean(frames, threads);
+        freeFrame(mean);
+    }
+    cout << "rows: " << (omp_get_wtime() - start) * 1000 / repetitions << " ms" << endl;
+
+    const char* schedules[] = { "static", "dynamic", "guided" };
+    int tileRows[] = { 0, 4, 16, 64, 256 };
+    int failures = 0;
+    for (const char* schedule : schedules) {
+        for (int rows : tileRows) {
+            TileConfig config = { rows, schedule };
+            Frame check = calculateColorBackgroundMeanTiled(frames, config, threads);
+            bool exact = sameFrame(check, reference);
+            failures += !exact;
+            freeFrame(check);
+
+            start = omp_get_wtime();
+            for (int rep = 0; rep < repetitions; rep++) {
+                Frame mean = calculateColorBackgroundMeanTiled(frames, config, threads);
+                freeFrame(mean);
+            }
+            cout << "tiles " << schedule << ", " << (rows ? to_string(rows) : string("default"))
+                << " rows: " << (omp_get_wtime() - start) * 1000 / repetitions << " ms, "
+                << (exact ? "bit-exact" : "MISMATCH") << endl;
+        }
+    }
+
+    freeFrame(reference);
+    for (auto& frame : frames) {
+        freeFrame(frame);
+    }
+    return failures ? 1 : 0;
+}
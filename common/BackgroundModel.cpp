@@ -0,0 +1,1241 @@
+#include "BackgroundModel.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+
+#include "Kernels.h"
+#include "Morphology.h"
+#include "Trace.h"
+
+using namespace std;
+
+// Past this many frames the running sums are halved together with the count,
+// which keeps them in 32 bits and the divisor in fixed-point range.
+static const int MAX_MEAN_FRAMES = 1 << 23;
+
+static const int EMA_SHIFT = 16;
+
+// Median counts are 16-bit; an unbounded median halves them once this many
+// frames are in.
+static const int MAX_MEDIAN_FRAMES = 65535;
+// Per pixel and channel: 16 counts of 16 levels each, then the counts of
+// each level in the coarse bins around the median. With a window that is
+// the median's bin alone (one 64-byte line), rebuilt from the ring when the
+// median moves to another; without one the bins either side are tracked
+// too, since the samples they held are gone.
+static const int COARSE_SHIFT = 4;
+static const int COARSE_BINS = 256 >> COARSE_SHIFT;
+static const int COARSE_MASK = (1 << COARSE_SHIFT) - 1;
+
+// Tracked bins either side of the median's
+static int medianNeighbours(int windowSize) {
+    return windowSize > 0 ? 0 : 1;
+}
+
+static size_t medianCounts(int windowSize) {
+    return (size_t)COARSE_BINS * (2 + 2 * medianNeighbours(windowSize));
+}
+
+// Counts fit a byte in windows of up to 255 frames
+static size_t medianCountBytes(int windowSize) {
+    return windowSize > 0 && windowSize <= 255 ? 1 : 2;
+}
+
+// Mixture planes per component: weight, variance, R/G/B mean
+static const int MIXTURE_FIELDS = 5;
+// OpenCV MOG2 defaults
+static const MixtureParams DEFAULT_MIXTURE = { 0.05f, 16.0f, 15.0f, 4.0f, 75.0f, 0.9f };
+
+// Rows the pyramid downsamples and accumulates at a time; whole coarse rows
+// at every level
+static const int PYRAMID_BAND_ROWS = 16;
+// Mean and EMA: every coarse row is accumulated whole once per this many
+// frames (staggered), so areas that stay outside the regions still track
+// the scene
+static const int PYRAMID_REFRESH_FRAMES = 16;
+
+string pyramidReport(const PyramidConfig& config, const PyramidStats& stats) {
+    ostringstream out;
+    out << "  Pyramid: " << config.Levels << " levels, margin " << config.Margin << ", coarse threshold "
+        << config.Threshold << "; refined " << 100.0 * stats.Refined / max<size_t>(1, stats.Pixels)
+        << "% of pixels" << endl;
+    if (stats.CheckedFrames > 0) {
+        double perFrame = 1000.0 / stats.CheckedFrames;
+        out << "  Pyramid vs full-resolution mask (" << stats.CheckedFrames
+            << " frames checked): recall vs. pyramid background "
+            << 100.0 * (stats.Foreground - stats.Missed) / max<size_t>(1, stats.Foreground) << "%, "
+            << (double)stats.Missed / stats.CheckedFrames << " pixels missed per frame" << endl;
+        out << "  Pyramid cost per frame: downsample " << stats.DownsampleSeconds * perFrame
+            << " ms, full-resolution accumulate " << stats.AccumulateSeconds * perFrame
+            << " ms, coarse model and refinement " << stats.PyramidSeconds * perFrame
+            << " ms; the check itself " << stats.CheckSeconds * perFrame << " ms" << endl;
+    }
+    return out.str();
+}
+
+static double nowSeconds() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* backgroundModeName(BackgroundMode mode) {
+    switch (mode) {
+    case BACKGROUND_EMA: return "streaming EMA";
+    case BACKGROUND_WINDOW: return "sliding window";
+    case BACKGROUND_MEDIAN: return "temporal median";
+    case BACKGROUND_MIXTURE: return "Gaussian mixture";
+    default: return "streaming mean";
+    }
+}
+
+BackgroundModel::BackgroundModel(int width, int height, BackgroundMode mode, double alpha,
+    int windowSize)
+    : mode_(mode), alpha_(alpha), frameCount_(0), windowSize_(0), ringHead_(0), mixture_(nullptr),
+      mixtureParams_(DEFAULT_MIXTURE), mixtureMask_(nullptr), skip_(), skipStats_(), framesSeen_(0),
+      tilesAcross_(0), tileOffset_(0), reference_(), tileMask_(nullptr), pyramid_(), pyramidStats_(),
+      dilateRegions_(true), refinedOnly_(false), firstCoarseRow_(0), coarseFrame_(), regions_(nullptr), regionScratch_(nullptr), checkMask_(nullptr) {
+    if (mode == BACKGROUND_WINDOW && (windowSize < 1 || windowSize >= MAX_MEAN_FRAMES)) {
+        throw invalid_argument("window size must be between 1 and 2^23 - 1");
+    }
+    if (mode == BACKGROUND_MEDIAN && (windowSize < 0 || windowSize > MAX_MEDIAN_FRAMES)) {
+        throw invalid_argument("median window size must be between 0 and 65535");
+    }
+    background_ = allocateFrame(width, height);
+    planeSize_ = (size_t)background_.Stride * height;
+    if (mode == BACKGROUND_WINDOW || mode == BACKGROUND_MEDIAN) {
+        windowSize_ = windowSize;
+        ring_.assign((size_t)windowSize * 3 * planeSize_, 0);
+    }
+    double clamped = min(1.0, max(alpha, 1.0 / (1 << EMA_SHIFT)));
+    alphaQ16_ = (uint32_t)lround(clamped * (1 << EMA_SHIFT));
+    if (mode == BACKGROUND_MIXTURE) {
+        mixtureParams_.LearningRate = (float)min(1.0, max(alpha, 1e-4));
+        size_t components = (size_t)MIXTURE_COMPONENTS * MIXTURE_FIELDS;
+        mixture_ = (float*)alignedAlloc(components * planeSize_ * sizeof(float));
+        for (int k = 0; k < MIXTURE_COMPONENTS; k++) {
+            float* weight = mixture_ + (size_t)k * MIXTURE_FIELDS * planeSize_;
+            fill(weight, weight + planeSize_, 0.0f);
+            fill(weight + planeSize_, weight + 2 * planeSize_, mixtureParams_.InitialVariance);
+            fill(weight + 2 * planeSize_, weight + MIXTURE_FIELDS * planeSize_, 0.0f);
+        }
+        mixtureMask_ = allocateMask(width, height);
+    }
+    for (int c = 0; c < 3; c++) {
+        if (mode == BACKGROUND_MEDIAN) {
+            counts_[c].assign(planeSize_ * medianCounts(windowSize) * medianCountBytes(windowSize), 0);
+            median_[c].assign(planeSize_, 0);
+            below_[c].assign(planeSize_, 0);
+            samples_[c].assign(planeSize_, 0);
+        }
+        else if (mode != BACKGROUND_MIXTURE) {
+            state_[c].assign(planeSize_, 0);
+        }
+    }
+}
+
+BackgroundModel::~BackgroundModel() {
+    freeFrame(background_);
+    alignedFree(mixture_);
+    alignedFree(mixtureMask_);
+    freeFrame(reference_);
+    alignedFree(tileMask_);
+    freeFrame(coarseFrame_);
+    alignedFree(regions_);
+    alignedFree(regionScratch_);
+    alignedFree(checkMask_);
+}
+
+void BackgroundModel::setChangeSkipping(const ChangeSkipConfig& config, int firstTileRow) {
+    if (!config.Enabled) {
+        return;
+    }
+    skip_ = config;
+    skip_.RefreshInterval = min(MAX_SKIP_REFRESH, max(1, config.RefreshInterval));
+    tilesAcross_ = (background_.Stride + CHANGE_TILE_WIDTH - 1) / CHANGE_TILE_WIDTH;
+    tileOffset_ = (size_t)firstTileRow * tilesAcross_;
+    int tilesDown = (background_.Height + CHANGE_TILE_ROWS - 1) / CHANGE_TILE_ROWS;
+    tileChanged_.assign((size_t)tilesAcross_ * tilesDown, 1);
+    if (mode_ == BACKGROUND_RUNNING_MEAN || mode_ == BACKGROUND_EMA) {
+        tilePending_.assign(tileChanged_.size(), 0);
+        // EMA weight of the reference after k skipped frames, 1 - (1 - alpha)^k
+        emaCatchUp_.resize(skip_.RefreshInterval + 1);
+        for (size_t k = 0; k < emaCatchUp_.size(); k++) {
+            double keep = pow(1.0 - (double)alphaQ16_ / (1 << EMA_SHIFT), (double)k);
+            emaCatchUp_[k] = (uint32_t)lround((1.0 - keep) * (1 << EMA_SHIFT));
+        }
+    }
+    freeFrame(reference_);
+    reference_ = allocateFrame(background_.Width, background_.Height);
+    if (mode_ != BACKGROUND_MIXTURE && !tileMask_) {
+        tileMask_ = allocateMask(background_.Width, background_.Height);
+    }
+}
+
+void BackgroundModel::setPyramid(const PyramidConfig& config, bool dilate, int firstCoarseRow) {
+    if (config.Levels <= 0) {
+        return;
+    }
+    if (config.Levels > MAX_PYRAMID_LEVELS) {
+        throw invalid_argument("pyramid levels must be between 0 (off) and 4");
+    }
+    if (mode_ == BACKGROUND_MIXTURE || skip_.Enabled) {
+        throw invalid_argument("the pyramid needs a thresholded model without change skipping");
+    }
+    pyramid_ = config;
+    pyramid_.Margin = max(0, config.Margin);
+    dilateRegions_ = dilate;
+    firstCoarseRow_ = firstCoarseRow;
+    refinedOnly_ = mode_ == BACKGROUND_RUNNING_MEAN || mode_ == BACKGROUND_EMA;
+    int block = 1 << config.Levels;
+    int width = (background_.Width + block - 1) >> config.Levels;
+    int height = (background_.Height + block - 1) >> config.Levels;
+    coarseModel_.reset(new BackgroundModel(width, height, mode_, alpha_, windowSize_));
+    freeFrame(coarseFrame_);
+    coarseFrame_ = allocateFrame(width, height);
+    if (mode_ == BACKGROUND_RUNNING_MEAN) {
+        regionPending_.assign((size_t)coarseFrame_.Stride * height, 0);
+    }
+    if (!regions_) {
+        regions_ = allocateMask(width, height);
+        regionScratch_ = allocateMask(width, height);
+    }
+    if (!tileMask_) {
+        tileMask_ = allocateMask(background_.Width, background_.Height);
+    }
+    if (config.CheckInterval > 0 && !checkMask_) {
+        checkMask_ = allocateMask(background_.Width, background_.Height);
+    }
+}
+
+template <typename Run>
+void BackgroundModel::forEachChangedRun(int firstRow, int lastRow, int columns, Run run) const {
+    for (int i = firstRow; i < lastRow; i++) {
+        const uint8_t* changed = tileChanged_.data() + (size_t)(i / CHANGE_TILE_ROWS) * tilesAcross_;
+        for (int t = 0; t < tilesAcross_; t++) {
+            if (!changed[t]) {
+                continue;
+            }
+            int end = t + 1;
+            while (end < tilesAcross_ && changed[end]) {
+                end++;
+            }
+            int first = t * CHANGE_TILE_WIDTH;
+            int last = min(end * CHANGE_TILE_WIDTH, columns);
+            if (first < last) {
+                run(i, first, last);
+            }
+            t = end;
+        }
+    }
+}
+
+template <typename Run>
+void BackgroundModel::forEachRegionRun(int firstRow, int lastRow, bool refresh, Run run) const {
+    int shift = pyramid_.Levels;
+    int width = background_.Width;
+    int coarseWidth = coarseFrame_.Width;
+    // Per thread, so a frame's rows allocate nothing once warm
+    thread_local vector<pair<int, int>> runs;
+    for (int top = firstRow; top < lastRow;) {
+        int bottom = min(lastRow, ((top >> shift) + 1) << shift);
+        const uint8_t* flagged = regions_ + (size_t)(top >> shift) * coarseFrame_.Stride;
+        runs.clear();
+        if (refresh && refreshesRow(top >> shift)) {
+            for (int i = top; i < bottom; i++) {
+                run(i, 0, width);
+            }
+            top = bottom;
+            continue;
+        }
+        for (int x = 0; x < coarseWidth; x++) {
+            if (!flagged[x]) {
+                continue;
+            }
+            int end = x + 1;
+            while (end < coarseWidth && flagged[end]) {
+                end++;
+            }
+            runs.push_back(make_pair(x << shift, min(end << shift, width)));
+            x = end;
+        }
+        for (int i = top; i < bottom; i++) {
+            for (const auto& r : runs) {
+                run(i, r.first, r.second);
+            }
+        }
+        top = bottom;
+    }
+}
+
+bool BackgroundModel::refreshesRow(int coarseRow) const {
+    return refinedOnly_ && (coarseRow + firstCoarseRow_ + framesSeen_) % PYRAMID_REFRESH_FRAMES == 0;
+}
+
+bool BackgroundModel::checkFrame(int frame) const {
+    return pyramid_.CheckInterval > 0 && frame % pyramid_.CheckInterval == 0;
+}
+
+// Box-filters the frame rows into the coarse frame: each coarse sample is
+// the rounded mean of its block, partial blocks at the right and bottom
+// included. Columns are summed down a block of rows, then neighbours are
+// added pairwise once per level, between two buffers.
+void BackgroundModel::downsample(const Frame& frame, int firstRow, int lastRow) {
+    TRACE_SCOPE("downsample");
+    int shift = pyramid_.Levels;
+    int block = 1 << shift;
+    int width = background_.Width;
+    int height = background_.Height;
+    if (firstRow % block != 0 || (lastRow % block != 0 && lastRow != height)) {
+        throw invalid_argument("the pyramid needs row ranges on coarse rows");
+    }
+    bool checking = checkFrame(framesSeen_ + 1);
+    double start = checking ? nowSeconds() : 0;
+    int coarseWidth = coarseFrame_.Width;
+    int columns = coarseWidth << shift;
+    // Block sums fit 16 bits: at most 16 x 16 samples of 255. Row ranges
+    // are downsampled concurrently, so the sums are kept per thread.
+    thread_local vector<uint16_t> sums;
+    thread_local vector<uint16_t> pairs;
+    if (sums.size() < (size_t)columns) {
+        sums.resize(columns);
+        pairs.resize(columns / 2);
+    }
+    for (int c = 0; c < 3; c++) {
+        const uint8_t* src = channelPlane(frame, c);
+        uint8_t* dst = channelPlane(coarseFrame_, c);
+        for (int top = firstRow; top < lastRow; top += block) {
+            int rows = min(block, height - top);
+            const uint8_t* px = src + (size_t)top * frame.Stride;
+            uint16_t* column = sums.data();
+            for (int j = 0; j < width; j++) {
+                column[j] = px[j];
+            }
+            // The last block's columns past the frame's edge add nothing;
+            // the pairwise sums below leave partial sums in them
+            fill(column + width, column + columns, 0);
+            for (int i = 1; i < rows; i++) {
+                px += frame.Stride;
+                for (int j = 0; j < width; j++) {
+                    column[j] += px[j];
+                }
+            }
+            uint16_t* half = pairs.data();
+            for (int level = 0, n = columns; level < shift; level++) {
+                n /= 2;
+                for (int x = 0; x < n; x++) {
+                    half[x] = column[2 * x] + column[2 * x + 1];
+                }
+                swap(column, half);
+            }
+            uint8_t* out = dst + (size_t)(top >> shift) * coarseFrame_.Stride;
+            int fullBlocks = rows == block ? width >> shift : 0;
+            int round = block * block / 2;
+            for (int x = 0; x < fullBlocks; x++) {
+                out[x] = (uint8_t)((column[x] + round) >> (2 * shift));
+            }
+            for (int x = fullBlocks; x < coarseWidth; x++) {
+                int count = rows * (min((x + 1) << shift, width) - (x << shift));
+                out[x] = (uint8_t)((column[x] + count / 2) / count);
+            }
+        }
+    }
+    if (checking) {
+        double seconds = nowSeconds() - start;
+        lock_guard<mutex> lock(statsMutex_);
+        pyramidStats_.DownsampleSeconds += seconds;
+    }
+}
+
+// Mean and EMA: adds the frame's refined pixels, and the rows whose turn it
+// is to be refreshed, to the state. For the mean every other coarse pixel
+// counts one more frame, to be folded in when it is next accumulated.
+void BackgroundModel::accumulateRegions(const Frame& frame, int firstRow, int lastRow) {
+    TRACE_SCOPE("accumulate");
+    bool checking = checkFrame(framesSeen_);
+    double start = checking ? nowSeconds() : 0;
+    int stride = background_.Stride;
+    if (!regionPending_.empty()) {
+        catchUpRegions(firstRow, lastRow, false);
+        for (int y = firstRow >> pyramid_.Levels; y << pyramid_.Levels < lastRow; y++) {
+            uint32_t* pending = regionPending_.data() + (size_t)y * coarseFrame_.Stride;
+            const uint8_t* flagged = regions_ + (size_t)y * coarseFrame_.Stride;
+            for (int x = 0; x < coarseFrame_.Width && !refreshesRow(y); x++) {
+                pending[x] += !flagged[x];
+            }
+        }
+    }
+    forEachRegionRun(firstRow, lastRow, true, [&](int i, int first, int last) {
+        for (int c = 0; c < 3; c++) {
+            uint32_t* state = state_[c].data() + (size_t)i * stride + first;
+            const uint8_t* px = channelPlane(frame, c) + (size_t)i * frame.Stride + first;
+            if (mode_ == BACKGROUND_RUNNING_MEAN) {
+                kernels().accumulatePlane(state, px, last - first);
+            }
+            else {
+                updateEma(state, px, last - first);
+            }
+        }
+    });
+    if (checking) {
+        double seconds = nowSeconds() - start;
+        lock_guard<mutex> lock(statsMutex_);
+        pyramidStats_.AccumulateSeconds += seconds;
+    }
+}
+
+// Mean: folds the frames a block was left out of into its sums at the
+// block's current background, which leaves its mean where it was. Only
+// blocks accumulated this frame are caught up, or every block with `all`.
+void BackgroundModel::catchUpRegions(int firstRow, int lastRow, bool all) {
+    int shift = pyramid_.Levels;
+    int stride = background_.Stride;
+    for (int y = firstRow >> shift; y << shift < lastRow; y++) {
+        uint32_t* pending = regionPending_.data() + (size_t)y * coarseFrame_.Stride;
+        const uint8_t* flagged = regions_ + (size_t)y * coarseFrame_.Stride;
+        int top = max(firstRow, y << shift);
+        int bottom = min(lastRow, (y + 1) << shift);
+        bool whole = all || refreshesRow(y);
+        for (int x = 0; x < coarseFrame_.Width; x++) {
+            if (pending[x] == 0 || !(whole || flagged[x])) {
+                continue;
+            }
+            int first = x << shift;
+            int n = min((x + 1) << shift, background_.Width) - first;
+            for (int c = 0; c < 3; c++) {
+                for (int i = top; i < bottom; i++) {
+                    size_t offset = (size_t)i * stride + first;
+                    uint32_t* sums = state_[c].data() + offset;
+                    const uint8_t* bg = channelPlane(background_, c) + offset;
+                    for (int j = 0; j < n; j++) {
+                        sums[j] += (uint32_t)bg[j] * pending[x];
+                    }
+                }
+            }
+            pending[x] = 0;
+        }
+    }
+}
+
+// The coarse model takes the downsampled frame; its mask, dilated by the
+// margin, marks the regions to refine.
+void BackgroundModel::detectRegions() {
+    TRACE_SCOPE("coarse");
+    bool checking = checkFrame(framesSeen_);
+    double start = checking ? nowSeconds() : 0;
+    coarseModel_->addFrame(coarseFrame_);
+    coarseModel_->foregroundMask(coarseFrame_, regions_, pyramid_.Threshold);
+    if (dilateRegions_ && pyramid_.Margin > 0) {
+        MorphologyConfig dilation = { MORPH_DILATE, 2 * pyramid_.Margin + 1, 2 * pyramid_.Margin + 1 };
+        applyMorphology(regions_, regionScratch_, coarseFrame_.Width, coarseFrame_.Height, coarseFrame_.Stride,
+            dilation);
+    }
+    if (checking) {
+        pyramidStats_.CheckedFrames++;
+        pyramidStats_.PyramidSeconds += nowSeconds() - start;
+    }
+}
+
+// Marks each tile of the row range changed or static.
+void BackgroundModel::detectChanges(const Frame& frame, int firstRow, int lastRow) {
+    TRACE_SCOPE("detect changes");
+    if (firstRow % CHANGE_TILE_ROWS != 0 || (lastRow % CHANGE_TILE_ROWS != 0 && lastRow != background_.Height)) {
+        throw invalid_argument("change skipping needs row ranges on tile rows");
+    }
+    const KernelTable& k = kernels();
+    int stride = background_.Stride;
+    int columns = frame.Stride == stride ? stride : background_.Width;
+    for (int top = firstRow; top < lastRow; top += CHANGE_TILE_ROWS) {
+        size_t tileRow = (size_t)(top / CHANGE_TILE_ROWS) * tilesAcross_;
+        uint8_t* changed = tileChanged_.data() + tileRow;
+        int bottom = min(top + CHANGE_TILE_ROWS, lastRow);
+        for (int t = 0; t < tilesAcross_; t++) {
+            changed[t] = framesSeen_ == 0 || (framesSeen_ + tileOffset_ + tileRow + t) % skip_.RefreshInterval == 0;
+        }
+        // Row by row in memory order; a tile is not compared again once it
+        // has changed.
+        for (int c = 0; c < 3; c++) {
+            for (int i = top; i < bottom; i++) {
+                const uint8_t* px = channelPlane(frame, c) + (size_t)i * frame.Stride;
+                const uint8_t* old = channelPlane(reference_, c) + (size_t)i * stride;
+                for (int t = 0; t < tilesAcross_; t++) {
+                    int first = t * CHANGE_TILE_WIDTH;
+                    int last = min(first + CHANGE_TILE_WIDTH, columns);
+                    if (!changed[t] && first < last) {
+                        changed[t] = k.maxDifference(px + first, old + first, last - first) > skip_.Threshold;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Changed tiles become the new reference, once their pending frames are in
+void BackgroundModel::updateReference(const Frame& frame, int firstRow, int lastRow) {
+    int stride = background_.Stride;
+    int columns = frame.Stride == stride ? stride : background_.Width;
+    for (int c = 0; c < 3; c++) {
+        const uint8_t* src = channelPlane(frame, c);
+        uint8_t* ref = channelPlane(reference_, c);
+        forEachChangedRun(firstRow, lastRow, columns, [&](int i, int first, int last) {
+            memcpy(ref + (size_t)i * stride + first, src + (size_t)i * frame.Stride + first, last - first);
+        });
+    }
+}
+
+void BackgroundModel::addFrame(const Frame& frame) {
+    accumulate(frame, 0, background_.Height);
+    commitFrame();
+    updateBackground(frame, 0, background_.Height);
+}
+
+// Folds the frames a tile skipped into the mean or EMA state as its
+// reference samples, which every skipped sample was within the skip
+// threshold of. Only changed tiles are caught up, or every tile with `all`.
+void BackgroundModel::catchUpTiles(int firstRow, int lastRow, bool all) {
+    int stride = background_.Stride;
+    for (int top = firstRow; top < lastRow; top += CHANGE_TILE_ROWS) {
+        size_t tileRow = (size_t)(top / CHANGE_TILE_ROWS) * tilesAcross_;
+        int bottom = min(top + CHANGE_TILE_ROWS, lastRow);
+        for (int t = 0; t < tilesAcross_; t++) {
+            uint16_t& pending = tilePending_[tileRow + t];
+            if (pending == 0 || !(all || tileChanged_[tileRow + t])) {
+                continue;
+            }
+            int first = t * CHANGE_TILE_WIDTH;
+            int n = min(first + CHANGE_TILE_WIDTH, stride) - first;
+            uint32_t weight = mode_ == BACKGROUND_EMA
+                ? emaCatchUp_[min<size_t>(pending, emaCatchUp_.size() - 1)] : 0;
+            for (int c = 0; c < 3; c++) {
+                for (int i = top; i < bottom; i++) {
+                    size_t offset = (size_t)i * stride + first;
+                    uint32_t* state = state_[c].data() + offset;
+                    const uint8_t* ref = channelPlane(reference_, c) + offset;
+                    if (mode_ == BACKGROUND_RUNNING_MEAN) {
+                        for (int j = 0; j < n; j++) {
+                            state[j] += (uint32_t)ref[j] * pending;
+                        }
+                        continue;
+                    }
+                    for (int j = 0; j < n; j++) {
+                        int64_t delta = ((int64_t)ref[j] << EMA_SHIFT) - (int64_t)state[j];
+                        state[j] = (uint32_t)((int64_t)state[j] + delta * weight / (1 << EMA_SHIFT));
+                    }
+                }
+            }
+            pending = 0;
+        }
+    }
+}
+
+// EMA step of n samples; the first frame seeds the average
+void BackgroundModel::updateEma(uint32_t* avg, const uint8_t* px, size_t n) const {
+    if (frameCount_ == 0) {
+        for (size_t j = 0; j < n; j++) {
+            avg[j] = (uint32_t)px[j] << EMA_SHIFT;
+        }
+        return;
+    }
+    for (size_t j = 0; j < n; j++) {
+        int64_t delta = ((int64_t)px[j] << EMA_SHIFT) - (int64_t)avg[j];
+        avg[j] = (uint32_t)((int64_t)avg[j] + delta * alphaQ16_ / (1 << EMA_SHIFT));
+    }
+}
+
+void BackgroundModel::accumulate(const Frame& frame, int firstRow, int lastRow) {
+    requirePlanar(frame, "BackgroundModel");
+    if (skip_.Enabled) {
+        detectChanges(frame, firstRow, lastRow);
+        if (!tilePending_.empty()) {
+            // Static tiles skip the mean and EMA too; they are caught up
+            // from their reference when they next change or are refreshed
+            TRACE_SCOPE("accumulate");
+            catchUpTiles(firstRow, lastRow, false);
+            int stride = background_.Stride;
+            forEachChangedRun(firstRow, lastRow, frame.Stride == stride ? stride : background_.Width,
+                [&](int i, int first, int last) {
+                    for (int c = 0; c < 3; c++) {
+                        uint32_t* state = state_[c].data() + (size_t)i * stride + first;
+                        const uint8_t* px = channelPlane(frame, c) + (size_t)i * frame.Stride + first;
+                        if (mode_ == BACKGROUND_RUNNING_MEAN) {
+                            kernels().accumulatePlane(state, px, last - first);
+                        }
+                        else {
+                            updateEma(state, px, last - first);
+                        }
+                    }
+                });
+        }
+        else {
+            accumulateRows(frame, firstRow, lastRow);
+        }
+        updateReference(frame, firstRow, lastRow);
+        return;
+    }
+    if (pyramid_.Levels > 0) {
+        // The mean and EMA wait for the regions, except on the first frame
+        if (refinedOnly_ && framesSeen_ > 0) {
+            downsample(frame, firstRow, lastRow);
+            return;
+        }
+        bool checking = checkFrame(framesSeen_ + 1);
+        double accumulateSeconds = 0;
+        // Band by band, so the accumulation reads rows the downsampling has
+        // just brought into cache
+        for (int top = firstRow; top < lastRow; top += PYRAMID_BAND_ROWS) {
+            int bottom = min(top + PYRAMID_BAND_ROWS, lastRow);
+            downsample(frame, top, bottom);
+            double start = checking ? nowSeconds() : 0;
+            accumulateRows(frame, top, bottom);
+            accumulateSeconds += checking ? nowSeconds() - start : 0;
+        }
+        if (checking) {
+            lock_guard<mutex> lock(statsMutex_);
+            pyramidStats_.AccumulateSeconds += accumulateSeconds;
+        }
+        return;
+    }
+    accumulateRows(frame, firstRow, lastRow);
+}
+
+void BackgroundModel::accumulateRows(const Frame& frame, int firstRow, int lastRow) {
+    TRACE_SCOPE("accumulate");
+    if (mode_ == BACKGROUND_MEDIAN) {
+        accumulateMedian(frame, firstRow, lastRow);
+        return;
+    }
+    if (mode_ == BACKGROUND_MIXTURE) {
+        accumulateMixture(frame, firstRow, lastRow);
+        return;
+    }
+    int width = background_.Width;
+    int stride = background_.Stride;
+    for (int c = 0; c < 3; c++) {
+        const uint8_t* src = channelPlane(frame, c);
+        uint32_t* state = state_[c].data();
+
+        if (mode_ == BACKGROUND_WINDOW) {
+            // Once the window is full the slot being overwritten holds the
+            // frame that drops out.
+            uint8_t* slot = ring_.data() + ((size_t)ringHead_ * 3 + c) * planeSize_;
+            bool full = frameCount_ == windowSize_;
+            // With matching strides the row range is one contiguous run.
+            bool contiguous = frame.Stride == stride;
+            int runs = contiguous ? 1 : lastRow - firstRow;
+            size_t runLength = contiguous ? (size_t)(lastRow - firstRow) * stride : width;
+            for (int r = 0; r < runs; r++) {
+                int i = firstRow + r;
+                uint32_t* sums = state + (size_t)i * stride;
+                const uint8_t* px = src + (size_t)i * frame.Stride;
+                uint8_t* old = slot + (size_t)i * stride;
+                if (full) {
+                    kernels().slidePlane(sums, px, old, runLength);
+                }
+                else {
+                    kernels().accumulatePlane(sums, px, runLength);
+                }
+                memcpy(old, px, runLength);
+            }
+            continue;
+        }
+
+        if (mode_ == BACKGROUND_RUNNING_MEAN) {
+            if (frame.Stride == stride) {
+                size_t offset = (size_t)firstRow * stride;
+                kernels().accumulatePlane(state + offset, src + offset,
+                    (size_t)(lastRow - firstRow) * stride);
+            }
+            else {
+                for (int i = firstRow; i < lastRow; i++) {
+                    kernels().accumulatePlane(state + (size_t)i * stride,
+                        src + (size_t)i * frame.Stride, width);
+                }
+            }
+            continue;
+        }
+
+        for (int i = firstRow; i < lastRow; i++) {
+            updateEma(state + (size_t)i * stride, src + (size_t)i * frame.Stride, width);
+        }
+    }
+}
+
+void BackgroundModel::commitFrame() {
+    TRACE_SCOPE("commit");
+    if (skip_.Enabled) {
+        skipStats_.Tiles += tileChanged_.size();
+        skipStats_.Skipped += count(tileChanged_.begin(), tileChanged_.end(), 0);
+        framesSeen_++;
+        for (size_t t = 0; t < tilePending_.size(); t++) {
+            tilePending_[t] += !tileChanged_[t];
+        }
+    }
+    if (windowSize_ > 0) {
+        ringHead_ = (ringHead_ + 1) % windowSize_;
+        frameCount_ = min(frameCount_ + 1, windowSize_);
+    }
+    else {
+        frameCount_++;
+        if (mode_ == BACKGROUND_RUNNING_MEAN && frameCount_ >= MAX_MEAN_FRAMES) {
+            rescaleSums();
+        }
+        if (mode_ == BACKGROUND_MEDIAN && frameCount_ >= MAX_MEDIAN_FRAMES) {
+            rescaleHistograms();
+        }
+    }
+    if (pyramid_.Levels > 0) {
+        framesSeen_++;
+        detectRegions();
+    }
+}
+
+void BackgroundModel::rescaleSums() {
+    if (!tilePending_.empty()) {
+        catchUpTiles(0, background_.Height, true);
+    }
+    if (!regionPending_.empty()) {
+        catchUpRegions(0, background_.Height, true);
+    }
+    for (int c = 0; c < 3; c++) {
+        for (size_t i = 0; i < planeSize_; i++) {
+            state_[c][i] = (state_[c][i] + 1) / 2;
+        }
+    }
+    frameCount_ /= 2;
+}
+
+// Adds this frame's samples (dropping the outgoing ones in a window) and
+// moves each median to the lower-median rank k = (samples + 1) / 2, keeping
+// below < k <= below + count[median]. The median steps level by level
+// through the fine counts and skips whole coarse bins. When it enters
+// another bin the tracked bins follow it: a bin that comes into range is
+// counted from the window's samples, or without a window spread evenly over
+// its levels (exact only while it is empty, so a median that moves by a
+// bin at a time stays exact).
+void BackgroundModel::accumulateMedian(const Frame& frame, int firstRow, int lastRow) {
+    if (medianCountBytes(windowSize_) == 1) {
+        accumulateMedianCounts<uint8_t>(frame, firstRow, lastRow);
+    }
+    else {
+        accumulateMedianCounts<uint16_t>(frame, firstRow, lastRow);
+    }
+}
+
+template <typename Count>
+void BackgroundModel::accumulateMedianCounts(const Frame& frame, int firstRow, int lastRow) {
+    int width = background_.Width;
+    int stride = background_.Stride;
+    bool full = windowSize_ > 0 && frameCount_ == windowSize_;
+    int half = medianNeighbours(windowSize_);
+    int tracked = 2 * half + 1;
+    size_t perPixel = medianCounts(windowSize_);
+    for (int c = 0; c < 3; c++) {
+        const uint8_t* src = channelPlane(frame, c);
+        Count* counts = (Count*)counts_[c].data();
+        uint8_t* median = median_[c].data();
+        uint16_t* below = below_[c].data();
+        uint16_t* samples = samples_[c].data();
+        const uint8_t* ring = windowSize_ > 0 ? ring_.data() + (size_t)c * planeSize_ : nullptr;
+        uint8_t* slot = windowSize_ > 0
+            ? ring_.data() + ((size_t)ringHead_ * 3 + c) * planeSize_ : nullptr;
+
+        for (int i = firstRow; i < lastRow; i++) {
+            const uint8_t* px = src + (size_t)i * frame.Stride;
+            for (int j = 0; j < width; j++) {
+                size_t p = (size_t)i * stride + j;
+                Count* coarse = counts + p * perPixel;
+                // Levels of the median's bin; its neighbours are 16 apart
+                Count* fine = coarse + COARSE_BINS * (1 + half);
+                int m = median[p];
+                int count = below[p];
+                uint8_t v = px[j];
+                coarse[v >> COARSE_SHIFT]++;
+                // Branch-free: noisy samples land either side at random
+                int offset = (v >> COARSE_SHIFT) - (m >> COARSE_SHIFT);
+                bool tracks = offset >= -half && offset <= half;
+                fine[tracks ? offset * COARSE_BINS + (v & COARSE_MASK) : 0] += tracks;
+                count += v < m;
+                if (slot && full) {
+                    uint8_t old = slot[p];
+                    coarse[old >> COARSE_SHIFT]--;
+                    fine[old & COARSE_MASK] -= (old >> COARSE_SHIFT) == (m >> COARSE_SHIFT);
+                    count -= old < m;
+                }
+                else {
+                    samples[p]++;
+                }
+                if (slot) {
+                    slot[p] = v;
+                }
+                if (samples[p] == 1) {
+                    // First sample: the median is the sample, with every
+                    // tracked bin but its own empty
+                    fill(coarse + COARSE_BINS, coarse + perPixel, 0);
+                    fine[v & COARSE_MASK] = 1;
+                    median[p] = v;
+                    below[p] = 0;
+                    continue;
+                }
+
+                // Re-centres the tracked bins on bin `to`, having been on
+                // `from`
+                auto follow = [&](int from, int to) {
+                    Count* first = coarse + COARSE_BINS;
+                    int kept = tracked - abs(to - from);
+                    if (kept > 0 && to > from) {
+                        memmove(first, first + (to - from) * COARSE_BINS, kept * COARSE_BINS * sizeof(Count));
+                    }
+                    else if (kept > 0) {
+                        memmove(first + (from - to) * COARSE_BINS, first, kept * COARSE_BINS * sizeof(Count));
+                    }
+                    kept = max(kept, 0);
+                    for (int k = 0; k < tracked; k++) {
+                        // Only the slots that came into range
+                        if (to > from ? k < kept : k >= tracked - kept) {
+                            continue;
+                        }
+                        int b = to - half + k;
+                        Count* levels = first + k * COARSE_BINS;
+                        fill(levels, levels + COARSE_BINS, 0);
+                        if (b < 0 || b >= COARSE_BINS) {
+                            continue;
+                        }
+                        if (ring) {
+                            int held = full ? windowSize_ : samples[p];
+                            for (int s = 0; s < held; s++) {
+                                uint8_t sample = ring[(size_t)s * 3 * planeSize_ + p];
+                                levels[sample & COARSE_MASK] += (sample >> COARSE_SHIFT) == b;
+                            }
+                        }
+                        else {
+                            for (int l = 0; l < COARSE_BINS; l++) {
+                                levels[l] = (Count)(coarse[b] / COARSE_BINS + (l < coarse[b] % COARSE_BINS));
+                            }
+                        }
+                    }
+                };
+                int rank = (samples[p] + 1) / 2;
+                while (count + fine[m & COARSE_MASK] < rank) {
+                    count += fine[m & COARSE_MASK];
+                    m++;
+                    if ((m & COARSE_MASK) == 0) {
+                        int from = (m >> COARSE_SHIFT) - 1;
+                        while (count + coarse[m >> COARSE_SHIFT] < rank) {
+                            count += coarse[m >> COARSE_SHIFT];
+                            m += COARSE_MASK + 1;
+                        }
+                        follow(from, m >> COARSE_SHIFT);
+                    }
+                }
+                while (count >= rank) {
+                    if ((m & COARSE_MASK) == 0) {
+                        int from = m >> COARSE_SHIFT;
+                        while (count - coarse[(m >> COARSE_SHIFT) - 1] >= rank) {
+                            count -= coarse[(m >> COARSE_SHIFT) - 1];
+                            m -= COARSE_MASK + 1;
+                        }
+                        follow(from, (m >> COARSE_SHIFT) - 1);
+                    }
+                    m--;
+                    count -= fine[m & COARSE_MASK];
+                }
+                median[p] = (uint8_t)m;
+                below[p] = (uint16_t)count;
+            }
+        }
+    }
+}
+
+MixtureRun BackgroundModel::mixtureRun(const Frame& frame, size_t offset,
+    size_t sampleOffset) const {
+    MixtureRun run;
+    for (int k = 0; k < MIXTURE_COMPONENTS; k++) {
+        float* planes = mixture_ + (size_t)k * MIXTURE_FIELDS * planeSize_ + offset;
+        run.Weight[k] = planes;
+        run.Variance[k] = planes + planeSize_;
+        for (int c = 0; c < 3; c++) {
+            run.Mean[k][c] = planes + (2 + c) * planeSize_;
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        run.Sample[c] = channelPlane(frame, c) + sampleOffset;
+        run.Background[c] = channelPlane(background_, c) + offset;
+    }
+    run.Mask = mixtureMask_ + offset;
+    return run;
+}
+
+// Classifies and updates in one pass over the state; the background planes
+// are written here too, so updateBackground has nothing left to do.
+void BackgroundModel::accumulateMixture(const Frame& frame, int firstRow, int lastRow) {
+    int stride = background_.Stride;
+    if (skip_.Enabled) {
+        forEachChangedRun(firstRow, lastRow, frame.Stride == stride ? stride : background_.Width,
+            [&](int i, int first, int last) {
+                kernels().mixtureUpdate(mixtureRun(frame, (size_t)i * stride + first,
+                    (size_t)i * frame.Stride + first), last - first, mixtureParams_);
+            });
+        return;
+    }
+    if (frame.Stride == stride) {
+        size_t offset = (size_t)firstRow * stride;
+        kernels().mixtureUpdate(mixtureRun(frame, offset, offset),
+            (size_t)(lastRow - firstRow) * stride, mixtureParams_);
+        return;
+    }
+    for (int i = firstRow; i < lastRow; i++) {
+        kernels().mixtureUpdate(mixtureRun(frame, (size_t)i * stride, (size_t)i * frame.Stride),
+            background_.Width, mixtureParams_);
+    }
+}
+
+// Halves every count, rounding up so no level drops out, and recounts the
+// samples and the ones below each median. The median's coarse count is the
+// sum of its halved fine counts, so the two stay consistent.
+void BackgroundModel::rescaleHistograms() {
+    int half = medianNeighbours(windowSize_);
+    size_t perPixel = medianCounts(windowSize_);
+    for (int c = 0; c < 3; c++) {
+        for (size_t p = 0; p < planeSize_; p++) {
+            // Without a window the counts are 16-bit
+            uint16_t* coarse = (uint16_t*)counts_[c].data() + p * perPixel;
+            int m = median_[c][p];
+            for (int k = 0; k < COARSE_BINS; k++) {
+                coarse[k] = (coarse[k] + 1) / 2;
+            }
+            for (int b = (m >> COARSE_SHIFT) - half; b <= (m >> COARSE_SHIFT) + half; b++) {
+                uint16_t* levels = coarse + COARSE_BINS * (1 + half + b - (m >> COARSE_SHIFT));
+                int inBin = 0;
+                for (int l = 0; l < COARSE_BINS; l++) {
+                    levels[l] = (levels[l] + 1) / 2;
+                    inBin += levels[l];
+                }
+                if (b >= 0 && b < COARSE_BINS) {
+                    coarse[b] = (uint16_t)inBin;
+                }
+            }
+            const uint16_t* fine = coarse + COARSE_BINS * (1 + half);
+            int total = 0;
+            int count = 0;
+            for (int k = 0; k < COARSE_BINS; k++) {
+                total += coarse[k];
+                count += k < (m >> COARSE_SHIFT) ? coarse[k] : 0;
+                count += k < (m & COARSE_MASK) ? fine[k] : 0;
+            }
+            samples_[c][p] = (uint16_t)total;
+            below_[c][p] = (uint16_t)count;
+        }
+    }
+    frameCount_ /= 2;
+}
+
+void BackgroundModel::updateBackground(const Frame& frame, int firstRow, int lastRow) {
+    TRACE_SCOPE("update");
+    requirePlanar(frame, "BackgroundModel");
+    if (frameCount_ == 0 || mode_ == BACKGROUND_MIXTURE) {
+        return;
+    }
+    int stride = background_.Stride;
+    FixedPointDivisor divisor = meanDivisor();
+    if (skip_.Enabled) {
+        forEachChangedRun(firstRow, lastRow, stride, [&](int i, int first, int last) {
+            updateRun((size_t)i * stride + first, last - first, divisor);
+        });
+        return;
+    }
+    if (pyramid_.Levels > 0) {
+        if (framesSeen_ == 1) {
+            // The first frame went in whole
+            updateRun((size_t)firstRow * stride, (size_t)(lastRow - firstRow) * stride, divisor);
+            return;
+        }
+        if (refinedOnly_) {
+            accumulateRegions(frame, firstRow, lastRow);
+        }
+        bool checking = checkFrame(framesSeen_);
+        double start = checking ? nowSeconds() : 0;
+        forEachRegionRun(firstRow, lastRow, true, [&](int i, int first, int last) {
+            updateRun((size_t)i * stride + first, last - first, divisor);
+        });
+        if (checking) {
+            double seconds = nowSeconds() - start;
+            lock_guard<mutex> lock(statsMutex_);
+            pyramidStats_.PyramidSeconds += seconds;
+        }
+        return;
+    }
+    updateRun((size_t)firstRow * stride, (size_t)(lastRow - firstRow) * stride, divisor);
+}
+
+void BackgroundModel::refreshBackground() {
+    if (!tilePending_.empty()) {
+        catchUpTiles(0, background_.Height, true);
+    }
+    if (!regionPending_.empty()) {
+        catchUpRegions(0, background_.Height, true);
+    }
+    if (frameCount_ > 0 && mode_ != BACKGROUND_MIXTURE) {
+        updateRun(0, planeSize_, meanDivisor());
+    }
+}
+
+// Fixed-point 1 / frameCount_ for the mean and window
+FixedPointDivisor BackgroundModel::meanDivisor() const {
+    FixedPointDivisor divisor = {};
+    if (mode_ == BACKGROUND_RUNNING_MEAN || mode_ == BACKGROUND_WINDOW) {
+        divisor = makeDivisor(frameCount_, 255u * frameCount_);
+    }
+    return divisor;
+}
+
+// Background samples [offset, offset + n) of every channel from the state
+void BackgroundModel::updateRun(size_t offset, size_t n, const FixedPointDivisor& divisor) {
+    if (mode_ == BACKGROUND_MEDIAN) {
+        for (int c = 0; c < 3; c++) {
+            memcpy(channelPlane(background_, c) + offset, median_[c].data() + offset, n);
+        }
+        return;
+    }
+    if (mode_ != BACKGROUND_EMA) {
+        for (int c = 0; c < 3; c++) {
+            kernels().dividePlane(channelPlane(background_, c) + offset,
+                state_[c].data() + offset, n, divisor);
+        }
+        return;
+    }
+
+    const uint32_t half = 1u << (EMA_SHIFT - 1);
+    for (int c = 0; c < 3; c++) {
+        uint8_t* dst = channelPlane(background_, c) + offset;
+        const uint32_t* avg = state_[c].data() + offset;
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = (uint8_t)min<uint32_t>(255, (avg[i] + half) >> EMA_SHIFT);
+        }
+    }
+}
+
+// Thresholds the changed tiles of the row range into tileMask_; the static
+// ones keep their mask from the frame they were last processed in.
+void BackgroundModel::refreshMask(const Frame& frame, int threshold, int firstRow, int lastRow) {
+    const Frame& bg = background_;
+    int columns = frame.Stride == bg.Stride ? bg.Stride : bg.Width;
+    forEachChangedRun(firstRow, lastRow, columns, [&](int i, int first, int last) {
+        size_t row = (size_t)i * bg.Stride + first;
+        size_t src = (size_t)i * frame.Stride + first;
+        kernels().thresholdMask(tileMask_ + row, bg.Red + row, bg.Green + row, bg.Blue + row,
+            frame.Red + src, frame.Green + src, frame.Blue + src, last - first, threshold);
+    });
+}
+
+// Mask rows thresholded inside the regions and background elsewhere
+void BackgroundModel::refineMask(const Frame& frame, uint8_t* mask, int threshold, int firstRow, int lastRow) {
+    bool checking = checkFrame(framesSeen_);
+    double start = checking ? nowSeconds() : 0;
+    const Frame& bg = background_;
+    memset(mask + (size_t)firstRow * bg.Stride, 0, (size_t)(lastRow - firstRow) * bg.Stride);
+    size_t refined = 0;
+    forEachRegionRun(firstRow, lastRow, false, [&](int i, int first, int last) {
+        size_t row = (size_t)i * bg.Stride + first;
+        size_t src = (size_t)i * frame.Stride + first;
+        kernels().thresholdMask(mask + row, bg.Red + row, bg.Green + row, bg.Blue + row,
+            frame.Red + src, frame.Green + src, frame.Blue + src, last - first, threshold);
+        refined += last - first;
+    });
+    double seconds = checking ? nowSeconds() - start : 0;
+    lock_guard<mutex> lock(statsMutex_);
+    pyramidStats_.Pixels += (size_t)(lastRow - firstRow) * bg.Width;
+    pyramidStats_.Refined += refined;
+    pyramidStats_.PyramidSeconds += seconds;
+}
+
+// refineMask() straight into bits. Runs are thresholded into tileMask_,
+// which is zero outside them between calls, and packed one span of words
+// at a time, so only the words the regions touch are built from bytes.
+void BackgroundModel::refineBits(const Frame& frame, BitMask& bits, int threshold, int firstRow, int lastRow) {
+    bool checking = checkFrame(framesSeen_);
+    double start = checking ? nowSeconds() : 0;
+    const Frame& bg = background_;
+    memset(bitMaskRow(bits, firstRow), 0, (size_t)(lastRow - firstRow) * bits.WordsPerRow * sizeof(uint64_t));
+    size_t refined = 0;
+    // Words [spanFirst, spanLast) of row spanRow are thresholded, not packed
+    int spanRow = -1;
+    int spanFirst = 0;
+    int spanLast = 0;
+    auto flush = [&]() {
+        if (spanRow < 0) {
+            return;
+        }
+        uint8_t* bytes = tileMask_ + (size_t)spanRow * bg.Stride + (size_t)spanFirst * 64;
+        size_t n = (size_t)(spanLast - spanFirst) * 64;
+        kernels().packMask(bitMaskRow(bits, spanRow) + spanFirst, bytes, n);
+        memset(bytes, 0, n);
+    };
+    forEachRegionRun(firstRow, lastRow, false, [&](int i, int first, int last) {
+        if (i != spanRow || first / 64 >= spanLast) {
+            flush();
+            spanRow = i;
+            spanFirst = first / 64;
+        }
+        spanLast = (last + 63) / 64;
+        size_t row = (size_t)i * bg.Stride + first;
+        size_t src = (size_t)i * frame.Stride + first;
+        kernels().thresholdMask(tileMask_ + row, bg.Red + row, bg.Green + row, bg.Blue + row,
+            frame.Red + src, frame.Green + src, frame.Blue + src, last - first, threshold);
+        refined += last - first;
+    });
+    flush();
+    double seconds = checking ? nowSeconds() - start : 0;
+    lock_guard<mutex> lock(statsMutex_);
+    pyramidStats_.Pixels += (size_t)(lastRow - firstRow) * bg.Width;
+    pyramidStats_.Refined += refined;
+    pyramidStats_.PyramidSeconds += seconds;
+}
+
+// On checked frames, also masks the rows at full resolution and counts the
+// foreground the pyramid's mask (bytes or bits) missed. The window and
+// median refresh the whole background first (it follows from the state,
+// so this changes nothing); the mean and EMA hold theirs outside the
+// regions, so their background already is the model's and the check sees
+// only the masking error, not the lag (the recall is labelled that way).
+void BackgroundModel::checkPyramid(const Frame& frame, const uint8_t* mask, const BitMask* bits, int threshold,
+    int firstRow, int lastRow) {
+    if (!checkFrame(framesSeen_)) {
+        return;
+    }
+    TRACE_SCOPE("pyramid check");
+    const Frame& bg = background_;
+    double start = nowSeconds();
+    if (!refinedOnly_) {
+        updateRun((size_t)firstRow * bg.Stride, (size_t)(lastRow - firstRow) * bg.Stride, meanDivisor());
+    }
+    bool contiguous = frame.Stride == bg.Stride;
+    for (int i = firstRow; i < lastRow; i = contiguous ? lastRow : i + 1) {
+        size_t row = (size_t)i * bg.Stride;
+        size_t src = (size_t)i * frame.Stride;
+        kernels().thresholdMask(checkMask_ + row, bg.Red + row, bg.Green + row, bg.Blue + row,
+            frame.Red + src, frame.Green + src, frame.Blue + src,
+            contiguous ? (size_t)(lastRow - firstRow) * bg.Stride : bg.Width, threshold);
+    }
+    size_t foreground = 0;
+    size_t missed = 0;
+    for (int i = firstRow; i < lastRow; i++) {
+        const uint8_t* full = checkMask_ + (size_t)i * bg.Stride;
+        const uint8_t* found = mask ? mask + (size_t)i * bg.Stride : nullptr;
+        const uint64_t* foundBits = bits ? bitMaskRow(*bits, i) : nullptr;
+        for (int j = 0; j < bg.Width; j++) {
+            bool hit = found ? found[j] != 0 : (foundBits[j / 64] >> (j % 64) & 1) != 0;
+            foreground += full[j] != 0;
+            missed += full[j] && !hit;
+        }
+    }
+    double seconds = nowSeconds() - start;
+    lock_guard<mutex> lock(statsMutex_);
+    pyramidStats_.CheckSeconds += seconds;
+    pyramidStats_.Foreground += foreground;
+    pyramidStats_.Missed += missed;
+}
+
+void BackgroundModel::foregroundMask(const Frame& frame, uint8_t* mask, int threshold) {
+    foregroundMask(frame, mask, threshold, 0, background_.Height);
+}
+
+void BackgroundModel::foregroundMask(const Frame& frame, uint8_t* mask, int threshold,
+    int firstRow, int lastRow) {
+    TRACE_SCOPE("mask");
+    requirePlanar(frame, "BackgroundModel");
+    const Frame& bg = background_;
+    if (mode_ == BACKGROUND_MIXTURE || skip_.Enabled) {
+        const uint8_t* source = mixtureMask_;
+        if (mode_ != BACKGROUND_MIXTURE) {
+            refreshMask(frame, threshold, firstRow, lastRow);
+            source = tileMask_;
+        }
+        size_t offset = (size_t)firstRow * bg.Stride;
+        memcpy(mask + offset, source + offset, (size_t)(lastRow - firstRow) * bg.Stride);
+        return;
+    }
+    if (pyramid_.Levels > 0) {
+        refineMask(frame, mask, threshold, firstRow, lastRow);
+        checkPyramid(frame, mask, nullptr, threshold, firstRow, lastRow);
+        return;
+    }
+    if (frame.Stride == bg.Stride) {
+        size_t offset = (size_t)firstRow * bg.Stride;
+        kernels().thresholdMask(mask + offset, bg.Red + offset, bg.Green + offset, bg.Blue + offset,
+            frame.Red + offset, frame.Green + offset, frame.Blue + offset,
+            (size_t)(lastRow - firstRow) * bg.Stride, threshold);
+        return;
+    }
+    for (int i = firstRow; i < lastRow; i++) {
+        size_t row = (size_t)i * bg.Stride;
+        size_t src = (size_t)i * frame.Stride;
+        kernels().thresholdMask(mask + row, bg.Red + row, bg.Green + row, bg.Blue + row,
+            frame.Red + src, frame.Green + src, frame.Blue + src, bg.Width, threshold);
+    }
+}
+
+void BackgroundModel::foregroundBits(const Frame& frame, BitMask& bits, int threshold) {
+    foregroundBits(frame, bits, threshold, 0, background_.Height);
+}
+
+void BackgroundModel::foregroundBits(const Frame& frame, BitMask& bits, int threshold,
+    int firstRow, int lastRow) {
+    TRACE_SCOPE("mask");
+    requirePlanar(frame, "BackgroundModel");
+    const Frame& bg = background_;
+    if (mode_ == BACKGROUND_MIXTURE) {
+        packMaskRows(bits, mixtureMask_, firstRow, lastRow);
+        return;
+    }
+    if (skip_.Enabled) {
+        refreshMask(frame, threshold, firstRow, lastRow);
+        packMaskRows(bits, tileMask_, firstRow, lastRow);
+        return;
+    }
+    if (pyramid_.Levels > 0) {
+        refineBits(frame, bits, threshold, firstRow, lastRow);
+        checkPyramid(frame, nullptr, &bits, threshold, firstRow, lastRow);
+        return;
+    }
+    if (frame.Stride == bg.Stride) {
+        size_t offset = (size_t)firstRow * bg.Stride;
+        kernels().thresholdBits(bitMaskRow(bits, firstRow), bg.Red + offset, bg.Green + offset,
+            bg.Blue + offset, frame.Red + offset, frame.Green + offset, frame.Blue + offset,
+            (size_t)(lastRow - firstRow) * bg.Stride, threshold);
+        return;
+    }
+    // Frame rows are narrower than the background's: threshold each row into
+    // a zero-padded background-width row first.
+    vector<uint8_t> row(bg.Stride, 0);
+    for (int i = firstRow; i < lastRow; i++) {
+        size_t offset = (size_t)i * bg.Stride;
+        size_t src = (size_t)i * frame.Stride;
+        kernels().thresholdMask(row.data(), bg.Red + offset, bg.Green + offset, bg.Blue + offset,
+            frame.Red + src, frame.Green + src, frame.Blue + src, bg.Width, threshold);
+        kernels().packMask(bitMaskRow(bits, i), row.data(), bg.Stride);
+    }
+}
+
+size_t BackgroundModel::memoryBytes() const {
+    size_t bytes = ring_.size() + frameBytes(background_);
+    if (mode_ == BACKGROUND_MIXTURE) {
+        bytes += (size_t)MIXTURE_COMPONENTS * MIXTURE_FIELDS * planeSize_ * sizeof(float) + planeSize_;
+    }
+    if (skip_.Enabled) {
+        bytes += frameBytes(reference_) + (tileMask_ ? planeSize_ : 0) + tileChanged_.size()
+            + tilePending_.size() * sizeof(uint16_t);
+    }
+    if (coarseModel_) {
+        size_t coarsePlane = (size_t)coarseFrame_.Stride * coarseFrame_.Height;
+        bytes += coarseModel_->memoryBytes() + frameBytes(coarseFrame_) + 2 * coarsePlane
+            + (1 + (checkMask_ != nullptr)) * planeSize_;
+    }
+    for (int c = 0; c < 3; c++) {
+        bytes += state_[c].size() * sizeof(uint32_t)
+            + counts_[c].size()
+            + median_[c].size() + (below_[c].size() + samples_[c].size()) * sizeof(uint16_t);
+    }
+    return bytes;
+}
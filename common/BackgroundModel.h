@@ -0,0 +1,313 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BitMask.h"
+#include "Frame.h"
+#include "Kernels.h"
+
+// Streaming background model: frames are fed one at a time and can be freed
+// as soon as addFrame returns, so memory stays constant however long the
+// sequence is, and a foreground mask is available after every frame.
+//
+// BACKGROUND_RUNNING_MEAN keeps 32-bit per-pixel sums and reproduces
+// calculateColorBackgroundMean exactly. BACKGROUND_EMA keeps a fixed-point
+// exponential moving average, bg += alpha * (frame - bg). BACKGROUND_WINDOW
+// is the mean of the last `windowSize` frames: a ring buffer keeps those
+// frames, and each new one adds its samples and subtracts the outgoing
+// frame's, so an update is O(1) per pixel whatever the window length.
+//
+// BACKGROUND_MEDIAN is the per-pixel temporal median (the lower one for an
+// even count), which an object passing through does not drag the way it
+// drags a mean. Each pixel and channel counts its samples in 16 coarse bins
+// of 16 levels, and level by level only in the coarse bin holding the
+// median, plus the current median and the number of samples below it; an
+// update adds (and, in a window, removes) one sample and steps the median,
+// skipping whole coarse bins, so updates and queries are O(1) amortized.
+// windowSize 0 takes every frame, otherwise the last windowSize through the
+// same ring buffer as BACKGROUND_WINDOW. A window median is exact: when the
+// median enters another coarse bin, that bin's levels are recounted from
+// the ring. Without a window the levels of the bins either side are kept
+// too, and a bin further away is spread evenly over its levels when the
+// median reaches it, so the median can be off by a few levels after it
+// jumps (model_bench: 2% of samples, by up to 6 levels). State per pixel:
+// 111 bytes with a window of up to 255 frames (8-bit counts), 207 with a
+// longer one, plus 3 bytes per window frame; 399 without a window. At
+// 1080p that is 230 MB plus 6.2 MB per window frame, or 830 MB.
+//
+// BACKGROUND_MIXTURE is an adaptive Gaussian mixture (MIXTURE_COMPONENTS per
+// pixel, learning rate alpha) that absorbs flicker and swaying foliage as
+// extra background modes. Its state is structure-of-arrays float planes
+// updated by the vectorised mixtureUpdate kernel, which classifies each
+// sample as it goes: for this mode foregroundMask() returns the mask of the
+// frame last accumulated, and the threshold is not used.
+//
+// Frames must be planar. The row-range overloads let a caller split one frame
+// across threads: accumulate every row range, then commitFrame() once, then
+// updateBackground()/foregroundMask() per range. A model of width n and
+// height 1 covers a flat pixel slice (one MPI rank's share).
+//
+// Change skipping (setChangeSkipping) is for mostly static scenes. The
+// frame is cut into CHANGE_TILE_WIDTH x CHANGE_TILE_ROWS tiles (columns in
+// stride space), and accumulate() compares each tile with the samples it
+// was last processed with. A tile where no sample moved by more than the
+// threshold keeps its background and mask from that frame: only tiles that
+// changed, or whose turn it is in the staggered refresh, are updated and
+// thresholded. The mean and EMA skip static tiles as well, counting the
+// frames each one skipped; when it is next processed those frames go in
+// as its reference samples (within the threshold of the real ones), so
+// their background stays within the threshold of the exact one. The
+// window and histograms still take every frame, so a refreshed tile is
+// exact again; the mixture skips its update too. A static tile's mask can
+// lag behind a background that is still settling (e.g. a ghost dissolving
+// from the mean) by up to the refresh interval. Row ranges must then start
+// on a tile row and end on one (or at the last row).
+//
+// The pyramid (setPyramid) is coarse-to-fine detection for large frames
+// where little moves. accumulate() box-filters each frame down by 2^Levels
+// each way, and commitFrame() feeds that to a second model of the same
+// kind, thresholds it and dilates its mask by Margin coarse pixels.
+// updateBackground() and the masks then only touch the full-resolution
+// pixels under those regions; the mask is background everywhere else. The
+// mean and EMA also accumulate only those pixels, in updateBackground()
+// once the regions are known (the first frame goes in whole), plus a
+// staggered band of whole coarse rows every frame so that each row is
+// accumulated at least every 16 frames. Elsewhere a frame counts as the
+// pixel's current background, so the background there holds its value
+// from the last time it was accumulated. The window and median take
+// every full-resolution frame in accumulate(), so their refined pixels are
+// exactly what the model gives without the pyramid. Row ranges must start
+// on a multiple of 2^Levels rows.
+
+enum BackgroundMode {
+    BACKGROUND_RUNNING_MEAN,
+    BACKGROUND_EMA,
+    BACKGROUND_WINDOW,
+    BACKGROUND_MEDIAN,
+    BACKGROUND_MIXTURE
+};
+
+const char* backgroundModeName(BackgroundMode mode);
+
+const int CHANGE_TILE_WIDTH = 128;
+const int CHANGE_TILE_ROWS = 16;
+
+struct ChangeSkipConfig {
+    bool Enabled;
+    // A tile has changed when any sample differs from the tile's last
+    // processed one by more than this
+    int Threshold;
+    // Every tile is processed at least once per this many frames, up to
+    // MAX_SKIP_REFRESH
+    int RefreshInterval;
+};
+
+// A tile counts the frames it skipped in 16 bits
+const int MAX_SKIP_REFRESH = 65535;
+
+struct ChangeSkipStats {
+    // Tiles seen over all frames, and those that were skipped
+    size_t Tiles;
+    size_t Skipped;
+};
+
+const int MAX_PYRAMID_LEVELS = 4;
+
+struct PyramidConfig {
+    // Halvings down to the coarse level, up to MAX_PYRAMID_LEVELS; 0 is off
+    int Levels;
+    // Coarse pixels added around every coarse detection
+    int Margin;
+    // Threshold of the coarse mask
+    int Threshold;
+    // Every this many frames the full-resolution mask is computed too and
+    // compared with the pyramid's (0: never)
+    int CheckInterval;
+};
+
+struct PyramidStats {
+    // Full-resolution pixels masked, and those inside refined regions
+    size_t Pixels;
+    size_t Refined;
+    // Checked frames: foreground pixels of the full-resolution masks and
+    // those the pyramid missed (it adds none: refined pixels are exact)
+    int CheckedFrames;
+    size_t Foreground;
+    size_t Missed;
+    // Checked frames: seconds spent downsampling, accumulating at full
+    // resolution (refined pixels, or every pixel for the window and
+    // median), in the coarse model and refining, and on the check itself
+    // (a full-resolution mask); summed over threads
+    double DownsampleSeconds;
+    double AccumulateSeconds;
+    double PyramidSeconds;
+    double CheckSeconds;
+};
+
+// Refined share and, for checked frames, recall (against a full mask over
+// the pyramid's own background) and the time of each pyramid stage, as
+// indented report lines.
+std::string pyramidReport(const PyramidConfig& config, const PyramidStats& stats);
+
+class BackgroundModel {
+public:
+    BackgroundModel(int width, int height, BackgroundMode mode = BACKGROUND_RUNNING_MEAN,
+        double alpha = 0.05, int windowSize = 0);
+    ~BackgroundModel();
+
+    BackgroundModel(const BackgroundModel&) = delete;
+    BackgroundModel& operator=(const BackgroundModel&) = delete;
+
+    // Before the first frame; does nothing unless config.Enabled. A model
+    // of a band of image rows starting at tile row `firstTileRow` (an MPI
+    // rank's slice) refreshes its tiles on the whole image's schedule.
+    void setChangeSkipping(const ChangeSkipConfig& config, int firstTileRow = 0);
+    ChangeSkipStats changeSkipStats() const { return skipStats_; }
+
+    // Before the first frame; does nothing unless config.Levels > 0. Not
+    // for the mixture, which masks as it updates, nor with change skipping.
+    // With dilate false commitFrame() leaves pyramidRegions() undilated for
+    // the caller (an MPI rank, which needs its neighbours' rows). A model of
+    // a band of image rows starting at coarse row `firstCoarseRow` refreshes
+    // its rows on the whole image's schedule.
+    void setPyramid(const PyramidConfig& config, bool dilate = true, int firstCoarseRow = 0);
+    PyramidStats pyramidStats() const { return pyramidStats_; }
+    // Coarse mask of the regions to refine: ceil(width / 2^Levels) wide,
+    // rows alignedStride() of that apart
+    uint8_t* pyramidRegions() { return regions_; }
+
+    // accumulate + commitFrame + updateBackground over the whole frame.
+    // Every frame passed in must be planar (requirePlanar()).
+    void addFrame(const Frame& frame);
+
+    void accumulate(const Frame& frame, int firstRow, int lastRow);
+    void commitFrame();
+    // `frame` is the one just committed; the pyramid accumulates its
+    // refined pixels here.
+    void updateBackground(const Frame& frame, int firstRow, int lastRow);
+
+    // Compares `frame` with the current background; mask rows use the
+    // background's stride. With change skipping, static tiles repeat the
+    // mask they last had; with the pyramid, pixels outside the refined
+    // regions are background.
+    void foregroundMask(const Frame& frame, uint8_t* mask, int threshold);
+    void foregroundMask(const Frame& frame, uint8_t* mask, int threshold,
+        int firstRow, int lastRow);
+    // Same mask straight into bits (rows of `bits` match background rows).
+    void foregroundBits(const Frame& frame, BitMask& bits, int threshold);
+    void foregroundBits(const Frame& frame, BitMask& bits, int threshold,
+        int firstRow, int lastRow);
+
+    // Brings the whole background up to date, e.g. before it is written:
+    // change skipping and the pyramid refresh only part of it per frame.
+    void refreshBackground();
+    const Frame& background() const { return background_; }
+    // Frames currently contributing (capped at the window length).
+    int frameCount() const { return frameCount_; }
+    int windowSize() const { return windowSize_; }
+    BackgroundMode mode() const { return mode_; }
+
+    // Resident bytes held by the model (state + window + background).
+    size_t memoryBytes() const;
+
+private:
+    void rescaleSums();
+    void accumulateMedian(const Frame& frame, int firstRow, int lastRow);
+    template <typename Count>
+    void accumulateMedianCounts(const Frame& frame, int firstRow, int lastRow);
+    void rescaleHistograms();
+    void accumulateMixture(const Frame& frame, int firstRow, int lastRow);
+    MixtureRun mixtureRun(const Frame& frame, size_t offset, size_t sampleOffset) const;
+    FixedPointDivisor meanDivisor() const;
+    void updateRun(size_t offset, size_t n, const FixedPointDivisor& divisor);
+    void detectChanges(const Frame& frame, int firstRow, int lastRow);
+    void updateReference(const Frame& frame, int firstRow, int lastRow);
+    void catchUpTiles(int firstRow, int lastRow, bool all);
+    void updateEma(uint32_t* avg, const uint8_t* px, size_t n) const;
+    void refreshMask(const Frame& frame, int threshold, int firstRow, int lastRow);
+    // Calls run(row, firstColumn, lastColumn) for every run of adjacent
+    // changed tiles in each row of the range; columns stop at `columns`.
+    template <typename Run>
+    void forEachChangedRun(int firstRow, int lastRow, int columns, Run run) const;
+    void downsample(const Frame& frame, int firstRow, int lastRow);
+    void detectRegions();
+    void accumulateRegions(const Frame& frame, int firstRow, int lastRow);
+    void catchUpRegions(int firstRow, int lastRow, bool all);
+    void accumulateRows(const Frame& frame, int firstRow, int lastRow);
+    void refineMask(const Frame& frame, uint8_t* mask, int threshold, int firstRow, int lastRow);
+    void refineBits(const Frame& frame, BitMask& bits, int threshold, int firstRow, int lastRow);
+    void checkPyramid(const Frame& frame, const uint8_t* mask, const BitMask* bits, int threshold,
+        int firstRow, int lastRow);
+    bool checkFrame(int frame) const;
+    // Calls run(row, firstColumn, lastColumn) for every run of flagged
+    // coarse pixels, at full resolution, in each row of the range; with
+    // `refresh`, rows being refreshed are one whole-width run.
+    template <typename Run>
+    void forEachRegionRun(int firstRow, int lastRow, bool refresh, Run run) const;
+    bool refreshesRow(int coarseRow) const;
+
+    BackgroundMode mode_;
+    double alpha_;
+    uint32_t alphaQ16_;
+    int frameCount_;
+    size_t planeSize_;
+    Frame background_;
+    // Running sums (mean, window) or averages scaled by 2^16 (EMA), one
+    // plane per channel.
+    std::vector<uint32_t> state_[3];
+    // Window mode: windowSize_ slots of three planes each; ringHead_ is the
+    // slot the next frame overwrites.
+    int windowSize_;
+    int ringHead_;
+    std::vector<uint8_t> ring_;
+    // Median: per channel and pixel (pixel-major), 16 coarse counts and the
+    // fine counts of the bins around the median's, 8-bit in windows of up
+    // to 255 frames and 16-bit otherwise; the median level, the samples
+    // below it and the samples held.
+    std::vector<uint8_t> counts_[3];
+    std::vector<uint8_t> median_[3];
+    std::vector<uint16_t> below_[3];
+    std::vector<uint16_t> samples_[3];
+    // Mixture: weight, variance and three mean planes per component, in one
+    // aligned block, and the mask produced while updating.
+    float* mixture_;
+    MixtureParams mixtureParams_;
+    uint8_t* mixtureMask_;
+    // Change skipping: whether each tile changed in the current frame, the
+    // samples each tile was last processed with and (except for the
+    // mixture, which keeps its own) the mask they gave. Mean and EMA: the
+    // frames each tile has skipped since, and the EMA weight of k of them.
+    ChangeSkipConfig skip_;
+    ChangeSkipStats skipStats_;
+    int framesSeen_;
+    int tilesAcross_;
+    size_t tileOffset_;
+    std::vector<uint8_t> tileChanged_;
+    std::vector<uint16_t> tilePending_;
+    std::vector<uint32_t> emaCatchUp_;
+    Frame reference_;
+    uint8_t* tileMask_;
+    // Pyramid: the coarse model and frame, the regions it flagged (and
+    // scratch to dilate them), and the full-resolution mask of checked
+    // frames. foregroundBits() thresholds into tileMask_ first, and leaves
+    // it zero. Mean and EMA accumulate refined pixels only; for the mean,
+    // the frames each coarse pixel was left out of. Stats are added to from
+    // several threads.
+    PyramidConfig pyramid_;
+    PyramidStats pyramidStats_;
+    bool dilateRegions_;
+    bool refinedOnly_;
+    int firstCoarseRow_;
+    std::vector<uint32_t> regionPending_;
+    std::unique_ptr<BackgroundModel> coarseModel_;
+    Frame coarseFrame_;
+    uint8_t* regions_;
+    uint8_t* regionScratch_;
+    uint8_t* checkMask_;
+    std::mutex statsMutex_;
+};
@@ -0,0 +1,48 @@
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+const char BENCH_CSV_HEADER[] = "backend,flow,background,isa,width,height,frames,threads,ranks,"
+    "repetition,compute_s,wall_s,compute_mpix_s,wall_mpix_s";
+
+double wallSeconds() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double megapixelsPerSecond(int width, int height, int frames, double seconds) {
+    return seconds > 0 ? (double)width * height * frames / seconds / 1e6 : 0.0;
+}
+
+double medianOf(vector<double> values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t middle = values.size() / 2;
+    nth_element(values.begin(), values.begin() + middle, values.end());
+    double upper = values[middle];
+    if (values.size() % 2) {
+        return upper;
+    }
+    return (upper + *max_element(values.begin(), values.begin() + middle)) / 2;
+}
+
+void appendBenchRecord(const string& path, const BenchRecord& record) {
+    ofstream out(path, ios::app);
+    if (!out) {
+        throw runtime_error("cannot open " + path);
+    }
+    if (out.tellp() == 0) {
+        out << BENCH_CSV_HEADER << '\n';
+    }
+    out << record.Backend << ',' << record.Flow << ',' << record.Background << ',' << record.Isa << ','
+        << record.Width << ',' << record.Height << ',' << record.Frames << ',' << record.Threads << ','
+        << record.Ranks << ',' << record.Repetition << ',' << record.ComputeSeconds << ','
+        << record.WallSeconds << ','
+        << megapixelsPerSecond(record.Width, record.Height, record.Frames, record.ComputeSeconds) << ','
+        << megapixelsPerSecond(record.Width, record.Height, record.Frames, record.WallSeconds) << '\n';
+}
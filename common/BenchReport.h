@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Wall-clock seconds from a monotonic clock; only differences are meaningful.
+double wallSeconds();
+
+// One measured repetition of a backend run. --report appends these as CSV
+// rows, so runs of every backend, size and thread/rank count land in one
+// table (bench/SuiteBench.cpp sweeps them). Compute time covers the model
+// update, masks and cleanup; wall time is the whole run, frame input and
+// output included.
+struct BenchRecord {
+    std::string Backend;
+    std::string Flow;
+    std::string Background;
+    std::string Isa;
+    int Width;
+    int Height;
+    int Frames;
+    int Threads;
+    int Ranks;
+    int Repetition;
+    double ComputeSeconds;
+    double WallSeconds;
+};
+
+// Column names, in the order appendBenchRecord() writes them.
+extern const char BENCH_CSV_HEADER[];
+
+// Frames * pixels / seconds, in millions.
+double megapixelsPerSecond(int width, int height, int frames, double seconds);
+// Median of repeated timings; 0 for none.
+double medianOf(std::vector<double> values);
+
+// Writes the header first when the file is new or empty. Throws
+// std::runtime_error if it cannot be opened.
+void appendBenchRecord(const std::string& path, const BenchRecord& record);
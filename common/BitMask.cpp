@@ -0,0 +1,103 @@
+#include "BitMask.h"
+
+#include <string.h>
+
+#include "Frame.h"
+#include "Kernels.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+static inline int popcount64(uint64_t x) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    return (int)__popcnt64(x);
+#elif defined(_MSC_VER)
+    return (int)(__popcnt((uint32_t)x) + __popcnt((uint32_t)(x >> 32)));
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+BitMask allocateBitMask(int width, int height) {
+    BitMask mask;
+    mask.Width = width;
+    mask.Height = height;
+    mask.WordsPerRow = alignedStride(width) / 64;
+    size_t bytes = bitMaskBytes(mask);
+    mask.Words = (uint64_t*)alignedAlloc(bytes);
+    memset(mask.Words, 0, bytes);
+    return mask;
+}
+
+void freeBitMask(BitMask& mask) {
+    alignedFree(mask.Words);
+    mask.Words = nullptr;
+}
+
+size_t bitMaskBytes(const BitMask& mask) {
+    return (size_t)mask.WordsPerRow * mask.Height * sizeof(uint64_t);
+}
+
+void packMaskRows(BitMask& bits, const uint8_t* mask, int firstRow, int lastRow) {
+    size_t stride = (size_t)bits.WordsPerRow * 64;
+    kernels().packMask(bitMaskRow(bits, firstRow), mask + firstRow * stride,
+        (size_t)(lastRow - firstRow) * stride);
+}
+
+void unpackMask(const BitMask& bits, uint8_t* mask) {
+    size_t stride = (size_t)bits.WordsPerRow * 64;
+    for (int i = 0; i < bits.Height; i++) {
+        const uint64_t* words = bitMaskRow(bits, i);
+        uint8_t* row = mask + i * stride;
+        // Masks are mostly empty or solid words; only mixed ones go bit by bit
+        for (int w = 0; w < bits.WordsPerRow; w++, row += 64) {
+            uint64_t word = words[w];
+            if (word == 0 || word == ~(uint64_t)0) {
+                memset(row, word ? 255 : 0, 64);
+                continue;
+            }
+            for (int j = 0; j < 64; j++) {
+                row[j] = (word >> j) & 1 ? 255 : 0;
+            }
+        }
+    }
+}
+
+size_t countForeground(const BitMask& mask) {
+    int fullWords = mask.Width / 64;
+    int tailBits = mask.Width % 64;
+    uint64_t tailMask = ((uint64_t)1 << tailBits) - 1;
+    size_t count = 0;
+    for (int i = 0; i < mask.Height; i++) {
+        const uint64_t* words = bitMaskRow(mask, i);
+        for (int w = 0; w < fullWords; w++) {
+            count += popcount64(words[w]);
+        }
+        if (tailBits) {
+            count += popcount64(words[fullWords] & tailMask);
+        }
+    }
+    return count;
+}
+
+double foregroundRatio(const BitMask& mask) {
+    size_t pixels = (size_t)mask.Width * mask.Height;
+    return pixels ? (double)countForeground(mask) / pixels : 0.0;
+}
+
+void andMasks(BitMask& dst, const BitMask& a, const BitMask& b) {
+    size_t n = (size_t)dst.WordsPerRow * dst.Height;
+    for (size_t i = 0; i < n; i++) {
+        dst.Words[i] = a.Words[i] & b.Words[i];
+    }
+}
+
+void orMasks(BitMask& dst, const BitMask& a, const BitMask& b) {
+    size_t n = (size_t)dst.WordsPerRow * dst.Height;
+    for (size_t i = 0; i < n; i++) {
+        dst.Words[i] = a.Words[i] | b.Words[i];
+    }
+}
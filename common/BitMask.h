@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Foreground mask at one bit per pixel, for masks that are kept, counted or
+// moved between ranks rather than cleaned or labelled (those work on byte
+// masks). Bit j of word w in a row is pixel 64 * w + j. A row holds
+// alignedStride(Width) / 64 words, so row r covers exactly the bytes of row
+// r of a frame or byte mask, padding included: thresholdBits and packMask
+// over a run of whole rows write whole rows of words.
+//
+// Padding bits are not guaranteed to be zero (a mixture mask can classify
+// padding); the counting functions ignore them.
+
+struct BitMask {
+    uint64_t* Words;
+    int Width;
+    int Height;
+    int WordsPerRow;
+};
+
+// Zeroed, 64-byte aligned.
+BitMask allocateBitMask(int width, int height);
+void freeBitMask(BitMask& mask);
+size_t bitMaskBytes(const BitMask& mask);
+
+inline uint64_t* bitMaskRow(const BitMask& mask, int row) {
+    return mask.Words + (size_t)row * mask.WordsPerRow;
+}
+
+// Rows [firstRow, lastRow) of a byte mask with the frame stride.
+void packMaskRows(BitMask& bits, const uint8_t* mask, int firstRow, int lastRow);
+// 0/255 bytes with the frame stride, for output.
+void unpackMask(const BitMask& bits, uint8_t* mask);
+
+// Foreground pixels (popcount) and their share of the image.
+size_t countForeground(const BitMask& mask);
+double foregroundRatio(const BitMask& mask);
+
+// dst = a & b, dst = a | b; all three the same size (dst may alias either).
+void andMasks(BitMask& dst, const BitMask& a, const BitMask& b);
+void orMasks(BitMask& dst, const BitMask& a, const BitMask& b);
@@ -0,0 +1,267 @@
+#include "Blobs.h"
+
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+
+#include "Trace.h"
+
+using namespace std;
+
+namespace {
+
+int findRoot(vector<int>& parent, int label) {
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+// The lower label stays the root, so roots keep first-seen order.
+void unite(vector<int>& parent, int a, int b) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a < b) {
+        parent[b] = a;
+    }
+    else if (b < a) {
+        parent[a] = b;
+    }
+}
+
+void addStats(BlobStats& into, const BlobStats& from) {
+    into.Area += from.Area;
+    into.SumX += from.SumX;
+    into.SumY += from.SumY;
+    into.Left = min(into.Left, from.Left);
+    into.Top = min(into.Top, from.Top);
+    into.Right = max(into.Right, from.Right);
+    into.Bottom = max(into.Bottom, from.Bottom);
+}
+
+// Unites every pair of runs, one from each row, that touch in 8-connectivity:
+// [s0, e0) and [s1, e1) touch when s0 <= e1 and s1 <= e0. Labels are offset
+// into the shared parent table.
+void uniteTouching(vector<int>& parent, const vector<BlobRun>& upper, int upperOffset,
+    const vector<BlobRun>& lower, int lowerOffset) {
+    size_t j = 0;
+    for (const BlobRun& run : lower) {
+        while (j < upper.size() && upper[j].End < run.Start) {
+            j++;
+        }
+        for (size_t k = j; k < upper.size() && upper[k].Start <= run.End; k++) {
+            unite(parent, upperOffset + upper[k].Label, lowerOffset + run.Label);
+        }
+    }
+}
+
+// Numbers the roots 0.. in label order, sums every label into its root and
+// maps the run labels to the component numbers.
+void compactLabels(vector<int>& parent, const vector<BlobStats>& stats, BlobBand& band,
+    vector<int>& component) {
+    int labels = parent.size();
+    component.assign(labels, -1);
+    band.Components.clear();
+    for (int label = 0; label < labels; label++) {
+        int root = findRoot(parent, label);
+        if (root == label) {
+            component[label] = band.Components.size();
+            band.Components.push_back(stats[label]);
+        }
+        else {
+            component[label] = component[root];
+            addStats(band.Components[component[label]], stats[label]);
+        }
+    }
+}
+
+}
+
+void labelBand(const uint8_t* mask, int width, int stride, int rows, int top, BlobBand& band) {
+    TRACE_SCOPE("label");
+    band.Top = top;
+    band.Rows = rows;
+    band.FirstRow.clear();
+    band.LastRow.clear();
+
+    vector<int> parent;
+    vector<BlobStats> stats;
+    vector<BlobRun> previous;
+    vector<BlobRun> current;
+    for (int r = 0; r < rows; r++) {
+        const uint8_t* row = mask + (size_t)r * stride;
+        int y = top + r;
+        current.clear();
+        int x = 0;
+        while (x < width) {
+            while (x < width && row[x] == 0) {
+                x++;
+            }
+            if (x == width) {
+                break;
+            }
+            int start = x;
+            while (x < width && row[x] != 0) {
+                x++;
+            }
+            current.push_back({ start, x, -1 });
+        }
+
+        // Runs of both rows are in order, so the candidates above each run
+        // start where the previous run's search left off.
+        size_t j = 0;
+        for (BlobRun& run : current) {
+            while (j < previous.size() && previous[j].End < run.Start) {
+                j++;
+            }
+            for (size_t k = j; k < previous.size() && previous[k].Start <= run.End; k++) {
+                if (run.Label < 0) {
+                    run.Label = previous[k].Label;
+                }
+                else {
+                    unite(parent, run.Label, previous[k].Label);
+                }
+            }
+            if (run.Label < 0) {
+                run.Label = parent.size();
+                parent.push_back(run.Label);
+                stats.push_back({ 0, 0, 0, run.Start, y, run.End - 1, y });
+            }
+
+            int64_t length = run.End - run.Start;
+            BlobStats& s = stats[run.Label];
+            s.Area += length;
+            s.SumX += length * (run.Start + run.End - 1) / 2;
+            s.SumY += length * y;
+            s.Left = min(s.Left, run.Start);
+            s.Top = min(s.Top, y);
+            s.Right = max(s.Right, run.End - 1);
+            s.Bottom = max(s.Bottom, y);
+        }
+
+        if (r == 0) {
+            band.FirstRow = current;
+        }
+        swap(previous, current);
+    }
+    if (rows > 0) {
+        band.LastRow = previous;
+    }
+
+    vector<int> component;
+    compactLabels(parent, stats, band, component);
+    for (BlobRun& run : band.FirstRow) {
+        run.Label = component[run.Label];
+    }
+    for (BlobRun& run : band.LastRow) {
+        run.Label = component[run.Label];
+    }
+}
+
+BlobBand mergeBands(const vector<BlobBand>& bands) {
+    BlobBand merged = {};
+    vector<int> parent;
+    vector<BlobStats> stats;
+    const BlobBand* above = nullptr;
+    int aboveOffset = 0;
+    const BlobBand* first = nullptr;
+    for (const BlobBand& band : bands) {
+        if (band.Rows == 0) {
+            continue;
+        }
+        int offset = stats.size();
+        for (size_t c = 0; c < band.Components.size(); c++) {
+            parent.push_back(offset + c);
+        }
+        stats.insert(stats.end(), band.Components.begin(), band.Components.end());
+        if (above) {
+            uniteTouching(parent, above->LastRow, aboveOffset, band.FirstRow, offset);
+        }
+        else {
+            first = &band;
+            merged.Top = band.Top;
+        }
+        merged.Rows += band.Rows;
+        above = &band;
+        aboveOffset = offset;
+    }
+    if (!first) {
+        return merged;
+    }
+
+    vector<int> component;
+    compactLabels(parent, stats, merged, component);
+    merged.FirstRow = first->FirstRow;
+    for (BlobRun& run : merged.FirstRow) {
+        run.Label = component[run.Label];
+    }
+    merged.LastRow = above->LastRow;
+    for (BlobRun& run : merged.LastRow) {
+        run.Label = component[aboveOffset + run.Label];
+    }
+    return merged;
+}
+
+vector<Blob> blobList(const BlobBand& band, int minArea) {
+    vector<Blob> blobs;
+    for (const BlobStats& s : band.Components) {
+        if (s.Area < minArea) {
+            continue;
+        }
+        Blob blob;
+        blob.Area = (int)s.Area;
+        blob.Left = s.Left;
+        blob.Top = s.Top;
+        blob.Right = s.Right;
+        blob.Bottom = s.Bottom;
+        blob.CentroidX = (double)s.SumX / s.Area;
+        blob.CentroidY = (double)s.SumY / s.Area;
+        blobs.push_back(blob);
+    }
+    // Component numbering depends on how the mask was split; this order
+    // does not.
+    sort(blobs.begin(), blobs.end(), [](const Blob& a, const Blob& b) {
+        if (a.Top != b.Top) return a.Top < b.Top;
+        if (a.Left != b.Left) return a.Left < b.Left;
+        if (a.Bottom != b.Bottom) return a.Bottom < b.Bottom;
+        if (a.Right != b.Right) return a.Right < b.Right;
+        if (a.Area != b.Area) return a.Area < b.Area;
+        if (a.CentroidY != b.CentroidY) return a.CentroidY < b.CentroidY;
+        return a.CentroidX < b.CentroidX;
+    });
+    return blobs;
+}
+
+vector<Blob> findBlobs(const uint8_t* mask, int width, int height, int stride, int minArea) {
+    BlobBand band;
+    labelBand(mask, width, stride, height, 0, band);
+    return blobList(band, minArea);
+}
+
+void writeBlobHeader(ostream& out) {
+    out << "frame,blob,area,left,top,right,bottom,centroid_x,centroid_y\n";
+}
+
+void writeBlobs(ostream& out, size_t frameIndex, const vector<Blob>& blobs) {
+    for (size_t b = 0; b < blobs.size(); b++) {
+        const Blob& blob = blobs[b];
+        out << frameIndex + 1 << ',' << b << ',' << blob.Area << ',' << blob.Left << ','
+            << blob.Top << ',' << blob.Right << ',' << blob.Bottom << ',' << blob.CentroidX << ','
+            << blob.CentroidY << '\n';
+    }
+}
+
+BlobLog::BlobLog(const string& path, int minArea)
+    : out_(path), minArea_(minArea), frames_(0), blobs_(0) {
+    if (!out_) {
+        throw runtime_error("cannot open " + path);
+    }
+    writeBlobHeader(out_);
+}
+
+void BlobLog::write(size_t frameIndex, const vector<Blob>& blobs) {
+    writeBlobs(out_, frameIndex, blobs);
+    frames_++;
+    blobs_ += blobs.size();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Connected components (8-connected) of 0/255 byte masks, reduced straight
+// to a blob list: area, bounding box and centroid per moving object, with
+// no label image. Rows are scanned as runs of foreground pixels; a run joins
+// every run it touches on the row above through union-find over provisional
+// labels, and per-label sums are folded into their roots at the end.
+//
+// Work splits into bands of whole rows: labelBand() runs independently per
+// band (one per thread or per MPI rank), and mergeBands() joins adjacent
+// bands by uniting the components whose runs touch across each shared
+// border, so only border rows and component sums cross threads or ranks.
+
+// Foreground pixels [Start, End) of one row, in component Label.
+struct BlobRun {
+    int Start;
+    int End;
+    int Label;
+};
+
+// Sums for one component; coordinates are absolute image rows/columns.
+struct BlobStats {
+    int64_t Area;
+    int64_t SumX;
+    int64_t SumY;
+    int Left;
+    int Top;
+    int Right;
+    int Bottom;
+};
+
+// Components of rows [Top, Top + Rows), plus the runs on its first and last
+// row that mergeBands() needs to join it to its neighbours.
+struct BlobBand {
+    int Top;
+    int Rows;
+    std::vector<BlobStats> Components;
+    std::vector<BlobRun> FirstRow;
+    std::vector<BlobRun> LastRow;
+};
+
+// Inclusive bounding box and centroid of one blob.
+struct Blob {
+    int Area;
+    int Left;
+    int Top;
+    int Right;
+    int Bottom;
+    double CentroidX;
+    double CentroidY;
+};
+
+// Labels `rows` rows of a mask starting at `mask`, which is image row `top`.
+void labelBand(const uint8_t* mask, int width, int stride, int rows, int top, BlobBand& band);
+
+// One band from consecutive bands, top to bottom; empty bands are skipped.
+BlobBand mergeBands(const std::vector<BlobBand>& bands);
+
+// Components of at least minArea pixels, ordered by top row, then left.
+std::vector<Blob> blobList(const BlobBand& band, int minArea);
+
+// Whole mask as a single band.
+std::vector<Blob> findBlobs(const uint8_t* mask, int width, int height, int stride, int minArea);
+
+// CSV rows "frame,blob,area,left,top,right,bottom,centroid_x,centroid_y",
+// frames numbered from 1 as in the mask file names.
+void writeBlobHeader(std::ostream& out);
+void writeBlobs(std::ostream& out, size_t frameIndex, const std::vector<Blob>& blobs);
+
+// Per-frame blob lists for one run, written as they arrive.
+class BlobLog {
+public:
+    BlobLog(const std::string& path, int minArea);
+
+    int minArea() const { return minArea_; }
+    void write(size_t frameIndex, const std::vector<Blob>& blobs);
+    size_t frames() const { return frames_; }
+    size_t blobs() const { return blobs_; }
+
+private:
+    std::ofstream out_;
+    int minArea_;
+    size_t frames_;
+    size_t blobs_;
+};
@@ -0,0 +1,54 @@
+#include "ForegroundMasks.h"
+
+#include <algorithm>
+
+#include "Kernels.h"
+#include "Trace.h"
+
+using namespace std;
+
+static const int MASK_TILE_BYTES = 16 * 1024;
+
+int maskTileRows(int stride) {
+    return max(1, MASK_TILE_BYTES / stride);
+}
+
+void foregroundMasks(const Frame& background, const Frame* frames, int numFrames,
+    uint8_t* const* masks, int threshold, int firstRow, int lastRow) {
+    TRACE_SCOPE("mask");
+    requirePlanar(background, "foregroundMasks");
+    for (int f = 0; f < numFrames; f++) {
+        requirePlanar(frames[f], "foregroundMasks");
+    }
+    int stride = background.Stride;
+    int tileRows = maskTileRows(stride);
+    uint8_t* gray = (uint8_t*)alignedAlloc((size_t)tileRows * stride);
+
+    for (int t = firstRow; t < lastRow; t += tileRows) {
+        int rows = min(tileRows, lastRow - t);
+        size_t offset = (size_t)t * stride;
+        size_t n = (size_t)rows * stride;
+        kernels().grayPlane(gray, background.Red + offset, background.Green + offset,
+            background.Blue + offset, n);
+
+        for (int f = 0; f < numFrames; f++) {
+            const Frame& frame = frames[f];
+            if (frame.Stride == stride) {
+                kernels().grayMask(masks[f] + offset, gray, frame.Red + offset,
+                    frame.Green + offset, frame.Blue + offset, n, threshold);
+                continue;
+            }
+            for (int i = 0; i < rows; i++) {
+                size_t src = (size_t)(t + i) * frame.Stride;
+                kernels().grayMask(masks[f] + offset + (size_t)i * stride, gray + (size_t)i * stride,
+                    frame.Red + src, frame.Green + src, frame.Blue + src, background.Width, threshold);
+            }
+        }
+    }
+    alignedFree(gray);
+}
+
+void foregroundMasks(const Frame& background, const Frame* frames, int numFrames,
+    uint8_t* const* masks, int threshold) {
+    foregroundMasks(background, frames, numFrames, masks, threshold, 0, background.Height);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Frame.h"
+
+// Foreground masks for a run of frames against one background. The background
+// is reduced to gray one tile of rows at a time and each tile is reused for
+// every frame, so its planes are read once per call rather than once per
+// frame. Masks use the background's stride, like allocateMask. All frames must
+// be planar.
+
+// Rows per tile so one tile's gray background stays in L1.
+int maskTileRows(int stride);
+
+// masks[f] receives the mask of frames[f], rows [firstRow, lastRow) only.
+void foregroundMasks(const Frame& background, const Frame* frames, int numFrames,
+    uint8_t* const* masks, int threshold, int firstRow, int lastRow);
+
+void foregroundMasks(const Frame& background, const Frame* frames, int numFrames,
+    uint8_t* const* masks, int threshold);
@@ -0,0 +1,99 @@
+#include "Frame.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+void* alignedAlloc(size_t bytes) {
+    void* ptr = nullptr;
+#ifdef _WIN32
+    ptr = _aligned_malloc(bytes, FRAME_ALIGNMENT);
+#else
+    if (posix_memalign(&ptr, FRAME_ALIGNMENT, bytes) != 0) {
+        ptr = nullptr;
+    }
+#endif
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void alignedFree(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+int alignedStride(int rowBytes) {
+    return (rowBytes + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT * FRAME_ALIGNMENT;
+}
+
+Frame frameView(uint8_t* buffer, int width, int height, FrameLayout layout) {
+    Frame frame;
+    frame.Data = nullptr;
+    frame.Width = width;
+    frame.Height = height;
+    frame.Layout = layout;
+
+    if (layout == FRAME_INTERLEAVED) {
+        frame.Stride = alignedStride(width * 3);
+        frame.PixelStep = 3;
+        frame.Red = buffer;
+        frame.Green = buffer + 1;
+        frame.Blue = buffer + 2;
+    }
+    else {
+        frame.Stride = alignedStride(width);
+        frame.PixelStep = 1;
+        size_t planeBytes = (size_t)frame.Stride * height;
+        frame.Red = buffer;
+        frame.Green = buffer + planeBytes;
+        frame.Blue = buffer + 2 * planeBytes;
+    }
+    return frame;
+}
+
+Frame allocateFrameUntouched(int width, int height, FrameLayout layout) {
+    Frame shape = frameView(nullptr, width, height, layout);
+    Frame frame = frameView((uint8_t*)alignedAlloc(frameBytes(shape)), width, height, layout);
+    frame.Data = frame.Red;
+    return frame;
+}
+
+Frame allocateFrame(int width, int height, FrameLayout layout) {
+    Frame frame = allocateFrameUntouched(width, height, layout);
+    memset(frame.Data, 0, frameBytes(frame));
+    return frame;
+}
+
+void requirePlanar(const Frame& frame, const char* user) {
+    if (frame.Layout != FRAME_PLANAR) {
+        throw std::invalid_argument(std::string(user) + " needs planar frames");
+    }
+}
+
+void freeFrame(Frame& frame) {
+    alignedFree(frame.Data);
+    frame.Data = frame.Red = frame.Green = frame.Blue = nullptr;
+}
+
+size_t frameBytes(const Frame& frame) {
+    size_t bytes = (size_t)frame.Stride * frame.Height;
+    return frame.Layout == FRAME_PLANAR ? bytes * 3 : bytes;
+}
+
+uint8_t* allocateMask(int width, int height) {
+    size_t bytes = (size_t)alignedStride(width) * height;
+    uint8_t* mask = (uint8_t*)alignedAlloc(bytes);
+    memset(mask, 0, bytes);
+    return mask;
+}
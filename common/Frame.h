@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact 8-bit frame shared by all backends. One 64-byte-aligned allocation
+// holds either three planes (R, G, B) or a single interleaved RGB24 buffer.
+// Every row starts on a 64-byte boundary; Stride is the row pitch in bytes.
+//
+// Channel c of pixel (i, j) is Red/Green/Blue[i * Stride + j * PixelStep],
+// which works for both layouts. Padding bytes at the end of each row are
+// zeroed, so kernels may run over Stride * Height elements of a plane.
+
+const int FRAME_ALIGNMENT = 64;
+
+enum FrameLayout {
+    FRAME_PLANAR,
+    FRAME_INTERLEAVED
+};
+
+struct Frame {
+    uint8_t* Data;
+    uint8_t* Red;
+    uint8_t* Green;
+    uint8_t* Blue;
+    int Width;
+    int Height;
+    int Stride;
+    int PixelStep;
+    FrameLayout Layout;
+};
+
+// 0 = red, 1 = green, 2 = blue
+inline uint8_t* channelPlane(const Frame& frame, int channel) {
+    return channel == 0 ? frame.Red : channel == 1 ? frame.Green : frame.Blue;
+}
+
+void* alignedAlloc(size_t bytes);
+void alignedFree(void* ptr);
+
+int alignedStride(int rowBytes);
+
+Frame allocateFrame(int width, int height, FrameLayout layout = FRAME_PLANAR);
+// The allocateFrame() layout over a caller's buffer of at least
+// frameBytes() bytes, which must be 64-byte aligned. Data is null: the frame
+// does not own the buffer, and freeFrame() on it is a no-op.
+Frame frameView(uint8_t* buffer, int width, int height, FrameLayout layout = FRAME_PLANAR);
+// Same layout, but the buffer is left unwritten so each page lands on the
+// NUMA node of the thread that first writes it. The caller must write every
+// byte, padding included.
+Frame allocateFrameUntouched(int width, int height, FrameLayout layout = FRAME_PLANAR);
+void freeFrame(Frame& frame);
+
+// The models, mask builders and SIMD kernels walk whole planes with unit
+// pixel step; interleaved frames are only for decoding and output. Throws
+// invalid_argument naming `user` if the frame is not planar.
+void requirePlanar(const Frame& frame, const char* user);
+
+// Bytes held by the frame's buffer, padding included.
+size_t frameBytes(const Frame& frame);
+
+// Zero-initialised 8-bit mask with the same row pitch as a planar frame.
+uint8_t* allocateMask(int width, int height);
@@ -0,0 +1,340 @@
+#include "FrameCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "ImageIO.h"
+
+using namespace std;
+
+static const char FRAME_CACHE_MAGIC[8] = { 'B', 'G', 'S', 'F', 'R', 'A', 'M', 'E' };
+static const char FRAME_CACHE_PREFIX[] = "framecache:";
+
+namespace {
+
+uint64_t roundUp(uint64_t bytes, uint64_t multiple) {
+    return (bytes + multiple - 1) / multiple * multiple;
+}
+
+void sourceStamp(const string& path, int64_t* size, int64_t* time) {
+#ifdef _WIN32
+    struct _stat64 st;
+    bool found = _stat64(path.c_str(), &st) == 0;
+#else
+    struct stat st;
+    bool found = stat(path.c_str(), &st) == 0;
+#endif
+    *size = found ? (int64_t)st.st_size : -1;
+    *time = found ? (int64_t)st.st_mtime : -1;
+}
+
+// Offsets passed to mmap/MapViewOfFile must be multiples of this
+size_t mapGranularity() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+bool readHeader(FILE* file, FrameCacheHeader& header, vector<FrameCacheEntry>& entries) {
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.Magic, FRAME_CACHE_MAGIC, 8) != 0
+        || header.Version != FRAME_CACHE_VERSION || header.Frames < 0) {
+        return false;
+    }
+    entries.resize(header.Frames);
+    return header.Frames == 0 || fread(entries.data(), sizeof(FrameCacheEntry), entries.size(), file) == entries.size();
+}
+
+struct FileCloser {
+    void operator()(FILE* file) const {
+        fclose(file);
+    }
+};
+typedef unique_ptr<FILE, FileCloser> FilePtr;
+
+}
+
+void buildFrameCache(const string& path, const vector<string>& imagePaths) {
+    if (imagePaths.empty()) {
+        throw runtime_error("no frames to cache in " + path);
+    }
+    string temporary = path + ".tmp";
+    FilePtr file(fopen(temporary.c_str(), "wb"));
+    if (!file) {
+        throw runtime_error("cannot create " + temporary);
+    }
+
+    FrameCacheHeader header = {};
+    vector<FrameCacheEntry> entries(imagePaths.size());
+    vector<uint8_t> zeros;
+    for (size_t f = 0; f < imagePaths.size(); f++) {
+        int width, height;
+        Frame frame = inputColorImage(&width, &height, imagePaths[f]);
+        if (f == 0) {
+            memcpy(header.Magic, FRAME_CACHE_MAGIC, 8);
+            header.Version = FRAME_CACHE_VERSION;
+            header.Width = width;
+            header.Height = height;
+            header.Stride = frame.Stride;
+            header.Frames = imagePaths.size();
+            header.PlanePitch = roundUp((uint64_t)frame.Stride * height + FRAME_CACHE_SLACK, FRAME_CACHE_PAGE);
+            header.DataOffset = roundUp(sizeof(header) + entries.size() * sizeof(FrameCacheEntry),
+                FRAME_CACHE_PAGE);
+            zeros.assign(max<uint64_t>(header.DataOffset, header.PlanePitch), 0);
+            // Header and index are written last, once the frames are in
+            fwrite(zeros.data(), 1, header.DataOffset, file.get());
+        }
+        if (width != header.Width || height != header.Height) {
+            freeFrame(frame);
+            throw runtime_error(imagePaths[f] + " is not the size of the first frame");
+        }
+
+        FrameCacheEntry& entry = entries[f];
+        entry.Offset = header.DataOffset + f * 3 * header.PlanePitch;
+        sourceStamp(imagePaths[f], &entry.SourceSize, &entry.SourceTime);
+        if (imagePaths[f].size() >= sizeof(entry.Source)) {
+            freeFrame(frame);
+            throw runtime_error("path too long for the frame cache index: " + imagePaths[f]);
+        }
+        strcpy(entry.Source, imagePaths[f].c_str());
+
+        size_t planeBytes = (size_t)frame.Stride * height;
+        for (int c = 0; c < 3; c++) {
+            fwrite(channelPlane(frame, c), 1, planeBytes, file.get());
+            fwrite(zeros.data(), 1, header.PlanePitch - planeBytes, file.get());
+        }
+        freeFrame(frame);
+    }
+
+    fseek(file.get(), 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file.get());
+    fwrite(entries.data(), sizeof(FrameCacheEntry), entries.size(), file.get());
+    bool failed = ferror(file.get()) != 0;
+    file.reset();
+    if (failed) {
+        remove(temporary.c_str());
+        throw runtime_error("failed to write " + temporary);
+    }
+    // rename() does not replace an existing file on Windows
+    remove(path.c_str());
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        throw runtime_error("cannot rename " + temporary + " to " + path);
+    }
+}
+
+bool frameCacheMatches(const string& path, const vector<string>& imagePaths) {
+    FilePtr file(fopen(path.c_str(), "rb"));
+    FrameCacheHeader header;
+    vector<FrameCacheEntry> entries;
+    if (!file || !readHeader(file.get(), header, entries) || entries.size() != imagePaths.size()) {
+        return false;
+    }
+    for (size_t f = 0; f < entries.size(); f++) {
+        int64_t size, time;
+        sourceStamp(imagePaths[f], &size, &time);
+        if (imagePaths[f] != entries[f].Source || size != entries[f].SourceSize || time != entries[f].SourceTime) {
+            return false;
+        }
+    }
+    // A build cut short leaves a .tmp file, not a short cache, but check anyway
+    int64_t size, time;
+    sourceStamp(path, &size, &time);
+    return size >= (int64_t)(header.DataOffset + entries.size() * 3 * header.PlanePitch);
+}
+
+string frameCachePath(const string& file, int index) {
+    return FRAME_CACHE_PREFIX + file + ":" + to_string(index);
+}
+
+vector<string> frameCachePaths(const string& file, int numFrames) {
+    vector<string> paths;
+    for (int i = 0; i < numFrames; i++) {
+        paths.push_back(frameCachePath(file, i));
+    }
+    return paths;
+}
+
+bool parseFrameCachePath(const string& path, string* file, int* index) {
+    size_t prefix = strlen(FRAME_CACHE_PREFIX);
+    size_t colon = path.rfind(':');
+    if (path.compare(0, prefix, FRAME_CACHE_PREFIX) != 0 || colon == string::npos || colon <= prefix) {
+        return false;
+    }
+    *file = path.substr(prefix, colon - prefix);
+    return sscanf(path.c_str() + colon + 1, "%d", index) == 1 && *index >= 0;
+}
+
+FrameCache::FrameCache(const string& path, int first, int last)
+    : first_(first), last_(last), frames_(nullptr), view_(nullptr), viewBytes_(0) {
+    vector<FrameCacheEntry> entries;
+    {
+        FilePtr file(fopen(path.c_str(), "rb"));
+        if (!file || !readHeader(file.get(), header_, entries)) {
+            throw runtime_error(path + " is not a frame cache");
+        }
+    }
+    if (last_ < 0) {
+        last_ = header_.Frames;
+    }
+    if (first_ < 0 || first_ >= last_ || last_ > header_.Frames) {
+        throw runtime_error("frames [" + to_string(first) + ", " + to_string(last) + ") are not in " + path);
+    }
+
+    uint64_t frameBytes = 3 * header_.PlanePitch;
+    uint64_t start = header_.DataOffset + first_ * frameBytes;
+    uint64_t mapStart = start / mapGranularity() * mapGranularity();
+    viewBytes_ = (size_t)(start - mapStart + (last_ - first_) * frameBytes);
+
+#ifdef _WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    section_ = file_ == INVALID_HANDLE_VALUE ? nullptr
+        : CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (section_) {
+        view_ = MapViewOfFile(section_, FILE_MAP_READ, (DWORD)(mapStart >> 32), (DWORD)mapStart, viewBytes_);
+    }
+    if (!view_) {
+        if (section_) {
+            CloseHandle(section_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+        throw runtime_error("cannot map " + path);
+    }
+#else
+    fd_ = open(path.c_str(), O_RDONLY);
+    void* view = fd_ < 0 ? MAP_FAILED : mmap(nullptr, viewBytes_, PROT_READ, MAP_SHARED, fd_, (off_t)mapStart);
+    if (view == MAP_FAILED) {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+        throw runtime_error("cannot map " + path);
+    }
+    view_ = view;
+#endif
+    frames_ = (uint8_t*)view_ + (start - mapStart);
+}
+
+FrameCache::~FrameCache() {
+#ifdef _WIN32
+    UnmapViewOfFile(view_);
+    CloseHandle(section_);
+    CloseHandle(file_);
+#else
+    munmap(view_, viewBytes_);
+    close(fd_);
+#endif
+}
+
+Frame FrameCache::frame(int index) const {
+    if (!holds(index)) {
+        throw runtime_error("frame " + to_string(index) + " is not mapped");
+    }
+    Frame frame;
+    frame.Data = nullptr;
+    frame.Red = frames_ + (size_t)(index - first_) * 3 * header_.PlanePitch;
+    frame.Green = frame.Red + header_.PlanePitch;
+    frame.Blue = frame.Green + header_.PlanePitch;
+    frame.Width = header_.Width;
+    frame.Height = header_.Height;
+    frame.Stride = header_.Stride;
+    frame.PixelStep = 1;
+    frame.Layout = FRAME_PLANAR;
+    return frame;
+}
+
+void FrameCache::prefetch(int index, size_t offset, size_t count) const {
+    Frame view = frame(index);
+    size_t page = mapGranularity();
+    for (int c = 0; c < 3; c++) {
+        uintptr_t begin = (uintptr_t)(channelPlane(view, c) + offset) / page * page;
+        uintptr_t end = (uintptr_t)(channelPlane(view, c) + offset + count);
+#ifdef _WIN32
+        WIN32_MEMORY_RANGE_ENTRY range = { (void*)begin, end - begin };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+        madvise((void*)begin, end - begin, MADV_WILLNEED);
+#endif
+    }
+}
+
+namespace {
+
+struct MappedFile {
+    string File;
+    unique_ptr<FrameCache> Cache;
+};
+
+mutex mappingsMutex;
+vector<MappedFile> mappings;
+
+// last < 0 asks for every frame from `first` on
+const FrameCache* findMapping(const string& file, int first, int last) {
+    for (const auto& mapping : mappings) {
+        const FrameCache& cache = *mapping.Cache;
+        if (mapping.File == file && cache.holds(first)
+            && (last < 0 ? cache.last() == cache.frames() : cache.holds(last - 1))) {
+            return mapping.Cache.get();
+        }
+    }
+    return nullptr;
+}
+
+}
+
+const FrameCache& mapFrameCache(const string& file, int first, int last) {
+    lock_guard<mutex> lock(mappingsMutex);
+    const FrameCache* found = findMapping(file, first, last);
+    if (found) {
+        return *found;
+    }
+    mappings.push_back({ file, unique_ptr<FrameCache>(new FrameCache(file, first, last)) });
+    return *mappings.back().Cache;
+}
+
+void mapCachedFrames(const vector<string>& paths, int first, int last) {
+    string file;
+    int firstIndex, lastIndex;
+    if (first < last && parseFrameCachePath(paths[first], &file, &firstIndex)
+        && parseFrameCachePath(paths[last - 1], &file, &lastIndex) && lastIndex - firstIndex == last - 1 - first) {
+        mapFrameCache(file, firstIndex, lastIndex + 1);
+    }
+}
+
+Frame loadFrame(int* w, int* h, const string& path) {
+    string file;
+    int index;
+    if (!parseFrameCachePath(path, &file, &index)) {
+        return inputColorImage(w, h, path);
+    }
+    const FrameCache* cache;
+    {
+        lock_guard<mutex> lock(mappingsMutex);
+        cache = findMapping(file, index, index + 1);
+    }
+    if (!cache) {
+        cache = &mapFrameCache(file);
+    }
+    *w = cache->width();
+    *h = cache->height();
+    return cache->frame(index);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Frame.h"
+
+// Decoded-frame cache: the input frames decoded once into a raw file that
+// later runs map read-only instead of decoding the PNGs again.
+//
+// File layout: a FrameCacheHeader, the index (one FrameCacheEntry per
+// frame), then the frames from the first FRAME_CACHE_PAGE boundary after
+// the index. A frame is three planes (R, G, B) with the stride and zeroed
+// row padding of allocateFrame(). Every plane starts on a page boundary and
+// is followed by at least FRAME_CACHE_SLACK zero bytes, so a mapped plane
+// may be read a little past its end (SIMD tails, MPI slice rows) without
+// leaving the mapping.
+//
+// Frames are addressed by pseudo-paths "framecache:FILE:index".
+// inputColorImage() copies them out; loadFrame() returns a view into the
+// mapping, so reading a frame costs only the page faults of the bytes that
+// are actually touched.
+
+const int FRAME_CACHE_VERSION = 1;
+const int FRAME_CACHE_PAGE = 4096;
+const int FRAME_CACHE_SLACK = 4096;
+
+struct FrameCacheHeader {
+    char Magic[8];
+    uint32_t Version;
+    int32_t Width;
+    int32_t Height;
+    int32_t Stride;
+    int32_t Frames;
+    uint32_t Reserved;
+    // Bytes from one plane to the next; a frame is three of these
+    uint64_t PlanePitch;
+    uint64_t DataOffset;
+};
+
+// Where a frame came from, to tell when the cache is stale. Sources that
+// are not files (synthetic frames) have size and time -1.
+struct FrameCacheEntry {
+    uint64_t Offset;
+    int64_t SourceSize;
+    int64_t SourceTime;
+    char Source[232];
+};
+
+// Decodes `imagePaths` (all the same size) into a cache at `path`, written
+// to path + ".tmp" and then renamed. Throws std::runtime_error.
+void buildFrameCache(const std::string& path, const std::vector<std::string>& imagePaths);
+// True if `path` is a cache of exactly these inputs, in this order, and none
+// of them changed since (size and modification time).
+bool frameCacheMatches(const std::string& path, const std::vector<std::string>& imagePaths);
+
+std::string frameCachePath(const std::string& file, int index);
+std::vector<std::string> frameCachePaths(const std::string& file, int numFrames);
+bool parseFrameCachePath(const std::string& path, std::string* file, int* index);
+
+// Read-only mapping of frames [first, last) of a cache file (all of them
+// when last < 0); the rest of the file is not mapped. Throws
+// std::runtime_error.
+class FrameCache {
+public:
+    explicit FrameCache(const std::string& path, int first = 0, int last = -1);
+    ~FrameCache();
+
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    int width() const { return header_.Width; }
+    int height() const { return header_.Height; }
+    int stride() const { return header_.Stride; }
+    // In the file; only [first(), last()) are mapped
+    int frames() const { return header_.Frames; }
+    int first() const { return first_; }
+    int last() const { return last_; }
+    bool holds(int index) const { return index >= first_ && index < last_; }
+
+    // View of a mapped frame, valid while the cache is open. Data is null,
+    // so freeFrame() on it is a no-op.
+    Frame frame(int index) const;
+    // Asks the OS to read ahead bytes [offset, offset + count) of each plane
+    // of a mapped frame, e.g. the pixel range an MPI rank owns.
+    void prefetch(int index, size_t offset, size_t count) const;
+
+private:
+    FrameCacheHeader header_;
+    int first_;
+    int last_;
+    uint8_t* frames_;
+    void* view_;
+    size_t viewBytes_;
+#ifdef _WIN32
+    void* file_;
+    void* section_;
+#else
+    int fd_;
+#endif
+};
+
+// Process-wide mapping of frames [first, last) of `file`, or an existing
+// one that holds them. Mappings stay open until exit, so views taken from
+// them stay valid. Thread-safe.
+const FrameCache& mapFrameCache(const std::string& file, int first = 0, int last = -1);
+// Maps just the frames of paths[first, last) when they are cache paths of
+// one file in frame order (as from frameCachePaths()); otherwise does nothing.
+void mapCachedFrames(const std::vector<std::string>& paths, int first, int last);
+
+// inputColorImage() for planar frames, except that a cache path gives a
+// view of the mapped frame instead of a copy (see mapFrameCache(); the
+// whole file is mapped unless a mapping already holds the frame).
+Frame loadFrame(int* w, int* h, const std::string& path);
@@ -0,0 +1,128 @@
+#include "FramePool.h"
+
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+// Frames and masks never share buffers: a mask's padding need not be zero.
+// Nor do frames of different shapes with the same byte count, whose row
+// padding falls in different places.
+enum PoolKind {
+    POOL_FRAME,
+    POOL_MASK
+};
+
+PoolBuffer::PoolBuffer() : pool_(nullptr), shape_(), buffer_(nullptr), bytes_(0), frame_() {}
+
+PoolBuffer::PoolBuffer(const Frame& view)
+    : pool_(nullptr), shape_(), buffer_(nullptr), bytes_(0), frame_(view) {
+    frame_.Data = nullptr;
+}
+
+PoolBuffer::PoolBuffer(PoolBuffer&& other)
+    : pool_(other.pool_), shape_(other.shape_), buffer_(other.buffer_), bytes_(other.bytes_), frame_(other.frame_) {
+    other.pool_ = nullptr;
+    other.buffer_ = nullptr;
+    other.bytes_ = 0;
+    other.frame_ = Frame();
+}
+
+PoolBuffer& PoolBuffer::operator=(PoolBuffer&& other) {
+    if (this != &other) {
+        reset();
+        swap(pool_, other.pool_);
+        swap(shape_, other.shape_);
+        swap(buffer_, other.buffer_);
+        swap(bytes_, other.bytes_);
+        swap(frame_, other.frame_);
+    }
+    return *this;
+}
+
+PoolBuffer::~PoolBuffer() {
+    reset();
+}
+
+void PoolBuffer::reset() {
+    if (pool_ && buffer_) {
+        pool_->give(shape_, buffer_, bytes_);
+    }
+    pool_ = nullptr;
+    buffer_ = nullptr;
+    bytes_ = 0;
+    frame_ = Frame();
+}
+
+FramePool::FramePool() : stats_() {}
+
+FramePool::~FramePool() {
+    for (auto& sized : idle_) {
+        for (uint8_t* buffer : sized.second) {
+            alignedFree(buffer);
+        }
+    }
+}
+
+uint8_t* FramePool::take(const PoolShape& shape, size_t bytes) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stats_.InUseBytes += bytes;
+        stats_.PeakInUseBytes = max(stats_.PeakInUseBytes, stats_.InUseBytes);
+        vector<uint8_t*>& idle = idle_[shape];
+        if (!idle.empty()) {
+            uint8_t* buffer = idle.back();
+            idle.pop_back();
+            stats_.Reuses++;
+            return buffer;
+        }
+        stats_.HeldBytes += bytes;
+        stats_.Allocations++;
+    }
+    // Zeroed outside the lock; this also faults the pages in
+    uint8_t* buffer = (uint8_t*)alignedAlloc(bytes);
+    memset(buffer, 0, bytes);
+    return buffer;
+}
+
+void FramePool::give(const PoolShape& shape, uint8_t* buffer, size_t bytes) {
+    lock_guard<mutex> lock(mutex_);
+    stats_.InUseBytes -= bytes;
+    idle_[shape].push_back(buffer);
+}
+
+PoolBuffer FramePool::acquireFrame(int width, int height, FrameLayout layout) {
+    PoolBuffer handle;
+    handle.shape_ = PoolShape(POOL_FRAME, width, height, layout);
+    handle.bytes_ = frameBytes(frameView(nullptr, width, height, layout));
+    handle.buffer_ = take(handle.shape_, handle.bytes_);
+    handle.pool_ = this;
+    handle.frame_ = frameView(handle.buffer_, width, height, layout);
+    return handle;
+}
+
+PoolBuffer FramePool::acquireMask(int width, int height) {
+    PoolBuffer handle;
+    handle.shape_ = PoolShape(POOL_MASK, width, height, FRAME_PLANAR);
+    handle.bytes_ = (size_t)alignedStride(width) * height;
+    handle.buffer_ = take(handle.shape_, handle.bytes_);
+    handle.pool_ = this;
+    return handle;
+}
+
+void FramePool::reserveFrames(int count, int width, int height, FrameLayout layout) {
+    size_t bytes = frameBytes(frameView(nullptr, width, height, layout));
+    for (int i = 0; i < count; i++) {
+        uint8_t* buffer = (uint8_t*)alignedAlloc(bytes);
+        memset(buffer, 0, bytes);
+        lock_guard<mutex> lock(mutex_);
+        idle_[PoolShape(POOL_FRAME, width, height, layout)].push_back(buffer);
+        stats_.HeldBytes += bytes;
+        stats_.Allocations++;
+    }
+}
+
+FramePoolStats FramePool::stats() const {
+    lock_guard<mutex> lock(mutex_);
+    return stats_;
+}
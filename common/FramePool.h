@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "Frame.h"
+
+// Recycles 64-byte-aligned frame and mask buffers, so a long run allocates
+// only while the pool warms up: a buffer handed back is reused by the next
+// request of the same kind and shape (width, height and layout, not just
+// byte count). New buffers are zeroed, which also faults their pages in
+// before first use.
+//
+// Reused buffers keep their old contents. Frames only ever have their
+// pixels written and a reused frame has the same rows, so its row padding
+// stays zero; masks may come back holding anything. Thread-safe; handles may be released on any thread.
+
+struct FramePoolStats {
+    // Handed out now, and the most ever handed out at once
+    size_t InUseBytes;
+    size_t PeakInUseBytes;
+    // Owned by the pool, in use or not
+    size_t HeldBytes;
+    size_t Allocations;
+    size_t Reuses;
+};
+
+class FramePool;
+
+// Kind (frame or mask), width, height and layout of a pooled buffer.
+typedef std::tuple<int, int, int, int> PoolShape;
+
+// RAII handle to a pooled buffer: it goes back to its pool when the handle
+// is destroyed, reset or assigned over. Move-only. A handle may also wrap a
+// frame that needs no buffer (a view into a frame cache).
+class PoolBuffer {
+public:
+    PoolBuffer();
+    explicit PoolBuffer(const Frame& view);
+    PoolBuffer(PoolBuffer&& other);
+    PoolBuffer& operator=(PoolBuffer&& other);
+    ~PoolBuffer();
+
+    PoolBuffer(const PoolBuffer&) = delete;
+    PoolBuffer& operator=(const PoolBuffer&) = delete;
+
+    // Buffers from acquireFrame() and views. Data is null, so freeFrame()
+    // on it is a no-op.
+    const Frame& frame() const { return frame_; }
+    uint8_t* data() const { return buffer_; }
+    size_t bytes() const { return bytes_; }
+    bool empty() const { return !buffer_ && !frame_.Red; }
+    void reset();
+
+private:
+    friend class FramePool;
+    FramePool* pool_;
+    PoolShape shape_;
+    uint8_t* buffer_;
+    size_t bytes_;
+    Frame frame_;
+};
+
+class FramePool {
+public:
+    FramePool();
+    // Frees the idle buffers; every handle must have been released.
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    PoolBuffer acquireFrame(int width, int height, FrameLayout layout = FRAME_PLANAR);
+    // alignedStride(width) * height bytes, like allocateMask().
+    PoolBuffer acquireMask(int width, int height);
+    // Allocates `count` idle frames up front, so even the first requests
+    // are served from the pool.
+    void reserveFrames(int count, int width, int height, FrameLayout layout = FRAME_PLANAR);
+
+    FramePoolStats stats() const;
+
+private:
+    friend class PoolBuffer;
+    uint8_t* take(const PoolShape& shape, size_t bytes);
+    void give(const PoolShape& shape, uint8_t* buffer, size_t bytes);
+
+    mutable std::mutex mutex_;
+    std::map<PoolShape, std::vector<uint8_t*>> idle_;
+    FramePoolStats stats_;
+};
@@ -0,0 +1,242 @@
+#include "FrameStream.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "FrameCache.h"
+#include "ImageIO.h"
+#include "Trace.h"
+
+using namespace std;
+
+namespace {
+
+inline uint8_t clamp255(int v) {
+    return (uint8_t)min(255, max(0, v));
+}
+
+// One header or frame-header line without the newline; false at EOF.
+bool readLine(FILE* file, string& line) {
+    line.clear();
+    int c;
+    while ((c = fgetc(file)) != EOF && c != '\n') {
+        line += (char)c;
+    }
+    return c != EOF || !line.empty();
+}
+
+}
+
+bool parseStreamFormat(const string& text, StreamFormat* format) {
+    if (text == "y4m") {
+        *format = STREAM_Y4M;
+        return true;
+    }
+    if (text == "rgb24") {
+        *format = STREAM_RGB24;
+        return true;
+    }
+    return false;
+}
+
+FrameStream::FrameStream(const string& path, StreamFormat format, int width, int height)
+    : file_(nullptr), ownsFile_(path != "-"), format_(format), width_(width), height_(height),
+      chromaShiftX_(1), chromaShiftY_(1), mono_(false), frames_(0) {
+    if (ownsFile_) {
+        file_ = fopen(path.c_str(), "rb");
+        if (!file_) {
+            throw runtime_error("cannot open " + path);
+        }
+    }
+    else {
+        file_ = stdin;
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    }
+
+    if (format_ == STREAM_Y4M) {
+        readY4mHeader();
+    }
+    else if (width_ <= 0 || height_ <= 0) {
+        throw runtime_error("raw RGB24 input needs a frame size");
+    }
+
+    size_t luma = (size_t)width_ * height_;
+    if (format_ == STREAM_RGB24) {
+        buffer_.resize(3 * luma);
+    }
+    else {
+        int chromaWidth = (width_ + (1 << chromaShiftX_) - 1) >> chromaShiftX_;
+        int chromaHeight = (height_ + (1 << chromaShiftY_) - 1) >> chromaShiftY_;
+        buffer_.resize(luma + (mono_ ? 0 : 2 * (size_t)chromaWidth * chromaHeight));
+    }
+}
+
+FrameStream::~FrameStream() {
+    if (ownsFile_) {
+        fclose(file_);
+    }
+}
+
+void FrameStream::readY4mHeader() {
+    string header;
+    if (!readLine(file_, header) || header.compare(0, 10, "YUV4MPEG2 ") != 0) {
+        throw runtime_error("input is not a YUV4MPEG2 stream");
+    }
+    string colorspace = "420";
+    size_t pos = 10;
+    while (pos < header.size()) {
+        size_t end = header.find(' ', pos);
+        if (end == string::npos) {
+            end = header.size();
+        }
+        string token = header.substr(pos, end - pos);
+        if (!token.empty() && token[0] == 'W') {
+            width_ = atoi(token.c_str() + 1);
+        }
+        else if (!token.empty() && token[0] == 'H') {
+            height_ = atoi(token.c_str() + 1);
+        }
+        else if (!token.empty() && token[0] == 'C') {
+            colorspace = token.substr(1);
+        }
+        pos = end + 1;
+    }
+    if (width_ <= 0 || height_ <= 0) {
+        throw runtime_error("YUV4MPEG2 header has no frame size");
+    }
+
+    // 420jpeg, 420mpeg2 and 420paldv differ only in chroma siting, which
+    // nearest-sample upsampling ignores
+    if (colorspace == "420" || colorspace == "420jpeg" || colorspace == "420mpeg2" || colorspace == "420paldv") {
+        chromaShiftX_ = chromaShiftY_ = 1;
+    }
+    else if (colorspace == "422") {
+        chromaShiftX_ = 1;
+        chromaShiftY_ = 0;
+    }
+    else if (colorspace == "444") {
+        chromaShiftX_ = chromaShiftY_ = 0;
+    }
+    else if (colorspace == "mono") {
+        chromaShiftX_ = chromaShiftY_ = 0;
+        mono_ = true;
+    }
+    else {
+        throw runtime_error("unsupported YUV4MPEG2 colour space C" + colorspace + " (8-bit only)");
+    }
+}
+
+bool FrameStream::read(const Frame& frame) {
+    TRACE_SCOPE("decode");
+    if (format_ == STREAM_Y4M) {
+        string line;
+        if (!readLine(file_, line)) {
+            return false;
+        }
+        if (line.compare(0, 5, "FRAME") != 0) {
+            throw runtime_error("bad YUV4MPEG2 frame header after frame " + to_string(frames_));
+        }
+    }
+
+    size_t got = fread(buffer_.data(), 1, buffer_.size(), file_);
+    if (got == 0 && format_ == STREAM_RGB24) {
+        return false;
+    }
+    if (got != buffer_.size()) {
+        throw runtime_error("input ends inside frame " + to_string(frames_));
+    }
+    TRACE_COUNT("input bytes", got);
+
+    if (format_ == STREAM_RGB24) {
+        for (int i = 0; i < height_; i++) {
+            const uint8_t* src = buffer_.data() + (size_t)i * width_ * 3;
+            uint8_t* red = frame.Red + (size_t)i * frame.Stride;
+            uint8_t* green = frame.Green + (size_t)i * frame.Stride;
+            uint8_t* blue = frame.Blue + (size_t)i * frame.Stride;
+            for (int j = 0; j < width_; j++) {
+                red[j] = src[3 * j];
+                green[j] = src[3 * j + 1];
+                blue[j] = src[3 * j + 2];
+            }
+        }
+    }
+    else {
+        convertYuv(frame);
+    }
+    frames_++;
+    return true;
+}
+
+// BT.601 limited range, 8-bit fixed point; chroma is upsampled by nearest
+// sample.
+void FrameStream::convertYuv(const Frame& frame) const {
+    const uint8_t* yPlane = buffer_.data();
+    int chromaWidth = (width_ + (1 << chromaShiftX_) - 1) >> chromaShiftX_;
+    int chromaHeight = (height_ + (1 << chromaShiftY_) - 1) >> chromaShiftY_;
+    const uint8_t* uPlane = yPlane + (size_t)width_ * height_;
+    const uint8_t* vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+    for (int i = 0; i < height_; i++) {
+        const uint8_t* y = yPlane + (size_t)i * width_;
+        const uint8_t* u = uPlane + (size_t)(i >> chromaShiftY_) * chromaWidth;
+        const uint8_t* v = vPlane + (size_t)(i >> chromaShiftY_) * chromaWidth;
+        uint8_t* red = frame.Red + (size_t)i * frame.Stride;
+        uint8_t* green = frame.Green + (size_t)i * frame.Stride;
+        uint8_t* blue = frame.Blue + (size_t)i * frame.Stride;
+        for (int j = 0; j < width_; j++) {
+            int luma = 298 * (y[j] - 16) + 128;
+            int d = mono_ ? 0 : u[j >> chromaShiftX_] - 128;
+            int e = mono_ ? 0 : v[j >> chromaShiftX_] - 128;
+            red[j] = clamp255((luma + 409 * e) >> 8);
+            green[j] = clamp255((luma - 100 * d - 208 * e) >> 8);
+            blue[j] = clamp255((luma + 516 * d) >> 8);
+        }
+    }
+}
+
+FrameSource::FrameSource(const vector<string>& paths, FramePool& pool)
+    : paths_(&paths), stream_(nullptr), pool_(pool), next_(0) {}
+
+FrameSource::FrameSource(FrameStream& stream, FramePool& pool)
+    : paths_(nullptr), stream_(&stream), pool_(pool), next_(0) {}
+
+bool FrameSource::next(PoolBuffer& frame) {
+    frame.reset();
+    if (stream_) {
+        frame = pool_.acquireFrame(stream_->width(), stream_->height());
+        if (!stream_->read(frame.frame())) {
+            frame.reset();
+            return false;
+        }
+    }
+    else if ((size_t)next_ < paths_->size()) {
+        frame = loadPooledFrame(pool_, (*paths_)[next_]);
+    }
+    else {
+        return false;
+    }
+    next_++;
+    return true;
+}
+
+PoolBuffer loadPooledFrame(FramePool& pool, const string& path) {
+    string cacheFile;
+    int index, width, height;
+    if (parseFrameCachePath(path, &cacheFile, &index)) {
+        return PoolBuffer(loadFrame(&width, &height, path));
+    }
+    PoolBuffer frame;
+    decodeColorImage(path, [&](int w, int h) {
+        frame = pool.acquireFrame(w, h);
+        return frame.frame();
+    });
+    return frame;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "FramePool.h"
+#include "Frame.h"
+
+// Uncompressed video from a file, a named pipe or stdin, so a decoder
+// process can feed the subtractor directly, e.g.
+//   ffmpeg -i video.mp4 -f yuv4mpegpipe - | sequential_background_subtractor --input -
+//
+// STREAM_Y4M is YUV4MPEG2 with 8-bit 4:2:0, 4:2:2, 4:4:4 or mono samples,
+// converted to RGB with BT.601 limited-range coefficients. STREAM_RGB24 is
+// headerless interleaved RGB24 of a size given up front. Each frame is read
+// with one fread into a buffer reused for the whole stream and then
+// converted into the caller's planar frame, so nothing is allocated per
+// frame.
+
+enum StreamFormat {
+    STREAM_Y4M,
+    STREAM_RGB24
+};
+
+// "y4m" or "rgb24"; false for anything else.
+bool parseStreamFormat(const std::string& text, StreamFormat* format);
+
+class FrameStream {
+public:
+    // `path` "-" is stdin. The size is read from the Y4M header; RGB24
+    // needs it given. Throws std::runtime_error.
+    FrameStream(const std::string& path, StreamFormat format, int width = 0, int height = 0);
+    ~FrameStream();
+
+    FrameStream(const FrameStream&) = delete;
+    FrameStream& operator=(const FrameStream&) = delete;
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int framesRead() const { return frames_; }
+
+    // Next frame into `frame` (planar, width() x height()); false at the end
+    // of the stream. Throws std::runtime_error on a truncated frame.
+    bool read(const Frame& frame);
+
+private:
+    void readY4mHeader();
+    void convertYuv(const Frame& frame) const;
+
+    FILE* file_;
+    bool ownsFile_;
+    StreamFormat format_;
+    int width_;
+    int height_;
+    // Y4M chroma subsampling as shifts; mono has no chroma planes
+    int chromaShiftX_;
+    int chromaShiftY_;
+    bool mono_;
+    std::vector<uint8_t> buffer_;
+    int frames_;
+};
+
+// Frames of a run, in order: loaded from a list of paths (PNG, synthetic
+// or frame cache, see loadFrame()) or read from a FrameStream until it
+// ends. Decoded frames come from `pool`; cached frames are views.
+class FrameSource {
+public:
+    FrameSource(const std::vector<std::string>& paths, FramePool& pool);
+    FrameSource(FrameStream& stream, FramePool& pool);
+
+    // Replaces `frame` with the next frame (the old one goes back to the
+    // pool first); false once there are no more.
+    bool next(PoolBuffer& frame);
+    // Frames handed out so far
+    int count() const { return next_; }
+    // Open-ended: the frame count is only known at the end
+    bool streaming() const { return stream_ != nullptr; }
+
+private:
+    const std::vector<std::string>* paths_;
+    FrameStream* stream_;
+    FramePool& pool_;
+    int next_;
+};
+
+// loadFrame() into a pooled buffer; cache paths give a view.
+PoolBuffer loadPooledFrame(FramePool& pool, const std::string& path);
@@ -0,0 +1,398 @@
+#include "ImageIO.h"
+
+#include <png.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+#include "FrameCache.h"
+#include "Synthetic.h"
+#include "Trace.h"
+
+using namespace std;
+
+namespace {
+
+struct FileCloser {
+    FILE* fp;
+    ~FileCloser() { if (fp) fclose(fp); }
+};
+
+FILE* openFile(const string& path, const char* mode) {
+    FILE* fp = fopen(path.c_str(), mode);
+    if (!fp) {
+        throw runtime_error("cannot open " + path);
+    }
+    return fp;
+}
+
+// Decodes a PNG as 8-bit RGB into caller-provided rows. `allocate` is called
+// once the dimensions are known and must fill in one pointer per row.
+template <typename RowAllocator>
+void decodePngRgb(const string& path, RowAllocator allocate) {
+    FileCloser file = { openFile(path, "rb") };
+
+    png_byte signature[8];
+    if (fread(signature, 1, 8, file.fp) != 8 || png_sig_cmp(signature, 0, 8)) {
+        throw runtime_error(path + " is not a PNG file");
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (!info) {
+        png_destroy_read_struct(&png, nullptr, nullptr);
+        throw runtime_error("out of memory decoding " + path);
+    }
+
+    vector<png_bytep> rows;
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, nullptr);
+        throw runtime_error("corrupt PNG " + path);
+    }
+
+    png_init_io(png, file.fp);
+    png_set_sig_bytes(png, 8);
+    png_read_info(png, info);
+
+    // Normalise every colour type to 8-bit RGB so callers only see one layout.
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_strip_alpha(png);
+    png_set_gray_to_rgb(png);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    int width = png_get_image_width(png, info);
+    int height = png_get_image_height(png, info);
+    rows.resize(height);
+    allocate(width, height, rows.data());
+    png_read_image(png, rows.data());
+    png_read_end(png, nullptr);
+    png_destroy_read_struct(&png, &info, nullptr);
+}
+
+}
+
+void readPngRgb(const string& path, vector<uint8_t>& rgb, int* width, int* height) {
+    decodePngRgb(path, [&](int w, int h, png_bytep* rows) {
+        rgb.resize((size_t)w * h * 3);
+        for (int i = 0; i < h; i++) {
+            rows[i] = &rgb[(size_t)i * w * 3];
+        }
+        *width = w;
+        *height = h;
+    });
+}
+
+void writePng(const string& path, const uint8_t* pixels, int width, int height,
+    int channels, int stride, int level) {
+    FileCloser file = { openFile(path, "wb") };
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (!info) {
+        png_destroy_write_struct(&png, nullptr);
+        throw runtime_error("out of memory encoding " + path);
+    }
+
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        throw runtime_error("failed to write " + path);
+    }
+
+    png_init_io(png, file.fp);
+    if (level >= 0) {
+        png_set_compression_level(png, level);
+    }
+    png_set_IHDR(png, info, width, height, 8,
+        channels == 1 ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_RGB,
+        PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    for (int i = 0; i < height; i++) {
+        png_write_row(png, (png_const_bytep)(pixels + (size_t)i * stride));
+    }
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+}
+
+namespace {
+
+OutputConfig currentOutput = { OUTPUT_PNG, -1 };
+// Keeps the "saved" lines of concurrent writers whole
+mutex logMutex;
+
+// Opens `path` with a stdio buffer as large as the file, so the rows copied
+// in leave in one write() when it is closed.
+FILE* openWholeFile(const string& path, vector<char>& buffer, size_t bytes) {
+    FILE* fp = openFile(path, "wb");
+    buffer.resize(bytes + 1);
+    setvbuf(fp, buffer.data(), _IOFBF, buffer.size());
+    return fp;
+}
+
+void writeRows(FILE* fp, const uint8_t* pixels, size_t rowBytes, int height, int stride) {
+    if ((size_t)stride == rowBytes) {
+        fwrite(pixels, 1, rowBytes * height, fp);
+        return;
+    }
+    for (int i = 0; i < height; i++) {
+        fwrite(pixels + (size_t)i * stride, 1, rowBytes, fp);
+    }
+}
+
+void closeWholeFile(FILE* fp, const string& path) {
+    bool failed = ferror(fp) != 0;
+    failed = fclose(fp) != 0 || failed;
+    if (failed) {
+        throw runtime_error("failed to write " + path);
+    }
+}
+
+}
+
+void writePnm(const string& path, const uint8_t* pixels, int width, int height,
+    int channels, int stride) {
+    char header[64];
+    int headerBytes = snprintf(header, sizeof(header), "P%d\n%d %d\n255\n", channels == 1 ? 5 : 6,
+        width, height);
+    size_t rowBytes = (size_t)width * channels;
+    vector<char> buffer;
+    FILE* fp = openWholeFile(path, buffer, headerBytes + rowBytes * height);
+    fwrite(header, 1, headerBytes, fp);
+    writeRows(fp, pixels, rowBytes, height, stride);
+    closeWholeFile(fp, path);
+}
+
+void writeRaw(const string& path, const uint8_t* pixels, int width, int height,
+    int channels, int stride) {
+    size_t rowBytes = (size_t)width * channels;
+    vector<char> buffer;
+    FILE* fp = openWholeFile(path, buffer, rowBytes * height);
+    writeRows(fp, pixels, rowBytes, height, stride);
+    closeWholeFile(fp, path);
+}
+
+bool parseOutputFormat(const string& text, OutputFormat* format) {
+    const char* names[] = { "png", "pnm", "raw", "none" };
+    for (int f = OUTPUT_PNG; f <= OUTPUT_NONE; f++) {
+        if (text == names[f]) {
+            *format = (OutputFormat)f;
+            return true;
+        }
+    }
+    return false;
+}
+
+void setOutputConfig(const OutputConfig& config) {
+    currentOutput = config;
+}
+
+const OutputConfig& outputConfig() {
+    return currentOutput;
+}
+
+string outputFileName(const string& filename, int channels) {
+    const char* extension = currentOutput.Format == OUTPUT_PNM ? (channels == 1 ? ".pgm" : ".ppm")
+        : currentOutput.Format == OUTPUT_RAW ? ".raw" : ".png";
+    size_t dot = filename.rfind(".png");
+    if (dot == string::npos || dot + 4 != filename.size()) {
+        return filename + extension;
+    }
+    return filename.substr(0, dot) + extension;
+}
+
+namespace {
+
+// Tightly packed RGB24 rows into the planes of `img`.
+void splitRgb(const uint8_t* rgb, const Frame& img) {
+    for (int i = 0; i < img.Height; i++) {
+        const uint8_t* src = rgb + (size_t)i * img.Width * 3;
+        uint8_t* red = img.Red + (size_t)i * img.Stride;
+        uint8_t* green = img.Green + (size_t)i * img.Stride;
+        uint8_t* blue = img.Blue + (size_t)i * img.Stride;
+        for (int j = 0; j < img.Width; j++) {
+            red[j] = src[3 * j];
+            green[j] = src[3 * j + 1];
+            blue[j] = src[3 * j + 2];
+        }
+    }
+}
+
+// Planar copy of a cached frame, row padding included.
+void copyPlanes(const Frame& src, const Frame& dst) {
+    for (int c = 0; c < 3; c++) {
+        memcpy(channelPlane(dst, c), channelPlane(src, c), (size_t)src.Stride * src.Height);
+    }
+}
+
+}
+
+Frame inputColorImage(int* w, int* h, const string& imagePath, FrameLayout layout) {
+    TRACE_SCOPE("decode");
+    int index;
+    if (parseSyntheticPath(imagePath, w, h, &index)) {
+        return syntheticFrame(*w, *h, index, layout);
+    }
+    string cacheFile;
+    if (parseFrameCachePath(imagePath, &cacheFile, &index)) {
+        Frame view = loadFrame(w, h, imagePath);
+        Frame img = allocateFrameUntouched(*w, *h, layout);
+        for (int i = 0; i < *h; i++) {
+            for (int c = 0; c < 3; c++) {
+                const uint8_t* src = channelPlane(view, c) + (size_t)i * view.Stride;
+                uint8_t* dst = channelPlane(img, c) + (size_t)i * img.Stride;
+                if (layout == FRAME_PLANAR) {
+                    memcpy(dst, src, view.Stride);
+                    continue;
+                }
+                for (int j = 0; j < *w; j++) {
+                    dst[3 * j] = src[j];
+                }
+            }
+            if (layout == FRAME_INTERLEAVED) {
+                memset(img.Data + (size_t)i * img.Stride + 3 * *w, 0, img.Stride - 3 * *w);
+            }
+        }
+        return img;
+    }
+
+    Frame img = {};
+    vector<uint8_t> rgb;
+
+    try {
+        decodePngRgb(imagePath, [&](int width, int height, png_bytep* rows) {
+            img = allocateFrame(width, height, layout);
+            if (layout == FRAME_INTERLEAVED) {
+                for (int i = 0; i < height; i++) {
+                    rows[i] = img.Data + (size_t)i * img.Stride;
+                }
+            }
+            else {
+                rgb.resize((size_t)width * height * 3);
+                for (int i = 0; i < height; i++) {
+                    rows[i] = &rgb[(size_t)i * width * 3];
+                }
+            }
+        });
+    }
+    catch (...) {
+        if (img.Data) {
+            freeFrame(img);
+        }
+        throw;
+    }
+    *w = img.Width;
+    *h = img.Height;
+
+    if (layout == FRAME_PLANAR) {
+        splitRgb(rgb.data(), img);
+    }
+    return img;
+}
+
+void decodeColorImage(const string& imagePath, const function<Frame(int, int)>& allocate) {
+    TRACE_SCOPE("decode");
+    int width, height, index;
+    string cacheFile;
+    if (parseSyntheticPath(imagePath, &width, &height, &index)) {
+        renderSyntheticFrame(allocate(width, height), index);
+        return;
+    }
+    if (parseFrameCachePath(imagePath, &cacheFile, &index)) {
+        Frame view = loadFrame(&width, &height, imagePath);
+        copyPlanes(view, allocate(width, height));
+        return;
+    }
+
+    thread_local vector<uint8_t> rgb;
+    Frame img = {};
+    decodePngRgb(imagePath, [&](int w, int h, png_bytep* rows) {
+        img = allocate(w, h);
+        rgb.resize((size_t)w * h * 3);
+        for (int i = 0; i < h; i++) {
+            rows[i] = &rgb[(size_t)i * w * 3];
+        }
+    });
+    splitRgb(rgb.data(), img);
+}
+
+void createColorImage(const Frame& img, string filename) {
+    const OutputConfig& output = currentOutput;
+    if (output.Format == OUTPUT_NONE) {
+        return;
+    }
+    TRACE_SCOPE("encode");
+    filename = outputFileName(filename, 3);
+    string path = OUTPUT_DIR + filename;
+    if (img.Layout == FRAME_INTERLEAVED) {
+        if (output.Format == OUTPUT_PNG) {
+            writePng(path, img.Red, img.Width, img.Height, 3, img.Stride, output.PngLevel);
+        }
+        else if (output.Format == OUTPUT_PNM) {
+            writePnm(path, img.Red, img.Width, img.Height, 3, img.Stride);
+        }
+        else {
+            writeRaw(path, img.Red, img.Width, img.Height, 3, img.Stride);
+        }
+    }
+    else if (output.Format == OUTPUT_RAW) {
+        vector<char> buffer;
+        FILE* fp = openWholeFile(path, buffer, (size_t)img.Width * img.Height * 3);
+        for (int c = 0; c < 3; c++) {
+            writeRows(fp, channelPlane(img, c), img.Width, img.Height, img.Stride);
+        }
+        closeWholeFile(fp, path);
+    }
+    else {
+        vector<uint8_t> rgb((size_t)img.Width * img.Height * 3);
+        for (int i = 0; i < img.Height; i++) {
+            uint8_t* dst = &rgb[(size_t)i * img.Width * 3];
+            for (int j = 0; j < img.Width; j++) {
+                dst[3 * j] = img.Red[i * img.Stride + j];
+                dst[3 * j + 1] = img.Green[i * img.Stride + j];
+                dst[3 * j + 2] = img.Blue[i * img.Stride + j];
+            }
+        }
+        if (output.Format == OUTPUT_PNG) {
+            writePng(path, rgb.data(), img.Width, img.Height, 3, img.Width * 3, output.PngLevel);
+        }
+        else {
+            writePnm(path, rgb.data(), img.Width, img.Height, 3, img.Width * 3);
+        }
+    }
+    lock_guard<mutex> lock(logMutex);
+    cout << "Color image saved: " << filename << endl;
+}
+
+void createGrayImage(const uint8_t* image, int width, int height, int stride, string filename) {
+    const OutputConfig& output = currentOutput;
+    if (output.Format == OUTPUT_NONE) {
+        return;
+    }
+    TRACE_SCOPE("encode");
+    filename = outputFileName(filename, 1);
+    string path = OUTPUT_DIR + filename;
+    if (output.Format == OUTPUT_PNG) {
+        writePng(path, image, width, height, 1, stride, output.PngLevel);
+    }
+    else if (output.Format == OUTPUT_PNM) {
+        writePnm(path, image, width, height, 1, stride);
+    }
+    else {
+        writeRaw(path, image, width, height, 1, stride);
+    }
+    lock_guard<mutex> lock(logMutex);
+    cout << "Grayscale image saved: " << filename << endl;
+}
+
+void createGrayImage(const BitMask& mask, string filename) {
+    if (currentOutput.Format == OUTPUT_NONE) {
+        return;
+    }
+    uint8_t* pixels = allocateMask(mask.Width, mask.Height);
+    unpackMask(mask, pixels);
+    createGrayImage(pixels, mask.Width, mask.Height, mask.WordsPerRow * 64, filename);
+    alignedFree(pixels);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "BitMask.h"
+#include "Frame.h"
+
+// Native image I/O shared by the sequential, OpenMP and MPI builds.
+// PNG decode/encode goes through libpng a whole row at a time instead of
+// System::Drawing::Bitmap::GetPixel/SetPixel, so it also builds on Linux.
+
+const std::string INPUT_DIR = "..//Data//Input//";
+const std::string OUTPUT_DIR = "..//Data//OutPut//";
+
+// Decodes any 8/16-bit PNG (gray, palette, alpha are expanded/stripped) into
+// a tightly packed interleaved RGB24 buffer. Throws std::runtime_error.
+void readPngRgb(const std::string& path, std::vector<uint8_t>& rgb, int* width, int* height);
+
+// Encodes `height` rows of `stride` bytes each. `channels` is 1 (gray) or 3 (RGB).
+// `level` is the zlib level, 0 (stored) to 9; -1 keeps libpng's default.
+void writePng(const std::string& path, const uint8_t* pixels, int width, int height,
+    int channels, int stride, int level = -1);
+// Binary PGM (1 channel) or PPM (3, interleaved), and headerless raw bytes:
+// the rows are written as they are, without the stride padding. The file is
+// buffered whole, so each leaves in a single write().
+void writePnm(const std::string& path, const uint8_t* pixels, int width, int height,
+    int channels, int stride);
+void writeRaw(const std::string& path, const uint8_t* pixels, int width, int height,
+    int channels, int stride);
+
+// Format of everything createColorImage() and createGrayImage() write.
+// OUTPUT_PNM is PGM/PPM. OUTPUT_RAW writes gray masks as width x height
+// bytes and colour images in their own layout (a planar frame as its R, G
+// and B planes one after another, an interleaved one as RGB24), so nothing
+// is converted. OUTPUT_NONE writes nothing, to time a run without its
+// output.
+enum OutputFormat {
+    OUTPUT_PNG,
+    OUTPUT_PNM,
+    OUTPUT_RAW,
+    OUTPUT_NONE
+};
+
+struct OutputConfig {
+    OutputFormat Format;
+    // zlib level for PNG, or -1 for libpng's default
+    int PngLevel;
+};
+
+// "png", "pnm", "raw" or "none"; false for anything else.
+bool parseOutputFormat(const std::string& text, OutputFormat* format);
+// Process-wide; set it before any output is written. PNG by default.
+void setOutputConfig(const OutputConfig& config);
+const OutputConfig& outputConfig();
+// `filename` with its ".png" swapped for the configured format's extension
+// (.pgm/.ppm or .raw).
+std::string outputFileName(const std::string& filename, int channels);
+
+// Interleaved frames are decoded straight into the frame rows; planar frames
+// are split per row after decoding. "synthetic:" paths are rendered instead
+// (common/Synthetic.h) and "framecache:" paths copied out of the mapped
+// cache (common/FrameCache.h).
+Frame inputColorImage(int* w, int* h, const std::string& imagePath,
+    FrameLayout layout = FRAME_PLANAR);
+// Decodes any path inputColorImage() takes into the frame that
+// `allocate(width, height)` returns once the size is known: planar, with
+// zero row padding (e.g. from a FramePool). The RGB row buffer is kept per
+// thread, so decoding allocates nothing once warm.
+void decodeColorImage(const std::string& imagePath, const std::function<Frame(int, int)>& allocate);
+// Write to OUTPUT_DIR in the outputConfig() format (filenames are given as
+// .png); thread-safe.
+void createColorImage(const Frame& img, std::string filename);
+void createGrayImage(const uint8_t* image, int width, int height, int stride, std::string filename);
+// Unpacked to 0/255 only here, at output time.
+void createGrayImage(const BitMask& mask, std::string filename);
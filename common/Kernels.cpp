@@ -0,0 +1,224 @@
+#include "Kernels.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+
+#include "KernelsIsa.h"
+#include "MixtureKernel.h"
+
+#if BGS_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+FixedPointDivisor makeDivisor(uint32_t divisor, uint32_t maxDividend) {
+    if (divisor == 0) {
+        throw std::invalid_argument("division by zero");
+    }
+    // Smallest shift whose rounded-up reciprocal keeps the error below one
+    // for every dividend in range (Granlund-Montgomery).
+    for (int shift = 0; shift < 64; shift++) {
+        uint64_t power = (uint64_t)1 << shift;
+        uint64_t multiplier = power / divisor + (power % divisor != 0);
+        if (multiplier > 0xFFFFFFFFu) {
+            break;
+        }
+        uint64_t error = multiplier * divisor - power;
+        if ((uint64_t)maxDividend * error < power) {
+            FixedPointDivisor result = { multiplier, shift };
+            return result;
+        }
+    }
+    throw std::invalid_argument("divisor out of range for fixed-point division");
+}
+
+static void sumPlanesScalar(uint32_t* sums, const uint8_t* const* planes, int numPlanes,
+    size_t offset, size_t n) {
+    for (int k = 0; k < numPlanes; k++) {
+        const uint8_t* plane = planes[k] + offset;
+        for (size_t i = 0; i < n; i++) {
+            sums[i] += plane[i];
+        }
+    }
+}
+
+static void accumulatePlaneScalar(uint32_t* sums, const uint8_t* plane, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        sums[i] += plane[i];
+    }
+}
+
+static void slidePlaneScalar(uint32_t* sums, const uint8_t* incoming, const uint8_t* outgoing,
+    size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        sums[i] += incoming[i] - outgoing[i];
+    }
+}
+
+static void dividePlaneScalar(uint8_t* out, const uint32_t* sums, size_t n,
+    FixedPointDivisor divisor) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (uint8_t)((sums[i] * divisor.Multiplier) >> divisor.Shift);
+    }
+}
+
+static void thresholdMaskScalar(uint8_t* mask, const uint8_t* bgRed, const uint8_t* bgGreen,
+    const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+    size_t n, int threshold) {
+    for (size_t i = 0; i < n; i++) {
+        int bgGray = (bgRed[i] + bgGreen[i] + bgBlue[i]) / 3;
+        int frameGray = (red[i] + green[i] + blue[i]) / 3;
+        int diff = abs(bgGray - frameGray);
+        mask[i] = (diff > threshold) ? 255 : 0;
+    }
+}
+
+static void grayPlaneScalar(uint8_t* out, const uint8_t* red, const uint8_t* green,
+    const uint8_t* blue, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (uint8_t)((red[i] + green[i] + blue[i]) / 3);
+    }
+}
+
+static void grayMaskScalar(uint8_t* mask, const uint8_t* bgGray, const uint8_t* red,
+    const uint8_t* green, const uint8_t* blue, size_t n, int threshold) {
+    for (size_t i = 0; i < n; i++) {
+        int frameGray = (red[i] + green[i] + blue[i]) / 3;
+        int diff = abs(bgGray[i] - frameGray);
+        mask[i] = (diff > threshold) ? 255 : 0;
+    }
+}
+
+static void mixtureUpdateScalar(const MixtureRun& run, size_t n, const MixtureParams& params) {
+    mixtureUpdateGeneric(run, n, params);
+}
+
+static void packMaskScalar(uint64_t* bits, const uint8_t* mask, size_t n) {
+    for (size_t w = 0; w < (n + 63) / 64; w++) {
+        size_t count = n - w * 64 < 64 ? n - w * 64 : 64;
+        uint64_t word = 0;
+        for (size_t j = 0; j < count; j++) {
+            word |= (uint64_t)(mask[w * 64 + j] != 0) << j;
+        }
+        bits[w] = word;
+    }
+}
+
+static void thresholdBitsScalar(uint64_t* bits, const uint8_t* bgRed, const uint8_t* bgGreen,
+    const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+    size_t n, int threshold) {
+    thresholdBitsByBlock(thresholdMaskScalar, packMaskScalar, bits, bgRed, bgGreen, bgBlue,
+        red, green, blue, n, threshold);
+}
+
+static uint8_t maxDifferenceScalar(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint8_t worst = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        worst = d > worst ? d : worst;
+    }
+    return worst;
+}
+
+const KernelTable SCALAR_KERNELS = {
+    "scalar",
+    sumPlanesScalar,
+    accumulatePlaneScalar,
+    slidePlaneScalar,
+    dividePlaneScalar,
+    thresholdMaskScalar,
+    grayPlaneScalar,
+    grayMaskScalar,
+    mixtureUpdateScalar,
+    thresholdBitsScalar,
+    packMaskScalar,
+    maxDifferenceScalar
+};
+
+#if BGS_X86
+
+static bool cpuSupports(const char* isa) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (strcmp(isa, "sse2") == 0) {
+        return sse2;
+    }
+    if (!osxsave || maxLeaf < 7) {
+        return false;
+    }
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if (strcmp(isa, "avx2") == 0) {
+        return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+    }
+    if (strcmp(isa, "avx512") == 0) {
+        bool f = (info[1] & (1 << 16)) != 0;
+        bool bw = (info[1] & (1 << 30)) != 0;
+        return (xcr0 & 0xE6) == 0xE6 && f && bw;
+    }
+    return false;
+#else
+    __builtin_cpu_init();
+    if (strcmp(isa, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+    if (strcmp(isa, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(isa, "avx512") == 0) {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    }
+    return false;
+#endif
+}
+
+#endif
+
+const KernelTable* kernelTableFor(const char* isa) {
+    if (strcmp(isa, "scalar") == 0) {
+        return &SCALAR_KERNELS;
+    }
+#if BGS_X86
+    if (!cpuSupports(isa)) {
+        return nullptr;
+    }
+    if (strcmp(isa, "sse2") == 0) {
+        return &SSE2_KERNELS;
+    }
+    if (strcmp(isa, "avx2") == 0) {
+        return &AVX2_KERNELS;
+    }
+    if (strcmp(isa, "avx512") == 0) {
+        return &AVX512_KERNELS;
+    }
+#endif
+    return nullptr;
+}
+
+static const KernelTable* selectKernels() {
+    const char* forced = getenv("BGS_ISA");
+    if (forced) {
+        const KernelTable* table = kernelTableFor(forced);
+        if (table) {
+            return table;
+        }
+    }
+    const char* preference[] = { "avx512", "avx2", "sse2" };
+    for (const char* isa : preference) {
+        const KernelTable* table = kernelTableFor(isa);
+        if (table) {
+            return table;
+        }
+    }
+    return &SCALAR_KERNELS;
+}
+
+const KernelTable& kernels() {
+    static const KernelTable* selected = selectKernels();
+    return *selected;
+}
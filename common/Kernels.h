@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Vectorised inner loops for background accumulation and foreground
+// thresholding. An SSE2, AVX2 or AVX-512BW implementation is chosen once at
+// startup from CPUID (override with BGS_ISA=scalar|sse2|avx2|avx512); every
+// implementation is bit-exact with the plain scalar loops (the mixture
+// kernel is one branch-free loop, auto-vectorised per ISA).
+//
+// All kernels work on flat runs of planar 8-bit samples, so a whole padded
+// plane (Stride * Height), a row, or an MPI slice can be passed directly.
+
+// floor(x / d) as (x * Multiplier) >> Shift, exact for x <= MaxDividend.
+struct FixedPointDivisor {
+    uint64_t Multiplier;
+    int Shift;
+};
+
+FixedPointDivisor makeDivisor(uint32_t divisor, uint32_t maxDividend);
+
+// Gaussians per pixel in the mixture background model.
+const int MIXTURE_COMPONENTS = 3;
+
+// One run of a structure-of-arrays Gaussian mixture: every field is a plane
+// indexed like the sample planes. Components are kept in decreasing weight
+// and share one variance across R, G and B.
+struct MixtureRun {
+    float* Weight[MIXTURE_COMPONENTS];
+    float* Variance[MIXTURE_COMPONENTS];
+    float* Mean[MIXTURE_COMPONENTS][3];
+    const uint8_t* Sample[3];
+    uint8_t* Background[3];
+    uint8_t* Mask;
+};
+
+struct MixtureParams {
+    float LearningRate;
+    // Squared distance, in variances, within which a sample matches
+    float MatchThreshold;
+    float InitialVariance;
+    float MinVariance;
+    float MaxVariance;
+    // Leading weight fraction whose components count as background
+    float BackgroundRatio;
+};
+
+struct KernelTable {
+    const char* Name;
+    // sums[i] += planes[0][offset + i] + ... + planes[numPlanes - 1][offset + i]
+    void (*sumPlanes)(uint32_t* sums, const uint8_t* const* planes, int numPlanes,
+        size_t offset, size_t n);
+    // sums[i] += plane[i]
+    void (*accumulatePlane)(uint32_t* sums, const uint8_t* plane, size_t n);
+    // sums[i] += incoming[i] - outgoing[i]  (sliding window; never underflows
+    // while outgoing was added earlier)
+    void (*slidePlane)(uint32_t* sums, const uint8_t* incoming, const uint8_t* outgoing, size_t n);
+    // out[i] = sums[i] / divisor
+    void (*dividePlane)(uint8_t* out, const uint32_t* sums, size_t n, FixedPointDivisor divisor);
+    // mask[i] = |(bR+bG+bB)/3 - (fR+fG+fB)/3| > threshold ? 255 : 0
+    void (*thresholdMask)(uint8_t* mask, const uint8_t* bgRed, const uint8_t* bgGreen,
+        const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+        size_t n, int threshold);
+    // out[i] = (r[i] + g[i] + b[i]) / 3
+    void (*grayPlane)(uint8_t* out, const uint8_t* red, const uint8_t* green,
+        const uint8_t* blue, size_t n);
+    // thresholdMask against a background already reduced by grayPlane
+    void (*grayMask)(uint8_t* mask, const uint8_t* bgGray, const uint8_t* red,
+        const uint8_t* green, const uint8_t* blue, size_t n, int threshold);
+    // Classifies n samples against the mixture (Mask 255 = foreground), then
+    // updates it and writes the leading component's mean to Background.
+    void (*mixtureUpdate)(const MixtureRun& run, size_t n, const MixtureParams& params);
+    // thresholdMask packed 64 pixels to a word: bit j of bits[w] is pixel
+    // 64 * w + j. A partial last word has the bits past n clear.
+    void (*thresholdBits)(uint64_t* bits, const uint8_t* bgRed, const uint8_t* bgGreen,
+        const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+        size_t n, int threshold);
+    // Bit j of bits[w] = mask[64 * w + j] != 0; a partial last word has the
+    // bits past n clear.
+    void (*packMask)(uint64_t* bits, const uint8_t* mask, size_t n);
+    // max |a[i] - b[i]|, 0 for an empty run
+    uint8_t (*maxDifference)(const uint8_t* a, const uint8_t* b, size_t n);
+};
+
+// Table picked for this CPU (or by BGS_ISA).
+const KernelTable& kernels();
+
+// Table for a named ISA, or nullptr if the CPU or build does not support it.
+const KernelTable* kernelTableFor(const char* isa);
+
+extern const KernelTable SCALAR_KERNELS;
@@ -0,0 +1,48 @@
+#pragma once
+
+// Internal to the Kernels_*.cpp translation units: each one is compiled with
+// its own instruction-set flags and only exports its table.
+
+#include "Kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BGS_X86 1
+#else
+#define BGS_X86 0
+#endif
+
+#if BGS_X86
+extern const KernelTable SSE2_KERNELS;
+extern const KernelTable AVX2_KERNELS;
+extern const KernelTable AVX512_KERNELS;
+#endif
+
+// sumPlanes walks SUM_BLOCK pixels of one plane at a time so every plane is
+// read sequentially; 257 * 255 still fits in 16 bits, so up to 257 planes are
+// summed into an L1-resident 16-bit block before spilling to the 32-bit sums.
+const int SUM_BLOCK = 2048;
+const int MAX_16BIT_PLANES = 257;
+
+// Luma divide (r + g + b) / 3 for sums <= 765 as a 16-bit high multiply:
+// (x * 21846) >> 16 == x / 3 for all x < 32768.
+const int DIV3_MULTIPLIER = 21846;
+
+// thresholdBits for ISAs without compare-to-bitmask: the byte kernel fills
+// an L1-resident block, which is then packed.
+const int BIT_BLOCK = 2048;
+
+typedef void (*ThresholdMaskFn)(uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*,
+    const uint8_t*, const uint8_t*, const uint8_t*, size_t, int);
+typedef void (*PackMaskFn)(uint64_t*, const uint8_t*, size_t);
+
+inline void thresholdBitsByBlock(ThresholdMaskFn thresholdMask, PackMaskFn packMask, uint64_t* bits,
+    const uint8_t* bgRed, const uint8_t* bgGreen, const uint8_t* bgBlue, const uint8_t* red,
+    const uint8_t* green, const uint8_t* blue, size_t n, int threshold) {
+    alignas(64) uint8_t block[BIT_BLOCK];
+    for (size_t i = 0; i < n; i += BIT_BLOCK) {
+        size_t len = n - i < (size_t)BIT_BLOCK ? n - i : BIT_BLOCK;
+        thresholdMask(block, bgRed + i, bgGreen + i, bgBlue + i, red + i, green + i, blue + i, len,
+            threshold);
+        packMask(bits + i / 64, block, len);
+    }
+}
@@ -0,0 +1,213 @@
+#include "KernelsIsa.h"
+#include "MixtureKernel.h"
+
+#include <string.h>
+
+#if BGS_X86
+
+#include <immintrin.h>
+
+static inline __m256i load16(const uint8_t* p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p));
+}
+
+static void sumPlanesAVX2(uint32_t* sums, const uint8_t* const* planes, int numPlanes,
+    size_t offset, size_t n) {
+    alignas(64) uint16_t block[SUM_BLOCK];
+    size_t i = 0;
+    while (i + 16 <= n) {
+        int len = n - i >= SUM_BLOCK ? SUM_BLOCK : (int)((n - i) / 16 * 16);
+        for (int k0 = 0; k0 < numPlanes; k0 += MAX_16BIT_PLANES) {
+            int k1 = k0 + MAX_16BIT_PLANES < numPlanes ? k0 + MAX_16BIT_PLANES : numPlanes;
+            memset(block, 0, len * sizeof(uint16_t));
+            for (int k = k0; k < k1; k++) {
+                const uint8_t* p = planes[k] + offset + i;
+                for (int j = 0; j < len; j += 16) {
+                    __m256i* acc = (__m256i*)(block + j);
+                    _mm256_store_si256(acc, _mm256_add_epi16(_mm256_load_si256(acc), load16(p + j)));
+                }
+            }
+            uint32_t* out = sums + i;
+            for (int j = 0; j < len; j += 16) {
+                __m256i* dst = (__m256i*)(out + j);
+                __m256i acc = _mm256_load_si256((const __m256i*)(block + j));
+                __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(acc));
+                __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(acc, 1));
+                _mm256_storeu_si256(dst, _mm256_add_epi32(_mm256_loadu_si256(dst), lo));
+                _mm256_storeu_si256(dst + 1, _mm256_add_epi32(_mm256_loadu_si256(dst + 1), hi));
+            }
+        }
+        i += len;
+    }
+    SCALAR_KERNELS.sumPlanes(sums + i, planes, numPlanes, offset + i, n - i);
+}
+
+static void accumulatePlaneAVX2(uint32_t* sums, const uint8_t* plane, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i* out = (__m256i*)(sums + i);
+        __m128i x = _mm_loadu_si128((const __m128i*)(plane + i));
+        __m256i lo = _mm256_cvtepu8_epi32(x);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(x, 8));
+        _mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), lo));
+        _mm256_storeu_si256(out + 1, _mm256_add_epi32(_mm256_loadu_si256(out + 1), hi));
+    }
+    SCALAR_KERNELS.accumulatePlane(sums + i, plane + i, n - i);
+}
+
+static void slidePlaneAVX2(uint32_t* sums, const uint8_t* incoming, const uint8_t* outgoing,
+    size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i* out = (__m256i*)(sums + i);
+        __m128i x = _mm_loadu_si128((const __m128i*)(incoming + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(outgoing + i));
+        __m256i lo = _mm256_sub_epi32(_mm256_cvtepu8_epi32(x), _mm256_cvtepu8_epi32(y));
+        __m256i hi = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(x, 8)),
+            _mm256_cvtepu8_epi32(_mm_srli_si128(y, 8)));
+        _mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), lo));
+        _mm256_storeu_si256(out + 1, _mm256_add_epi32(_mm256_loadu_si256(out + 1), hi));
+    }
+    SCALAR_KERNELS.slidePlane(sums + i, incoming + i, outgoing + i, n - i);
+}
+
+static inline __m256i divide8(__m256i x, __m256i multiplier, __m128i shift) {
+    __m256i even = _mm256_srl_epi64(_mm256_mul_epu32(x, multiplier), shift);
+    __m256i odd = _mm256_srl_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), multiplier), shift);
+    return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
+
+static void dividePlaneAVX2(uint8_t* out, const uint32_t* sums, size_t n,
+    FixedPointDivisor divisor) {
+    const __m256i multiplier = _mm256_set1_epi32((int)divisor.Multiplier);
+    const __m128i shift = _mm_cvtsi32_si128(divisor.Shift);
+    // packs interleave 128-bit lanes; this restores dword order afterwards
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i* in = (const __m256i*)(sums + i);
+        __m256i q0 = divide8(_mm256_loadu_si256(in), multiplier, shift);
+        __m256i q1 = divide8(_mm256_loadu_si256(in + 1), multiplier, shift);
+        __m256i q2 = divide8(_mm256_loadu_si256(in + 2), multiplier, shift);
+        __m256i q3 = divide8(_mm256_loadu_si256(in + 3), multiplier, shift);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(q0, q1), _mm256_packs_epi32(q2, q3));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    SCALAR_KERNELS.dividePlane(out + i, sums + i, n - i, divisor);
+}
+
+static inline __m256i gray16(const uint8_t* r, const uint8_t* g, const uint8_t* b, __m256i div3) {
+    __m256i sum = _mm256_add_epi16(_mm256_add_epi16(load16(r), load16(g)), load16(b));
+    return _mm256_mulhi_epu16(sum, div3);
+}
+
+static inline __m256i absDiff16(__m256i a, __m256i b) {
+    return _mm256_or_si256(_mm256_subs_epu16(a, b), _mm256_subs_epu16(b, a));
+}
+
+static void thresholdMaskAVX2(uint8_t* mask, const uint8_t* bgRed, const uint8_t* bgGreen,
+    const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+    size_t n, int threshold) {
+    const __m256i div3 = _mm256_set1_epi16((short)DIV3_MULTIPLIER);
+    const __m256i limit = _mm256_set1_epi16((short)(threshold < -1 ? -1 : threshold > 32767 ? 32767 : threshold));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i lo = _mm256_cmpgt_epi16(absDiff16(
+            gray16(bgRed + i, bgGreen + i, bgBlue + i, div3),
+            gray16(red + i, green + i, blue + i, div3)), limit);
+        __m256i hi = _mm256_cmpgt_epi16(absDiff16(
+            gray16(bgRed + i + 16, bgGreen + i + 16, bgBlue + i + 16, div3),
+            gray16(red + i + 16, green + i + 16, blue + i + 16, div3)), limit);
+        __m256i packed = _mm256_packs_epi16(lo, hi);
+        _mm256_storeu_si256((__m256i*)(mask + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    SCALAR_KERNELS.thresholdMask(mask + i, bgRed + i, bgGreen + i, bgBlue + i,
+        red + i, green + i, blue + i, n - i, threshold);
+}
+
+static void grayPlaneAVX2(uint8_t* out, const uint8_t* red, const uint8_t* green,
+    const uint8_t* blue, size_t n) {
+    const __m256i div3 = _mm256_set1_epi16((short)DIV3_MULTIPLIER);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i lo = gray16(red + i, green + i, blue + i, div3);
+        __m256i hi = gray16(red + i + 16, green + i + 16, blue + i + 16, div3);
+        __m256i packed = _mm256_packus_epi16(lo, hi);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    SCALAR_KERNELS.grayPlane(out + i, red + i, green + i, blue + i, n - i);
+}
+
+static void grayMaskAVX2(uint8_t* mask, const uint8_t* bgGray, const uint8_t* red,
+    const uint8_t* green, const uint8_t* blue, size_t n, int threshold) {
+    const __m256i div3 = _mm256_set1_epi16((short)DIV3_MULTIPLIER);
+    const __m256i limit = _mm256_set1_epi16((short)(threshold < -1 ? -1 : threshold > 32767 ? 32767 : threshold));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i lo = _mm256_cmpgt_epi16(absDiff16(load16(bgGray + i),
+            gray16(red + i, green + i, blue + i, div3)), limit);
+        __m256i hi = _mm256_cmpgt_epi16(absDiff16(load16(bgGray + i + 16),
+            gray16(red + i + 16, green + i + 16, blue + i + 16, div3)), limit);
+        __m256i packed = _mm256_packs_epi16(lo, hi);
+        _mm256_storeu_si256((__m256i*)(mask + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    SCALAR_KERNELS.grayMask(mask + i, bgGray + i, red + i, green + i, blue + i, n - i, threshold);
+}
+
+static void mixtureUpdateAVX2(const MixtureRun& run, size_t n, const MixtureParams& params) {
+    mixtureUpdateGeneric(run, n, params);
+}
+
+static void packMaskAVX2(uint64_t* bits, const uint8_t* mask, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    for (size_t w = 0; w < n / 64; w++) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*)(mask + w * 64));
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(mask + w * 64 + 32));
+        uint32_t emptyLo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, zero));
+        uint32_t emptyHi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, zero));
+        bits[w] = ~((uint64_t)emptyLo | ((uint64_t)emptyHi << 32));
+    }
+    SCALAR_KERNELS.packMask(bits + n / 64, mask + n / 64 * 64, n % 64);
+}
+
+static void thresholdBitsAVX2(uint64_t* bits, const uint8_t* bgRed, const uint8_t* bgGreen,
+    const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+    size_t n, int threshold) {
+    thresholdBitsByBlock(thresholdMaskAVX2, packMaskAVX2, bits, bgRed, bgGreen, bgBlue,
+        red, green, blue, n, threshold);
+}
+
+static uint8_t maxDifferenceAVX2(const uint8_t* a, const uint8_t* b, size_t n) {
+    __m256i worst = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        worst = _mm256_max_epu8(worst, _mm256_or_si256(_mm256_subs_epu8(x, y), _mm256_subs_epu8(y, x)));
+    }
+    __m128i half = _mm_max_epu8(_mm256_castsi256_si128(worst), _mm256_extracti128_si256(worst, 1));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 8));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 4));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 2));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 1));
+    uint8_t vector = (uint8_t)_mm_cvtsi128_si32(half);
+    uint8_t tail = SCALAR_KERNELS.maxDifference(a + i, b + i, n - i);
+    return vector > tail ? vector : tail;
+}
+
+const KernelTable AVX2_KERNELS = {
+    "avx2",
+    sumPlanesAVX2,
+    accumulatePlaneAVX2,
+    slidePlaneAVX2,
+    dividePlaneAVX2,
+    thresholdMaskAVX2,
+    grayPlaneAVX2,
+    grayMaskAVX2,
+    mixtureUpdateAVX2,
+    thresholdBitsAVX2,
+    packMaskAVX2,
+    maxDifferenceAVX2
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "KernelsIsa.h"
+#include "MixtureKernel.h"
+
+#include <string.h>
+
+#if BGS_X86
+
+#include <immintrin.h>
+
+static inline __m512i load32(const uint8_t* p) {
+    return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)p));
+}
+
+static void sumPlanesAVX512(uint32_t* sums, const uint8_t* const* planes, int numPlanes,
+    size_t offset, size_t n) {
+    alignas(64) uint16_t block[SUM_BLOCK];
+    size_t i = 0;
+    while (i + 32 <= n) {
+        int len = n - i >= SUM_BLOCK ? SUM_BLOCK : (int)((n - i) / 32 * 32);
+        for (int k0 = 0; k0 < numPlanes; k0 += MAX_16BIT_PLANES) {
+            int k1 = k0 + MAX_16BIT_PLANES < numPlanes ? k0 + MAX_16BIT_PLANES : numPlanes;
+            memset(block, 0, len * sizeof(uint16_t));
+            for (int k = k0; k < k1; k++) {
+                const uint8_t* p = planes[k] + offset + i;
+                for (int j = 0; j < len; j += 32) {
+                    __m512i* acc = (__m512i*)(block + j);
+                    _mm512_store_si512(acc, _mm512_add_epi16(_mm512_load_si512(acc), load32(p + j)));
+                }
+            }
+            uint32_t* out = sums + i;
+            for (int j = 0; j < len; j += 32) {
+                __m512i acc = _mm512_load_si512(block + j);
+                __m512i lo = _mm512_cvtepu16_epi32(_mm512_castsi512_si256(acc));
+                __m512i hi = _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(acc, 1));
+                _mm512_storeu_si512(out + j, _mm512_add_epi32(_mm512_loadu_si512(out + j), lo));
+                _mm512_storeu_si512(out + j + 16, _mm512_add_epi32(_mm512_loadu_si512(out + j + 16), hi));
+            }
+        }
+        i += len;
+    }
+    SCALAR_KERNELS.sumPlanes(sums + i, planes, numPlanes, offset + i, n - i);
+}
+
+static void accumulatePlaneAVX512(uint32_t* sums, const uint8_t* plane, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        uint32_t* out = sums + i;
+        __m512i lo = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(plane + i)));
+        __m512i hi = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(plane + i + 16)));
+        _mm512_storeu_si512(out, _mm512_add_epi32(_mm512_loadu_si512(out), lo));
+        _mm512_storeu_si512(out + 16, _mm512_add_epi32(_mm512_loadu_si512(out + 16), hi));
+    }
+    SCALAR_KERNELS.accumulatePlane(sums + i, plane + i, n - i);
+}
+
+static void slidePlaneAVX512(uint32_t* sums, const uint8_t* incoming, const uint8_t* outgoing,
+    size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        uint32_t* out = sums + i;
+        __m512i lo = _mm512_sub_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(incoming + i))),
+            _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(outgoing + i))));
+        __m512i hi = _mm512_sub_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(incoming + i + 16))),
+            _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(outgoing + i + 16))));
+        _mm512_storeu_si512(out, _mm512_add_epi32(_mm512_loadu_si512(out), lo));
+        _mm512_storeu_si512(out + 16, _mm512_add_epi32(_mm512_loadu_si512(out + 16), hi));
+    }
+    SCALAR_KERNELS.slidePlane(sums + i, incoming + i, outgoing + i, n - i);
+}
+
+static inline __m512i divide16(__m512i x, __m512i multiplier, __m128i shift) {
+    __m512i even = _mm512_srl_epi64(_mm512_mul_epu32(x, multiplier), shift);
+    __m512i odd = _mm512_srl_epi64(_mm512_mul_epu32(_mm512_srli_epi64(x, 32), multiplier), shift);
+    return _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32));
+}
+
+static void dividePlaneAVX512(uint8_t* out, const uint32_t* sums, size_t n,
+    FixedPointDivisor divisor) {
+    const __m512i multiplier = _mm512_set1_epi32((int)divisor.Multiplier);
+    const __m128i shift = _mm_cvtsi32_si128(divisor.Shift);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i q = divide16(_mm512_loadu_si512(sums + i), multiplier, shift);
+        _mm_storeu_si128((__m128i*)(out + i), _mm512_cvtepi32_epi8(q));
+    }
+    SCALAR_KERNELS.dividePlane(out + i, sums + i, n - i, divisor);
+}
+
+static inline __m512i gray32(const uint8_t* r, const uint8_t* g, const uint8_t* b, __m512i div3) {
+    __m512i sum = _mm512_add_epi16(_mm512_add_epi16(load32(r), load32(g)), load32(b));
+    return _mm512_mulhi_epu16(sum, div3);
+}
+
+static inline __m512i absDiff16(__m512i a, __m512i b) {
+    return _mm512_or_si512(_mm512_subs_epu16(a, b), _mm512_subs_epu16(b, a));
+}
+
+static void thresholdMaskAVX512(uint8_t* mask, const uint8_t* bgRed, const uint8_t* bgGreen,
+    const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+    size_t n, int threshold) {
+    const __m512i div3 = _mm512_set1_epi16((short)DIV3_MULTIPLIER);
+    const __m512i limit = _mm512_set1_epi16((short)(threshold < -1 ? -1 : threshold > 32767 ? 32767 : threshold));
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __mmask32 lo = _mm512_cmpgt_epi16_mask(absDiff16(
+            gray32(bgRed + i, bgGreen + i, bgBlue + i, div3),
+            gray32(red + i, green + i, blue + i, div3)), limit);
+        __mmask32 hi = _mm512_cmpgt_epi16_mask(absDiff16(
+            gray32(bgRed + i + 32, bgGreen + i + 32, bgBlue + i + 32, div3),
+            gray32(red + i + 32, green + i + 32, blue + i + 32, div3)), limit);
+        __mmask64 bits = (__mmask64)lo | ((__mmask64)hi << 32);
+        _mm512_storeu_si512(mask + i, _mm512_movm_epi8(bits));
+    }
+    SCALAR_KERNELS.thresholdMask(mask + i, bgRed + i, bgGreen + i, bgBlue + i,
+        red + i, green + i, blue + i, n - i, threshold);
+}
+
+static void grayPlaneAVX512(uint8_t* out, const uint8_t* red, const uint8_t* green,
+    const uint8_t* blue, size_t n) {
+    const __m512i div3 = _mm512_set1_epi16((short)DIV3_MULTIPLIER);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512i gray = gray32(red + i, green + i, blue + i, div3);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtepi16_epi8(gray));
+    }
+    SCALAR_KERNELS.grayPlane(out + i, red + i, green + i, blue + i, n - i);
+}
+
+static void grayMaskAVX512(uint8_t* mask, const uint8_t* bgGray, const uint8_t* red,
+    const uint8_t* green, const uint8_t* blue, size_t n, int threshold) {
+    const __m512i div3 = _mm512_set1_epi16((short)DIV3_MULTIPLIER);
+    const __m512i limit = _mm512_set1_epi16((short)(threshold < -1 ? -1 : threshold > 32767 ? 32767 : threshold));
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __mmask32 lo = _mm512_cmpgt_epi16_mask(absDiff16(load32(bgGray + i),
+            gray32(red + i, green + i, blue + i, div3)), limit);
+        __mmask32 hi = _mm512_cmpgt_epi16_mask(absDiff16(load32(bgGray + i + 32),
+            gray32(red + i + 32, green + i + 32, blue + i + 32, div3)), limit);
+        __mmask64 bits = (__mmask64)lo | ((__mmask64)hi << 32);
+        _mm512_storeu_si512(mask + i, _mm512_movm_epi8(bits));
+    }
+    SCALAR_KERNELS.grayMask(mask + i, bgGray + i, red + i, green + i, blue + i, n - i, threshold);
+}
+
+static void mixtureUpdateAVX512(const MixtureRun& run, size_t n, const MixtureParams& params) {
+    mixtureUpdateGeneric(run, n, params);
+}
+
+// The 16-bit compares already yield one mask bit per pixel; they are
+// stored as they are instead of being widened to bytes.
+static void thresholdBitsAVX512(uint64_t* bits, const uint8_t* bgRed, const uint8_t* bgGreen,
+    const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+    size_t n, int threshold) {
+    const __m512i div3 = _mm512_set1_epi16((short)DIV3_MULTIPLIER);
+    const __m512i limit = _mm512_set1_epi16((short)(threshold < -1 ? -1 : threshold > 32767 ? 32767 : threshold));
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __mmask32 lo = _mm512_cmpgt_epi16_mask(absDiff16(
+            gray32(bgRed + i, bgGreen + i, bgBlue + i, div3),
+            gray32(red + i, green + i, blue + i, div3)), limit);
+        __mmask32 hi = _mm512_cmpgt_epi16_mask(absDiff16(
+            gray32(bgRed + i + 32, bgGreen + i + 32, bgBlue + i + 32, div3),
+            gray32(red + i + 32, green + i + 32, blue + i + 32, div3)), limit);
+        bits[i / 64] = (uint64_t)lo | ((uint64_t)hi << 32);
+    }
+    SCALAR_KERNELS.thresholdBits(bits + i / 64, bgRed + i, bgGreen + i, bgBlue + i,
+        red + i, green + i, blue + i, n - i, threshold);
+}
+
+static void packMaskAVX512(uint64_t* bits, const uint8_t* mask, size_t n) {
+    for (size_t w = 0; w < n / 64; w++) {
+        __m512i v = _mm512_loadu_si512(mask + w * 64);
+        bits[w] = _mm512_test_epi8_mask(v, v);
+    }
+    SCALAR_KERNELS.packMask(bits + n / 64, mask + n / 64 * 64, n % 64);
+}
+
+static uint8_t maxDifferenceAVX512(const uint8_t* a, const uint8_t* b, size_t n) {
+    __m512i worst = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i x = _mm512_loadu_si512(a + i);
+        __m512i y = _mm512_loadu_si512(b + i);
+        worst = _mm512_max_epu8(worst, _mm512_or_si512(_mm512_subs_epu8(x, y), _mm512_subs_epu8(y, x)));
+    }
+    __m256i quarter = _mm256_max_epu8(_mm512_castsi512_si256(worst), _mm512_extracti64x4_epi64(worst, 1));
+    __m128i half = _mm_max_epu8(_mm256_castsi256_si128(quarter), _mm256_extracti128_si256(quarter, 1));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 8));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 4));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 2));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 1));
+    uint8_t vector = (uint8_t)_mm_cvtsi128_si32(half);
+    uint8_t tail = SCALAR_KERNELS.maxDifference(a + i, b + i, n - i);
+    return vector > tail ? vector : tail;
+}
+
+const KernelTable AVX512_KERNELS = {
+    "avx512",
+    sumPlanesAVX512,
+    accumulatePlaneAVX512,
+    slidePlaneAVX512,
+    dividePlaneAVX512,
+    thresholdMaskAVX512,
+    grayPlaneAVX512,
+    grayMaskAVX512,
+    mixtureUpdateAVX512,
+    thresholdBitsAVX512,
+    packMaskAVX512,
+    maxDifferenceAVX512
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include "KernelsIsa.h"
+#include "MixtureKernel.h"
+
+#include <string.h>
+
+#if BGS_X86
+
+#include <emmintrin.h>
+
+static void sumPlanesSSE2(uint32_t* sums, const uint8_t* const* planes, int numPlanes,
+    size_t offset, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    alignas(64) uint16_t block[SUM_BLOCK];
+    size_t i = 0;
+    while (i + 16 <= n) {
+        int len = n - i >= SUM_BLOCK ? SUM_BLOCK : (int)((n - i) / 16 * 16);
+        for (int k0 = 0; k0 < numPlanes; k0 += MAX_16BIT_PLANES) {
+            int k1 = k0 + MAX_16BIT_PLANES < numPlanes ? k0 + MAX_16BIT_PLANES : numPlanes;
+            memset(block, 0, len * sizeof(uint16_t));
+            for (int k = k0; k < k1; k++) {
+                const uint8_t* p = planes[k] + offset + i;
+                for (int j = 0; j < len; j += 16) {
+                    __m128i x = _mm_loadu_si128((const __m128i*)(p + j));
+                    __m128i* acc = (__m128i*)(block + j);
+                    _mm_store_si128(acc, _mm_add_epi16(_mm_load_si128(acc), _mm_unpacklo_epi8(x, zero)));
+                    _mm_store_si128(acc + 1, _mm_add_epi16(_mm_load_si128(acc + 1), _mm_unpackhi_epi8(x, zero)));
+                }
+            }
+            uint32_t* out = sums + i;
+            for (int j = 0; j < len; j += 16) {
+                __m128i* dst = (__m128i*)(out + j);
+                __m128i lo = _mm_load_si128((const __m128i*)(block + j));
+                __m128i hi = _mm_load_si128((const __m128i*)(block + j + 8));
+                _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), _mm_unpacklo_epi16(lo, zero)));
+                _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), _mm_unpackhi_epi16(lo, zero)));
+                _mm_storeu_si128(dst + 2, _mm_add_epi32(_mm_loadu_si128(dst + 2), _mm_unpacklo_epi16(hi, zero)));
+                _mm_storeu_si128(dst + 3, _mm_add_epi32(_mm_loadu_si128(dst + 3), _mm_unpackhi_epi16(hi, zero)));
+            }
+        }
+        i += len;
+    }
+    SCALAR_KERNELS.sumPlanes(sums + i, planes, numPlanes, offset + i, n - i);
+}
+
+static void accumulatePlaneSSE2(uint32_t* sums, const uint8_t* plane, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i* out = (__m128i*)(sums + i);
+        __m128i x = _mm_loadu_si128((const __m128i*)(plane + i));
+        __m128i lo = _mm_unpacklo_epi8(x, zero);
+        __m128i hi = _mm_unpackhi_epi8(x, zero);
+        _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(out + 2, _mm_add_epi32(_mm_loadu_si128(out + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(out + 3, _mm_add_epi32(_mm_loadu_si128(out + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+    SCALAR_KERNELS.accumulatePlane(sums + i, plane + i, n - i);
+}
+
+// Differences are formed in 16 bits and sign-extended to 32 before the add.
+static void slidePlaneSSE2(uint32_t* sums, const uint8_t* incoming, const uint8_t* outgoing,
+    size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i* out = (__m128i*)(sums + i);
+        __m128i x = _mm_loadu_si128((const __m128i*)(incoming + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(outgoing + i));
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(y, zero));
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(y, zero));
+        __m128i loSign = _mm_srai_epi16(lo, 15);
+        __m128i hiSign = _mm_srai_epi16(hi, 15);
+        _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), _mm_unpacklo_epi16(lo, loSign)));
+        _mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_unpackhi_epi16(lo, loSign)));
+        _mm_storeu_si128(out + 2, _mm_add_epi32(_mm_loadu_si128(out + 2), _mm_unpacklo_epi16(hi, hiSign)));
+        _mm_storeu_si128(out + 3, _mm_add_epi32(_mm_loadu_si128(out + 3), _mm_unpackhi_epi16(hi, hiSign)));
+    }
+    SCALAR_KERNELS.slidePlane(sums + i, incoming + i, outgoing + i, n - i);
+}
+
+// Four 32-bit quotients: 32x32->64 multiplies on even and odd lanes, shift,
+// then recombine the low halves.
+static inline __m128i divide4(__m128i x, __m128i multiplier, __m128i shift) {
+    __m128i even = _mm_srl_epi64(_mm_mul_epu32(x, multiplier), shift);
+    __m128i odd = _mm_srl_epi64(_mm_mul_epu32(_mm_srli_epi64(x, 32), multiplier), shift);
+    return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+static void dividePlaneSSE2(uint8_t* out, const uint32_t* sums, size_t n,
+    FixedPointDivisor divisor) {
+    const __m128i multiplier = _mm_set1_epi32((int)divisor.Multiplier);
+    const __m128i shift = _mm_cvtsi32_si128(divisor.Shift);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i* in = (const __m128i*)(sums + i);
+        __m128i q0 = divide4(_mm_loadu_si128(in), multiplier, shift);
+        __m128i q1 = divide4(_mm_loadu_si128(in + 1), multiplier, shift);
+        __m128i q2 = divide4(_mm_loadu_si128(in + 2), multiplier, shift);
+        __m128i q3 = divide4(_mm_loadu_si128(in + 3), multiplier, shift);
+        __m128i lo = _mm_packs_epi32(q0, q1);
+        __m128i hi = _mm_packs_epi32(q2, q3);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+    }
+    SCALAR_KERNELS.dividePlane(out + i, sums + i, n - i, divisor);
+}
+
+static inline __m128i gray8(__m128i r, __m128i g, __m128i b, __m128i div3) {
+    __m128i sum = _mm_add_epi16(_mm_add_epi16(r, g), b);
+    return _mm_mulhi_epu16(sum, div3);
+}
+
+static inline __m128i absDiff16(__m128i a, __m128i b) {
+    return _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a));
+}
+
+static void thresholdMaskSSE2(uint8_t* mask, const uint8_t* bgRed, const uint8_t* bgGreen,
+    const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+    size_t n, int threshold) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i div3 = _mm_set1_epi16((short)DIV3_MULTIPLIER);
+    const __m128i limit = _mm_set1_epi16((short)(threshold < -1 ? -1 : threshold > 32767 ? 32767 : threshold));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i br = _mm_loadu_si128((const __m128i*)(bgRed + i));
+        __m128i bg = _mm_loadu_si128((const __m128i*)(bgGreen + i));
+        __m128i bb = _mm_loadu_si128((const __m128i*)(bgBlue + i));
+        __m128i fr = _mm_loadu_si128((const __m128i*)(red + i));
+        __m128i fg = _mm_loadu_si128((const __m128i*)(green + i));
+        __m128i fb = _mm_loadu_si128((const __m128i*)(blue + i));
+
+        __m128i bgLo = gray8(_mm_unpacklo_epi8(br, zero), _mm_unpacklo_epi8(bg, zero),
+            _mm_unpacklo_epi8(bb, zero), div3);
+        __m128i bgHi = gray8(_mm_unpackhi_epi8(br, zero), _mm_unpackhi_epi8(bg, zero),
+            _mm_unpackhi_epi8(bb, zero), div3);
+        __m128i frLo = gray8(_mm_unpacklo_epi8(fr, zero), _mm_unpacklo_epi8(fg, zero),
+            _mm_unpacklo_epi8(fb, zero), div3);
+        __m128i frHi = gray8(_mm_unpackhi_epi8(fr, zero), _mm_unpackhi_epi8(fg, zero),
+            _mm_unpackhi_epi8(fb, zero), div3);
+
+        __m128i lo = _mm_cmpgt_epi16(absDiff16(bgLo, frLo), limit);
+        __m128i hi = _mm_cmpgt_epi16(absDiff16(bgHi, frHi), limit);
+        _mm_storeu_si128((__m128i*)(mask + i), _mm_packs_epi16(lo, hi));
+    }
+    SCALAR_KERNELS.thresholdMask(mask + i, bgRed + i, bgGreen + i, bgBlue + i,
+        red + i, green + i, blue + i, n - i, threshold);
+}
+
+static void grayPlaneSSE2(uint8_t* out, const uint8_t* red, const uint8_t* green,
+    const uint8_t* blue, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i div3 = _mm_set1_epi16((short)DIV3_MULTIPLIER);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i r = _mm_loadu_si128((const __m128i*)(red + i));
+        __m128i g = _mm_loadu_si128((const __m128i*)(green + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(blue + i));
+        __m128i lo = gray8(_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero),
+            _mm_unpacklo_epi8(b, zero), div3);
+        __m128i hi = gray8(_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero),
+            _mm_unpackhi_epi8(b, zero), div3);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+    }
+    SCALAR_KERNELS.grayPlane(out + i, red + i, green + i, blue + i, n - i);
+}
+
+static void grayMaskSSE2(uint8_t* mask, const uint8_t* bgGray, const uint8_t* red,
+    const uint8_t* green, const uint8_t* blue, size_t n, int threshold) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i div3 = _mm_set1_epi16((short)DIV3_MULTIPLIER);
+    const __m128i limit = _mm_set1_epi16((short)(threshold < -1 ? -1 : threshold > 32767 ? 32767 : threshold));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bg = _mm_loadu_si128((const __m128i*)(bgGray + i));
+        __m128i fr = _mm_loadu_si128((const __m128i*)(red + i));
+        __m128i fg = _mm_loadu_si128((const __m128i*)(green + i));
+        __m128i fb = _mm_loadu_si128((const __m128i*)(blue + i));
+
+        __m128i frLo = gray8(_mm_unpacklo_epi8(fr, zero), _mm_unpacklo_epi8(fg, zero),
+            _mm_unpacklo_epi8(fb, zero), div3);
+        __m128i frHi = gray8(_mm_unpackhi_epi8(fr, zero), _mm_unpackhi_epi8(fg, zero),
+            _mm_unpackhi_epi8(fb, zero), div3);
+
+        __m128i lo = _mm_cmpgt_epi16(absDiff16(_mm_unpacklo_epi8(bg, zero), frLo), limit);
+        __m128i hi = _mm_cmpgt_epi16(absDiff16(_mm_unpackhi_epi8(bg, zero), frHi), limit);
+        _mm_storeu_si128((__m128i*)(mask + i), _mm_packs_epi16(lo, hi));
+    }
+    SCALAR_KERNELS.grayMask(mask + i, bgGray + i, red + i, green + i, blue + i, n - i, threshold);
+}
+
+static void mixtureUpdateSSE2(const MixtureRun& run, size_t n, const MixtureParams& params) {
+    mixtureUpdateGeneric(run, n, params);
+}
+
+static void packMaskSSE2(uint64_t* bits, const uint8_t* mask, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t w = 0; w < n / 64; w++) {
+        uint64_t word = 0;
+        for (int k = 0; k < 4; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(mask + w * 64 + k * 16));
+            uint64_t empty = (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+            word |= (~empty & 0xFFFF) << (k * 16);
+        }
+        bits[w] = word;
+    }
+    SCALAR_KERNELS.packMask(bits + n / 64, mask + n / 64 * 64, n % 64);
+}
+
+static void thresholdBitsSSE2(uint64_t* bits, const uint8_t* bgRed, const uint8_t* bgGreen,
+    const uint8_t* bgBlue, const uint8_t* red, const uint8_t* green, const uint8_t* blue,
+    size_t n, int threshold) {
+    thresholdBitsByBlock(thresholdMaskSSE2, packMaskSSE2, bits, bgRed, bgGreen, bgBlue,
+        red, green, blue, n, threshold);
+}
+
+static uint8_t maxDifferenceSSE2(const uint8_t* a, const uint8_t* b, size_t n) {
+    __m128i worst = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        worst = _mm_max_epu8(worst, _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x)));
+    }
+    worst = _mm_max_epu8(worst, _mm_srli_si128(worst, 8));
+    worst = _mm_max_epu8(worst, _mm_srli_si128(worst, 4));
+    worst = _mm_max_epu8(worst, _mm_srli_si128(worst, 2));
+    worst = _mm_max_epu8(worst, _mm_srli_si128(worst, 1));
+    uint8_t vector = (uint8_t)_mm_cvtsi128_si32(worst);
+    uint8_t tail = SCALAR_KERNELS.maxDifference(a + i, b + i, n - i);
+    return vector > tail ? vector : tail;
+}
+
+const KernelTable SSE2_KERNELS = {
+    "sse2",
+    sumPlanesSSE2,
+    accumulatePlaneSSE2,
+    slidePlaneSSE2,
+    dividePlaneSSE2,
+    thresholdMaskSSE2,
+    grayPlaneSSE2,
+    grayMaskSSE2,
+    mixtureUpdateSSE2,
+    thresholdBitsSSE2,
+    packMaskSSE2,
+    maxDifferenceSSE2
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "MaskWriter.h"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "Frame.h"
+#include "ImageIO.h"
+#include "Pipeline.h"
+
+using namespace std;
+
+namespace {
+
+// An empty Name tells an encoder thread to stop.
+struct MaskJob {
+    string Name;
+    BitMask Bits;
+};
+
+}
+
+struct MaskWriter::State {
+    explicit State(size_t depth) : Jobs(depth), Spares(depth), Failed(false), Finished(false) {}
+
+    BoundedQueue<MaskJob> Jobs;
+    // Written masks, reused by the next write() of the same size
+    BoundedQueue<BitMask> Spares;
+    vector<thread> Threads;
+    mutex ErrorMutex;
+    exception_ptr Error;
+    atomic<bool> Failed;
+    bool Finished;
+
+    BitMask acquire(int width, int height) {
+        BitMask bits;
+        if (Spares.tryPop(bits)) {
+            if (bits.Width == width && bits.Height == height) {
+                return bits;
+            }
+            freeBitMask(bits);
+        }
+        return allocateBitMask(width, height);
+    }
+
+    void release(BitMask& bits) {
+        if (!Spares.tryPush(move(bits))) {
+            freeBitMask(bits);
+        }
+    }
+};
+
+void MaskWriter::StateDeleter::operator()(State* state) const {
+    state->~State();
+    alignedFree(state);
+}
+
+MaskWriter::MaskWriter(int threads, int depth) {
+    void* memory = alignedAlloc(sizeof(State));
+    try {
+        state_.reset(new (memory) State(max(1, depth)));
+    }
+    catch (...) {
+        alignedFree(memory);
+        throw;
+    }
+    if (outputConfig().Format == OUTPUT_NONE) {
+        threads = 0;
+    }
+    for (int t = 0; t < threads; t++) {
+        state_->Threads.emplace_back([this]() {
+            State& state = *state_;
+            for (;;) {
+                MaskJob job = state.Jobs.pop();
+                if (job.Name.empty()) {
+                    break;
+                }
+                try {
+                    if (!state.Failed.load()) {
+                        createGrayImage(job.Bits, job.Name);
+                    }
+                }
+                catch (...) {
+                    lock_guard<mutex> lock(state.ErrorMutex);
+                    if (!state.Error) {
+                        state.Error = current_exception();
+                    }
+                    state.Failed.store(true);
+                }
+                state.release(job.Bits);
+            }
+        });
+    }
+}
+
+MaskWriter::~MaskWriter() {
+    try {
+        finish();
+    }
+    catch (...) {
+    }
+}
+
+void MaskWriter::write(const BitMask& mask, const string& filename) {
+    if (state_->Threads.empty()) {
+        createGrayImage(mask, filename);
+        return;
+    }
+    MaskJob job = { filename, state_->acquire(mask.Width, mask.Height) };
+    memcpy(job.Bits.Words, mask.Words, bitMaskBytes(mask));
+    state_->Jobs.push(move(job));
+}
+
+void MaskWriter::write(const uint8_t* mask, int width, int height, const string& filename) {
+    if (state_->Threads.empty()) {
+        createGrayImage(mask, width, height, alignedStride(width), filename);
+        return;
+    }
+    MaskJob job = { filename, state_->acquire(width, height) };
+    packMaskRows(job.Bits, mask, 0, height);
+    state_->Jobs.push(move(job));
+}
+
+void MaskWriter::finish() {
+    State& state = *state_;
+    if (state.Finished) {
+        return;
+    }
+    state.Finished = true;
+    for (size_t t = 0; t < state.Threads.size(); t++) {
+        MaskJob stop = { string(), BitMask() };
+        state.Jobs.push(move(stop));
+    }
+    for (auto& t : state.Threads) {
+        t.join();
+    }
+    BitMask bits;
+    while (state.Spares.tryPop(bits)) {
+        freeBitMask(bits);
+    }
+    if (state.Error) {
+        rethrow_exception(state.Error);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "BitMask.h"
+
+// Per-frame mask output off the compute thread: write() copies the mask
+// bit-packed (1/8 of a byte mask) into a queue and returns, and `threads`
+// encoder threads write the queued masks with createGrayImage(), several
+// frames at once. A full queue makes write() wait (back-pressure), so at
+// most `depth` + `threads` masks are held; idle encoders block rather than
+// spin. With 0 threads write() writes the mask itself, and when the output
+// format is OUTPUT_NONE no threads are started and masks are dropped.
+class MaskWriter {
+public:
+    MaskWriter(int threads, int depth = 8);
+    // Waits for the queued masks; an error is only reported by finish().
+    ~MaskWriter();
+
+    MaskWriter(const MaskWriter&) = delete;
+    MaskWriter& operator=(const MaskWriter&) = delete;
+
+    void write(const BitMask& mask, const std::string& filename);
+    // A 0/255 byte mask with alignedStride(width) rows.
+    void write(const uint8_t* mask, int width, int height, const std::string& filename);
+    // Waits until every queued mask is written; rethrows the first write
+    // error. Further writes are not allowed.
+    void finish();
+
+private:
+    struct State;
+    // State holds cache-line aligned queues, which plain new does not
+    // align before C++17; it lives in alignedAlloc() memory instead.
+    struct StateDeleter {
+        void operator()(State* state) const;
+    };
+    std::unique_ptr<State, StateDeleter> state_;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+// Internal to the Kernels*.cpp translation units. The Gaussian mixture update
+// is written once as a branch-free loop over pixels; each kernel file wraps
+// it, so the compiler vectorises it with that file's instruction-set flags.
+// The kernel files are built with -fno-trapping-math, which lets the
+// conditional arithmetic become selects, and -ffp-contract=off, so no ISA
+// fuses into FMA and every table gives bit-identical state.
+
+#include "Kernels.h"
+
+// The state planes never overlap; without this the compiler gives up on
+// the run-time alias checks for so many streams.
+#if defined(_MSC_VER)
+#define BGS_IVDEP __pragma(loop(ivdep))
+#else
+#define BGS_IVDEP _Pragma("GCC ivdep")
+#endif
+
+// Per pixel (Stauffer-Grimson with the MOG2 variance update):
+// - the sample matches the first component, by weight, whose squared
+//   distance is under MatchThreshold * Variance; it is background when that
+//   component lies within the leading BackgroundRatio of the weight
+// - weights decay by LearningRate and the matched one gains LearningRate;
+//   the matched mean and variance move by LearningRate / weight
+// - with no match the weakest component is replaced by the sample
+// - weights are renormalised and one bubble pass restores their order
+static inline void mixtureUpdateGeneric(const MixtureRun& run, size_t n, const MixtureParams& params) {
+    const int K = MIXTURE_COMPONENTS;
+    float* weight[K];
+    float* variance[K];
+    float* mean[K][3];
+    for (int k = 0; k < K; k++) {
+        weight[k] = run.Weight[k];
+        variance[k] = run.Variance[k];
+        for (int c = 0; c < 3; c++) {
+            mean[k][c] = run.Mean[k][c];
+        }
+    }
+    const uint8_t* red = run.Sample[0];
+    const uint8_t* green = run.Sample[1];
+    const uint8_t* blue = run.Sample[2];
+    uint8_t* bgRed = run.Background[0];
+    uint8_t* bgGreen = run.Background[1];
+    uint8_t* bgBlue = run.Background[2];
+    uint8_t* mask = run.Mask;
+
+    const float rate = params.LearningRate;
+    const float keep = 1.0f - rate;
+
+    BGS_IVDEP
+    for (size_t i = 0; i < n; i++) {
+        float x[3] = { (float)red[i], (float)green[i], (float)blue[i] };
+        float w[K], v[K], m[K][3];
+        for (int k = 0; k < K; k++) {
+            w[k] = weight[k][i];
+            v[k] = variance[k][i];
+            for (int c = 0; c < 3; c++) {
+                m[k][c] = mean[k][c][i];
+            }
+        }
+
+        int found = 0;
+        int background = 0;
+        float cumulative = 0.0f;
+        for (int k = 0; k < K; k++) {
+            float d[3];
+            float dist2 = 0.0f;
+            for (int c = 0; c < 3; c++) {
+                d[c] = x[c] - m[k][c];
+                dist2 = dist2 + d[c] * d[c];
+            }
+            int match = (dist2 < params.MatchThreshold * v[k]) & (w[k] > 0.0f);
+            int hit = match & !found;
+            background |= hit & (cumulative < params.BackgroundRatio);
+            cumulative = cumulative + w[k];
+            found |= match;
+
+            w[k] = keep * w[k] + (hit ? rate : 0.0f);
+            float rho = hit ? rate / w[k] : 0.0f;
+            rho = rho < 1.0f ? rho : 1.0f;
+            for (int c = 0; c < 3; c++) {
+                m[k][c] = m[k][c] + rho * d[c];
+            }
+            float var = v[k] + rho * (dist2 - v[k]);
+            var = var < params.MinVariance ? params.MinVariance : var;
+            v[k] = var > params.MaxVariance ? params.MaxVariance : var;
+        }
+
+        // No match: the weakest component restarts at the sample
+        const int last = K - 1;
+        w[last] = found ? w[last] : rate;
+        v[last] = found ? v[last] : params.InitialVariance;
+        for (int c = 0; c < 3; c++) {
+            m[last][c] = found ? m[last][c] : x[c];
+        }
+
+        float total = 0.0f;
+        for (int k = 0; k < K; k++) {
+            total = total + w[k];
+        }
+        float scale = 1.0f / total;
+        for (int k = 0; k < K; k++) {
+            w[k] = w[k] * scale;
+        }
+
+        for (int k = K - 1; k > 0; k--) {
+            int swap = w[k] > w[k - 1];
+            float hiW = swap ? w[k] : w[k - 1];
+            float loW = swap ? w[k - 1] : w[k];
+            float hiV = swap ? v[k] : v[k - 1];
+            float loV = swap ? v[k - 1] : v[k];
+            w[k - 1] = hiW;
+            w[k] = loW;
+            v[k - 1] = hiV;
+            v[k] = loV;
+            for (int c = 0; c < 3; c++) {
+                float hiM = swap ? m[k][c] : m[k - 1][c];
+                float loM = swap ? m[k - 1][c] : m[k][c];
+                m[k - 1][c] = hiM;
+                m[k][c] = loM;
+            }
+        }
+
+        for (int k = 0; k < K; k++) {
+            weight[k][i] = w[k];
+            variance[k][i] = v[k];
+            for (int c = 0; c < 3; c++) {
+                mean[k][c][i] = m[k][c];
+            }
+        }
+        bgRed[i] = (uint8_t)(m[0][0] + 0.5f);
+        bgGreen[i] = (uint8_t)(m[0][1] + 0.5f);
+        bgBlue[i] = (uint8_t)(m[0][2] + 0.5f);
+        mask[i] = background ? 0 : 255;
+    }
+}
@@ -0,0 +1,188 @@
+#include "Morphology.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "Trace.h"
+
+using namespace std;
+
+MorphologyOp morphologyOp(const string& name) {
+    if (name == "none") return MORPH_NONE;
+    if (name == "erode") return MORPH_ERODE;
+    if (name == "dilate") return MORPH_DILATE;
+    if (name == "open") return MORPH_OPEN;
+    if (name == "close") return MORPH_CLOSE;
+    throw invalid_argument("unknown morphology operation: " + name);
+}
+
+const char* morphologyName(MorphologyOp op) {
+    switch (op) {
+    case MORPH_ERODE: return "erode";
+    case MORPH_DILATE: return "dilate";
+    case MORPH_OPEN: return "open";
+    case MORPH_CLOSE: return "close";
+    default: return "none";
+    }
+}
+
+int morphologyPasses(MorphologyOp op) {
+    return op == MORPH_NONE ? 0 : op == MORPH_OPEN || op == MORPH_CLOSE ? 2 : 1;
+}
+
+bool morphologyDilates(MorphologyOp op, int pass) {
+    switch (op) {
+    case MORPH_DILATE: return true;
+    case MORPH_OPEN: return pass == 1;
+    case MORPH_CLOSE: return pass == 0;
+    default: return false;
+    }
+}
+
+int morphologyHalo(const MorphologyConfig& config) {
+    return max(1, config.KernelHeight) / 2;
+}
+
+namespace {
+
+// dst[i] = min or max of a[i], b[i]; plain loops the compiler vectorises.
+inline void combine(uint8_t* dst, const uint8_t* a, const uint8_t* b, size_t n, bool dilate) {
+    if (dilate) {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = max(a[i], b[i]);
+        }
+    }
+    else {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = min(a[i], b[i]);
+        }
+    }
+}
+
+// Pass scratch is kept per thread and only ever grows, so a warm pass
+// allocates and clears nothing; every byte read is written first.
+uint8_t* scratchRows(vector<uint8_t>& buffer, size_t bytes) {
+    if (buffer.size() < bytes) {
+        buffer.resize(bytes);
+    }
+    return buffer.data();
+}
+
+// van Herk/Gil-Werman along one row: out[x] is the min/max of
+// in[x - k/2 .. x - k/2 + k - 1]. g is the running value from the start of
+// each k-block, h from its end; any window spans at most two blocks, so it
+// is h at its first sample combined with g at its last.
+void rowPass(const uint8_t* in, uint8_t* out, int width, int k, bool dilate, uint8_t identity,
+    vector<uint8_t>& g, vector<uint8_t>& h) {
+    int before = k / 2;
+    int length = width + k - 1;
+    uint8_t* pg = scratchRows(g, length);
+    uint8_t* ph = scratchRows(h, length);
+    for (int t = 0; t < length; t++) {
+        int x = t - before;
+        ph[t] = x >= 0 && x < width ? in[x] : identity;
+    }
+    for (int block = 0; block < length; block += k) {
+        int end = min(block + k, length);
+        pg[block] = ph[block];
+        for (int t = block + 1; t < end; t++) {
+            pg[t] = dilate ? max(pg[t - 1], ph[t]) : min(pg[t - 1], ph[t]);
+        }
+        for (int t = end - 2; t >= block; t--) {
+            ph[t] = dilate ? max(ph[t], ph[t + 1]) : min(ph[t], ph[t + 1]);
+        }
+    }
+    combine(out, ph, pg + k - 1, width, dilate);
+}
+
+}
+
+// The vertical half works on whole rows at a time, so its min/max loops run
+// across the row; the horizontal half then runs row by row.
+void morphologyPass(const uint8_t* src, uint8_t* dst, int width, int stride, int rows,
+    const MorphologyConfig& config, bool dilate, int firstRow, int lastRow) {
+    TRACE_SCOPE("morphology");
+    int kw = max(1, config.KernelWidth);
+    int kh = max(1, config.KernelHeight);
+    uint8_t identity = dilate ? 0 : 255;
+    int outRows = lastRow - firstRow;
+    if (outRows <= 0) {
+        return;
+    }
+
+    // Vertical: g and h over the source rows the range needs, blocks of kh
+    // rows counted from the first of them.
+    int before = kh / 2;
+    int length = outRows + kh - 1;
+    thread_local vector<uint8_t> identityRows[2];
+    thread_local vector<uint8_t> g;
+    thread_local vector<uint8_t> h;
+    thread_local vector<uint8_t> vertical;
+    vector<uint8_t>& identityRow = identityRows[dilate];
+    if (identityRow.size() < (size_t)width) {
+        identityRow.assign(width, identity);
+    }
+    scratchRows(g, (size_t)length * stride);
+    scratchRows(h, (size_t)length * stride);
+    scratchRows(vertical, (size_t)outRows * stride);
+    if (kh == 1) {
+        memcpy(vertical.data(), src + (size_t)firstRow * stride, (size_t)outRows * stride);
+    }
+    else {
+        auto sourceRow = [&](int t) {
+            int row = firstRow - before + t;
+            return row >= 0 && row < rows ? src + (size_t)row * stride : identityRow.data();
+        };
+        for (int t = 0; t < length; t++) {
+            uint8_t* gRow = g.data() + (size_t)t * stride;
+            if (t % kh == 0) {
+                memcpy(gRow, sourceRow(t), width);
+            }
+            else {
+                combine(gRow, gRow - stride, sourceRow(t), width, dilate);
+            }
+        }
+        for (int t = length - 1; t >= 0; t--) {
+            uint8_t* hRow = h.data() + (size_t)t * stride;
+            if ((t + 1) % kh == 0 || t == length - 1) {
+                memcpy(hRow, sourceRow(t), width);
+            }
+            else {
+                combine(hRow, hRow + stride, sourceRow(t), width, dilate);
+            }
+        }
+        for (int s = 0; s < outRows; s++) {
+            combine(vertical.data() + (size_t)s * stride, h.data() + (size_t)s * stride,
+                g.data() + (size_t)(s + kh - 1) * stride, width, dilate);
+        }
+    }
+
+    // Horizontal
+    thread_local vector<uint8_t> rowG;
+    thread_local vector<uint8_t> rowH;
+    for (int s = 0; s < outRows; s++) {
+        const uint8_t* in = vertical.data() + (size_t)s * stride;
+        uint8_t* out = dst + (size_t)(firstRow + s) * stride;
+        if (kw == 1) {
+            memcpy(out, in, width);
+        }
+        else {
+            rowPass(in, out, width, kw, dilate, identity, rowG, rowH);
+        }
+    }
+}
+
+void applyMorphology(uint8_t* mask, uint8_t* scratch, int width, int height, int stride,
+    const MorphologyConfig& config) {
+    int passes = morphologyPasses(config.Op);
+    uint8_t* buffers[2] = { mask, scratch };
+    for (int p = 0; p < passes; p++) {
+        morphologyPass(buffers[p & 1], buffers[(p + 1) & 1], width, stride, height, config,
+            morphologyDilates(config.Op, p), 0, height);
+    }
+    if (passes & 1) {
+        memcpy(mask, scratch, (size_t)stride * height);
+    }
+}
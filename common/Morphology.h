@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Morphological cleanup of 0/255 byte masks with a rectangular structuring
+// element. Erosion (min) and dilation (max) are separable, and each 1-D
+// pass uses the van Herk/Gil-Werman block prefix/suffix scheme: three
+// min/max operations per pixel whatever the kernel size. Open is erode then
+// dilate, close is dilate then erode. Outside the mask counts as the
+// operation's identity (255 for erode, 0 for dilate), so borders are
+// neither eroded nor dilated into.
+//
+// A pass can be split by output rows: rows [firstRow, lastRow) read source
+// rows up to morphologyHalo() beyond the range, so passes of a compound
+// operation need the whole previous pass (a barrier between them, or a
+// halo exchange between MPI ranks).
+
+enum MorphologyOp {
+    MORPH_NONE,
+    MORPH_ERODE,
+    MORPH_DILATE,
+    MORPH_OPEN,
+    MORPH_CLOSE
+};
+
+struct MorphologyConfig {
+    MorphologyOp Op;
+    int KernelWidth;
+    int KernelHeight;
+};
+
+// "none", "erode", "dilate", "open" or "close"; throws invalid_argument.
+MorphologyOp morphologyOp(const std::string& name);
+const char* morphologyName(MorphologyOp op);
+
+// Number of erode/dilate passes (0 for MORPH_NONE) and whether pass
+// `pass` dilates.
+int morphologyPasses(MorphologyOp op);
+bool morphologyDilates(MorphologyOp op, int pass);
+
+// Rows above or below a row range that one pass reads.
+int morphologyHalo(const MorphologyConfig& config);
+
+// One pass over a `rows`-tall mask: dst rows [firstRow, lastRow) from src.
+// src and dst must not overlap. Its row buffers are kept per thread, so
+// warm passes do not allocate.
+void morphologyPass(const uint8_t* src, uint8_t* dst, int width, int stride, int rows,
+    const MorphologyConfig& config, bool dilate, int firstRow, int lastRow);
+
+// Every pass over the whole mask, in place; scratch is another mask-sized
+// buffer.
+void applyMorphology(uint8_t* mask, uint8_t* scratch, int width, int height, int stride,
+    const MorphologyConfig& config);
@@ -0,0 +1,39 @@
+#include "Options.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+static const char* findValue(int argc, char* argv[], const char* name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return nullptr;
+}
+
+bool hasOption(int argc, char* argv[], const char* name) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int intOption(int argc, char* argv[], const char* name, int fallback) {
+    const char* value = findValue(argc, argv, name);
+    return value ? atoi(value) : fallback;
+}
+
+double doubleOption(int argc, char* argv[], const char* name, double fallback) {
+    const char* value = findValue(argc, argv, name);
+    return value ? atof(value) : fallback;
+}
+
+string stringOption(int argc, char* argv[], const char* name, const string& fallback) {
+    const char* value = findValue(argc, argv, name);
+    return value ? string(value) : fallback;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+// Minimal "--name value" command-line lookup shared by the backends. Each
+// backend keeps its compile-time constants as defaults.
+
+bool hasOption(int argc, char* argv[], const char* name);
+int intOption(int argc, char* argv[], const char* name, int fallback);
+double doubleOption(int argc, char* argv[], const char* name, double fallback);
+std::string stringOption(int argc, char* argv[], const char* name, const std::string& fallback);
@@ -0,0 +1,221 @@
+#include "Pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "FramePool.h"
+#include "FrameStream.h"
+#include "ImageIO.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+namespace {
+
+// Index == SIZE_MAX tells the compute stage a decoder has stopped.
+struct DecodedFrame {
+    size_t Index;
+    PoolBuffer Image;
+};
+
+// Index == SIZE_MAX tells an encoder to stop.
+struct MaskJob {
+    size_t Index;
+    PoolBuffer Mask;
+    int Width;
+    int Height;
+};
+
+// First error raised by any stage; later ones are dropped.
+class ErrorSlot {
+public:
+    void capture() {
+        lock_guard<mutex> lock(mutex_);
+        if (!error_) {
+            error_ = current_exception();
+        }
+    }
+    void rethrow() {
+        if (error_) {
+            rethrow_exception(error_);
+        }
+    }
+private:
+    mutex mutex_;
+    exception_ptr error_;
+};
+
+// Frames a decoder may start: those less than `depth` ahead of the one the
+// compute stage needs next, so a slow frame cannot let the others pile up.
+class DecodeWindow {
+public:
+    explicit DecodeWindow(size_t depth) : depth_(depth), next_(0), closed_(false) {}
+
+    // Waits until `index` is inside the window; false once it is closed.
+    bool wait(size_t index) {
+        unique_lock<mutex> lock(mutex_);
+        changed_.wait(lock, [&]() { return closed_ || index < next_ + depth_; });
+        return !closed_;
+    }
+    void advance(size_t next) {
+        lock_guard<mutex> lock(mutex_);
+        next_ = next;
+        changed_.notify_all();
+    }
+    void close() {
+        lock_guard<mutex> lock(mutex_);
+        closed_ = true;
+        changed_.notify_all();
+    }
+private:
+    mutex mutex_;
+    condition_variable changed_;
+    size_t depth_;
+    size_t next_;
+    bool closed_;
+};
+
+}
+
+PipelineStats runPipeline(const vector<string>& paths, const PipelineConfig& config,
+    const function<void(const Frame&, size_t, uint8_t*)>& compute,
+    const function<string(size_t)>& maskName) {
+    int decodeThreads = max(1, config.DecodeThreads);
+    int encodeThreads = max(1, config.EncodeThreads);
+    size_t depth = max(1, config.QueueDepth);
+
+    // Declared first: buffers still queued go back to it on the way out
+    FramePool pool;
+    BoundedQueue<DecodedFrame> decoded(depth);
+    BoundedQueue<MaskJob> masks(depth);
+    DecodeWindow window(depth);
+    atomic<size_t> nextToDecode(0);
+    atomic<bool> failed(false);
+    ErrorSlot error;
+
+    Clock::time_point wallStart = Clock::now();
+
+    vector<thread> decoders;
+    for (int t = 0; t < decodeThreads; t++) {
+        decoders.emplace_back([&]() {
+            try {
+                for (;;) {
+                    size_t index = nextToDecode.fetch_add(1);
+                    if (index >= paths.size() || failed.load() || !window.wait(index)) {
+                        break;
+                    }
+                    DecodedFrame item = { index, loadPooledFrame(pool, paths[index]) };
+                    decoded.push(move(item));
+                }
+            }
+            catch (...) {
+                error.capture();
+                failed.store(true);
+            }
+            DecodedFrame done = { SIZE_MAX, PoolBuffer() };
+            decoded.push(move(done));
+        });
+    }
+
+    vector<thread> encoders;
+    for (int t = 0; t < encodeThreads; t++) {
+        encoders.emplace_back([&]() {
+            for (;;) {
+                MaskJob job = masks.pop();
+                if (job.Index == SIZE_MAX) {
+                    break;
+                }
+                try {
+                    if (!failed.load()) {
+                        createGrayImage(job.Mask.data(), job.Width, job.Height, alignedStride(job.Width),
+                            maskName(job.Index));
+                    }
+                }
+                catch (...) {
+                    error.capture();
+                    failed.store(true);
+                }
+            }
+        });
+    }
+
+    // Compute stage: decoders finish out of order, so frames wait in
+    // `pending` until their turn. The decode window keeps it within depth.
+    map<size_t, PoolBuffer> pending;
+    double computeSeconds = 0;
+    size_t next = 0;
+    int decodersDone = 0;
+    while (next < paths.size()) {
+        auto it = pending.find(next);
+        if (it != pending.end()) {
+            PoolBuffer pooled = move(it->second);
+            pending.erase(it);
+            const Frame& frame = pooled.frame();
+            PoolBuffer mask = pool.acquireMask(frame.Width, frame.Height);
+
+            Clock::time_point start = Clock::now();
+            try {
+                compute(frame, next, mask.data());
+            }
+            catch (...) {
+                error.capture();
+                failed.store(true);
+            }
+            computeSeconds += chrono::duration<double>(Clock::now() - start).count();
+
+            MaskJob job = { next, move(mask), frame.Width, frame.Height };
+            masks.push(move(job));
+            next++;
+            window.advance(next);
+            if (failed.load()) {
+                break;
+            }
+            continue;
+        }
+
+        // Every decoder has stopped; only a failure leaves frames missing
+        if (decodersDone == decodeThreads) {
+            break;
+        }
+        DecodedFrame item = decoded.pop();
+        if (item.Index == SIZE_MAX) {
+            decodersDone++;
+        }
+        else {
+            pending[item.Index] = move(item.Image);
+        }
+    }
+
+    for (int t = 0; t < encodeThreads; t++) {
+        MaskJob stop = { SIZE_MAX, PoolBuffer(), 0, 0 };
+        masks.push(move(stop));
+    }
+    // Keep draining so decoders blocked on a full queue can exit
+    failed.store(failed.load() || next < paths.size());
+    window.close();
+    while (decodersDone < decodeThreads) {
+        if (decoded.pop().Index == SIZE_MAX) {
+            decodersDone++;
+        }
+    }
+    for (auto& t : decoders) {
+        t.join();
+    }
+    for (auto& t : encoders) {
+        t.join();
+    }
+
+    error.rethrow();
+
+    PipelineStats stats;
+    stats.ComputeSeconds = computeSeconds;
+    stats.WallSeconds = chrono::duration<double>(Clock::now() - wallStart).count();
+    stats.Frames = (int)next;
+    return stats;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Frame.h"
+
+// Decode -> compute -> encode pipeline. Decoder threads read PNG frames,
+// the calling thread runs the compute stage in frame order, and encoder
+// threads write the per-frame masks, all on different frames at once.
+// Stages are joined by bounded lock-free queues; a full queue parks the
+// stage feeding it, and decoders stay within QueueDepth frames of the
+// compute stage, so at most QueueDepth decoded frames and about
+// QueueDepth + EncodeThreads masks are in flight.
+
+// Bounded multi-producer multi-consumer queue (Vyukov's array queue). Each
+// cell carries a sequence number telling producers and consumers whether
+// it is free or filled for their lap; positions are claimed with a CAS.
+// Values are moved in and out, so T may be move-only. push() and pop()
+// park on a condition variable when the queue is full or empty; the
+// other side only takes the lock when someone is parked.
+template <typename T>
+class BoundedQueue {
+public:
+    // Capacity is rounded up to a power of two (at least 2).
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        cells_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            cells_[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+        mask_ = size - 1;
+        enqueuePos_.store(0, std::memory_order_relaxed);
+        dequeuePos_.store(0, std::memory_order_relaxed);
+        pushWaiters_.store(0, std::memory_order_relaxed);
+        popWaiters_.store(0, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // `value` is moved from only when the push succeeds.
+    bool tryPush(T&& value) {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.Sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.Value = std::move(value);
+                    cell.Sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value) {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.Sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.Value);
+                    cell.Sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Blocking forms; they wait while the queue is full (back-pressure) or empty.
+    void push(T&& value) {
+        if (!tryPush(std::move(value))) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            pushWaiters_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            notFull_.wait(lock, [&]() { return tryPush(std::move(value)); });
+            pushWaiters_.fetch_sub(1);
+        }
+        wake(popWaiters_, notEmpty_);
+    }
+
+    T pop() {
+        T value;
+        if (!tryPop(value)) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            popWaiters_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            notEmpty_.wait(lock, [&]() { return tryPop(value); });
+            popWaiters_.fetch_sub(1);
+        }
+        wake(pushWaiters_, notFull_);
+        return value;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> Sequence;
+        T Value;
+    };
+
+    // The fence pairs with the one a waiter issues after counting itself,
+    // so either the waiter sees the new cell state or this sees the waiter.
+    void wake(std::atomic<int>& waiters, std::condition_variable& cv) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv.notify_all();
+        }
+    }
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueuePos_;
+    alignas(64) std::atomic<size_t> dequeuePos_;
+    alignas(64) std::mutex mutex_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+    std::atomic<int> pushWaiters_;
+    std::atomic<int> popWaiters_;
+};
+
+struct PipelineConfig {
+    int DecodeThreads;
+    int EncodeThreads;
+    // Capacity of each queue between stages
+    int QueueDepth;
+};
+
+struct PipelineStats {
+    double ComputeSeconds;
+    double WallSeconds;
+    int Frames;
+};
+
+// compute(frame, index, mask) runs on the calling thread for frames
+// 0, 1, 2, ... in order; mask is an allocateMask()-sized buffer for the
+// frame which the encoders then write to maskName(index). Frames and masks
+// are recycled through a FramePool, so a reused mask holds an old frame's
+// pixels until compute overwrites them. Decode or encode errors are
+// rethrown once every stage has stopped.
+PipelineStats runPipeline(const std::vector<std::string>& paths, const PipelineConfig& config,
+    const std::function<void(const Frame&, size_t, uint8_t*)>& compute,
+    const std::function<std::string(size_t)>& maskName);
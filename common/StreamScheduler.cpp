@@ -0,0 +1,314 @@
+#include "StreamScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "Trace.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct StreamScheduler::Stream {
+    string Name;
+    double Interval;
+    function<bool(size_t)> Process;
+    // Next frame to process; only the thread running the feed changes it
+    size_t Next;
+    double BusySeconds;
+    vector<double> Latencies;
+    int MaxBacklog;
+    double LastDone;
+};
+
+// Feeds with a due frame, run by this thread unless another steals them
+struct StreamScheduler::Worker {
+    mutex Mutex;
+    deque<int> Ready;
+};
+
+struct StreamScheduler::State {
+    Clock::time_point Start;
+    // Feeds not yet ended
+    atomic<int> Active;
+    atomic<bool> Failed;
+    atomic<size_t> Steals;
+    // Feeds waiting for their next frame to fall due
+    mutex ParkedMutex;
+    vector<int> Parked;
+    mutex ErrorMutex;
+    exception_ptr Error;
+    // Idle threads sleep on Changed until Epoch moves (a feed was queued,
+    // parked or ended) or the earliest parked feed falls due
+    mutex WaitMutex;
+    condition_variable Changed;
+    atomic<size_t> Epoch;
+    int Sleepers;
+
+    double now() const {
+        return chrono::duration<double>(Clock::now() - Start).count();
+    }
+
+    void signal() {
+        lock_guard<mutex> lock(WaitMutex);
+        Epoch++;
+        if (Sleepers > 0) {
+            Changed.notify_all();
+        }
+    }
+};
+
+StreamScheduler::StreamScheduler(const StreamSchedulerConfig& config)
+    : config_(config), state_(new State()) {
+    config_.Threads = max(1, config.Threads);
+    config_.LocalitySlack = max(0.0, config.LocalitySlack);
+    for (int t = 0; t < config_.Threads; t++) {
+        workers_.emplace_back(new Worker());
+    }
+}
+
+StreamScheduler::~StreamScheduler() {}
+
+void StreamScheduler::addStream(const string& name, double interval, const function<bool(size_t)>& process) {
+    unique_ptr<Stream> stream(new Stream());
+    stream->Name = name;
+    stream->Interval = max(0.0, interval);
+    stream->Process = process;
+    stream->Next = 0;
+    stream->BusySeconds = 0;
+    stream->MaxBacklog = 0;
+    stream->LastDone = 0;
+    streams_.push_back(move(stream));
+}
+
+double StreamScheduler::dueTime(const Stream& stream, size_t frame) const {
+    return stream.Interval * frame;
+}
+
+// Index in `ready` of the feed whose next frame fell due first; ties go to
+// the feed with fewer frames done, so recorded feeds take turns.
+static int mostOverdue(const deque<int>& ready, const vector<double>& due, const vector<size_t>& done) {
+    int best = -1;
+    for (int i = 0; i < (int)ready.size(); i++) {
+        int s = ready[i];
+        if (best < 0 || due[s] < due[ready[best]] || (due[s] == due[ready[best]] && done[s] < done[ready[best]])) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+bool StreamScheduler::takeTask(int self, int& stream) {
+    // Keys of queued feeds; a feed's Next only changes while it is running,
+    // never while it sits in a deque
+    auto keysOf = [&](const deque<int>& ready, vector<double>& due, vector<size_t>& done) {
+        for (int s : ready) {
+            due[s] = dueTime(*streams_[s], streams_[s]->Next);
+            done[s] = streams_[s]->Next;
+        }
+    };
+    vector<double> due(streams_.size());
+    vector<size_t> done(streams_.size());
+
+    double localDue = 0;
+    bool haveLocal = false;
+    {
+        Worker& own = *workers_[self];
+        lock_guard<mutex> lock(own.Mutex);
+        keysOf(own.Ready, due, done);
+        int best = mostOverdue(own.Ready, due, done);
+        if (best >= 0) {
+            haveLocal = true;
+            localDue = due[own.Ready[best]];
+        }
+    }
+
+    // Steal the most overdue feed elsewhere if it waited LocalitySlack
+    // longer than ours, or if we have nothing
+    int n = (int)workers_.size();
+    for (int k = 1; k < n; k++) {
+        Worker& victim = *workers_[(self + k) % n];
+        lock_guard<mutex> lock(victim.Mutex);
+        keysOf(victim.Ready, due, done);
+        int best = mostOverdue(victim.Ready, due, done);
+        if (best >= 0 && (!haveLocal || due[victim.Ready[best]] < localDue - config_.LocalitySlack)) {
+            stream = victim.Ready[best];
+            victim.Ready.erase(victim.Ready.begin() + best);
+            state_->Steals++;
+            return true;
+        }
+    }
+
+    Worker& own = *workers_[self];
+    lock_guard<mutex> lock(own.Mutex);
+    keysOf(own.Ready, due, done);
+    int best = mostOverdue(own.Ready, due, done);
+    if (best < 0) {
+        return false;
+    }
+    stream = own.Ready[best];
+    own.Ready.erase(own.Ready.begin() + best);
+    return true;
+}
+
+void StreamScheduler::runTask(int self, int index) {
+    Stream& stream = *streams_[index];
+    TRACE_SCOPE("stream frame");
+    double start = state_->now();
+    bool more = false;
+    try {
+        more = !state_->Failed.load() && stream.Process(stream.Next);
+    }
+    catch (...) {
+        lock_guard<mutex> lock(state_->ErrorMutex);
+        if (!state_->Error) {
+            state_->Error = current_exception();
+        }
+        state_->Failed.store(true);
+    }
+    double end = state_->now();
+    if (!more) {
+        state_->Active--;
+        state_->signal();
+        return;
+    }
+
+    stream.BusySeconds += end - start;
+    stream.Latencies.push_back(end - dueTime(stream, stream.Next));
+    stream.LastDone = end;
+    stream.Next++;
+    if (stream.Interval > 0) {
+        int due = (int)(end / stream.Interval) + 1;
+        stream.MaxBacklog = max(stream.MaxBacklog, due - (int)stream.Next);
+    }
+
+    if (dueTime(stream, stream.Next) <= end) {
+        Worker& own = *workers_[self];
+        lock_guard<mutex> lock(own.Mutex);
+        own.Ready.push_back(index);
+    }
+    else {
+        lock_guard<mutex> lock(state_->ParkedMutex);
+        state_->Parked.push_back(index);
+    }
+    state_->signal();
+}
+
+void StreamScheduler::workerLoop(int self) {
+    while (state_->Active.load() > 0 && !state_->Failed.load()) {
+        // Read before looking, so a feed queued after the look still wakes
+        // this thread
+        size_t seen = state_->Epoch.load();
+        int stream;
+        if (takeTask(self, stream)) {
+            runTask(self, stream);
+            continue;
+        }
+
+        // Nothing runnable: wake the parked feeds that are due now, else
+        // sleep until the next one falls due or a running feed requeues
+        double now = state_->now();
+        double wake = -1;
+        vector<int> woken;
+        {
+            lock_guard<mutex> lock(state_->ParkedMutex);
+            vector<int>& parked = state_->Parked;
+            for (size_t i = 0; i < parked.size();) {
+                const Stream& s = *streams_[parked[i]];
+                double due = dueTime(s, s.Next);
+                if (due <= now) {
+                    woken.push_back(parked[i]);
+                    parked[i] = parked.back();
+                    parked.pop_back();
+                }
+                else {
+                    wake = wake < 0 ? due : min(wake, due);
+                    i++;
+                }
+            }
+        }
+        if (!woken.empty()) {
+            {
+                Worker& own = *workers_[self];
+                lock_guard<mutex> lock(own.Mutex);
+                own.Ready.insert(own.Ready.end(), woken.begin(), woken.end());
+            }
+            // Others may steal what this thread cannot run yet
+            if (woken.size() > 1) {
+                state_->signal();
+            }
+            continue;
+        }
+
+        auto changed = [&]() {
+            return state_->Epoch.load() != seen || state_->Active.load() == 0 || state_->Failed.load();
+        };
+        unique_lock<mutex> lock(state_->WaitMutex);
+        state_->Sleepers++;
+        if (wake < 0) {
+            state_->Changed.wait(lock, changed);
+        }
+        else {
+            auto deadline = state_->Start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(wake));
+            state_->Changed.wait_until(lock, deadline, changed);
+        }
+        state_->Sleepers--;
+    }
+}
+
+StreamSchedulerStats StreamScheduler::run() {
+    state_->Active.store((int)streams_.size());
+    state_->Failed.store(false);
+    state_->Steals.store(0);
+    state_->Epoch.store(0);
+    state_->Sleepers = 0;
+    // Every feed's first frame is due at the start; deal them out
+    for (size_t s = 0; s < streams_.size(); s++) {
+        workers_[s % workers_.size()]->Ready.push_back((int)s);
+    }
+    state_->Start = Clock::now();
+
+    vector<thread> threads;
+    for (int t = 1; t < config_.Threads; t++) {
+        threads.emplace_back([this, t]() { workerLoop(t); });
+    }
+    workerLoop(0);
+    for (auto& t : threads) {
+        t.join();
+    }
+    if (state_->Error) {
+        rethrow_exception(state_->Error);
+    }
+
+    StreamSchedulerStats stats;
+    stats.WallSeconds = state_->now();
+    stats.Steals = state_->Steals.load();
+    for (auto& stream : streams_) {
+        StreamMetrics m = {};
+        m.Name = stream->Name;
+        m.Frames = (int)stream->Next;
+        m.BusySeconds = stream->BusySeconds;
+        m.MaxBacklog = stream->MaxBacklog;
+        vector<double>& latencies = stream->Latencies;
+        if (!latencies.empty()) {
+            double total = 0;
+            for (double l : latencies) {
+                total += l;
+            }
+            m.MeanLatency = total / latencies.size();
+            m.MaxLatency = *max_element(latencies.begin(), latencies.end());
+            size_t rank = (latencies.size() * 95 + 99) / 100 - 1;
+            nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+            m.P95Latency = latencies[rank];
+            m.FramesPerSecond = m.Frames / max(stream->LastDone, 1e-9);
+        }
+        stats.Streams.push_back(m);
+    }
+    return stats;
+}
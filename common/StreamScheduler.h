@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Many independent feeds (one camera each) on one shared thread pool. A
+// feed's frames are a chain of tasks: frame i + 1 is only runnable once
+// frame i is done, since each feed owns a sequential model, so a feed never
+// holds more than one thread and a slow high-resolution feed cannot take
+// over the pool.
+//
+// Frames fall due every Interval seconds from the start of run() (all at
+// once with 0, as for recorded input). A feed with a due frame is queued on
+// the deque of the thread that last ran it, which keeps its model warm in
+// that core's cache; idle threads steal. Every thread picks the feed whose
+// oldest due frame has waited longest, and takes one from another thread's
+// deque only when it has waited more than LocalitySlack seconds longer than
+// the best local one, so feeds that fall behind go first without moving
+// feeds between cores for nothing.
+
+struct StreamSchedulerConfig {
+    int Threads;
+    double LocalitySlack;
+};
+
+struct StreamMetrics {
+    std::string Name;
+    int Frames;
+    // Seconds inside process()
+    double BusySeconds;
+    // From a frame falling due to its process() returning
+    double MeanLatency;
+    double P95Latency;
+    double MaxLatency;
+    // Most frames due and not yet done at once
+    int MaxBacklog;
+    // Frames per second from the start of the run to the feed's last frame
+    double FramesPerSecond;
+};
+
+struct StreamSchedulerStats {
+    double WallSeconds;
+    // Tasks run by a thread other than the one whose deque held them
+    size_t Steals;
+    std::vector<StreamMetrics> Streams;
+};
+
+class StreamScheduler {
+public:
+    explicit StreamScheduler(const StreamSchedulerConfig& config);
+    ~StreamScheduler();
+
+    StreamScheduler(const StreamScheduler&) = delete;
+    StreamScheduler& operator=(const StreamScheduler&) = delete;
+
+    // process(index) handles frame `index` of the feed (0, 1, 2, ... in
+    // order, never two at once) and returns false once the feed has ended.
+    void addStream(const std::string& name, double interval, const std::function<bool(size_t)>& process);
+
+    // Runs every feed to its end on Threads threads (the caller is one of
+    // them). The first exception from process() stops all feeds and is
+    // rethrown.
+    StreamSchedulerStats run();
+
+private:
+    struct Stream;
+    struct Worker;
+
+    bool takeTask(int self, int& stream);
+    void runTask(int self, int stream);
+    void workerLoop(int self);
+    double dueTime(const Stream& stream, size_t frame) const;
+
+    StreamSchedulerConfig config_;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    struct State;
+    std::unique_ptr<State> state_;
+};
@@ -0,0 +1,120 @@
+#include "Synthetic.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+static const char SYNTHETIC_PREFIX[] = "synthetic:";
+// Moving objects, and noise amplitude (well below the default threshold)
+static const int NUM_OBJECTS = 4;
+static const int NOISE = 4;
+
+namespace {
+
+inline uint32_t mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t hash3(uint32_t a, uint32_t b, uint32_t c) {
+    return mix(a * 0x9e3779b1U ^ mix(b * 0x85ebca77U ^ mix(c)));
+}
+
+// Position along a path that bounces between 0 and span.
+int bounce(int start, int step, int index, int span) {
+    if (span <= 0) {
+        return 0;
+    }
+    int p = (int)(((long long)start + (long long)step * index) % (2 * span));
+    return p < span ? p : 2 * span - p;
+}
+
+struct Box {
+    int Left;
+    int Top;
+    int Right;
+    int Bottom;
+    uint8_t Color[3];
+};
+
+}
+
+string syntheticFramePath(int width, int height, int index) {
+    return SYNTHETIC_PREFIX + to_string(width) + "x" + to_string(height) + ":" + to_string(index);
+}
+
+vector<string> syntheticFramePaths(int width, int height, int numFrames) {
+    vector<string> paths;
+    for (int i = 0; i < numFrames; i++) {
+        paths.push_back(syntheticFramePath(width, height, i));
+    }
+    return paths;
+}
+
+bool parseSyntheticPath(const string& path, int* width, int* height, int* index) {
+    if (path.compare(0, strlen(SYNTHETIC_PREFIX), SYNTHETIC_PREFIX) != 0) {
+        return false;
+    }
+    return sscanf(path.c_str() + strlen(SYNTHETIC_PREFIX), "%dx%d:%d", width, height, index) == 3
+        && *width > 0 && *height > 0 && *index >= 0;
+}
+
+bool parseFrameSize(const string& text, int* width, int* height) {
+    return sscanf(text.c_str(), "%dx%d", width, height) == 2 && *width > 0 && *height > 0;
+}
+
+Frame syntheticFrame(int width, int height, int index, FrameLayout layout) {
+    Frame frame = allocateFrame(width, height, layout);
+    renderSyntheticFrame(frame, index);
+    return frame;
+}
+
+void renderSyntheticFrame(const Frame& frame, int index) {
+    int width = frame.Width;
+    int height = frame.Height;
+
+    // Alternately bright and dark, so they stand out in gray; speeds scale
+    // with the frame so every size sees the same motion in relative terms
+    Box boxes[NUM_OBJECTS];
+    int boxWidth = max(1, width / 12);
+    int boxHeight = max(1, height / 8);
+    int speedX = max(1, width / 160);
+    int speedY = max(1, height / 160);
+    for (int k = 0; k < NUM_OBJECTS; k++) {
+        uint32_t seed = hash3(k, 0, 0);
+        int left = bounce(seed % 997, speedX * (2 + k), index, width - boxWidth);
+        int top = bounce((seed >> 10) % 997, speedY * (1 + k), index, height - boxHeight);
+        int level = k % 2 ? 16 : 224;
+        boxes[k] = { left, top, left + boxWidth, top + boxHeight,
+            { (uint8_t)(level + (seed >> 28)), (uint8_t)(level + ((seed >> 24) & 15)),
+                (uint8_t)(level + ((seed >> 20) & 15)) } };
+    }
+
+    for (int i = 0; i < height; i++) {
+        size_t row = (size_t)i * frame.Stride;
+        for (int j = 0; j < width; j++) {
+            uint32_t texture = hash3(i, j, 0x5eed);
+            uint32_t noise = hash3(i, j, index + 1);
+            int base[3] = { j * 160 / width + (int)(texture & 31), i * 160 / height + (int)((texture >> 8) & 31),
+                96 + (int)((texture >> 16) & 63) };
+            for (const Box& box : boxes) {
+                if (j >= box.Left && j < box.Right && i >= box.Top && i < box.Bottom) {
+                    base[0] = box.Color[0];
+                    base[1] = box.Color[1];
+                    base[2] = box.Color[2];
+                }
+            }
+            size_t at = row + (size_t)j * frame.PixelStep;
+            for (int c = 0; c < 3; c++) {
+                int v = base[c] + (int)((noise >> (8 * c)) % (2 * NOISE + 1)) - NOISE;
+                channelPlane(frame, c)[at] = (uint8_t)min(255, max(0, v));
+            }
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Frame.h"
+
+// Deterministic test sequence for benchmarks, so runs need no PNGs: a fixed
+// textured background with low-level sensor noise that changes every frame,
+// and a few solid rectangles moving across it. The same (width, height,
+// index) always gives the same frame on every rank and backend.
+//
+// Frames are addressed by pseudo-paths "synthetic:WxH:index", which
+// inputColorImage() renders instead of decoding, so every flow that reads a
+// list of image paths runs on them unchanged.
+
+std::string syntheticFramePath(int width, int height, int index);
+std::vector<std::string> syntheticFramePaths(int width, int height, int numFrames);
+bool parseSyntheticPath(const std::string& path, int* width, int* height, int* index);
+
+Frame syntheticFrame(int width, int height, int index, FrameLayout layout = FRAME_PLANAR);
+// Writes every pixel of `frame` (any size or layout) with frame `index`.
+void renderSyntheticFrame(const Frame& frame, int index);
+
+// "WxH", e.g. "1920x1080"; false unless both are positive.
+bool parseFrameSize(const std::string& text, int* width, int* height);
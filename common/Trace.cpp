@@ -0,0 +1,217 @@
+#include "Trace.h"
+
+#ifdef BGS_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+namespace {
+
+enum EventKind {
+    EVENT_SCOPE,
+    EVENT_COUNTER
+};
+
+struct TraceEvent {
+    const char* Name;
+    // Microseconds since traceEnable(); duration for scopes
+    double Start;
+    double Duration;
+    // Counter running total
+    int64_t Value;
+    int Depth;
+    EventKind Kind;
+};
+
+struct ThreadBuffer {
+    int Tid;
+    int Depth;
+    vector<TraceEvent> Events;
+};
+
+atomic<bool> enabled(false);
+int processId = 0;
+Clock::time_point origin;
+
+mutex registryMutex;
+vector<unique_ptr<ThreadBuffer>> buffers;
+map<string, int64_t> counters;
+
+thread_local ThreadBuffer* localBuffer = nullptr;
+
+ThreadBuffer& threadBuffer() {
+    if (!localBuffer) {
+        lock_guard<mutex> lock(registryMutex);
+        buffers.emplace_back(new ThreadBuffer());
+        localBuffer = buffers.back().get();
+        localBuffer->Tid = buffers.size() - 1;
+        localBuffer->Depth = 0;
+        localBuffer->Events.reserve(4096);
+    }
+    return *localBuffer;
+}
+
+double now() {
+    return chrono::duration<double, micro>(Clock::now() - origin).count();
+}
+
+void appendJsonString(ostringstream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\';
+        }
+        out << *c;
+    }
+    out << '"';
+}
+
+}
+
+void traceEnable(int process) {
+    lock_guard<mutex> lock(registryMutex);
+    processId = process;
+    origin = Clock::now();
+    for (auto& buffer : buffers) {
+        buffer->Events.clear();
+    }
+    counters.clear();
+    enabled = true;
+}
+
+bool traceEnabled() {
+    return enabled.load(memory_order_relaxed);
+}
+
+TraceScope::TraceScope(const char* name) : name_(name), start_(-1) {
+    if (traceEnabled()) {
+        threadBuffer().Depth++;
+        start_ = now();
+    }
+}
+
+TraceScope::~TraceScope() {
+    if (start_ < 0) {
+        return;
+    }
+    double end = now();
+    ThreadBuffer& buffer = threadBuffer();
+    buffer.Depth--;
+    buffer.Events.push_back({ name_, start_, end - start_, 0, buffer.Depth, EVENT_SCOPE });
+}
+
+void traceCount(const char* name, int64_t value) {
+    if (!traceEnabled()) {
+        return;
+    }
+    int64_t total;
+    {
+        lock_guard<mutex> lock(registryMutex);
+        total = counters[name] += value;
+    }
+    threadBuffer().Events.push_back({ name, now(), 0, total, 0, EVENT_COUNTER });
+}
+
+string traceEventsJson() {
+    lock_guard<mutex> lock(registryMutex);
+    ostringstream out;
+    out.precision(3);
+    out << fixed;
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << processId
+        << ",\"args\":{\"name\":\"rank " << processId << "\"}}";
+    for (const auto& buffer : buffers) {
+        // Threads of earlier, untraced runs
+        if (buffer->Events.empty()) {
+            continue;
+        }
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << processId << ",\"tid\":" << buffer->Tid
+            << ",\"args\":{\"name\":\"thread " << buffer->Tid << "\"}}";
+        for (const TraceEvent& e : buffer->Events) {
+            out << ",\n{\"name\":";
+            appendJsonString(out, e.Name);
+            if (e.Kind == EVENT_SCOPE) {
+                out << ",\"ph\":\"X\",\"ts\":" << e.Start << ",\"dur\":" << e.Duration;
+            }
+            else {
+                out << ",\"ph\":\"C\",\"ts\":" << e.Start << ",\"args\":{\"bytes\":" << e.Value << "}";
+            }
+            out << ",\"pid\":" << processId << ",\"tid\":" << buffer->Tid << "}";
+        }
+    }
+    return out.str();
+}
+
+string traceSummary() {
+    double span = now();
+    lock_guard<mutex> lock(registryMutex);
+
+    struct Stage {
+        size_t Count;
+        double Total;
+        double Max;
+    };
+    map<string, Stage> stages;
+    ostringstream out;
+    out.precision(3);
+    out << fixed;
+    out << "Trace (rank " << processId << ", " << span / 1000 << " ms):" << endl;
+    for (const auto& buffer : buffers) {
+        if (buffer->Events.empty()) {
+            continue;
+        }
+        double busy = 0;
+        for (const TraceEvent& e : buffer->Events) {
+            if (e.Kind != EVENT_SCOPE) {
+                continue;
+            }
+            Stage& stage = stages[e.Name];
+            stage.Count++;
+            stage.Total += e.Duration;
+            stage.Max = max(stage.Max, e.Duration);
+            if (e.Depth == 0) {
+                busy += e.Duration;
+            }
+        }
+        out << "  thread " << buffer->Tid << ": busy " << busy / 1000 << " ms, idle "
+            << max(0.0, span - busy) / 1000 << " ms" << endl;
+    }
+    for (const auto& stage : stages) {
+        const Stage& s = stage.second;
+        out << "  " << stage.first << ": " << s.Count << " x, total " << s.Total / 1000 << " ms, mean "
+            << s.Total / s.Count << " us, max " << s.Max << " us" << endl;
+    }
+    for (const auto& counter : counters) {
+        out << "  " << counter.first << ": " << counter.second << " bytes" << endl;
+    }
+    return out.str();
+}
+
+void writeTrace(const string& path, const vector<string>& eventLists) {
+    ofstream out(path);
+    if (!out) {
+        throw runtime_error("cannot open " + path);
+    }
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const string& events : eventLists) {
+        if (events.empty()) {
+            continue;
+        }
+        out << (first ? "" : ",\n") << events;
+        first = false;
+    }
+    out << "\n]}\n";
+}
+
+#endif
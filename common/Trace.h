@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Hot-path instrumentation: scoped timers and byte counters, exported as a
+// Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev) plus a text
+// summary of per-stage latency, counter totals and each thread's busy and
+// idle time.
+//
+// Built only with -DBGS_TRACE (CMake option BGS_TRACE). Without it the
+// macros expand to nothing and the functions are empty inlines, so call
+// sites need no #ifdef. With it, nothing is recorded until traceEnable():
+// a disabled scope costs one branch.
+//
+// Each thread appends to its own buffer; a scope is one "complete" event
+// (two clock reads). Busy time is the sum of a thread's outermost scopes,
+// idle the rest of the span from traceEnable() to the report.
+
+#ifdef BGS_TRACE
+
+const bool TRACE_COMPILED = true;
+
+// Starts recording and resets the time origin. `process` is the trace pid
+// (the MPI rank), so traces of several ranks can be merged.
+void traceEnable(int process);
+bool traceEnabled();
+
+// The readers below expect no traced work to be running on other threads.
+// This process's events as a comma-separated list of JSON objects, for
+// writeTrace() here or on another rank.
+std::string traceEventsJson();
+// Per-stage count/total/mean/max, counter totals, per-thread busy/idle.
+std::string traceSummary();
+// One trace file from the event lists of one or more processes.
+void writeTrace(const std::string& path, const std::vector<std::string>& eventLists);
+
+// Adds `value` to a process-wide counter; the trace plots the running total.
+// MPI call sites count this rank's own share of a collective, so the totals
+// of all ranks add up to the bytes moved.
+void traceCount(const char* name, int64_t value);
+
+class TraceScope {
+public:
+    // `name` must outlive the trace (a string literal).
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+
+private:
+    const char* name_;
+    double start_;
+};
+
+#define BGS_TRACE_CONCAT2(a, b) a##b
+#define BGS_TRACE_CONCAT(a, b) BGS_TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope BGS_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_COUNT(name, value) traceCount(name, (int64_t)(value))
+
+#else
+
+const bool TRACE_COMPILED = false;
+
+inline void traceEnable(int) {}
+inline bool traceEnabled() { return false; }
+inline std::string traceEventsJson() { return std::string(); }
+inline std::string traceSummary() { return std::string(); }
+inline void writeTrace(const std::string&, const std::vector<std::string>&) {}
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNT(name, value) ((void)0)
+
+#endif
@@ -0,0 +1,128 @@
+#include "BackgroundMean.h"
+
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Kernels.h"
+#include "Trace.h"
+
+using namespace std;
+
+// Per-thread sums budget; below a typical 1-2 MiB L2 to leave room for the
+// frame rows streaming through.
+static const int L2_TILE_BYTES = 512 * 1024;
+
+Frame calculateColorBackgroundMean(const vector<Frame>& images, int num_threads) {
+    for (const Frame& image : images) {
+        requirePlanar(image, "calculateColorBackgroundMean");
+    }
+    Frame mean = allocateFrame(images[0].Width, images[0].Height);
+    int numImages = images.size();
+    FixedPointDivisor divisor = makeDivisor(numImages, 255u * numImages);
+
+    omp_set_num_threads(num_threads);
+#pragma omp parallel
+    {
+        vector<uint32_t> sums(mean.Stride);
+        vector<const uint8_t*> planes(numImages);
+
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < mean.Height; i++) {
+            TRACE_SCOPE("mean");
+            size_t row = (size_t)i * mean.Stride;
+            for (int c = 0; c < 3; c++) {
+                for (int k = 0; k < numImages; k++) {
+                    planes[k] = channelPlane(images[k], c);
+                }
+                fill(sums.begin(), sums.end(), 0);
+                kernels().sumPlanes(sums.data(), planes.data(), numImages, row, mean.Stride);
+                kernels().dividePlane(channelPlane(mean, c) + row, sums.data(), mean.Stride, divisor);
+            }
+        }
+    }
+    return mean;
+}
+
+int defaultTileRows(int stride) {
+    return max(1, L2_TILE_BYTES / (stride * (int)sizeof(uint32_t)));
+}
+
+static void setSchedule(const string& schedule) {
+    string kind = schedule.substr(0, schedule.find(','));
+    int chunk = schedule.find(',') == string::npos ? 0 : atoi(schedule.c_str() + schedule.find(',') + 1);
+    if (kind == "static") {
+        omp_set_schedule(omp_sched_static, chunk);
+    }
+    else if (kind == "dynamic") {
+        omp_set_schedule(omp_sched_dynamic, chunk);
+    }
+    else if (kind == "guided") {
+        omp_set_schedule(omp_sched_guided, chunk);
+    }
+    else {
+        throw invalid_argument("unknown OpenMP schedule: " + schedule);
+    }
+}
+
+Frame allocateFrameTiled(int width, int height, const TileConfig& config, int num_threads) {
+    Frame frame = allocateFrameUntouched(width, height);
+    int tileRows = config.TileRows > 0 ? config.TileRows : defaultTileRows(frame.Stride);
+    int numTiles = (height + tileRows - 1) / tileRows;
+
+    omp_set_num_threads(num_threads);
+    setSchedule(config.Schedule);
+    // Same tile loop as the engine below, so a static schedule hands each
+    // tile to the thread that will sum it
+#pragma omp parallel for schedule(runtime)
+    for (int t = 0; t < numTiles; t++) {
+        int rows = min(tileRows, height - t * tileRows);
+        size_t offset = (size_t)t * tileRows * frame.Stride;
+        for (int c = 0; c < 3; c++) {
+            memset(channelPlane(frame, c) + offset, 0, (size_t)rows * frame.Stride);
+        }
+    }
+    return frame;
+}
+
+Frame calculateColorBackgroundMeanTiled(const vector<Frame>& images,
+    const TileConfig& config, int num_threads) {
+    for (const Frame& image : images) {
+        requirePlanar(image, "calculateColorBackgroundMeanTiled");
+    }
+    const Frame& first = images[0];
+    Frame mean = allocateFrameUntouched(first.Width, first.Height);
+    int numImages = images.size();
+    FixedPointDivisor divisor = makeDivisor(numImages, 255u * numImages);
+    int tileRows = config.TileRows > 0 ? config.TileRows : defaultTileRows(mean.Stride);
+    int numTiles = (mean.Height + tileRows - 1) / tileRows;
+
+    omp_set_num_threads(num_threads);
+    setSchedule(config.Schedule);
+#pragma omp parallel
+    {
+        // Allocated and zeroed inside the region: first touch is local
+        vector<uint32_t> sums((size_t)tileRows * mean.Stride);
+        vector<const uint8_t*> planes(numImages);
+
+#pragma omp for schedule(runtime)
+        for (int t = 0; t < numTiles; t++) {
+            TRACE_SCOPE("mean");
+            int rows = min(tileRows, mean.Height - t * tileRows);
+            size_t offset = (size_t)t * tileRows * mean.Stride;
+            size_t n = (size_t)rows * mean.Stride;
+            for (int c = 0; c < 3; c++) {
+                for (int k = 0; k < numImages; k++) {
+                    planes[k] = channelPlane(images[k], c);
+                }
+                fill(sums.begin(), sums.begin() + n, 0);
+                kernels().sumPlanes(sums.data(), planes.data(), numImages, offset, n);
+                // Writes the whole tile, padding included
+                kernels().dividePlane(channelPlane(mean, c) + offset, sums.data(), n, divisor);
+            }
+        }
+    }
+    return mean;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Frame.h"
+
+// Batch background-mean engines for the OpenMP backend; planar frames only.
+
+// Row loop: every image row is a dynamically scheduled work item and each
+// channel of it sums all frames.
+Frame calculateColorBackgroundMean(const std::vector<Frame>& images, int num_threads);
+
+struct TileConfig {
+    // Rows per tile; 0 sizes tiles so a thread's 32-bit sums fit in L2.
+    int TileRows;
+    // OpenMP schedule for tiles: "static", "dynamic" or "guided", with an
+    // optional ",chunk" suffix.
+    std::string Schedule;
+};
+
+int defaultTileRows(int stride);
+
+// A zeroed frame whose tiles are first touched by the threads that will own
+// them in calculateColorBackgroundMeanTiled() with the same `config`, so the
+// frame rows are read from the local NUMA node. Decode into it afterwards.
+Frame allocateFrameTiled(int width, int height, const TileConfig& config, int num_threads);
+
+// Tiled engine: whole tiles of rows go to threads, and all frames are
+// streamed through a tile (per channel) while its sums stay in L2. The mean
+// and each thread's sums are first touched by the thread that uses them.
+Frame calculateColorBackgroundMeanTiled(const std::vector<Frame>& images,
+    const TileConfig& config, int num_threads);
@@ -3,185 +3,732 @@
 #include <omp.h>
 #include <cmath>
 #include <algorithm>
-#include <msclr\marshal_cppstd.h>
-#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <string.h>
+
+#include "BackgroundMean.h"
+#include "BackgroundModel.h"
+#include "BenchReport.h"
+#include "BitMask.h"
+#include "Blobs.h"
+#include "ForegroundMasks.h"
+#include "FrameCache.h"
+#include "FramePool.h"
+#include "FrameStream.h"
+#include "ImageIO.h"
+#include "Kernels.h"
+#include "MaskWriter.h"
+#include "Morphology.h"
+#include "Options.h"
+#include "Pipeline.h"
+#include "StreamScheduler.h"
+#include "Synthetic.h"
+#include "Trace.h"
 
-#using <mscorlib.dll>
-#using <System.dll>
-#using <System.Drawing.dll>
-#using <System.Windows.Forms.dll>
 using namespace std;
-using namespace msclr::interop;
 
 const int NUM_FRAMES = 20;          
 const int DEFAULT_THREADS = 4;      
 const int DEFAULT_THRESHOLD = 30;
+// Rows handed to a thread at a time when streaming frames through the model
+const int ROW_BLOCK = 16;
+// Frames per work item when masking a whole sequence against one background
+const int MASK_FRAME_GROUP = 8;
+// Output rows per morphology work item; each also reads the kernel's halo
+const int MORPH_ROW_BLOCK = 64;
+// Rows per blob labelling band; bands are joined along their border rows
+const int BLOB_ROW_BLOCK = 64;
+
+// One mask per frame against the same background. Work items are
+// (row tile, frame group) pairs: frames are split across threads, and a
+// thread reuses its gray background tile for every frame in its group.
+vector<uint8_t*> calculateForegroundMasks(const Frame& background,
+    const vector<Frame>& frames,
+    int threshold = DEFAULT_THRESHOLD,
+    int num_threads = DEFAULT_THREADS) {
+    int numFrames = frames.size();
+    vector<uint8_t*> masks(numFrames);
+    for (auto& mask : masks) {
+        mask = allocateMask(background.Width, background.Height);
+    }
 
-struct ColorImage {
-    int* Red;
-    int* Green;
-    int* Blue;
-    int Width;
-    int Height;
-};
+    int tileRows = maskTileRows(background.Stride);
+    int numTiles = (background.Height + tileRows - 1) / tileRows;
+    int numGroups = (numFrames + MASK_FRAME_GROUP - 1) / MASK_FRAME_GROUP;
 
+    omp_set_num_threads(num_threads);
+#pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int t = 0; t < numTiles; t++) {
+        for (int g = 0; g < numGroups; g++) {
+            int first = g * MASK_FRAME_GROUP;
+            int count = min(MASK_FRAME_GROUP, numFrames - first);
+            foregroundMasks(background, &frames[first], count, &masks[first], threshold,
+                t * tileRows, min((t + 1) * tileRows, background.Height));
+        }
+    }
+    return masks;
+}
 
-ColorImage inputColorImage(int* w, int* h, System::String^ imagePath) {
-    ColorImage img;
-    System::Drawing::Bitmap BM(imagePath);
-    img.Width = BM.Width;
-    img.Height = BM.Height;
-    *w = BM.Width;
-    *h = BM.Height;
+// Mask cleanup in place: each erode/dilate pass is split by row blocks
+// across threads, with the implicit barrier between passes.
+void cleanMask(uint8_t* mask, uint8_t* scratch, int width, int height, int stride,
+    const MorphologyConfig& cleanup) {
+    int passes = morphologyPasses(cleanup.Op);
+    uint8_t* buffers[2] = { mask, scratch };
+    for (int p = 0; p < passes; p++) {
+        bool dilate = morphologyDilates(cleanup.Op, p);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < height; i += MORPH_ROW_BLOCK) {
+            morphologyPass(buffers[p & 1], buffers[(p + 1) & 1], width, stride, height, cleanup,
+                dilate, i, min(i + MORPH_ROW_BLOCK, height));
+        }
+    }
+    if (passes & 1) {
+        memcpy(mask, scratch, (size_t)stride * height);
+    }
+}
 
-    img.Red = new int[BM.Height * BM.Width];
-    img.Green = new int[BM.Height * BM.Width];
-    img.Blue = new int[BM.Height * BM.Width];
+// Blobs of one mask: threads label bands of rows independently, then the
+// bands are merged on this thread.
+vector<Blob> maskBlobs(const uint8_t* mask, int width, int height, int stride, int minArea) {
+    int numBands = (height + BLOB_ROW_BLOCK - 1) / BLOB_ROW_BLOCK;
+    vector<BlobBand> bands(numBands);
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < numBands; b++) {
+        int first = b * BLOB_ROW_BLOCK;
+        labelBand(mask + (size_t)first * stride, width, stride, min(BLOB_ROW_BLOCK, height - first),
+            first, bands[b]);
+    }
+    return blobList(mergeBands(bands), minArea);
+}
 
-    for (int i = 0; i < BM.Height; i++) {
-        for (int j = 0; j < BM.Width; j++) {
-            System::Drawing::Color c = BM.GetPixel(j, i);
-            img.Red[i * BM.Width + j] = c.R;
-            img.Green[i * BM.Width + j] = c.G;
-            img.Blue[i * BM.Width + j] = c.B;
-        }
+string maskFileName(size_t frameIndex) {
+    return "mask_" + to_string(frameIndex + 1) + ".png";
+}
+
+vector<string> getImagePaths(int num_frames) {
+    vector<string> paths;
+    for (int i = 1; i <= num_frames; i++) {
+        paths.push_back(INPUT_DIR + "frame" + to_string(i) + ".png");
     }
-    return img;
+    return paths;
 }
 
-void createColorImage(ColorImage img, string filename) {
-    System::Drawing::Bitmap MyNewImage(img.Width, img.Height);
+// What each flow hands back to main
+struct RunStats {
+    // Wall-clock time of the model, masks and cleanup, without frame I/O
+    double ComputeSeconds;
+    // Sum over the masks of their foreground share
+    double Foreground;
+    int Frames;
+    int Width;
+    int Height;
+    ChangeSkipStats Skipped;
+    PyramidStats Pyramid;
+};
 
-    for (int i = 0; i < MyNewImage.Height; i++) {
-        for (int j = 0; j < MyNewImage.Width; j++) {
-            int r = max(0, min(255, img.Red[i * img.Width + j]));
-            int g = max(0, min(255, img.Green[i * img.Width + j]));
-            int b = max(0, min(255, img.Blue[i * img.Width + j]));
+// Original flow: decode every frame, then compute the mean and every mask.
+// Per-frame masks go to `maskWriter` when it is set (--save-masks).
+RunStats runBatch(const vector<string>& paths, int threshold, int num_threads,
+    const MorphologyConfig& cleanup, BlobLog* blobs, MaskWriter* maskWriter, bool tiled, const TileConfig& tiles) {
+    RunStats stats = {};
+    vector<Frame> frames;
+    int width, height;
 
-            System::Drawing::Color c = System::Drawing::Color::FromArgb(r, g, b);
-            MyNewImage.SetPixel(j, i, c);
+    for (const auto& path : paths) {
+        if (!tiled) {
+            frames.push_back(loadFrame(&width, &height, path));
+            continue;
         }
+        // Decoding stays serial, but the pages it writes were first touched
+        // by the tile owners (cache frames are copied out for the same reason)
+        decodeColorImage(path, [&](int w, int h) {
+            width = w;
+            height = h;
+            frames.push_back(allocateFrameTiled(w, h, tiles, num_threads));
+            return frames.back();
+        });
     }
-    MyNewImage.Save("..//Data//Output//" + gcnew System::String(filename.c_str()));
-    cout << "Color image saved: " << filename << endl;
-}
 
-void createGrayImage(int* image, int width, int height, string filename) {
-    System::Drawing::Bitmap MyNewImage(width, height);
+    double start = omp_get_wtime();
 
-    for (int i = 0; i < MyNewImage.Height; i++) {
-        for (int j = 0; j < MyNewImage.Width; j++) {
-            int val = max(0, min(255, image[i * width + j]));
-            System::Drawing::Color c = System::Drawing::Color::FromArgb(val, val, val);
-            MyNewImage.SetPixel(j, i, c);
+    Frame bg = tiled ? calculateColorBackgroundMeanTiled(frames, tiles, num_threads)
+        : calculateColorBackgroundMean(frames, num_threads);
+    vector<uint8_t*> masks = calculateForegroundMasks(bg, frames, threshold, num_threads);
+    if (cleanup.Op != MORPH_NONE) {
+        uint8_t* scratch = allocateMask(width, height);
+        for (auto& mask : masks) {
+            cleanMask(mask, scratch, width, height, bg.Stride, cleanup);
         }
+        alignedFree(scratch);
+    }
+    vector<vector<Blob>> frameBlobs(blobs ? masks.size() : 0);
+    for (size_t f = 0; f < frameBlobs.size(); f++) {
+        frameBlobs[f] = maskBlobs(masks[f], width, height, bg.Stride, blobs->minArea());
+    }
+    vector<double> ratios(masks.size());
+#pragma omp parallel num_threads(num_threads)
+    {
+        BitMask bits = allocateBitMask(width, height);
+#pragma omp for schedule(static)
+        for (int f = 0; f < (int)masks.size(); f++) {
+            packMaskRows(bits, masks[f], 0, height);
+            ratios[f] = foregroundRatio(bits);
+        }
+        freeBitMask(bits);
+    }
+    for (double ratio : ratios) {
+        stats.Foreground += ratio;
     }
-    MyNewImage.Save("..//Data//Output//" + gcnew System::String(filename.c_str()));
-    cout << "Grayscale image saved: " << filename << endl;
-}
 
+    stats.ComputeSeconds = omp_get_wtime() - start;
+    createColorImage(bg, "background.png");
+    createGrayImage(masks.back(), width, height, bg.Stride, "mask.png");
+    for (size_t f = 0; maskWriter && f < masks.size(); f++) {
+        maskWriter->write(masks[f], width, height, maskFileName(f));
+    }
+    for (size_t f = 0; f < frameBlobs.size(); f++) {
+        blobs->write(f, frameBlobs[f]);
+    }
 
-ColorImage calculateColorBackgroundMean(const vector<ColorImage>& images, int num_threads = DEFAULT_THREADS) {
-    ColorImage mean;
-    mean.Width = images[0].Width;
-    mean.Height = images[0].Height;
+    for (auto& mask : masks) {
+        alignedFree(mask);
+    }
+    for (auto& frame : frames) {
+        freeFrame(frame);
+    }
+    freeFrame(bg);
 
-    mean.Red = new int[mean.Width * mean.Height]();
-    mean.Green = new int[mean.Width * mean.Height]();
-    mean.Blue = new int[mean.Width * mean.Height]();
+    stats.Frames = paths.size();
+    stats.Width = width;
+    stats.Height = height;
+    return stats;
+}
+
+// One streaming step: every thread accumulates its row blocks, the frame is
+// committed once, then each block's background and mask rows are refreshed.
+// The mask is written as bytes when `mask` is set, otherwise into `bits`.
+void processFrame(BackgroundModel& model, const Frame& frame, uint8_t* mask, BitMask& bits, int threshold) {
+    int height = frame.Height;
+#pragma omp parallel
+    {
+#pragma omp for schedule(static)
+        for (int i = 0; i < height; i += ROW_BLOCK) {
+            model.accumulate(frame, i, min(i + ROW_BLOCK, height));
+        }
+#pragma omp single
+        model.commitFrame();
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < height; i += ROW_BLOCK) {
+            int last = min(i + ROW_BLOCK, height);
+            model.updateBackground(frame, i, last);
+            if (mask) {
+                model.foregroundMask(frame, mask, threshold, i, last);
+            }
+            else {
+                model.foregroundBits(frame, bits, threshold, i, last);
+            }
+        }
+    }
+}
+
+// Streaming flow: each frame updates the model and gets a mask, then its
+// buffer goes back to the pool for the next frame. Masks are kept
+// bit-packed; the byte mask is only built for cleanup or blobs.
+RunStats runStreaming(FrameSource& source, int threshold, int num_threads,
+    BackgroundMode mode, double alpha, int windowSize, const ChangeSkipConfig& skip,
+    const PyramidConfig& pyramid, const MorphologyConfig& cleanup, BlobLog* blobs, MaskWriter* maskWriter) {
+    RunStats stats = {};
+    PoolBuffer pooled;
+    if (!source.next(pooled)) {
+        throw runtime_error("no input frames");
+    }
+    int width = pooled.frame().Width;
+    int height = pooled.frame().Height;
+    BackgroundModel model(width, height, mode, alpha, windowSize);
+    model.setChangeSkipping(skip);
+    model.setPyramid(pyramid);
+    bool byteMask = cleanup.Op != MORPH_NONE || blobs;
+    uint8_t* mask = byteMask ? allocateMask(width, height) : nullptr;
+    uint8_t* scratch = byteMask ? allocateMask(width, height) : nullptr;
+    BitMask bits = allocateBitMask(width, height);
 
     omp_set_num_threads(num_threads);
-#pragma omp parallel for collapse(2) schedule(dynamic)
-    for (int i = 0; i < mean.Height; i++) {
-        for (int j = 0; j < mean.Width; j++) {
-            int sum_r = 0, sum_g = 0, sum_b = 0;
-
-            for (const auto& img : images) {
-                sum_r += img.Red[i * mean.Width + j];
-                sum_g += img.Green[i * mean.Width + j];
-                sum_b += img.Blue[i * mean.Width + j];
+    for (size_t f = 0; f == 0 || source.next(pooled); f++) {
+        const Frame& frame = pooled.frame();
+        double start = omp_get_wtime();
+        processFrame(model, frame, mask, bits, threshold);
+        vector<Blob> frameBlobs;
+        if (byteMask) {
+            cleanMask(mask, scratch, width, height, model.background().Stride, cleanup);
+            if (blobs) {
+                frameBlobs = maskBlobs(mask, width, height, model.background().Stride, blobs->minArea());
             }
+            packMaskRows(bits, mask, 0, height);
+        }
+        stats.Foreground += foregroundRatio(bits);
+        stats.ComputeSeconds += omp_get_wtime() - start;
+
+        if (blobs) {
+            blobs->write(f, frameBlobs);
+        }
 
-            mean.Red[i * mean.Width + j] = sum_r / images.size();
-            mean.Green[i * mean.Width + j] = sum_g / images.size();
-            mean.Blue[i * mean.Width + j] = sum_b / images.size();
+        if (maskWriter) {
+            maskWriter->write(bits, maskFileName(f));
         }
     }
-    return mean;
+
+    model.refreshBackground();
+    createColorImage(model.background(), "background.png");
+    createGrayImage(bits, "mask.png");
+    cout << "Model memory: " << model.memoryBytes() / 1024 << " KiB" << endl;
+
+    alignedFree(mask);
+    alignedFree(scratch);
+    freeBitMask(bits);
+    stats.Frames = source.count();
+    stats.Skipped = model.changeSkipStats();
+    stats.Pyramid = model.pyramidStats();
+    stats.Width = width;
+    stats.Height = height;
+    return stats;
 }
 
-int* calculateForegroundMask(const ColorImage& background,
-    const ColorImage& currentFrame,
-    int threshold = DEFAULT_THRESHOLD,
-    int num_threads = DEFAULT_THREADS) {
-    int* mask = new int[background.Width * background.Height];
+// Pipelined flow: decoder threads, the OpenMP model update on this thread and
+// encoder threads writing every frame's mask run concurrently.
+RunStats runPipelined(const vector<string>& paths, int threshold, int num_threads,
+    BackgroundMode mode, double alpha, int windowSize, const ChangeSkipConfig& skip,
+    const PyramidConfig& pyramid, const MorphologyConfig& cleanup, BlobLog* blobs, const PipelineConfig& config) {
+    RunStats result = {};
+    unique_ptr<BackgroundModel> model;
+    BitMask bits = {};
+    uint8_t* scratch = nullptr;
 
     omp_set_num_threads(num_threads);
-#pragma omp parallel for collapse(2) schedule(dynamic)
-    for (int i = 0; i < background.Height; i++) {
-        for (int j = 0; j < background.Width; j++) {
-            int bg_gray = (background.Red[i * background.Width + j] +
-                background.Green[i * background.Width + j] +
-                background.Blue[i * background.Width + j]) / 3;
+    PipelineStats stats = runPipeline(paths, config,
+        [&](const Frame& frame, size_t index, uint8_t* mask) {
+            if (!model) {
+                model.reset(new BackgroundModel(frame.Width, frame.Height, mode, alpha, windowSize));
+                model->setChangeSkipping(skip);
+                model->setPyramid(pyramid);
+                bits = allocateBitMask(frame.Width, frame.Height);
+                scratch = allocateMask(frame.Width, frame.Height);
+            }
+            processFrame(*model, frame, mask, bits, threshold);
+            cleanMask(mask, scratch, frame.Width, frame.Height, model->background().Stride, cleanup);
+            if (blobs) {
+                blobs->write(index, maskBlobs(mask, frame.Width, frame.Height, model->background().Stride,
+                    blobs->minArea()));
+            }
+            // The last frame's bits are left for the final mask
+            packMaskRows(bits, mask, 0, frame.Height);
+            result.Foreground += foregroundRatio(bits);
+        },
+        maskFileName);
+
+    model->refreshBackground();
+    createColorImage(model->background(), "background.png");
+    createGrayImage(bits, "mask.png");
+    cout << "Pipeline: " << stats.Frames << " frames in " << (int)(stats.WallSeconds * 1000)
+        << " ms wall (" << config.DecodeThreads << " decoders, " << config.EncodeThreads
+        << " encoders, queue depth " << config.QueueDepth << ")" << endl;
+
+    freeBitMask(bits);
+    alignedFree(scratch);
+    result.ComputeSeconds = stats.ComputeSeconds;
+    result.Frames = stats.Frames;
+    result.Skipped = model->changeSkipStats();
+    result.Pyramid = model->pyramidStats();
+    result.Width = model->background().Width;
+    result.Height = model->background().Height;
+    return result;
+}
 
-            int frame_gray = (currentFrame.Red[i * background.Width + j] +
-                currentFrame.Green[i * background.Width + j] +
-                currentFrame.Blue[i * background.Width + j]) / 3;
+// One camera feed of the multi-stream flow
+struct Feed {
+    string Spec;
+    vector<string> Paths;
+    unique_ptr<FrameStream> Stream;
+    unique_ptr<FrameSource> Source;
+    unique_ptr<BackgroundModel> Model;
+    BitMask Bits;
+    PoolBuffer Frame;
+    double Foreground;
+};
 
-            mask[i * background.Width + j] = (abs(bg_gray - frame_gray) > threshold) ? 255 : 0;
+vector<string> splitList(const string& text) {
+    vector<string> items;
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == string::npos) {
+            end = text.size();
+        }
+        if (end > pos) {
+            items.push_back(text.substr(pos, end - pos));
         }
+        pos = end + 1;
     }
-    return mask;
+    return items;
 }
 
+// Multi-stream flow: every feed gets its own model and bit mask, and their
+// frames run as tasks on one shared pool of num_threads threads (see
+// StreamScheduler.h); the model itself runs single-threaded inside a task.
+// A spec is a synthetic size (WxH), a .y4m file read to its end, or a
+// directory of frame1.png ... frameN.png. Frames fall due at `fps` per feed
+// (0: all at once, as fast as the pool goes).
+void runStreams(const vector<string>& specs, int numFrames, double fps, double slack, int threshold,
+    int num_threads, BackgroundMode mode, double alpha, int windowSize, const ChangeSkipConfig& skip,
+    const PyramidConfig& pyramid, bool saveMasks) {
+    FramePool pool;
+    vector<unique_ptr<Feed>> feeds;
+    for (const string& spec : specs) {
+        unique_ptr<Feed> feed(new Feed());
+        feed->Spec = spec;
+        int width, height;
+        if (parseFrameSize(spec, &width, &height)) {
+            feed->Paths = syntheticFramePaths(width, height, numFrames);
+        }
+        else if (spec.size() > 4 && spec.compare(spec.size() - 4, 4, ".y4m") == 0) {
+            feed->Stream.reset(new FrameStream(spec, STREAM_Y4M));
+        }
+        else {
+            for (int i = 1; i <= numFrames; i++) {
+                feed->Paths.push_back(spec + "/frame" + to_string(i) + ".png");
+            }
+        }
+        feed->Source.reset(feed->Stream ? new FrameSource(*feed->Stream, pool) : new FrameSource(feed->Paths, pool));
+        feeds.push_back(move(feed));
+    }
 
-vector<string> getImagePaths(int num_frames) {
-    vector<string> paths;
-    for (int i = 1; i <= num_frames; i++) {
-        paths.push_back("..//Data//Input//frame" + to_string(i) + ".png");
+    StreamSchedulerConfig config = { num_threads, slack };
+    StreamScheduler scheduler(config);
+    for (size_t k = 0; k < feeds.size(); k++) {
+        Feed& feed = *feeds[k];
+        string prefix = "stream" + to_string(k + 1) + "_";
+        scheduler.addStream(feed.Spec, fps > 0 ? 1 / fps : 0, [&feed, prefix, threshold, mode, alpha, windowSize,
+            &skip, &pyramid, saveMasks](size_t index) {
+            if (!feed.Source->next(feed.Frame)) {
+                return false;
+            }
+            const Frame& frame = feed.Frame.frame();
+            if (!feed.Model) {
+                feed.Model.reset(new BackgroundModel(frame.Width, frame.Height, mode, alpha, windowSize));
+                feed.Model->setChangeSkipping(skip);
+                feed.Model->setPyramid(pyramid);
+                feed.Bits = allocateBitMask(frame.Width, frame.Height);
+            }
+            feed.Model->addFrame(frame);
+            feed.Model->foregroundBits(frame, feed.Bits, threshold);
+            feed.Foreground += foregroundRatio(feed.Bits);
+            if (saveMasks) {
+                createGrayImage(feed.Bits, prefix + maskFileName(index));
+            }
+            return true;
+        });
     }
-    return paths;
-}
+    StreamSchedulerStats stats = scheduler.run();
 
-int main() {
-    int start_s, stop_s, TotalTime = 0;
-    cout << "OpenMP Background subtractor" << endl;
-    // Load images
-    vector<ColorImage> frames;
-    auto paths = getImagePaths(NUM_FRAMES);
-    int width, height;
+    double megapixels = 0;
+    for (size_t k = 0; k < feeds.size(); k++) {
+        Feed& feed = *feeds[k];
+        if (!feed.Model) {
+            continue;
+        }
+        string prefix = "stream" + to_string(k + 1) + "_";
+        feed.Model->refreshBackground();
+        createColorImage(feed.Model->background(), prefix + "background.png");
+        createGrayImage(feed.Bits, prefix + "mask.png");
+        megapixels += (double)feed.Bits.Width * feed.Bits.Height * stats.Streams[k].Frames / 1e6;
+    }
 
-    for (const auto& path : paths) {
-        System::String^ imgPath = marshal_as<System::String^>(path);
-        frames.push_back(inputColorImage(&width, &height, imgPath));
+    cout << "Streams: " << feeds.size() << " feeds on " << num_threads << " threads in "
+        << (int)(stats.WallSeconds * 1000) << " ms wall, " << stats.Steals << " tasks stolen" << endl;
+    cout << "Throughput: " << megapixels / stats.WallSeconds << " MP/s over all feeds" << endl;
+    for (size_t k = 0; k < feeds.size(); k++) {
+        const StreamMetrics& m = stats.Streams[k];
+        cout << "  stream " << k + 1 << " (" << m.Name << "): " << m.Frames << " frames, " << m.FramesPerSecond
+            << " fps, latency mean " << m.MeanLatency * 1000 << " / p95 " << m.P95Latency * 1000 << " / max "
+            << m.MaxLatency * 1000 << " ms, busy " << (int)(m.BusySeconds * 1000) << " ms";
+        if (fps > 0) {
+            cout << ", backlog up to " << m.MaxBacklog << " frames";
+        }
+        cout << ", foreground " << 100.0 * feeds[k]->Foreground / max(1, m.Frames) << "%" << endl;
+        freeBitMask(feeds[k]->Bits);
     }
+}
 
-    start_s = clock();
+static int run(int argc, char* argv[]) {
+    int numFrames = intOption(argc, argv, "--frames", NUM_FRAMES);
+    int numThreads = intOption(argc, argv, "--threads", DEFAULT_THREADS);
+    int threshold = intOption(argc, argv, "--threshold", DEFAULT_THRESHOLD);
+    bool batch = hasOption(argc, argv, "--batch");
+    bool tiled = stringOption(argc, argv, "--engine", "tiles") != "rows";
+    TileConfig tiles;
+    tiles.TileRows = intOption(argc, argv, "--tile-rows", 0);
+    tiles.Schedule = stringOption(argc, argv, "--schedule", "static");
+    bool saveMasks = hasOption(argc, argv, "--save-masks");
+    OutputConfig output = { OUTPUT_PNG, intOption(argc, argv, "--png-level", -1) };
+    int outputThreads = intOption(argc, argv, "--output-threads", 0);
+    bool pipelined = hasOption(argc, argv, "--pipeline");
+    PipelineConfig pipeline;
+    pipeline.DecodeThreads = intOption(argc, argv, "--decoders", 2);
+    pipeline.EncodeThreads = intOption(argc, argv, "--encoders", 2);
+    pipeline.QueueDepth = intOption(argc, argv, "--queue-depth", 4);
+    double alpha = doubleOption(argc, argv, "--ema", 0);
+    double mixtureRate = doubleOption(argc, argv, "--mog", 0);
+    int windowSize = intOption(argc, argv, "--window", 0);
+    // --median with --window N is the median of the last N frames
+    // --skip-static reuses the background and mask of tiles that moved by
+    // no more than --skip-threshold N since they were last processed;
+    // each tile is still processed once every --skip-refresh N frames
+    ChangeSkipConfig skip;
+    skip.Enabled = hasOption(argc, argv, "--skip-static");
+    skip.Threshold = intOption(argc, argv, "--skip-threshold", 12);
+    skip.RefreshInterval = intOption(argc, argv, "--skip-refresh", 16);
+    // --pyramid N thresholds at 1/2^N resolution first (--pyramid-threshold)
+    // and refines only within --pyramid-margin N coarse pixels of what it
+    // finds; every --pyramid-check N frames the mask is compared with the
+    // full-resolution one
+    PyramidConfig pyramid;
+    pyramid.Levels = intOption(argc, argv, "--pyramid", 0);
+    pyramid.Margin = intOption(argc, argv, "--pyramid-margin", 2);
+    pyramid.Threshold = intOption(argc, argv, "--pyramid-threshold", threshold / 2);
+    pyramid.CheckInterval = intOption(argc, argv, "--pyramid-check", 10);
+    MorphologyConfig cleanup;
+    cleanup.Op = morphologyOp(stringOption(argc, argv, "--morph", "none"));
+    cleanup.KernelWidth = intOption(argc, argv, "--morph-width", 3);
+    cleanup.KernelHeight = intOption(argc, argv, "--morph-height", cleanup.KernelWidth);
+    // --blobs writes each frame's blobs of at least --min-area pixels
+    bool labelBlobs = hasOption(argc, argv, "--blobs");
+    int minArea = intOption(argc, argv, "--min-area", 20);
+    unique_ptr<BlobLog> blobs;
+    // --synthetic WxH replaces the input PNGs with generated frames;
+    // --warmup N and --repeat N rerun the whole flow, and --report FILE
+    // appends each measured run to a CSV. --trace FILE records the last run
+    // as a Chrome trace (builds with BGS_TRACE only)
+    string synthetic = stringOption(argc, argv, "--synthetic", "");
+    int warmup = max(0, intOption(argc, argv, "--warmup", 0));
+    int repeat = max(1, intOption(argc, argv, "--repeat", 1));
+    string report = stringOption(argc, argv, "--report", "");
+    string trace = stringOption(argc, argv, "--trace", "");
+    // --frame-cache FILE decodes the inputs once into FILE (again only when
+    // they change) and maps it instead of decoding on later runs
+    string frameCache = stringOption(argc, argv, "--frame-cache", "");
+    // --input FILE reads an uncompressed video stream (- for stdin) to its
+    // end instead of the PNGs: --input-format y4m (default) or rgb24, which
+    // needs --size WxH
+    string input = stringOption(argc, argv, "--input", "");
+    // --streams SPEC,SPEC,... runs many feeds at once on one pool of
+    // --threads threads: each SPEC is WxH (synthetic), a .y4m file or a
+    // directory of frameN.png. --stream-fps F paces every feed at F frames
+    // per second (default 0: all frames available up front); a thread
+    // takes a feed from another only when it waited --steal-slack MS longer
+    string streams = stringOption(argc, argv, "--streams", "");
+    double streamFps = doubleOption(argc, argv, "--stream-fps", 0);
+    double stealSlack = doubleOption(argc, argv, "--steal-slack", 2) / 1000;
+    BackgroundMode mode = hasOption(argc, argv, "--median") ? BACKGROUND_MEDIAN
+        : mixtureRate > 0 ? BACKGROUND_MIXTURE
+        : windowSize > 0 ? BACKGROUND_WINDOW
+        : alpha > 0 ? BACKGROUND_EMA : BACKGROUND_RUNNING_MEAN;
+    if (mode == BACKGROUND_MIXTURE) {
+        alpha = mixtureRate;
+    }
 
-    ColorImage bg = calculateColorBackgroundMean(frames, DEFAULT_THREADS);
-    int* mask = calculateForegroundMask(bg, frames.back(), DEFAULT_THRESHOLD, DEFAULT_THREADS);
-    
+    cout << "OpenMP Background subtractor" << endl;
+    if (!parseOutputFormat(stringOption(argc, argv, "--output", "png"), &output.Format)) {
+        cout << "--output must be png, pnm, raw or none" << endl;
+        return -1;
+    }
+    if (output.PngLevel < -1 || output.PngLevel > 9) {
+        cout << "--png-level takes 0 to 9" << endl;
+        return -1;
+    }
+    setOutputConfig(output);
+    if (skip.Enabled && batch) {
+        cout << "--skip-static needs the streaming model, not --batch" << endl;
+        return -1;
+    }
+    if (skip.Enabled && (skip.RefreshInterval < 1 || skip.RefreshInterval > MAX_SKIP_REFRESH)) {
+        cout << "--skip-refresh takes 1 to " << MAX_SKIP_REFRESH << " frames" << endl;
+        return -1;
+    }
+    if (pyramid.Levels < 0 || pyramid.Levels > MAX_PYRAMID_LEVELS) {
+        cout << "--pyramid takes 0 (off) to " << MAX_PYRAMID_LEVELS << " levels" << endl;
+        return -1;
+    }
+    if (pyramid.Levels > 0 && (batch || skip.Enabled || mode == BACKGROUND_MIXTURE)) {
+        cout << "--pyramid needs the streaming model, without --skip-static or --mog" << endl;
+        return -1;
+    }
+    if (!streams.empty()) {
+        if (batch || pipelined || !input.empty() || !frameCache.empty() || cleanup.Op != MORPH_NONE || labelBlobs) {
+            cout << "--streams runs the streaming model per feed, without --batch, --pipeline, --input, "
+                "--frame-cache, --morph or --blobs" << endl;
+            return -1;
+        }
+        runStreams(splitList(streams), numFrames, streamFps, stealSlack, threshold, numThreads, mode, alpha,
+            windowSize, skip, pyramid, saveMasks);
+        cout << "  Background: " << backgroundModeName(mode) << ", threshold " << threshold << endl;
+        cout << "  SIMD kernels: " << kernels().Name << endl;
+        return 0;
+    }
+    vector<string> paths;
+    unique_ptr<FrameStream> stream;
+    if (!input.empty()) {
+        StreamFormat format;
+        int width = 0, height = 0;
+        string size = stringOption(argc, argv, "--size", "");
+        if (!parseStreamFormat(stringOption(argc, argv, "--input-format", "y4m"), &format)) {
+            cout << "--input-format must be y4m or rgb24" << endl;
+            return -1;
+        }
+        if (!size.empty() && !parseFrameSize(size, &width, &height)) {
+            cout << "--size needs a size such as 1920x1080" << endl;
+            return -1;
+        }
+        if (batch || pipelined || warmup + repeat > 1) {
+            cout << "--input is read once, by the streaming flow" << endl;
+            return -1;
+        }
+        stream.reset(new FrameStream(input, format, width, height));
+    }
+    else if (!synthetic.empty()) {
+        int width, height;
+        if (!parseFrameSize(synthetic, &width, &height)) {
+            cout << "--synthetic needs a size such as 1920x1080" << endl;
+            return -1;
+        }
+        paths = syntheticFramePaths(width, height, numFrames);
+    }
+    else {
+        paths = getImagePaths(numFrames);
+    }
+    if (!stream && paths.empty()) {
+        cout << "No input images found!" << endl;
+        return -1;
+    }
+    if (!frameCache.empty()) {
+        if (!frameCacheMatches(frameCache, paths)) {
+            cout << "Building frame cache " << frameCache << endl;
+            buildFrameCache(frameCache, paths);
+        }
+        paths = frameCachePaths(frameCache, paths.size());
+    }
 
-    stop_s = clock();
-    createColorImage(bg, "background.png");
-    createGrayImage(mask, width, height, "mask.png");
-    TotalTime += (stop_s - start_s) / double(CLOCKS_PER_SEC) * 1000;
+    RunStats stats = {};
+    vector<double> computeSeconds;
+    FramePool pool;
+    for (int rep = 0; rep < warmup + repeat; rep++) {
+        if (labelBlobs) {
+            blobs.reset(new BlobLog(OUTPUT_DIR + "blobs.csv", minArea));
+        }
+        if (!trace.empty() && rep == warmup + repeat - 1) {
+            traceEnable(0);
+        }
+        unique_ptr<MaskWriter> maskWriter;
+        if (saveMasks && !pipelined) {
+            maskWriter.reset(new MaskWriter(outputThreads));
+        }
+        double wallStart = omp_get_wtime();
+        if (batch) {
+            stats = runBatch(paths, threshold, numThreads, cleanup, blobs.get(), maskWriter.get(), tiled, tiles);
+        }
+        else if (pipelined) {
+            stats = runPipelined(paths, threshold, numThreads, mode, alpha, windowSize, skip, pyramid,
+                cleanup, blobs.get(), pipeline);
+        }
+        else {
+            FrameSource source = stream ? FrameSource(*stream, pool) : FrameSource(paths, pool);
+            stats = runStreaming(source, threshold, numThreads, mode, alpha, windowSize, skip, pyramid,
+                cleanup, blobs.get(), maskWriter.get());
+        }
+        if (maskWriter) {
+            maskWriter->finish();
+        }
+        double wallTime = omp_get_wtime() - wallStart;
+        if (rep < warmup) {
+            continue;
+        }
 
-    delete[] mask;
-    for (auto& frame : frames) {
-        delete[] frame.Red;
-        delete[] frame.Green;
-        delete[] frame.Blue;
+        computeSeconds.push_back(stats.ComputeSeconds);
+        if (warmup + repeat > 1) {
+            cout << "Run " << rep - warmup + 1 << ": " << stats.ComputeSeconds * 1000 << " ms compute, "
+                << wallTime * 1000 << " ms wall" << endl;
+        }
+        if (!report.empty()) {
+            BenchRecord record = { "openmp", batch ? "batch" : pipelined ? "pipeline" : "streaming",
+                batch ? "batch mean" : backgroundModeName(mode), kernels().Name, stats.Width, stats.Height,
+                stats.Frames, numThreads, 1, rep - warmup, stats.ComputeSeconds, wallTime };
+            appendBenchRecord(report, record);
+        }
     }
-    delete[] bg.Red; delete[] bg.Green; delete[] bg.Blue;
 
-   
-    cout << "Processing time: " << TotalTime << " ms" << endl;
+    cout << "Processing time: " << medianOf(computeSeconds) * 1000 << " ms"
+        << (repeat > 1 ? " (median)" : "") << endl;
+    cout << "Throughput: " << megapixelsPerSecond(stats.Width, stats.Height, stats.Frames, medianOf(computeSeconds))
+        << " MP/s" << endl;
     cout << "Used parameters: " << endl;
-    cout << "  Number of frames: " << NUM_FRAMES << endl;
-    cout << "  Number of threads: " << DEFAULT_THREADS << endl;
-    cout << "  Threshold value: " << DEFAULT_THRESHOLD << endl;
+    cout << "  Number of frames: " << stats.Frames << endl;
+    cout << "  Number of threads: " << numThreads << endl;
+    cout << "  Threshold value: " << threshold << endl;
+    cout << "  Background: " << (batch ? "batch mean" : backgroundModeName(mode)) << endl;
+    if (batch) {
+        cout << "  Mean engine: " << (tiled ? "tiles, schedule " + tiles.Schedule : string("rows")) << endl;
+    }
+    cout << "  Mask cleanup: " << morphologyName(cleanup.Op);
+    if (cleanup.Op != MORPH_NONE) {
+        cout << " " << cleanup.KernelWidth << "x" << cleanup.KernelHeight;
+    }
+    cout << endl;
+    if (skip.Enabled) {
+        cout << "  Change skipping: " << 100.0 * stats.Skipped.Skipped / max<size_t>(1, stats.Skipped.Tiles)
+            << "% of tiles skipped (threshold " << skip.Threshold << ", refresh every " << skip.RefreshInterval
+            << " frames)" << endl;
+    }
+    if (pyramid.Levels > 0) {
+        cout << pyramidReport(pyramid, stats.Pyramid);
+    }
+    cout << "  Foreground: " << 100.0 * stats.Foreground / stats.Frames << "% of pixels per mask" << endl;
+    if (blobs) {
+        cout << "  Blobs: " << blobs->blobs() << " in " << blobs->frames() << " frames (min area "
+            << blobs->minArea() << ")" << endl;
+    }
+    if (!batch && !pipelined) {
+        FramePoolStats poolStats = pool.stats();
+        cout << "  Frame pool: peak " << poolStats.PeakInUseBytes / 1024 << " KiB in use, "
+            << poolStats.HeldBytes / 1024 << " KiB held, " << poolStats.Allocations << " allocations, "
+            << poolStats.Reuses << " reuses" << endl;
+    }
+    cout << "  SIMD kernels: " << kernels().Name << endl;
+    if (!trace.empty()) {
+        if (TRACE_COMPILED) {
+            cout << traceSummary();
+            writeTrace(trace, { traceEventsJson() });
+            cout << "Trace written to " << trace << endl;
+        }
+        else {
+            cout << "Built without BGS_TRACE; --trace ignored" << endl;
+        }
+    }
 
+#ifdef _WIN32
     system("pause");
+#endif
     return 0;
-}
\ No newline at end of file
+}
+
+// Errors that reach here (an unreadable input, a malformed stream, a bad
+// option value) end the run with a message instead of std::terminate
+int main(int argc, char* argv[]) {
+    try {
+        return run(argc, argv);
+    }
+    catch (const exception& e) {
+        cout << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
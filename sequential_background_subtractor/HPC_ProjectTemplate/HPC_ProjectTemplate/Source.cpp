@@ -3,189 +3,510 @@
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
-#include <msclr\marshal_cppstd.h>
-#include <ctime>
-#pragma once
-
-#using <mscorlib.dll>
-#using <System.dll>
-#using <System.Drawing.dll>
-#using <System.Windows.Forms.dll>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "BackgroundModel.h"
+#include "BenchReport.h"
+#include "BitMask.h"
+#include "Blobs.h"
+#include "ForegroundMasks.h"
+#include "FrameCache.h"
+#include "FramePool.h"
+#include "FrameStream.h"
+#include "ImageIO.h"
+#include "Kernels.h"
+#include "MaskWriter.h"
+#include "Morphology.h"
+#include "Options.h"
+#include "Pipeline.h"
+#include "Synthetic.h"
+#include "Trace.h"
+
 using namespace std;
-using namespace msclr::interop;
 
 
 const int NUM_FRAMES = 100;     
 const int THRESHOLD = 30;      
 
-struct ColorImage {
-    int* Red;
-    int* Green;
-    int* Blue;
-    int Width;
-    int Height;
-};
-
-ColorImage inputColorImage(int* w, int* h, System::String^ imagePath) {
-    ColorImage img;
-    System::Drawing::Bitmap BM(imagePath);
-    img.Width = BM.Width;
-    img.Height = BM.Height;
-    *w = BM.Width;
-    *h = BM.Height;
+Frame calculateColorBackgroundMean(const vector<Frame>& images) {
+    TRACE_SCOPE("mean");
+    for (const Frame& image : images) {
+        requirePlanar(image, "calculateColorBackgroundMean");
+    }
+    Frame mean = allocateFrame(images[0].Width, images[0].Height);
 
-    img.Red = new int[BM.Height * BM.Width];
-    img.Green = new int[BM.Height * BM.Width];
-    img.Blue = new int[BM.Height * BM.Width];
+    // 8-bit samples are summed into a 32-bit plane; only the sums need the width.
+    size_t planeSize = (size_t)mean.Stride * mean.Height;
+    int numImages = images.size();
+    FixedPointDivisor divisor = makeDivisor(numImages, 255u * numImages);
+    vector<uint32_t> sums(planeSize);
+    vector<const uint8_t*> planes(numImages);
 
-    for (int i = 0; i < BM.Height; i++) {
-        for (int j = 0; j < BM.Width; j++) {
-            System::Drawing::Color c = BM.GetPixel(j, i);
-            img.Red[i * BM.Width + j] = c.R;
-            img.Green[i * BM.Width + j] = c.G;
-            img.Blue[i * BM.Width + j] = c.B;
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < numImages; k++) {
+            planes[k] = channelPlane(images[k], c);
         }
+        fill(sums.begin(), sums.end(), 0);
+        kernels().sumPlanes(sums.data(), planes.data(), numImages, 0, planeSize);
+        kernels().dividePlane(channelPlane(mean, c), sums.data(), planeSize, divisor);
     }
-    return img;
+
+    return mean;
 }
 
-void createColorImage(ColorImage img, string filename) {
-    System::Drawing::Bitmap MyNewImage(img.Width, img.Height);
+// One mask per frame, all against the same background in a single tiled pass.
+vector<uint8_t*> calculateForegroundMasks(const Frame& background, const vector<Frame>& frames,
+    int threshold = THRESHOLD) {
+    vector<uint8_t*> masks(frames.size());
+    for (auto& mask : masks) {
+        mask = allocateMask(background.Width, background.Height);
+    }
 
-    for (int i = 0; i < MyNewImage.Height; i++) {
-        for (int j = 0; j < MyNewImage.Width; j++) {
-            int r = max(0, min(255, img.Red[i * img.Width + j]));
-            int g = max(0, min(255, img.Green[i * img.Width + j]));
-            int b = max(0, min(255, img.Blue[i * img.Width + j]));
+    foregroundMasks(background, frames.data(), frames.size(), masks.data(), threshold);
 
-            System::Drawing::Color c = System::Drawing::Color::FromArgb(r, g, b);
-            MyNewImage.SetPixel(j, i, c);
-        }
-    }
-    MyNewImage.Save("..//Data//Output//" + gcnew System::String(filename.c_str()));
-    cout << "Color image saved: " << filename << endl;
+    return masks;
 }
 
-void createGrayImage(int* image, int width, int height, string filename) {
-    System::Drawing::Bitmap MyNewImage(width, height);
+string maskFileName(size_t frameIndex) {
+    return "foreground_mask_" + to_string(frameIndex + 1) + ".png";
+}
 
-    for (int i = 0; i < MyNewImage.Height; i++) {
-        for (int j = 0; j < MyNewImage.Width; j++) {
-            int val = max(0, min(255, image[i * width + j]));
-            System::Drawing::Color c = System::Drawing::Color::FromArgb(val, val, val);
-            MyNewImage.SetPixel(j, i, c);
-        }
+vector<string> getImagePaths(int numFrames) {
+    vector<string> paths;
+    for (int i = 1; i <= numFrames; i++) {
+        paths.push_back(INPUT_DIR + "frame" + to_string(i) + ".png");
     }
-    MyNewImage.Save("..//Data//Output//" + gcnew System::String(filename.c_str()));
-    cout << "Grayscale image saved: " << filename << endl;
+    return paths;
 }
 
-ColorImage calculateColorBackgroundMean(const vector<ColorImage>& images) {
-    ColorImage mean;
-    mean.Width = images[0].Width;
-    mean.Height = images[0].Height;
-    mean.Red = new int[mean.Width * mean.Height];
-    mean.Green = new int[mean.Width * mean.Height];
-    mean.Blue = new int[mean.Width * mean.Height];
-
-    memset(mean.Red, 0, mean.Width * mean.Height * sizeof(int));
-    memset(mean.Green, 0, mean.Width * mean.Height * sizeof(int));
-    memset(mean.Blue, 0, mean.Width * mean.Height * sizeof(int));
-
-    for (const auto& img : images) {
-        for (int i = 0; i < mean.Height; i++) {
-            for (int j = 0; j < mean.Width; j++) {
-                mean.Red[i * mean.Width + j] += img.Red[i * mean.Width + j];
-                mean.Green[i * mean.Width + j] += img.Green[i * mean.Width + j];
-                mean.Blue[i * mean.Width + j] += img.Blue[i * mean.Width + j];
-            }
-        }
+// What each flow hands back to main
+struct RunStats {
+    // Wall-clock time of the model, masks and cleanup, without frame I/O
+    double ComputeSeconds;
+    // Sum over the masks of their foreground share
+    double Foreground;
+    int Frames;
+    int Width;
+    int Height;
+    ChangeSkipStats Skipped;
+    PyramidStats Pyramid;
+};
+
+// Original flow: decode every frame, then compute the mean and one mask.
+// Per-frame masks go to `maskWriter` when it is set (--save-masks).
+RunStats runBatch(const vector<string>& imagePaths, int threshold, const MorphologyConfig& cleanup,
+    BlobLog* blobs, MaskWriter* maskWriter) {
+    RunStats stats = {};
+    vector<Frame> colorImages;
+    int width, height;
+    for (const auto& path : imagePaths) {
+        Frame img = loadFrame(&width, &height, path);
+        colorImages.push_back(img);
     }
 
-    int numImages = images.size();
-    for (int i = 0; i < mean.Height; i++) {
-        for (int j = 0; j < mean.Width; j++) {
-            mean.Red[i * mean.Width + j] /= numImages;
-            mean.Green[i * mean.Width + j] /= numImages;
-            mean.Blue[i * mean.Width + j] /= numImages;
+    double start = wallSeconds();
+
+    Frame colorBackground = calculateColorBackgroundMean(colorImages);
+
+    vector<uint8_t*> foregroundMasks = calculateForegroundMasks(colorBackground, colorImages, threshold);
+    if (cleanup.Op != MORPH_NONE) {
+        uint8_t* scratch = allocateMask(width, height);
+        for (auto& mask : foregroundMasks) {
+            applyMorphology(mask, scratch, width, height, colorBackground.Stride, cleanup);
         }
+        alignedFree(scratch);
+    }
+    vector<vector<Blob>> frameBlobs(blobs ? foregroundMasks.size() : 0);
+    for (size_t f = 0; f < frameBlobs.size(); f++) {
+        frameBlobs[f] = findBlobs(foregroundMasks[f], width, height, colorBackground.Stride, blobs->minArea());
+    }
+    BitMask bits = allocateBitMask(width, height);
+    for (auto& mask : foregroundMasks) {
+        packMaskRows(bits, mask, 0, height);
+        stats.Foreground += foregroundRatio(bits);
     }
 
-    return mean;
-}
+    stats.ComputeSeconds = wallSeconds() - start;
+    createColorImage(colorBackground, "color_background.png");
+    createGrayImage(foregroundMasks.back(), width, height, colorBackground.Stride, "foreground_mask.png");
+    for (size_t f = 0; maskWriter && f < foregroundMasks.size(); f++) {
+        maskWriter->write(foregroundMasks[f], width, height, maskFileName(f));
+    }
+    for (size_t f = 0; f < frameBlobs.size(); f++) {
+        blobs->write(f, frameBlobs[f]);
+    }
+
+    for (auto& img : colorImages) {
+        freeFrame(img);
+    }
+    freeFrame(colorBackground);
+    for (auto& mask : foregroundMasks) {
+        alignedFree(mask);
+    }
+    freeBitMask(bits);
 
-int* calculateForegroundMask(const ColorImage& background, const ColorImage& currentFrame) {
-    int* foregroundMask = new int[background.Width * background.Height];
+    stats.Frames = imagePaths.size();
+    stats.Width = width;
+    stats.Height = height;
+    return stats;
+}
 
-    for (int i = 0; i < background.Height; i++) {
-        for (int j = 0; j < background.Width; j++) {
-            int bgGray = (background.Red[i * background.Width + j] +
-                background.Green[i * background.Width + j] +
-                background.Blue[i * background.Width + j]) / 3;
+// Streaming flow: each frame updates the model and gets a mask, then its
+// buffer goes back to the pool for the next frame. Masks are kept
+// bit-packed; the byte mask is only built for cleanup or blobs.
+RunStats runStreaming(FrameSource& source, int threshold, BackgroundMode mode, double alpha,
+    int windowSize, const ChangeSkipConfig& skip, const PyramidConfig& pyramid, const MorphologyConfig& cleanup,
+    BlobLog* blobs, MaskWriter* maskWriter) {
+    RunStats stats = {};
+    PoolBuffer pooled;
+    if (!source.next(pooled)) {
+        throw runtime_error("no input frames");
+    }
+    int width = pooled.frame().Width;
+    int height = pooled.frame().Height;
+    BackgroundModel model(width, height, mode, alpha, windowSize);
+    model.setChangeSkipping(skip);
+    model.setPyramid(pyramid);
+    bool byteMask = cleanup.Op != MORPH_NONE || blobs;
+    uint8_t* foregroundMask = byteMask ? allocateMask(width, height) : nullptr;
+    uint8_t* scratch = byteMask ? allocateMask(width, height) : nullptr;
+    BitMask bits = allocateBitMask(width, height);
+
+    for (size_t f = 0; f == 0 || source.next(pooled); f++) {
+        const Frame& frame = pooled.frame();
+        double start = wallSeconds();
+        model.addFrame(frame);
+        vector<Blob> frameBlobs;
+        if (byteMask) {
+            model.foregroundMask(frame, foregroundMask, threshold);
+            applyMorphology(foregroundMask, scratch, width, height, model.background().Stride, cleanup);
+            if (blobs) {
+                frameBlobs = findBlobs(foregroundMask, width, height, model.background().Stride, blobs->minArea());
+            }
+            packMaskRows(bits, foregroundMask, 0, height);
+        }
+        else {
+            model.foregroundBits(frame, bits, threshold);
+        }
+        stats.Foreground += foregroundRatio(bits);
+        stats.ComputeSeconds += wallSeconds() - start;
 
-            int frameGray = (currentFrame.Red[i * background.Width + j] +
-                currentFrame.Green[i * background.Width + j] +
-                currentFrame.Blue[i * background.Width + j]) / 3;
+        if (blobs) {
+            blobs->write(f, frameBlobs);
+        }
 
-            int diff = abs(bgGray - frameGray);
-            foregroundMask[i * background.Width + j] = (diff > THRESHOLD) ? 255 : 0;
+        if (maskWriter) {
+            maskWriter->write(bits, maskFileName(f));
         }
     }
 
-    return foregroundMask;
+    model.refreshBackground();
+    createColorImage(model.background(), "color_background.png");
+    createGrayImage(bits, "foreground_mask.png");
+    cout << "Model memory: " << model.memoryBytes() / 1024 << " KiB" << endl;
+
+    alignedFree(foregroundMask);
+    alignedFree(scratch);
+    freeBitMask(bits);
+    stats.Frames = source.count();
+    stats.Skipped = model.changeSkipStats();
+    stats.Pyramid = model.pyramidStats();
+    stats.Width = width;
+    stats.Height = height;
+    return stats;
 }
 
-vector<string> getImagePaths() {
-    vector<string> paths;
-    for (int i = 1; i <= NUM_FRAMES; i++) {
-        paths.push_back("..//Data//Input//frame" + to_string(i) + ".png");
-    }
-    return paths;
+// Pipelined flow: decoder threads, this thread's model update and encoder
+// threads writing every frame's mask run concurrently on different frames.
+RunStats runPipelined(const vector<string>& imagePaths, int threshold, BackgroundMode mode, double alpha,
+    int windowSize, const ChangeSkipConfig& skip, const PyramidConfig& pyramid, const MorphologyConfig& cleanup,
+    BlobLog* blobs, const PipelineConfig& config) {
+    RunStats result = {};
+    unique_ptr<BackgroundModel> model;
+    BitMask bits = {};
+    uint8_t* scratch = nullptr;
+
+    PipelineStats stats = runPipeline(imagePaths, config,
+        [&](const Frame& frame, size_t index, uint8_t* mask) {
+            if (!model) {
+                model.reset(new BackgroundModel(frame.Width, frame.Height, mode, alpha, windowSize));
+                model->setChangeSkipping(skip);
+                model->setPyramid(pyramid);
+                bits = allocateBitMask(frame.Width, frame.Height);
+                scratch = allocateMask(frame.Width, frame.Height);
+            }
+            model->addFrame(frame);
+            model->foregroundMask(frame, mask, threshold);
+            applyMorphology(mask, scratch, frame.Width, frame.Height, model->background().Stride, cleanup);
+            if (blobs) {
+                blobs->write(index, findBlobs(mask, frame.Width, frame.Height, model->background().Stride,
+                    blobs->minArea()));
+            }
+            // The last frame's bits are left for the final mask
+            packMaskRows(bits, mask, 0, frame.Height);
+            result.Foreground += foregroundRatio(bits);
+        },
+        maskFileName);
+
+    model->refreshBackground();
+    createColorImage(model->background(), "color_background.png");
+    createGrayImage(bits, "foreground_mask.png");
+    cout << "Pipeline: " << stats.Frames << " frames in " << (int)(stats.WallSeconds * 1000)
+        << " ms wall (" << config.DecodeThreads << " decoders, " << config.EncodeThreads
+        << " encoders, queue depth " << config.QueueDepth << ")" << endl;
+
+    freeBitMask(bits);
+    alignedFree(scratch);
+    result.ComputeSeconds = stats.ComputeSeconds;
+    result.Frames = stats.Frames;
+    result.Skipped = model->changeSkipStats();
+    result.Pyramid = model->pyramidStats();
+    result.Width = model->background().Width;
+    result.Height = model->background().Height;
+    return result;
 }
 
-int main() {
-    int start_s, stop_s, TotalTime = 0;
+static int run(int argc, char* argv[]) {
+    int numFrames = intOption(argc, argv, "--frames", NUM_FRAMES);
+    int threshold = intOption(argc, argv, "--threshold", THRESHOLD);
+    bool batch = hasOption(argc, argv, "--batch");
+    bool saveMasks = hasOption(argc, argv, "--save-masks");
+    OutputConfig output = { OUTPUT_PNG, intOption(argc, argv, "--png-level", -1) };
+    int outputThreads = intOption(argc, argv, "--output-threads", 0);
+    bool pipelined = hasOption(argc, argv, "--pipeline");
+    PipelineConfig pipeline;
+    pipeline.DecodeThreads = intOption(argc, argv, "--decoders", 2);
+    pipeline.EncodeThreads = intOption(argc, argv, "--encoders", 2);
+    pipeline.QueueDepth = intOption(argc, argv, "--queue-depth", 4);
+    double alpha = doubleOption(argc, argv, "--ema", 0);
+    double mixtureRate = doubleOption(argc, argv, "--mog", 0);
+    int windowSize = intOption(argc, argv, "--window", 0);
+    // --median with --window N is the median of the last N frames
+    // --skip-static reuses the background and mask of tiles that moved by
+    // no more than --skip-threshold N since they were last processed;
+    // each tile is still processed once every --skip-refresh N frames
+    ChangeSkipConfig skip;
+    skip.Enabled = hasOption(argc, argv, "--skip-static");
+    skip.Threshold = intOption(argc, argv, "--skip-threshold", 12);
+    skip.RefreshInterval = intOption(argc, argv, "--skip-refresh", 16);
+    // --pyramid N thresholds at 1/2^N resolution first (--pyramid-threshold)
+    // and refines only within --pyramid-margin N coarse pixels of what it
+    // finds; every --pyramid-check N frames the mask is compared with the
+    // full-resolution one
+    PyramidConfig pyramid;
+    pyramid.Levels = intOption(argc, argv, "--pyramid", 0);
+    pyramid.Margin = intOption(argc, argv, "--pyramid-margin", 2);
+    pyramid.Threshold = intOption(argc, argv, "--pyramid-threshold", threshold / 2);
+    pyramid.CheckInterval = intOption(argc, argv, "--pyramid-check", 10);
+    MorphologyConfig cleanup;
+    cleanup.Op = morphologyOp(stringOption(argc, argv, "--morph", "none"));
+    cleanup.KernelWidth = intOption(argc, argv, "--morph-width", 3);
+    cleanup.KernelHeight = intOption(argc, argv, "--morph-height", cleanup.KernelWidth);
+    // --blobs writes each frame's blobs of at least --min-area pixels
+    bool labelBlobs = hasOption(argc, argv, "--blobs");
+    int minArea = intOption(argc, argv, "--min-area", 20);
+    unique_ptr<BlobLog> blobs;
+    // --synthetic WxH replaces the input PNGs with generated frames;
+    // --warmup N and --repeat N rerun the whole flow, and --report FILE
+    // appends each measured run to a CSV. --trace FILE records the last run
+    // as a Chrome trace (builds with BGS_TRACE only)
+    string synthetic = stringOption(argc, argv, "--synthetic", "");
+    int warmup = max(0, intOption(argc, argv, "--warmup", 0));
+    int repeat = max(1, intOption(argc, argv, "--repeat", 1));
+    string report = stringOption(argc, argv, "--report", "");
+    string trace = stringOption(argc, argv, "--trace", "");
+    // --frame-cache FILE decodes the inputs once into FILE (again only when
+    // they change) and maps it instead of decoding on later runs
+    string frameCache = stringOption(argc, argv, "--frame-cache", "");
+    // --input FILE reads an uncompressed video stream (- for stdin) to its
+    // end instead of the PNGs: --input-format y4m (default) or rgb24, which
+    // needs --size WxH
+    string input = stringOption(argc, argv, "--input", "");
+    BackgroundMode mode = hasOption(argc, argv, "--median") ? BACKGROUND_MEDIAN
+        : mixtureRate > 0 ? BACKGROUND_MIXTURE
+        : windowSize > 0 ? BACKGROUND_WINDOW
+        : alpha > 0 ? BACKGROUND_EMA : BACKGROUND_RUNNING_MEAN;
+    if (mode == BACKGROUND_MIXTURE) {
+        alpha = mixtureRate;
+    }
+
     cout << "Sequential  Background subtractor" << endl;
-    vector<string> imagePaths = getImagePaths();
-    if (imagePaths.empty()) {
+    if (!parseOutputFormat(stringOption(argc, argv, "--output", "png"), &output.Format)) {
+        cout << "--output must be png, pnm, raw or none" << endl;
+        return -1;
+    }
+    if (output.PngLevel < -1 || output.PngLevel > 9) {
+        cout << "--png-level takes 0 to 9" << endl;
+        return -1;
+    }
+    setOutputConfig(output);
+    if (skip.Enabled && batch) {
+        cout << "--skip-static needs the streaming model, not --batch" << endl;
+        return -1;
+    }
+    if (skip.Enabled && (skip.RefreshInterval < 1 || skip.RefreshInterval > MAX_SKIP_REFRESH)) {
+        cout << "--skip-refresh takes 1 to " << MAX_SKIP_REFRESH << " frames" << endl;
+        return -1;
+    }
+    if (pyramid.Levels < 0 || pyramid.Levels > MAX_PYRAMID_LEVELS) {
+        cout << "--pyramid takes 0 (off) to " << MAX_PYRAMID_LEVELS << " levels" << endl;
+        return -1;
+    }
+    if (pyramid.Levels > 0 && (batch || skip.Enabled || mode == BACKGROUND_MIXTURE)) {
+        cout << "--pyramid needs the streaming model, without --skip-static or --mog" << endl;
+        return -1;
+    }
+    vector<string> imagePaths;
+    unique_ptr<FrameStream> stream;
+    if (!input.empty()) {
+        StreamFormat format;
+        int width = 0, height = 0;
+        string size = stringOption(argc, argv, "--size", "");
+        if (!parseStreamFormat(stringOption(argc, argv, "--input-format", "y4m"), &format)) {
+            cout << "--input-format must be y4m or rgb24" << endl;
+            return -1;
+        }
+        if (!size.empty() && !parseFrameSize(size, &width, &height)) {
+            cout << "--size needs a size such as 1920x1080" << endl;
+            return -1;
+        }
+        if (batch || pipelined || warmup + repeat > 1) {
+            cout << "--input is read once, by the streaming flow" << endl;
+            return -1;
+        }
+        stream.reset(new FrameStream(input, format, width, height));
+    }
+    else if (!synthetic.empty()) {
+        int width, height;
+        if (!parseFrameSize(synthetic, &width, &height)) {
+            cout << "--synthetic needs a size such as 1920x1080" << endl;
+            return -1;
+        }
+        imagePaths = syntheticFramePaths(width, height, numFrames);
+    }
+    else {
+        imagePaths = getImagePaths(numFrames);
+    }
+    if (!stream && imagePaths.empty()) {
         cout << "No input images found!" << endl;
         return -1;
     }
-
-    vector<ColorImage> colorImages;
-    int width, height;
-    for (const auto& path : imagePaths) {
-        System::String^ imagePath = marshal_as<System::String^>(path);
-        ColorImage img = inputColorImage(&width, &height, imagePath);
-        colorImages.push_back(img);
+    if (!frameCache.empty()) {
+        if (!frameCacheMatches(frameCache, imagePaths)) {
+            cout << "Building frame cache " << frameCache << endl;
+            buildFrameCache(frameCache, imagePaths);
+        }
+        imagePaths = frameCachePaths(frameCache, imagePaths.size());
     }
 
-    start_s = clock();
-
-    ColorImage colorBackground = calculateColorBackgroundMean(colorImages);
-
-    int* foregroundMask = calculateForegroundMask(colorBackground, colorImages.back());
-
-    stop_s = clock();
-    createColorImage(colorBackground, "color_background.png");
-    createGrayImage(foregroundMask, width, height, "foreground_mask.png");
-    TotalTime += (stop_s - start_s) / double(CLOCKS_PER_SEC) * 1000;
+    RunStats stats = {};
+    vector<double> computeSeconds;
+    FramePool pool;
+    for (int rep = 0; rep < warmup + repeat; rep++) {
+        if (labelBlobs) {
+            blobs.reset(new BlobLog(OUTPUT_DIR + "foreground_blobs.csv", minArea));
+        }
+        if (!trace.empty() && rep == warmup + repeat - 1) {
+            traceEnable(0);
+        }
+        unique_ptr<MaskWriter> maskWriter;
+        if (saveMasks && !pipelined) {
+            maskWriter.reset(new MaskWriter(outputThreads));
+        }
+        double wallStart = wallSeconds();
+        if (batch) {
+            stats = runBatch(imagePaths, threshold, cleanup, blobs.get(), maskWriter.get());
+        }
+        else if (pipelined) {
+            stats = runPipelined(imagePaths, threshold, mode, alpha, windowSize, skip, pyramid, cleanup,
+                blobs.get(), pipeline);
+        }
+        else {
+            FrameSource source = stream ? FrameSource(*stream, pool) : FrameSource(imagePaths, pool);
+            stats = runStreaming(source, threshold, mode, alpha, windowSize, skip, pyramid, cleanup,
+                blobs.get(), maskWriter.get());
+        }
+        if (maskWriter) {
+            maskWriter->finish();
+        }
+        double wallTime = wallSeconds() - wallStart;
+        if (rep < warmup) {
+            continue;
+        }
 
-    for (auto& img : colorImages) {
-        delete[] img.Red;
-        delete[] img.Green;
-        delete[] img.Blue;
+        computeSeconds.push_back(stats.ComputeSeconds);
+        if (warmup + repeat > 1) {
+            cout << "Run " << rep - warmup + 1 << ": " << stats.ComputeSeconds * 1000 << " ms compute, "
+                << wallTime * 1000 << " ms wall" << endl;
+        }
+        if (!report.empty()) {
+            BenchRecord record = { "sequential", batch ? "batch" : pipelined ? "pipeline" : "streaming",
+                batch ? "batch mean" : backgroundModeName(mode), kernels().Name, stats.Width, stats.Height,
+                stats.Frames, 1, 1, rep - warmup, stats.ComputeSeconds, wallTime };
+            appendBenchRecord(report, record);
+        }
     }
-    delete[] colorBackground.Red;
-    delete[] colorBackground.Green;
-    delete[] colorBackground.Blue;
-    delete[] foregroundMask;
 
-    cout << "Processing time: " << TotalTime << " ms" << endl;
+    cout << "Processing time: " << medianOf(computeSeconds) * 1000 << " ms"
+        << (repeat > 1 ? " (median)" : "") << endl;
+    cout << "Throughput: " << megapixelsPerSecond(stats.Width, stats.Height, stats.Frames, medianOf(computeSeconds))
+        << " MP/s" << endl;
     cout << "Used parameters:" << endl;
-    cout << "  Number of frames: " << NUM_FRAMES << endl;
-    cout << "  Threshold value: " << THRESHOLD << endl;
+    cout << "  Number of frames: " << stats.Frames << endl;
+    cout << "  Threshold value: " << threshold << endl;
+    cout << "  Background: " << (batch ? "batch mean" : backgroundModeName(mode)) << endl;
+    cout << "  Mask cleanup: " << morphologyName(cleanup.Op);
+    if (cleanup.Op != MORPH_NONE) {
+        cout << " " << cleanup.KernelWidth << "x" << cleanup.KernelHeight;
+    }
+    cout << endl;
+    if (skip.Enabled) {
+        cout << "  Change skipping: " << 100.0 * stats.Skipped.Skipped / max<size_t>(1, stats.Skipped.Tiles)
+            << "% of tiles skipped (threshold " << skip.Threshold << ", refresh every " << skip.RefreshInterval
+            << " frames)" << endl;
+    }
+    if (pyramid.Levels > 0) {
+        cout << pyramidReport(pyramid, stats.Pyramid);
+    }
+    cout << "  Foreground: " << 100.0 * stats.Foreground / stats.Frames << "% of pixels per mask" << endl;
+    if (blobs) {
+        cout << "  Blobs: " << blobs->blobs() << " in " << blobs->frames() << " frames (min area "
+            << blobs->minArea() << ")" << endl;
+    }
+    if (!batch && !pipelined) {
+        FramePoolStats poolStats = pool.stats();
+        cout << "  Frame pool: peak " << poolStats.PeakInUseBytes / 1024 << " KiB in use, "
+            << poolStats.HeldBytes / 1024 << " KiB held, " << poolStats.Allocations << " allocations, "
+            << poolStats.Reuses << " reuses" << endl;
+    }
+    cout << "  SIMD kernels: " << kernels().Name << endl;
+    if (!trace.empty()) {
+        if (TRACE_COMPILED) {
+            cout << traceSummary();
+            writeTrace(trace, { traceEventsJson() });
+            cout << "Trace written to " << trace << endl;
+        }
+        else {
+            cout << "Built without BGS_TRACE; --trace ignored" << endl;
+        }
+    }
 
+#ifdef _WIN32
     system("pause");
+#endif
     return 0;
-}
\ No newline at end of file
+}
+
+// Errors that reach here (an unreadable input, a malformed stream, a bad
+// option value) end the run with a message instead of std::terminate
+int main(int argc, char* argv[]) {
+    try {
+        return run(argc, argv);
+    }
+    catch (const exception& e) {
+        cout << "Error: " << e.what() << endl;
+        return 1;
+    }
+}